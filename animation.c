@@ -0,0 +1,186 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Animation channels for rotators and flashing colours
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <math.h>
+
+/* Local header files */
+#include "sfformats.h"
+#include "misc.h"
+#include "byteorder.h"
+#include "colours.h"
+#include "animation.h"
+
+/* All integers in an animation file are little-endian and real numbers are
+   IEEE 754 single precision. Every table starts at a multiple of 8 bytes,
+   except the keys, which are 16-bit. */
+enum {
+  AnimationVersion = 1,
+  HeaderSize = 32,
+  RotatorRecordSize = 32,
+  ChannelRecordSize = 8,
+  KeyRecordSize = 2,
+  MaxUInt16 = 0xffff,
+  InitialRotators = 16,
+};
+
+#define NUM_LOGICAL_COLOURS \
+  ((int)ARRAY_SIZE(((SFObjectColours *)NULL)->colour_mappings))
+
+static const char animation_magic[8] = {'S','F','3','K','A','N','I','M'};
+
+void animation_init(Animation * const animation)
+{
+  assert(animation != NULL);
+
+  *animation = (Animation){
+    .rotators = NULL,
+    .nrotators = 0,
+    .rotators_alloc = 0,
+  };
+}
+
+bool animation_add_rotator(Animation * const animation,
+                           const Rotator * const rotator)
+{
+  assert(animation != NULL);
+  assert(rotator != NULL);
+  assert(rotator->index >= 0);
+  assert(rotator->type_count >= 0);
+  assert(rotator->first_vertex >= 1);
+  assert(rotator->nvertices >= 0);
+  assert(rotator->angle != 0.0);
+
+  if (animation->nrotators >= animation->rotators_alloc) {
+    const int nalloc = animation->rotators_alloc > 0 ?
+                       animation->rotators_alloc * 2 : InitialRotators;
+    _Optional Rotator * const rotators =
+      realloc(animation->rotators, sizeof(*rotators) * (size_t)nalloc);
+    if (rotators == NULL) {
+      fprintf(stderr, "Failed allocating memory for rotators\n");
+      return false;
+    }
+    animation->rotators = rotators;
+    animation->rotators_alloc = nalloc;
+  }
+
+  (&*animation->rotators)[animation->nrotators++] = *rotator;
+  return true;
+}
+
+bool animation_write(FILE * const out, const Animation * const animation)
+{
+  assert(out != NULL);
+  assert(animation != NULL);
+
+  int nchannels = 0;
+  for (int colour = 0; colour < NUM_LOGICAL_COLOURS; ++colour) {
+    if (get_flash_period(colour) > 0) {
+      ++nchannels;
+    }
+  }
+
+  for (int r = 0; r < animation->nrotators; ++r) {
+    const Rotator * const rotator = &*animation->rotators + r;
+    if ((rotator->index > MaxUInt16) || (rotator->type_count > MaxUInt16)) {
+      fprintf(stderr, "Object %d cannot be described in an animation file\n",
+              rotator->index);
+      return false;
+    }
+  }
+
+  const uint32_t rotators_offset = HeaderSize;
+  const uint32_t channels_offset = rotators_offset + ((uint32_t)
+                                   animation->nrotators * RotatorRecordSize);
+  const uint32_t keys_offset = channels_offset + ((uint32_t)nchannels *
+                                                  ChannelRecordSize);
+
+  unsigned char header[HeaderSize] = {0};
+  memcpy(header, animation_magic, sizeof(animation_magic));
+  put_uint32(header + 8, AnimationVersion);
+  put_uint32(header + 12, (uint32_t)animation->nrotators);
+  put_uint32(header + 16, (uint32_t)nchannels);
+  put_uint32(header + 20, rotators_offset);
+  put_uint32(header + 24, channels_offset);
+  put_uint32(header + 28, keys_offset);
+  bool success = (fwrite(header, sizeof(header), 1, out) == 1);
+
+  for (int r = 0; (r < animation->nrotators) && success; ++r) {
+    const Rotator * const rotator = &*animation->rotators + r;
+    /* The game rotates by a fixed angle on every frame */
+    const long int period = lround(2 * PI / fabs(rotator->angle));
+    unsigned char record[RotatorRecordSize] = {0};
+    put_uint32(record, (uint32_t)rotator->first_vertex);
+    put_uint32(record + 4, (uint32_t)rotator->nvertices);
+    for (size_t dim = 0; dim < ARRAY_SIZE(rotator->pivot); ++dim) {
+      put_float32(record + 8 + (dim * 4), rotator->pivot[dim]);
+    }
+    put_float32(record + 20, rotator->angle);
+    put_uint16(record + 24, (unsigned int)period);
+    put_uint16(record + 26, (unsigned int)rotator->index);
+    record[28] = (unsigned char)rotator->type;
+    put_uint16(record + 30, (unsigned int)rotator->type_count);
+    success = (fwrite(record, sizeof(record), 1, out) == 1);
+  }
+
+  uint32_t first_key = 0;
+  for (int colour = 0; (colour < NUM_LOGICAL_COLOURS) && success; ++colour) {
+    const int nframes = get_flash_period(colour);
+    if (nframes == 0) {
+      continue;
+    }
+    unsigned char record[ChannelRecordSize] = {0};
+    put_uint16(record, (unsigned int)colour);
+    put_uint16(record + 2, (unsigned int)nframes);
+    put_uint32(record + 4, first_key);
+    success = (fwrite(record, sizeof(record), 1, out) == 1);
+    first_key += (uint32_t)nframes;
+  }
+
+  /* One key per frame, giving the logical colour to be displayed */
+  for (int colour = 0; (colour < NUM_LOGICAL_COLOURS) && success; ++colour) {
+    const int nframes = get_flash_period(colour);
+    for (int frame = 0; (frame < nframes) && success; ++frame) {
+      unsigned char record[KeyRecordSize];
+      put_uint16(record, (unsigned int)get_frame_colour(colour, frame));
+      success = (fwrite(record, sizeof(record), 1, out) == 1);
+    }
+  }
+
+  if (!success) {
+    fprintf(stderr, "Failed writing to output file: %s\n",
+            strerror(errno));
+  }
+  return success;
+}
+
+void animation_free(Animation * const animation)
+{
+  assert(animation != NULL);
+
+  free(animation->rotators);
+  animation_init(animation);
+}
@@ -0,0 +1,43 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Animation channels for rotators and flashing colours
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "sfformats.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+typedef struct {
+  int index;         /* Object number within the file */
+  SFObjectType type;
+  int type_count;    /* Object number among objects of the same type */
+  int first_vertex;  /* Index of the first rotating 'v' line (from 1) */
+  int nvertices;     /* Number of rotating 'v' lines */
+  double pivot[3];   /* A point on the axis of rotation */
+  double angle;      /* Radians per frame about the z axis */
+} Rotator;
+
+typedef struct {
+  _Optional Rotator *rotators;
+  int nrotators;
+  int rotators_alloc;
+} Animation;
+
+void animation_init(Animation *animation);
+
+bool animation_add_rotator(Animation *animation, const Rotator *rotator);
+
+bool animation_write(FILE *out, const Animation *animation);
+
+void animation_free(Animation *animation);
+
+#endif /* ANIMATION_H */
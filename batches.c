@@ -0,0 +1,498 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Sorting of primitives into batches of the same colour
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <math.h>
+
+/* 3DObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local header files */
+#include "misc.h"
+#include "polygons.h"
+#include "batches.h"
+
+typedef struct {
+  int colour;
+  int bucket;           /* Index of the bucket for this colour */
+  int npreds;           /* Number of earlier primitives not yet emitted */
+  double normal[3];     /* Unit normal, or zero if the primitive is flat */
+  double dist;          /* Distance of the plane from the origin */
+  Coord min[3], max[3]; /* Bounding box */
+} PrimInfo;
+
+/* Primitives of one colour that are ready to be emitted */
+typedef struct {
+  int colour;
+  int *heap;  /* Indices of ready primitives, lowest at the top */
+  int nready;
+} Bucket;
+
+typedef struct {
+  int colour;
+  int p;
+} ColourIndex;
+
+/* Primitives that must be emitted after each primitive */
+typedef struct {
+  _Optional int *first; /* Index in succ of the first successor of each
+                           primitive, plus one for the end */
+  _Optional int *succ;
+} Successors;
+
+#define PLANE_TOLERANCE (1e-6)
+
+static bool get_info(const Primitive * const pp,
+                     const VertexArray * const varray, PrimInfo * const info)
+{
+  assert(pp != NULL);
+  assert(varray != NULL);
+  assert(info != NULL);
+
+  const int nsides = primitive_get_num_sides(pp);
+  for (int k = 0; k < 3; ++k) {
+    info->min[k] = info->max[k] = 0;
+  }
+
+  for (int s = 0; s < nsides; ++s) {
+    _Optional Coord (* const a)[3] =
+      vertex_array_get_coords(varray, primitive_get_side(pp, s));
+    if (!a) {
+      return false;
+    }
+
+    for (int k = 0; k < 3; ++k) {
+      if (s == 0 || (*a)[k] < info->min[k]) {
+        info->min[k] = (*a)[k];
+      }
+      if (s == 0 || (*a)[k] > info->max[k]) {
+        info->max[k] = (*a)[k];
+      }
+    }
+  }
+
+  double normal[3];
+  if (!polygon_normal(varray, pp, normal)) {
+    return false;
+  }
+
+  const double len = sqrt((normal[0] * normal[0]) + (normal[1] * normal[1]) +
+                          (normal[2] * normal[2]));
+  info->dist = 0.0;
+  if (len <= PLANE_TOLERANCE) {
+    info->normal[0] = info->normal[1] = info->normal[2] = 0.0;
+  } else {
+    _Optional Coord (* const v)[3] =
+      vertex_array_get_coords(varray, primitive_get_side(pp, 0));
+    if (!v) {
+      return false;
+    }
+    for (int k = 0; k < 3; ++k) {
+      info->normal[k] = normal[k] / len;
+      info->dist += info->normal[k] * (*v)[k];
+    }
+  }
+
+  return true;
+}
+
+static bool is_flat(const PrimInfo * const info)
+{
+  assert(info != NULL);
+  return (info->normal[0] == 0.0) && (info->normal[1] == 0.0) &&
+         (info->normal[2] == 0.0);
+}
+
+/* Returns true if the two primitives may cover each other, in which case
+   the order in which they are drawn matters. This is conservative: the
+   bounding boxes of coplanar polygons are compared instead of their
+   outlines. */
+static bool may_overlap(const PrimInfo * const a, const PrimInfo * const b)
+{
+  assert(a != NULL);
+  assert(b != NULL);
+
+  if (is_flat(a) || is_flat(b)) {
+    /* Lines and points are drawn on top of anything they touch */
+    for (int k = 0; k < 3; ++k) {
+      if ((a->min[k] > b->max[k]) || (b->min[k] > a->max[k])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /* Polygons facing different ways or in different planes can't be seen
+     on top of each other */
+  const double dot = (a->normal[0] * b->normal[0]) +
+                     (a->normal[1] * b->normal[1]) +
+                     (a->normal[2] * b->normal[2]);
+  const double scale = 1.0 + fabs(a->dist) + fabs(b->dist);
+  if ((fabs(dot - 1.0) > PLANE_TOLERANCE) ||
+      (fabs(a->dist - b->dist) > PLANE_TOLERANCE * scale)) {
+    return false;
+  }
+
+  /* Ignore the axis closest to the normal, because the extent of both
+     bounding boxes along it is the same */
+  int drop = 0;
+  for (int k = 1; k < 3; ++k) {
+    if (fabs(a->normal[k]) > fabs(a->normal[drop])) {
+      drop = k;
+    }
+  }
+
+  for (int k = 0; k < 3; ++k) {
+    if ((k != drop) &&
+        ((a->min[k] >= b->max[k]) || (b->min[k] >= a->max[k]))) {
+      return false; /* Shared edges don't count */
+    }
+  }
+  return true;
+}
+
+static void heap_push(Bucket * const bucket, const int p)
+{
+  assert(bucket != NULL);
+
+  int i = bucket->nready++;
+  while (i > 0) {
+    const int parent = (i - 1) / 2;
+    if (bucket->heap[parent] < p) {
+      break;
+    }
+    bucket->heap[i] = bucket->heap[parent];
+    i = parent;
+  }
+  bucket->heap[i] = p;
+}
+
+static int heap_pop(Bucket * const bucket)
+{
+  assert(bucket != NULL);
+  assert(bucket->nready > 0);
+
+  const int top = bucket->heap[0];
+  const int last = bucket->heap[--bucket->nready];
+  int i = 0;
+  for (;;) {
+    int child = (i * 2) + 1;
+    if (child >= bucket->nready) {
+      break;
+    }
+    if ((child + 1 < bucket->nready) &&
+        (bucket->heap[child + 1] < bucket->heap[child])) {
+      ++child;
+    }
+    if (last < bucket->heap[child]) {
+      break;
+    }
+    bucket->heap[i] = bucket->heap[child];
+    i = child;
+  }
+  bucket->heap[i] = last;
+  return top;
+}
+
+static int compare_colours(const void * const a, const void * const b)
+{
+  const ColourIndex * const ca = a, * const cb = b;
+
+  if (ca->colour != cb->colour) {
+    return (ca->colour > cb->colour) - (ca->colour < cb->colour);
+  }
+  return (ca->p > cb->p) - (ca->p < cb->p);
+}
+
+/* Finds every pair of primitives whose order matters. A primitive must
+   stay behind every earlier primitive that it might be drawn over. */
+static bool get_successors(PrimInfo * const info, const int nprims,
+                           Successors * const successors)
+{
+  assert(info != NULL);
+  assert(nprims > 0);
+  assert(successors != NULL);
+
+  /* Record the predecessors of each primitive in order, then invert
+     the lists */
+  int npairs = 0, nalloc = 0;
+  _Optional int (*pairs)[2] = NULL;
+  _Optional int * const first = calloc((size_t)nprims + 1, sizeof(int));
+  if (first == NULL) {
+    return false;
+  }
+
+  for (int p = 0; p < nprims; ++p) {
+    info[p].npreds = 0;
+    for (int q = 0; q < p; ++q) {
+      if (!may_overlap(info + q, info + p)) {
+        continue;
+      }
+
+      if (npairs == nalloc) {
+        nalloc = nalloc ? nalloc * 2 : 64;
+        _Optional int (* const tmp)[2] =
+          realloc(pairs, sizeof(*pairs) * (size_t)nalloc);
+        if (tmp == NULL) {
+          free(pairs);
+          free(first);
+          return false;
+        }
+        pairs = tmp;
+      }
+      (&*pairs)[npairs][0] = q;
+      (&*pairs)[npairs][1] = p;
+      ++npairs;
+      ++info[p].npreds;
+      ++(&*first)[q + 1];
+    }
+  }
+
+  _Optional int * const succ = malloc(sizeof(int) *
+                                      (size_t)(npairs > 0 ? npairs : 1));
+  if (succ == NULL) {
+    free(pairs);
+    free(first);
+    return false;
+  }
+
+  for (int p = 0; p < nprims; ++p) {
+    (&*first)[p + 1] += (&*first)[p];
+  }
+
+  /* Fill each list using its start as a cursor, which leaves it at the
+     start of the next list */
+  for (int i = 0; i < npairs; ++i) {
+    const int q = (&*pairs)[i][0];
+    (&*succ)[(&*first)[q]++] = (&*pairs)[i][1];
+  }
+  for (int p = nprims; p > 0; --p) {
+    (&*first)[p] = (&*first)[p - 1];
+  }
+  (&*first)[0] = 0;
+
+  free(pairs);
+  successors->first = first;
+  successors->succ = succ;
+  return true;
+}
+
+static bool sort_group(Group * const group, const VertexArray * const varray,
+                       OutputPrimitivesGetColourFn * const get_colour,
+                       void * const arg, int * const last_colour,
+                       const bool verbose)
+{
+  assert(group != NULL);
+  assert(varray != NULL);
+  assert(get_colour != NULL);
+  assert(last_colour != NULL);
+
+  const int nprims = group_get_num_primitives(group);
+  if (nprims < 2) {
+    if (nprims == 1) {
+      _Optional const Primitive * const pp = group_get_primitive(group, 0);
+      if (pp) {
+        *last_colour = get_colour(&*pp, arg);
+      }
+    }
+    return true;
+  }
+
+  _Optional PrimInfo * const alloc = malloc(sizeof(*alloc) * (size_t)nprims);
+  _Optional ColourIndex * const by_colour = malloc(sizeof(*by_colour) *
+                                                   (size_t)nprims);
+  _Optional Bucket * const buckets = malloc(sizeof(*buckets) *
+                                            (size_t)nprims);
+  _Optional int * const heaps = malloc(sizeof(int) * (size_t)nprims);
+  _Optional int * const order = malloc(sizeof(int) * (size_t)nprims);
+  Successors successors = {.first = NULL, .succ = NULL};
+  if ((alloc == NULL) || (by_colour == NULL) || (buckets == NULL) ||
+      (heaps == NULL) || (order == NULL)) {
+    fprintf(stderr, "Failed allocating memory for sorting\n");
+    free(order);
+    free(heaps);
+    free(buckets);
+    free(by_colour);
+    free(alloc);
+    return false;
+  }
+  PrimInfo * const info = &*alloc;
+  bool success = true;
+
+  for (int p = 0; (p < nprims) && success; ++p) {
+    _Optional const Primitive * const pp = group_get_primitive(group, p);
+    if (!pp || !get_info(&*pp, varray, info + p)) {
+      fprintf(stderr, "Bad primitive %d\n", p);
+      success = false;
+      break;
+    }
+    info[p].colour = get_colour(&*pp, arg);
+    (&*by_colour)[p] = (ColourIndex){.colour = info[p].colour, .p = p};
+  }
+
+  if (success && !get_successors(info, nprims, &successors)) {
+    fprintf(stderr, "Failed allocating memory for sorting\n");
+    success = false;
+  }
+
+  /* Give each colour a bucket big enough to hold all of its primitives */
+  int nbuckets = 0, current = -1;
+  if (success) {
+    qsort(&*by_colour, (size_t)nprims, sizeof(*by_colour), compare_colours);
+    for (int i = 0; i < nprims; ++i) {
+      const ColourIndex * const ci = &*by_colour + i;
+      if ((i == 0) || (ci->colour != ci[-1].colour)) {
+        if (ci->colour == *last_colour) {
+          current = nbuckets;
+        }
+        (&*buckets)[nbuckets++] = (Bucket){
+          .colour = ci->colour,
+          .heap = &*heaps + i,
+          .nready = 0
+        };
+      }
+      info[ci->p].bucket = nbuckets - 1;
+    }
+
+    for (int p = 0; p < nprims; ++p) {
+      if (info[p].npreds == 0) {
+        heap_push(&*buckets + info[p].bucket, p);
+      }
+    }
+  }
+
+  /* Greedily continue the current colour for as long as possible, then
+     switch to the colour with the most primitives ready to be drawn. This
+     doesn't guarantee the fewest changes of colour. */
+  for (int n = 0; (n < nprims) && success; ++n) {
+    if ((current < 0) || ((&*buckets)[current].nready == 0)) {
+      /* Break ties in favour of the earliest primitive */
+      current = -1;
+      for (int b = 0; b < nbuckets; ++b) {
+        const Bucket * const bucket = &*buckets + b;
+        if (bucket->nready == 0) {
+          continue;
+        }
+        if (current < 0) {
+          current = b;
+          continue;
+        }
+        const Bucket * const best = &*buckets + current;
+        if ((bucket->nready > best->nready) ||
+            ((bucket->nready == best->nready) &&
+             (bucket->heap[0] < best->heap[0]))) {
+          current = b;
+        }
+      }
+    }
+
+    /* There is always a ready primitive because dependencies only point
+       forwards */
+    assert(current >= 0);
+    const int pick = heap_pop(&*buckets + current);
+    *last_colour = info[pick].colour;
+    (&*order)[n] = pick;
+
+    const int end = (&*successors.first)[pick + 1];
+    for (int i = (&*successors.first)[pick]; i < end; ++i) {
+      const int q = (&*successors.succ)[i];
+      if (--info[q].npreds == 0) {
+        heap_push(&*buckets + info[q].bucket, q);
+      }
+    }
+  }
+
+  if (success) {
+    /* Rebuild the group in the new order */
+    Group sorted;
+    group_init(&sorted);
+
+    for (int n = 0; (n < nprims) && success; ++n) {
+      const int p = (&*order)[n];
+      _Optional const Primitive * const src = group_get_primitive(group, p);
+      _Optional Primitive * const dst = group_add_primitive(&sorted);
+      if (!src || !dst) {
+        fprintf(stderr, "Failed allocating memory for sorting\n");
+        success = false;
+        break;
+      }
+
+      const int nsides = primitive_get_num_sides(&*src);
+      for (int s = 0; s < nsides; ++s) {
+        if (primitive_add_side(&*dst, primitive_get_side(&*src, s)) < 0) {
+          fprintf(stderr, "Failed allocating memory for sorting\n");
+          success = false;
+          break;
+        }
+      }
+      primitive_set_colour(&*dst, primitive_get_colour(&*src));
+      primitive_set_id(&*dst, primitive_get_id(&*src));
+
+      if (verbose && (p != n)) {
+        printf("Moved primitive %d to position %d\n", p, n);
+      }
+    }
+
+    if (success) {
+      group_free(group);
+      *group = sorted;
+    } else {
+      group_free(&sorted);
+    }
+  }
+
+  free(successors.succ);
+  free(successors.first);
+  free(order);
+  free(heaps);
+  free(buckets);
+  free(by_colour);
+  free(alloc);
+  return success;
+}
+
+bool batches_sort(const VertexArray * const varray, Group * const groups,
+                  const int ngroups,
+                  OutputPrimitivesGetColourFn * const get_colour,
+                  void * const arg, const bool verbose)
+{
+  assert(varray != NULL);
+  assert(groups != NULL);
+  assert(ngroups >= 0);
+  assert(get_colour != NULL);
+
+  /* Groups are output in order of their index, so a run of one colour can
+     continue from the end of one group into the next */
+  int last_colour = -1;
+  for (int g = 0; g < ngroups; ++g) {
+    if (!sort_group(groups + g, varray, get_colour, arg, &last_colour,
+                    verbose)) {
+      return false;
+    }
+  }
+  return true;
+}
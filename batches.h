@@ -0,0 +1,20 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Sorting of primitives into batches of the same colour
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef BATCHES_H
+#define BATCHES_H
+
+#include <stdbool.h>
+
+#include "Vertex.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+bool batches_sort(const VertexArray *varray, Group *groups, int ngroups,
+                  OutputPrimitivesGetColourFn *get_colour, void *arg,
+                  bool verbose);
+
+#endif /* BATCHES_H */
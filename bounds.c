@@ -0,0 +1,426 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Bounding volumes of object geometry
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <stdint.h>
+
+/* 3DObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+
+/* Local header files */
+#include "misc.h"
+#include "byteorder.h"
+#include "bounds.h"
+
+enum {
+  BoundsVersion = 1,
+  HeaderSize = 16,
+  ObjectRecordSize = 48,
+  MaxUInt16 = 0xffff,
+  InitialObjects = 16,
+  MaxSupport = 4, /* Most points needed to define a sphere in 3D */
+};
+
+/* Points on the boundary of a sphere are allowed to be slightly outside it
+   because of rounding errors */
+#define TOLERANCE (1e-9)
+
+static const char bounds_magic[8] = {'S','F','3','K','B','N','D','S'};
+
+typedef struct {
+  double centre[3];
+  double radius; /* Negative if the sphere is empty */
+} Sphere;
+
+static void sub(const double * const a, const double * const b,
+                double * const d)
+{
+  for (int k = 0; k < 3; ++k) {
+    d[k] = a[k] - b[k];
+  }
+}
+
+static double dot(const double * const a, const double * const b)
+{
+  return (a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]);
+}
+
+static void cross(const double * const a, const double * const b,
+                  double * const c)
+{
+  c[0] = (a[1] * b[2]) - (a[2] * b[1]);
+  c[1] = (a[2] * b[0]) - (a[0] * b[2]);
+  c[2] = (a[0] * b[1]) - (a[1] * b[0]);
+}
+
+static bool sphere_contains(const Sphere * const s, const double * const p)
+{
+  assert(s != NULL);
+  assert(p != NULL);
+
+  if (s->radius < 0) {
+    return false;
+  }
+  double d[3];
+  sub(p, s->centre, d);
+  return sqrt(dot(d, d)) <= s->radius + (TOLERANCE * (1.0 + s->radius));
+}
+
+/* Finds the smallest sphere with all of the given points on its surface.
+   Returns false if the points are degenerate (e.g. collinear). */
+static bool circumsphere(const double * const * const pts, const int n,
+                         Sphere * const s)
+{
+  assert(pts != NULL);
+  assert(n >= 0);
+  assert(n <= MaxSupport);
+  assert(s != NULL);
+
+  double rel[3] = {0.0, 0.0, 0.0};
+
+  switch (n) {
+    case 0:
+      *s = (Sphere){.centre = {0.0, 0.0, 0.0}, .radius = -1.0};
+      return true;
+
+    case 1:
+      break;
+
+    case 2:
+    {
+      double a[3];
+      sub(pts[1], pts[0], a);
+      for (int k = 0; k < 3; ++k) {
+        rel[k] = a[k] / 2.0;
+      }
+      break;
+    }
+
+    case 3:
+    {
+      /* Centre of the circumcircle in the plane of the triangle */
+      double a[3], b[3], normal[3], t[3];
+      sub(pts[1], pts[0], a);
+      sub(pts[2], pts[0], b);
+      cross(a, b, normal);
+      const double nn = dot(normal, normal);
+      if (nn <= TOLERANCE * dot(a, a) * dot(b, b)) {
+        return false;
+      }
+      const double aa = dot(a, a), bb = dot(b, b);
+      for (int k = 0; k < 3; ++k) {
+        t[k] = (aa * b[k]) - (bb * a[k]);
+      }
+      cross(t, normal, rel);
+      for (int k = 0; k < 3; ++k) {
+        rel[k] /= 2.0 * nn;
+      }
+      break;
+    }
+
+    default:
+    {
+      /* Solve for the point equidistant from all four by Cramer's rule */
+      double e[3][3], rhs[3];
+      for (int i = 0; i < 3; ++i) {
+        sub(pts[i + 1], pts[0], e[i]);
+        rhs[i] = dot(e[i], e[i]) / 2.0;
+      }
+      double c12[3], c20[3], c01[3];
+      cross(e[1], e[2], c12);
+      cross(e[2], e[0], c20);
+      cross(e[0], e[1], c01);
+      const double det = dot(e[0], c12);
+      const double scale = sqrt(dot(e[0], e[0]) * dot(e[1], e[1]) *
+                                dot(e[2], e[2]));
+      if (fabs(det) <= TOLERANCE * scale) {
+        return false;
+      }
+      for (int k = 0; k < 3; ++k) {
+        rel[k] = ((rhs[0] * c12[k]) + (rhs[1] * c20[k]) +
+                  (rhs[2] * c01[k])) / det;
+      }
+      break;
+    }
+  }
+
+  for (int k = 0; k < 3; ++k) {
+    s->centre[k] = pts[0][k] + rel[k];
+  }
+  s->radius = sqrt(dot(rel, rel));
+  return true;
+}
+
+/* Finds the smallest sphere enclosing the given points, all of which
+   should be on its surface unless they are degenerate */
+static void support_sphere(const double * const * const pts, const int n,
+                           Sphere * const s)
+{
+  assert(pts != NULL);
+  assert(n >= 0);
+  assert(n <= MaxSupport);
+  assert(s != NULL);
+
+  if (circumsphere(pts, n, s)) {
+    return;
+  }
+
+  /* Use the smallest sphere through a subset of the points that encloses
+     the others */
+  s->radius = -1.0;
+  for (unsigned int mask = 1; mask < (1u << n) - 1; ++mask) {
+    const double *subset[MaxSupport];
+    int m = 0;
+    for (int i = 0; i < n; ++i) {
+      if (mask & (1u << i)) {
+        subset[m++] = pts[i];
+      }
+    }
+
+    Sphere candidate;
+    if (!circumsphere(subset, m, &candidate) ||
+        ((s->radius >= 0) && (candidate.radius >= s->radius))) {
+      continue;
+    }
+
+    int i = 0;
+    while ((i < n) && sphere_contains(&candidate, pts[i])) {
+      ++i;
+    }
+    if (i == n) {
+      *s = candidate;
+    }
+  }
+}
+
+/* Welzl's algorithm: the smallest sphere enclosing the first n points with
+   the given support points on its surface */
+static void welzl(const double * const * const pts, const int n,
+                  const double ** const support, const int nsupport,
+                  Sphere * const s)
+{
+  assert(pts != NULL || n == 0);
+  assert(n >= 0);
+  assert(support != NULL);
+  assert(nsupport >= 0);
+  assert(nsupport <= MaxSupport);
+  assert(s != NULL);
+
+  support_sphere(support, nsupport, s);
+  if (nsupport == MaxSupport) {
+    return;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    if (!sphere_contains(s, pts[i])) {
+      support[nsupport] = pts[i];
+      welzl(pts, i, support, nsupport + 1, s);
+    }
+  }
+}
+
+bool bounds_compute(const VertexArray * const varray, Bounds * const bounds)
+{
+  assert(varray != NULL);
+  assert(bounds != NULL);
+
+  *bounds = (Bounds){
+    .min = {0.0, 0.0, 0.0},
+    .max = {0.0, 0.0, 0.0},
+    .centre = {0.0, 0.0, 0.0},
+    .radius = 0.0,
+  };
+
+  const int nvertices = vertex_array_get_num_vertices(varray);
+  if (nvertices <= 0) {
+    return true;
+  }
+
+  _Optional double (* const coords)[3] = malloc(sizeof(*coords) *
+                                                (size_t)nvertices);
+  _Optional const double ** const pts = malloc(sizeof(*pts) *
+                                               (size_t)nvertices);
+  if ((coords == NULL) || (pts == NULL)) {
+    fprintf(stderr, "Failed allocating memory for bounding volumes\n");
+    free(pts);
+    free(coords);
+    return false;
+  }
+
+  /* Only vertices that are output contribute to the bounds */
+  int n = 0;
+  for (int v = 0; v < nvertices; ++v) {
+    if (!vertex_array_is_used(varray, v)) {
+      continue;
+    }
+    _Optional Coord (* const c)[3] = vertex_array_get_coords(varray, v);
+    assert(c != NULL);
+    for (int k = 0; k < 3; ++k) {
+      const double value = (*c)[k];
+      (&*coords)[n][k] = value;
+      if ((n == 0) || (value < bounds->min[k])) {
+        bounds->min[k] = value;
+      }
+      if ((n == 0) || (value > bounds->max[k])) {
+        bounds->max[k] = value;
+      }
+    }
+    (&*pts)[n] = (&*coords)[n];
+    ++n;
+  }
+
+  if (n > 0) {
+    /* Welzl's algorithm takes expected linear time if the points are in
+       random order. A fixed seed keeps the output reproducible. */
+    uint32_t seed = 1;
+    for (int i = n - 1; i > 0; --i) {
+      seed = (seed * UINT32_C(1103515245)) + 12345u;
+      const int j = (int)((seed >> 16) % (uint32_t)(i + 1));
+      const double * const tmp = (&*pts)[i];
+      (&*pts)[i] = (&*pts)[j];
+      (&*pts)[j] = tmp;
+    }
+
+    const double *support[MaxSupport];
+    Sphere s;
+    welzl(&*pts, n, support, 0, &s);
+    for (int k = 0; k < 3; ++k) {
+      bounds->centre[k] = s.centre[k];
+    }
+    bounds->radius = s.radius;
+  }
+
+  free(pts);
+  free(coords);
+  return true;
+}
+
+bool bounds_output(FILE * const out, const Bounds * const bounds)
+{
+  assert(out != NULL);
+  assert(bounds != NULL);
+
+  return fprintf(out, "# Bounding box: %f %f %f %f %f %f\n"
+                      "# Bounding sphere: %f %f %f %f\n",
+                 bounds->min[0], bounds->min[1], bounds->min[2],
+                 bounds->max[0], bounds->max[1], bounds->max[2],
+                 bounds->centre[0], bounds->centre[1], bounds->centre[2],
+                 bounds->radius) >= 0;
+}
+
+void bounds_list_init(BoundsList * const list)
+{
+  assert(list != NULL);
+
+  *list = (BoundsList){
+    .objects = NULL,
+    .nobjects = 0,
+    .objects_alloc = 0,
+  };
+}
+
+bool bounds_list_add(BoundsList * const list, const int index,
+                     const SFObjectType type, const int type_count,
+                     const Bounds * const bounds)
+{
+  assert(list != NULL);
+  assert(index >= 0);
+  assert(type_count >= 0);
+  assert(bounds != NULL);
+
+  if (list->nobjects >= list->objects_alloc) {
+    const int nalloc = list->objects_alloc > 0 ?
+                       list->objects_alloc * 2 : InitialObjects;
+    _Optional BoundsObject * const objects =
+      realloc(list->objects, sizeof(*objects) * (size_t)nalloc);
+    if (objects == NULL) {
+      fprintf(stderr, "Failed allocating memory for bounding volumes\n");
+      return false;
+    }
+    list->objects = objects;
+    list->objects_alloc = nalloc;
+  }
+
+  (&*list->objects)[list->nobjects++] = (BoundsObject){
+    .index = index,
+    .type = type,
+    .type_count = type_count,
+    .bounds = *bounds,
+  };
+  return true;
+}
+
+bool bounds_list_write(FILE * const out, const BoundsList * const list)
+{
+  assert(out != NULL);
+  assert(list != NULL);
+
+  for (int o = 0; o < list->nobjects; ++o) {
+    const BoundsObject * const object = &*list->objects + o;
+    if ((object->index > MaxUInt16) || (object->type_count > MaxUInt16)) {
+      fprintf(stderr, "Object %d has too high a number\n", object->index);
+      return false;
+    }
+  }
+
+  unsigned char header[HeaderSize] = {0};
+  memcpy(header, bounds_magic, sizeof(bounds_magic));
+  put_uint32(header + 8, BoundsVersion);
+  put_uint32(header + 12, (uint32_t)list->nobjects);
+  bool success = (fwrite(header, sizeof(header), 1, out) == 1);
+
+  for (int o = 0; (o < list->nobjects) && success; ++o) {
+    const BoundsObject * const object = &*list->objects + o;
+    const Bounds * const bounds = &object->bounds;
+    unsigned char record[ObjectRecordSize] = {0};
+    put_uint16(record, (unsigned int)object->index);
+    put_uint16(record + 2, (unsigned int)object->type_count);
+    record[4] = (unsigned char)object->type;
+    for (int k = 0; k < 3; ++k) {
+      put_float32(record + 8 + (4 * k), bounds->min[k]);
+      put_float32(record + 20 + (4 * k), bounds->max[k]);
+      put_float32(record + 32 + (4 * k), bounds->centre[k]);
+    }
+    put_float32(record + 44, bounds->radius);
+    success = (fwrite(record, sizeof(record), 1, out) == 1);
+  }
+
+  if (!success) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+  }
+  return success;
+}
+
+void bounds_list_free(BoundsList * const list)
+{
+  assert(list != NULL);
+
+  free(list->objects);
+  list->objects = NULL;
+  list->nobjects = 0;
+  list->objects_alloc = 0;
+}
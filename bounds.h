@@ -0,0 +1,56 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Bounding volumes of object geometry
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "Vertex.h"
+
+#include "sfformats.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+/* Axis-aligned bounding box and minimal bounding sphere, in the same
+   coordinate space as output vertices */
+typedef struct {
+  double min[3];
+  double max[3];
+  double centre[3];
+  double radius;
+} Bounds;
+
+typedef struct {
+  int index;       /* Object number within the file */
+  SFObjectType type;
+  int type_count;  /* Object number among objects of the same type */
+  Bounds bounds;
+} BoundsObject;
+
+typedef struct {
+  _Optional BoundsObject *objects;
+  int nobjects;
+  int objects_alloc;
+} BoundsList;
+
+bool bounds_compute(const VertexArray *varray, Bounds *bounds);
+
+bool bounds_output(FILE *out, const Bounds *bounds);
+
+void bounds_list_init(BoundsList *list);
+
+bool bounds_list_add(BoundsList *list, int index, SFObjectType type,
+                     int type_count, const Bounds *bounds);
+
+bool bounds_list_write(FILE *out, const BoundsList *list);
+
+void bounds_list_free(BoundsList *list);
+
+#endif /* BOUNDS_H */
@@ -0,0 +1,297 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Resource budgets for converting files and objects
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if defined(USE_PTHREADS) && !defined(_WIN32)
+/* Needed for clock_gettime() when compiling as strict ISO C */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#define USE_CLOCKS
+#endif
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+
+/* Local header files */
+#include "misc.h"
+#include "budget.h"
+
+typedef enum {
+  BudgetKey_Time,
+  BudgetKey_CPU,
+  BudgetKey_ObjectTime,
+  BudgetKey_ObjectCPU,
+  BudgetKey_Memory,
+  BudgetKey_Polygons,
+  BudgetKey_Vertices,
+  BudgetKey_Count
+} BudgetKey;
+
+static const char * const key_names[BudgetKey_Count] = {
+  [BudgetKey_Time] = "time",
+  [BudgetKey_CPU] = "cpu",
+  [BudgetKey_ObjectTime] = "object_time",
+  [BudgetKey_ObjectCPU] = "object_cpu",
+  [BudgetKey_Memory] = "memory",
+  [BudgetKey_Polygons] = "polygons",
+  [BudgetKey_Vertices] = "vertices",
+};
+
+static double wall_seconds(void)
+{
+#ifdef USE_CLOCKS
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+  }
+#endif
+  return (double)time(NULL);
+}
+
+static double cpu_seconds(void)
+{
+#ifdef USE_CLOCKS
+  /* Files may be converted by different threads, so each file is only
+     charged for the processor time of the thread converting it */
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+  }
+#endif
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static bool bad_budget(const char * const spec, const char * const what)
+{
+  assert(spec != NULL);
+  assert(what != NULL);
+
+  fprintf(stderr, "Bad budget: %s in '%s'\n", what, spec);
+  return false;
+}
+
+static bool parse_limit(const char * const spec, const BudgetKey key,
+                        const char * const value, const char ** const end,
+                        Budget * const budget)
+{
+  assert(spec != NULL);
+  assert(key < BudgetKey_Count);
+  assert(value != NULL);
+  assert(end != NULL);
+  assert(budget != NULL);
+
+  char *num_end;
+  errno = 0;
+  double num = strtod(value, &num_end);
+  if ((num_end == value) || (errno == ERANGE) || !(num > 0)) {
+    return bad_budget(spec, "expected a positive number");
+  }
+
+  switch (key) {
+    case BudgetKey_Time:
+      budget->time = num;
+      break;
+    case BudgetKey_CPU:
+      budget->cpu = num;
+      break;
+    case BudgetKey_ObjectTime:
+      budget->object_time = num;
+      break;
+    case BudgetKey_ObjectCPU:
+      budget->object_cpu = num;
+      break;
+    case BudgetKey_Memory:
+      /* Sizes may be given in kilobytes, megabytes or gigabytes */
+      switch (*num_end) {
+        case 'G':
+          num *= 1024;
+          /* fallthrough */
+        case 'M':
+          num *= 1024;
+          /* fallthrough */
+        case 'K':
+          num *= 1024;
+          ++num_end;
+          break;
+        default:
+          break;
+      }
+      if (num >= (double)LONG_MAX) {
+        return bad_budget(spec, "memory budget out of range");
+      }
+      budget->memory = HIGHEST((long int)num, 1);
+      break;
+    case BudgetKey_Polygons:
+      if (num >= (double)INT_MAX) {
+        return bad_budget(spec, "polygon budget out of range");
+      }
+      budget->polygons = HIGHEST((int)num, 1);
+      break;
+    case BudgetKey_Vertices:
+      if (num >= (double)INT_MAX) {
+        return bad_budget(spec, "vertex budget out of range");
+      }
+      budget->vertices = HIGHEST((int)num, 1);
+      break;
+    default:
+      assert(!"Unknown budget key");
+      break;
+  }
+
+  *end = num_end;
+  return true;
+}
+
+bool budget_parse(Budget * const budget, const char * const spec)
+{
+  assert(budget != NULL);
+  assert(spec != NULL);
+
+  *budget = (Budget){
+    .time = 0,
+    .cpu = 0,
+    .object_time = 0,
+    .object_cpu = 0,
+    .memory = 0,
+    .polygons = 0,
+    .vertices = 0,
+  };
+
+  /* The specification is a list of limits like "time=10,polygons=5000" */
+  const char *pos = spec;
+  do {
+    const char * const equals = strchr(pos, '=');
+    if (equals == NULL) {
+      return bad_budget(spec, "expected name=value");
+    }
+
+    const size_t len = (size_t)(equals - pos);
+    BudgetKey key;
+    for (key = 0; key < BudgetKey_Count; ++key) {
+      if ((strlen(key_names[key]) == len) &&
+          !strncmp(pos, key_names[key], len)) {
+        break;
+      }
+    }
+    if (key >= BudgetKey_Count) {
+      fprintf(stderr, "Bad budget: unknown limit '%.*s' in '%s'\n",
+              (int)len, pos, spec);
+      return false;
+    }
+
+    if (!parse_limit(spec, key, equals + 1, &pos, budget)) {
+      return false;
+    }
+
+    if ((*pos != ',') && (*pos != '\0')) {
+      return bad_budget(spec, "expected ',' between limits");
+    }
+  } while (*pos++ != '\0');
+
+  return true;
+}
+
+void budget_meter_start(BudgetMeter * const meter,
+                        const Budget * const budget)
+{
+  assert(meter != NULL);
+  assert(budget != NULL);
+
+  meter->budget = budget;
+  meter->file_time = meter->object_time = wall_seconds();
+  meter->file_cpu = meter->object_cpu = cpu_seconds();
+}
+
+void budget_meter_start_object(BudgetMeter * const meter)
+{
+  assert(meter != NULL);
+  assert(meter->budget != NULL);
+
+  const Budget * const budget = meter->budget;
+  if (budget->object_time > 0) {
+    meter->object_time = wall_seconds();
+  }
+  if (budget->object_cpu > 0) {
+    meter->object_cpu = cpu_seconds();
+  }
+}
+
+BudgetStatus budget_meter_check(const BudgetMeter * const meter,
+                                const int object_count,
+                                const int npolygons, const int nvertices)
+{
+  assert(meter != NULL);
+  assert(meter->budget != NULL);
+  assert(object_count >= 0);
+
+  const Budget * const budget = meter->budget;
+
+  /* Exceeding the budget for the whole file is checked first because no
+     more objects will be converted */
+  if ((budget->time > 0) || (budget->object_time > 0)) {
+    const double now = wall_seconds();
+    if ((budget->time > 0) && (now - meter->file_time > budget->time)) {
+      fprintf(stderr, "File exceeded its time budget of %g seconds "
+              "(object %d)\n", budget->time, object_count);
+      return BudgetStatus_FileExceeded;
+    }
+    if ((budget->object_time > 0) &&
+        (now - meter->object_time > budget->object_time)) {
+      fprintf(stderr, "Object %d exceeded its time budget of %g seconds\n",
+              object_count, budget->object_time);
+      return BudgetStatus_ObjectExceeded;
+    }
+  }
+
+  if ((budget->cpu > 0) || (budget->object_cpu > 0)) {
+    const double now = cpu_seconds();
+    if ((budget->cpu > 0) && (now - meter->file_cpu > budget->cpu)) {
+      fprintf(stderr, "File exceeded its processor time budget of "
+              "%g seconds (object %d)\n", budget->cpu, object_count);
+      return BudgetStatus_FileExceeded;
+    }
+    if ((budget->object_cpu > 0) &&
+        (now - meter->object_cpu > budget->object_cpu)) {
+      fprintf(stderr, "Object %d exceeded its processor time budget of "
+              "%g seconds\n", object_count, budget->object_cpu);
+      return BudgetStatus_ObjectExceeded;
+    }
+  }
+
+  if ((budget->polygons > 0) && (npolygons > budget->polygons)) {
+    fprintf(stderr, "Object %d exceeded its budget of %d polygons "
+            "(has %d)\n", object_count, budget->polygons, npolygons);
+    return BudgetStatus_ObjectExceeded;
+  }
+
+  if ((budget->vertices > 0) && (nvertices > budget->vertices)) {
+    fprintf(stderr, "Object %d exceeded its budget of %d vertices "
+            "(has %d)\n", object_count, budget->vertices, nvertices);
+    return BudgetStatus_ObjectExceeded;
+  }
+
+  return BudgetStatus_OK;
+}
@@ -0,0 +1,51 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Resource budgets for converting files and objects
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stdbool.h>
+
+/* Limits on the resources used to convert one file or object.
+   Zero means no limit. */
+typedef struct {
+  double time;        /* Elapsed seconds per file */
+  double cpu;         /* Processor seconds per file */
+  double object_time; /* Elapsed seconds per object */
+  double object_cpu;  /* Processor seconds per object */
+  long int memory;    /* Bytes of input data per file, once decompressed */
+  int polygons;       /* Polygons per object, before and after clipping */
+  int vertices;       /* Vertices per object, before and after clipping */
+} Budget;
+
+/* Resources used so far by the file and object being converted */
+typedef struct {
+  const Budget *budget;
+  double file_time;   /* When conversion of the file started */
+  double file_cpu;
+  double object_time; /* When conversion of the current object started */
+  double object_cpu;
+} BudgetMeter;
+
+typedef enum {
+  BudgetStatus_OK,
+  BudgetStatus_ObjectExceeded, /* Give up on the current object */
+  BudgetStatus_FileExceeded    /* Give up on the whole file */
+} BudgetStatus;
+
+bool budget_parse(Budget *budget, const char *spec);
+
+void budget_meter_start(BudgetMeter *meter, const Budget *budget);
+
+void budget_meter_start_object(BudgetMeter *meter);
+
+/* Reports whether the file or current object is over budget, with a
+   diagnostic, given the numbers of polygons and vertices in the object
+   (or -1 if not known) */
+BudgetStatus budget_meter_check(const BudgetMeter *meter, int object_count,
+                                int npolygons, int nvertices);
+
+#endif /* BUDGET_H */
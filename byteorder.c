@@ -0,0 +1,77 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Little-endian integer and floating-point encoding
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdint.h>
+#include <string.h>
+
+/* Local header files */
+#include "misc.h"
+#include "byteorder.h"
+
+void put_uint16(unsigned char * const p, unsigned int const value)
+{
+  assert(p != NULL);
+  p[0] = (unsigned char)value;
+  p[1] = (unsigned char)(value >> 8);
+}
+
+void put_uint32(unsigned char * const p, uint32_t const value)
+{
+  assert(p != NULL);
+  put_uint16(p, (unsigned int)(value & 0xffffu));
+  put_uint16(p + 2, (unsigned int)(value >> 16));
+}
+
+void put_uint64(unsigned char * const p, uint64_t const value)
+{
+  assert(p != NULL);
+  put_uint32(p, (uint32_t)value);
+  put_uint32(p + 4, (uint32_t)(value >> 32));
+}
+
+void put_float32(unsigned char * const p, const double value)
+{
+  assert(p != NULL);
+  assert(sizeof(float) == sizeof(uint32_t));
+
+  const float f = (float)value;
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  put_uint32(p, bits);
+}
+
+unsigned int get_uint16(const unsigned char * const p)
+{
+  assert(p != NULL);
+  return p[0] | ((unsigned int)p[1] << 8);
+}
+
+uint32_t get_uint32(const unsigned char * const p)
+{
+  assert(p != NULL);
+  return get_uint16(p) | ((uint32_t)get_uint16(p + 2) << 16);
+}
+
+uint64_t get_uint64(const unsigned char * const p)
+{
+  assert(p != NULL);
+  return get_uint32(p) | ((uint64_t)get_uint32(p + 4) << 32);
+}
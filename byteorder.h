@@ -0,0 +1,27 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Little-endian integer and floating-point encoding
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef BYTEORDER_H
+#define BYTEORDER_H
+
+#include <stdint.h>
+
+void put_uint16(unsigned char *p, unsigned int value);
+
+void put_uint32(unsigned char *p, uint32_t value);
+
+void put_uint64(unsigned char *p, uint64_t value);
+
+/* Encodes a value in IEEE 754 single precision */
+void put_float32(unsigned char *p, double value);
+
+unsigned int get_uint16(const unsigned char *p);
+
+uint32_t get_uint32(const unsigned char *p);
+
+uint64_t get_uint64(const unsigned char *p);
+
+#endif /* BYTEORDER_H */
@@ -0,0 +1,563 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Catalog of objects in many graphics files
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+/* StreamLib headers */
+#include "ReaderMem.h"
+
+/* Local header files */
+#include "sfformats.h"
+#include "misc.h"
+#include "flags.h"
+#include "parser.h"
+#include "names.h"
+#include "input.h"
+#include "workers.h"
+#include "byteorder.h"
+#include "hash.h"
+#include "catalog.h"
+
+/* All integers in a catalog file are little-endian. Every table starts at a
+   multiple of 8 bytes, so that a catalog can be mapped into memory and used
+   in place. */
+enum {
+  CatalogVersion = 1,
+  HeaderSize = 32,
+  FileRecordSize = 8,
+  ObjectRecordSize = 32,
+  MaxUInt16 = 0xffff,
+  InitialEntries = 32,
+};
+
+static const char catalog_magic[8] = {'S','F','3','K','C','A','T','L'};
+
+typedef struct {
+  int index;
+  SFObjectType type;
+  int type_count;
+  int nvertices;
+  int npolygons;
+  int plot_type;
+  long int offset;
+  long int size;
+  uint64_t hash;
+} CatalogEntry;
+
+typedef struct {
+  _Optional CatalogEntry *entries;
+  int nentries;
+  int nalloc;
+  bool success;
+} CatalogFile;
+
+typedef struct {
+  const char *const *input_files;
+  CatalogFile *files;
+  unsigned int flags;
+  bool raw;
+} BuildJob;
+
+typedef struct {
+  CatalogFile *file;
+  const unsigned char *data;
+} ScanContext;
+
+static bool add_entry(const ObjectSummary * const summary, void * const arg)
+{
+  assert(summary != NULL);
+  assert(summary->offset >= 0);
+  assert(summary->size >= 0);
+
+  const ScanContext * const ctx = arg;
+  assert(ctx != NULL);
+  CatalogFile * const file = ctx->file;
+
+  if (file->nentries >= file->nalloc) {
+    const int nalloc = file->nalloc > 0 ? file->nalloc * 2 : InitialEntries;
+    _Optional CatalogEntry * const entries = realloc(file->entries,
+                                               sizeof(*entries) *
+                                               (size_t)nalloc);
+    if (entries == NULL) {
+      fprintf(stderr, "Failed allocating memory for catalog\n");
+      return false;
+    }
+    file->entries = entries;
+    file->nalloc = nalloc;
+  }
+
+  (&*file->entries)[file->nentries++] = (CatalogEntry){
+    .index = summary->index,
+    .type = summary->type,
+    .type_count = summary->type_count,
+    .nvertices = summary->nvertices,
+    .npolygons = summary->npolygons,
+    .plot_type = summary->plot_type,
+    .offset = summary->offset,
+    .size = summary->size,
+    .hash = hash_bytes(ctx->data + summary->offset,
+                       (size_t)summary->size),
+  };
+
+  return true;
+}
+
+static bool scan_file(const char * const input_file,
+                      const unsigned int flags, const bool raw,
+                      CatalogFile * const file)
+{
+  assert(input_file != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+  assert(file != NULL);
+
+  *file = (CatalogFile){
+    .entries = NULL,
+    .nentries = 0,
+    .nalloc = 0,
+    .success = false,
+  };
+
+  if (flags & FLAGS_VERBOSE)
+    printf("Opening input file '%s'\n", input_file);
+
+  _Optional FILE * const in = fopen(input_file, "rb");
+  if (in == NULL) {
+    fprintf(stderr, "Failed to open input file '%s': %s\n",
+            input_file, strerror(errno));
+    return false;
+  }
+
+  long int size = 0;
+  _Optional unsigned char * const data = input_load(&*in, raw, &size);
+
+  if (flags & FLAGS_VERBOSE)
+    puts("Closing input file");
+  fclose(&*in);
+
+  if (data != NULL) {
+    Reader r;
+    reader_mem_init(&r, &*data, (size_t)size);
+    ScanContext ctx = {.file = file, .data = &*data};
+    /* Objects are validated as in check mode */
+    ConvertContext convert;
+    convert_context_init(&convert, flags | FLAGS_CHECK);
+    file->success = sf3k_scan(&convert, &r, add_entry, &ctx);
+    reader_destroy(&r);
+    free(data);
+  }
+
+  if (!file->success) {
+    free(file->entries);
+    file->entries = NULL;
+    file->nentries = 0;
+  }
+
+  return file->success;
+}
+
+static bool build_one(const int index, void * const arg)
+{
+  const BuildJob * const job = arg;
+  assert(job != NULL);
+  assert(index >= 0);
+
+  return scan_file(job->input_files[index], job->flags, job->raw,
+                   job->files + index);
+}
+
+static bool write_catalog(FILE * const out, const int nfiles,
+                          const char *const * const input_files,
+                          const CatalogFile * const files)
+{
+  assert(out != NULL);
+  assert(nfiles >= 0);
+  assert(input_files != NULL);
+  assert(files != NULL);
+
+  /* Files which couldn't be scanned are omitted */
+  uint32_t ncat_files = 0, nobjects = 0;
+  for (int f = 0; f < nfiles; ++f) {
+    if (files[f].success) {
+      ++ncat_files;
+      nobjects += (uint32_t)files[f].nentries;
+    }
+  }
+
+  const uint32_t files_offset = HeaderSize;
+  const uint32_t objects_offset = files_offset +
+                                  (ncat_files * FileRecordSize);
+  const uint32_t strings_offset = objects_offset +
+                                  (nobjects * ObjectRecordSize);
+
+  unsigned char header[HeaderSize] = {0};
+  memcpy(header, catalog_magic, sizeof(catalog_magic));
+  put_uint32(header + 8, CatalogVersion);
+  put_uint32(header + 12, ncat_files);
+  put_uint32(header + 16, nobjects);
+  put_uint32(header + 20, files_offset);
+  put_uint32(header + 24, objects_offset);
+  put_uint32(header + 28, strings_offset);
+  if (fwrite(header, sizeof(header), 1, out) != 1) {
+    return false;
+  }
+
+  uint32_t name_offset = 0;
+  for (int f = 0; f < nfiles; ++f) {
+    if (files[f].success) {
+      unsigned char record[FileRecordSize];
+      put_uint32(record, name_offset);
+      put_uint32(record + 4, (uint32_t)files[f].nentries);
+      if (fwrite(record, sizeof(record), 1, out) != 1) {
+        return false;
+      }
+      name_offset += (uint32_t)strlen(input_files[f]) + 1;
+    }
+  }
+
+  uint32_t file_index = 0;
+  for (int f = 0; f < nfiles; ++f) {
+    if (!files[f].success) {
+      continue;
+    }
+
+    for (int e = 0; e < files[f].nentries; ++e) {
+      const CatalogEntry * const entry = &*files[f].entries + e;
+      unsigned char record[ObjectRecordSize] = {0};
+      put_uint32(record, file_index);
+      put_uint16(record + 4, (unsigned int)entry->index);
+      put_uint16(record + 6, (unsigned int)entry->type_count);
+      record[8] = (unsigned char)entry->type;
+      record[9] = (unsigned char)entry->plot_type;
+      put_uint16(record + 10, (unsigned int)entry->nvertices);
+      put_uint16(record + 12, (unsigned int)entry->npolygons);
+      put_uint32(record + 16, (uint32_t)entry->offset);
+      put_uint32(record + 20, (uint32_t)entry->size);
+      put_uint64(record + 24, entry->hash);
+      if (fwrite(record, sizeof(record), 1, out) != 1) {
+        return false;
+      }
+    }
+    ++file_index;
+  }
+
+  for (int f = 0; f < nfiles; ++f) {
+    if (files[f].success &&
+        fwrite(input_files[f], strlen(input_files[f]) + 1, 1, out) != 1) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool check_limits(const char * const input_file,
+                         const CatalogFile * const file)
+{
+  assert(input_file != NULL);
+  assert(file != NULL);
+
+  for (int e = 0; e < file->nentries; ++e) {
+    const CatalogEntry * const entry = &*file->entries + e;
+    if ((entry->index > MaxUInt16) || (entry->type_count > MaxUInt16) ||
+        ((unsigned long)entry->offset + (unsigned long)entry->size >
+         UINT32_MAX)) {
+      fprintf(stderr, "Object %d of '%s' is too big to be cataloged\n",
+              entry->index, input_file);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool catalog_build(const char * const db_file, const int nfiles,
+                   const char *const * const input_files,
+                   const int nthreads, const unsigned int flags,
+                   const bool raw)
+{
+  assert(db_file != NULL);
+  assert(nfiles >= 1);
+  assert(input_files != NULL);
+  assert(nthreads >= 1);
+  assert(!(flags & ~FLAGS_ALL));
+
+  _Optional CatalogFile * const alloc = malloc(sizeof(*alloc) *
+                                               (size_t)nfiles);
+  if (alloc == NULL) {
+    fprintf(stderr, "Failed allocating memory for catalog\n");
+    return false;
+  }
+  CatalogFile * const files = &*alloc;
+
+  BuildJob job = {
+    .input_files = input_files,
+    .files = files,
+    .flags = flags,
+    .raw = raw,
+  };
+  bool success = workers_run(nthreads, nfiles, build_one, &job);
+
+  for (int f = 0; f < nfiles; ++f) {
+    if (files[f].success && !check_limits(input_files[f], &files[f])) {
+      free(files[f].entries);
+      files[f].entries = NULL;
+      files[f].nentries = 0;
+      files[f].success = false;
+      success = false;
+    }
+    if (!files[f].success) {
+      fprintf(stderr, "Warning: '%s' is not included in the catalog\n",
+              input_files[f]);
+    }
+  }
+
+  if (flags & FLAGS_VERBOSE)
+    printf("Opening catalog file '%s'\n", db_file);
+
+  _Optional FILE * const out = fopen(db_file, "wb");
+  if (out == NULL) {
+    fprintf(stderr, "Failed to open catalog file '%s': %s\n",
+            db_file, strerror(errno));
+    success = false;
+  } else {
+    bool written = write_catalog(&*out, nfiles, input_files, files);
+    if (!written) {
+      fprintf(stderr, "Failed writing to catalog file: %s\n",
+              strerror(errno));
+    }
+
+    if (flags & FLAGS_VERBOSE)
+      puts("Closing catalog file");
+
+    if (fclose(&*out)) {
+      fprintf(stderr, "Failed to close catalog file '%s': %s\n",
+              db_file, strerror(errno));
+      written = false;
+    }
+
+    /* Delete malformed output unless debugging is enabled */
+    if (!written) {
+      if (!(flags & FLAGS_VERBOSE)) {
+        remove(db_file);
+      }
+      success = false;
+    }
+  }
+
+  for (int f = 0; f < nfiles; ++f) {
+    free(files[f].entries);
+  }
+  free(files);
+
+  return success;
+}
+
+static bool matches(const CatalogFilter * const filter,
+                    const CatalogEntry * const entry)
+{
+  assert(filter != NULL);
+  assert(entry != NULL);
+
+  if ((filter->type != SFObjectType_Invalid) &&
+      (entry->type != filter->type)) {
+    return false;
+  }
+
+  /* As when listing a graphics file, object numbers are only counted
+     among objects of the same type if a type was specified. */
+  const int req_index = (filter->type != SFObjectType_Invalid) ?
+                        entry->type_count : entry->index;
+  if (((filter->first >= 0) && (req_index < filter->first)) ||
+      ((filter->last >= 0) && (req_index > filter->last))) {
+    return false;
+  }
+
+  if (((filter->nvertices >= 0) && (entry->nvertices != filter->nvertices)) ||
+      ((filter->npolygons >= 0) && (entry->npolygons != filter->npolygons)) ||
+      ((filter->plot_type >= 0) && (entry->plot_type != filter->plot_type))) {
+    return false;
+  }
+
+  char buffer[ObjNameSize];
+  if ((filter->name != NULL) &&
+      strcmp(&*filter->name, get_obj_name(entry->type, entry->type_count,
+                                           buffer, sizeof(buffer)))) {
+    return false;
+  }
+
+  if (filter->filter != NULL) {
+    assert(!(filter->filter->needs & ~CATALOG_FILTER_ATTRIBUTES));
+    const int values[FilterAttribute_Count] = {
+      [FilterAttribute_Index] = entry->index,
+      [FilterAttribute_Type] = entry->type,
+      [FilterAttribute_TypeIndex] = entry->type_count,
+      [FilterAttribute_Plot] = entry->plot_type,
+      [FilterAttribute_Vertices] = entry->nvertices,
+      [FilterAttribute_Faces] = entry->npolygons,
+    };
+    if (!filter_match(&*filter->filter, values)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool query_catalog(const unsigned char * const data,
+                          long int const size,
+                          const CatalogFilter * const filter,
+                          const unsigned int flags)
+{
+  assert(data != NULL);
+  assert(size >= 0);
+  assert(filter != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if ((size < HeaderSize) ||
+      memcmp(data, catalog_magic, sizeof(catalog_magic))) {
+    fprintf(stderr, "Not a catalog file\n");
+    return false;
+  }
+
+  const uint32_t version = get_uint32(data + 8);
+  if (version != CatalogVersion) {
+    fprintf(stderr, "Unsupported catalog version %" PRIu32 "\n", version);
+    return false;
+  }
+
+  const uint32_t nfiles = get_uint32(data + 12),
+                 nobjects = get_uint32(data + 16),
+                 files_offset = get_uint32(data + 20),
+                 objects_offset = get_uint32(data + 24),
+                 strings_offset = get_uint32(data + 28);
+
+  if ((files_offset + (uint64_t)nfiles * FileRecordSize >
+       (uint64_t)size) ||
+      (objects_offset + (uint64_t)nobjects * ObjectRecordSize >
+       (uint64_t)size) ||
+      (strings_offset > (uint64_t)size)) {
+    fprintf(stderr, "Catalog file is truncated\n");
+    return false;
+  }
+
+  if (flags & FLAGS_VERBOSE) {
+    printf("Catalog has %" PRIu32 " files and %" PRIu32 " objects\n",
+           nfiles, nobjects);
+  }
+
+  const char * const strings = (const char *)data + strings_offset;
+  const size_t strings_size = (size_t)size - strings_offset;
+  int nmatches = 0;
+
+  for (uint32_t o = 0; o < nobjects; ++o) {
+    const unsigned char * const record = data + objects_offset +
+                                         (size_t)o * ObjectRecordSize;
+    const uint32_t file_index = get_uint32(record);
+    const int type = record[8];
+
+    if ((file_index >= nfiles) || (type > SFObjectType_Aerial)) {
+      fprintf(stderr, "Bad catalog entry %" PRIu32 "\n", o);
+      return false;
+    }
+
+    const CatalogEntry entry = {
+      .index = (int)get_uint16(record + 4),
+      .type_count = (int)get_uint16(record + 6),
+      .type = (SFObjectType)type,
+      .plot_type = record[9],
+      .nvertices = (int)get_uint16(record + 10),
+      .npolygons = (int)get_uint16(record + 12),
+      .offset = (long int)get_uint32(record + 16),
+      .size = (long int)get_uint32(record + 20),
+      .hash = get_uint64(record + 24),
+    };
+
+    if (!matches(filter, &entry)) {
+      continue;
+    }
+
+    const uint32_t name_offset = get_uint32(data + files_offset +
+                                   (size_t)file_index * FileRecordSize);
+    if ((name_offset >= strings_size) ||
+        !memchr(strings + name_offset, '\0', strings_size - name_offset)) {
+      fprintf(stderr, "Bad file name in catalog entry %" PRIu32 "\n", o);
+      return false;
+    }
+
+    if (nmatches++ == 0) {
+      puts("\nIndex  Type    Index  Name          Verts  Faces  Plot      "
+           "Offset        Size  Hash              File");
+    }
+
+    char buffer[ObjNameSize];
+    printf("%5d  %-6.6s  %5d  %-12.12s  %5d  %5d  %4d  %10ld  %10ld  "
+           "%016" PRIx64 "  %s\n", entry.index, get_type_name(entry.type),
+           entry.type_count,
+           get_obj_name(entry.type, entry.type_count, buffer,
+                        sizeof(buffer)),
+           entry.nvertices, entry.npolygons, entry.plot_type, entry.offset,
+           entry.size, entry.hash, strings + name_offset);
+  }
+
+  printf("\nFound %d matching object definition%s\n", nmatches,
+         nmatches != 1 ? "s" : "");
+
+  return true;
+}
+
+bool catalog_query(const char * const db_file,
+                   const CatalogFilter * const filter,
+                   const unsigned int flags)
+{
+  assert(db_file != NULL);
+  assert(filter != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (flags & FLAGS_VERBOSE)
+    printf("Opening catalog file '%s'\n", db_file);
+
+  _Optional FILE * const in = fopen(db_file, "rb");
+  if (in == NULL) {
+    fprintf(stderr, "Failed to open catalog file '%s': %s\n",
+            db_file, strerror(errno));
+    return false;
+  }
+
+  long int size = 0;
+  _Optional unsigned char * const data = input_load(&*in, true, &size);
+
+  if (flags & FLAGS_VERBOSE)
+    puts("Closing catalog file");
+  fclose(&*in);
+
+  if (data == NULL) {
+    return false;
+  }
+
+  const bool success = query_catalog(&*data, size, filter, flags);
+  free(data);
+  return success;
+}
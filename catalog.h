@@ -0,0 +1,46 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Catalog of objects in many graphics files
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdbool.h>
+
+#include "sfformats.h"
+#include "filter.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+/* Attributes recorded in a catalog, which a filter expression can test */
+#define CATALOG_FILTER_ATTRIBUTES ((1u << FilterAttribute_Index) | \
+                                   (1u << FilterAttribute_Type) | \
+                                   (1u << FilterAttribute_TypeIndex) | \
+                                   (1u << FilterAttribute_Plot) | \
+                                   (1u << FilterAttribute_Vertices) | \
+                                   (1u << FilterAttribute_Faces))
+
+typedef struct {
+  int first;              /* -1 means no lower limit */
+  int last;               /* -1 means no upper limit */
+  SFObjectType type;      /* SFObjectType_Invalid means any type */
+  _Optional const char *name;
+  int nvertices;          /* -1 means any number */
+  int npolygons;          /* -1 means any number */
+  int plot_type;          /* -1 means any plot type */
+  _Optional const Filter *filter; /* Expression over the attributes in
+                                     CATALOG_FILTER_ATTRIBUTES */
+} CatalogFilter;
+
+bool catalog_build(const char *db_file, int nfiles,
+                   const char *const *input_files, int nthreads,
+                   unsigned int flags, bool raw);
+
+bool catalog_query(const char *db_file, const CatalogFilter *filter,
+                   unsigned int flags);
+
+#endif /* CATALOG_H */
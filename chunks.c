@@ -0,0 +1,428 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Chunked file format with random access to objects
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+/* Local header files */
+#include "sfformats.h"
+#include "misc.h"
+#include "gkeydec.h"
+#include "gkeyenc.h"
+#include "byteorder.h"
+#include "chunks.h"
+
+/* A chunked file consists of a header, a table describing each chunk, and
+   then the chunks themselves. Concatenating the uncompressed chunks gives
+   the original data. Every object is in a chunk of its own, so it can be
+   decompressed independently of the others. */
+enum {
+  ChunksVersion = 1,
+  HeaderSize = 24,
+  ChunkRecordSize = 24,
+  NotAnObject = 0xff,
+  NoIndex = 0xffff,
+  MaxUInt16 = 0xffff,
+};
+
+typedef enum {
+  ChunkMethod_Raw,
+  ChunkMethod_GKey, /* Complete GKey stream including the size */
+} ChunkMethod;
+
+static const char chunks_magic[8] = {'S','F','3','K','C','H','N','K'};
+
+typedef struct {
+  ChunkInfo info;
+  long int file_offset; /* Offset of the stored chunk in the chunked file */
+  long int stored_size;
+  ChunkMethod method;
+  _Optional unsigned char *buf; /* Compressed data, if writing the chunk */
+} ChunkRecord;
+
+bool chunks_is_chunked(FILE * const in)
+{
+  assert(in != NULL);
+
+  /* Random access is impossible unless the input is seekable, so don't
+     consume any input from a stream that isn't. */
+  const long int start = ftell(in);
+  if (start < 0) {
+    return false;
+  }
+
+  char magic[sizeof(chunks_magic)];
+  const bool is_chunked = (fread(magic, sizeof(magic), 1, in) == 1) &&
+                          !memcmp(magic, chunks_magic, sizeof(magic));
+
+  if (fseek(in, start, SEEK_SET)) {
+    return false;
+  }
+  clearerr(in);
+  return is_chunked;
+}
+
+static _Optional ChunkRecord *read_table(FILE * const in,
+                                         int * const nchunks,
+                                         long int * const size)
+{
+  assert(in != NULL);
+  assert(nchunks != NULL);
+  assert(size != NULL);
+
+  unsigned char header[HeaderSize];
+  if (fread(header, sizeof(header), 1, in) != 1 ||
+      memcmp(header, chunks_magic, sizeof(chunks_magic))) {
+    fprintf(stderr, "Failed to read chunked file header\n");
+    return NULL;
+  }
+
+  const uint32_t version = get_uint32(header + 8);
+  if (version != ChunksVersion) {
+    fprintf(stderr, "Unsupported chunked file version %" PRIu32 "\n",
+            version);
+    return NULL;
+  }
+
+  const uint32_t count = get_uint32(header + 12);
+  const uint32_t total = get_uint32(header + 16);
+  if ((count < 1) || (count > INT32_MAX / ChunkRecordSize) ||
+      (total > INT32_MAX)) {
+    fprintf(stderr, "Bad chunked file header\n");
+    return NULL;
+  }
+
+  _Optional ChunkRecord * const chunks = malloc(sizeof(*chunks) * count);
+  if (chunks == NULL) {
+    fprintf(stderr, "Failed allocating memory for %" PRIu32 " chunks\n",
+            count);
+    return NULL;
+  }
+
+  long int offset = 0;
+  for (uint32_t c = 0; c < count; ++c) {
+    unsigned char record[ChunkRecordSize];
+    if (fread(record, sizeof(record), 1, in) != 1) {
+      fprintf(stderr, "Failed to read chunk table\n");
+      free(chunks);
+      return NULL;
+    }
+
+    const int type = record[13];
+    const int method = record[12];
+    const long int chunk_size = (long int)get_uint32(record + 8);
+    if ((type != NotAnObject && type > SFObjectType_Aerial) ||
+        (method != ChunkMethod_Raw && method != ChunkMethod_GKey) ||
+        (chunk_size > (long int)total - offset)) {
+      fprintf(stderr, "Bad chunk %" PRIu32 "\n", c);
+      free(chunks);
+      return NULL;
+    }
+
+    (&*chunks)[c] = (ChunkRecord){
+      .info = {
+        .offset = offset,
+        .size = chunk_size,
+        .index = (type == NotAnObject) ? -1 : (int)get_uint16(record + 14),
+        .type = (type == NotAnObject) ? SFObjectType_Invalid :
+                                        (SFObjectType)type,
+        .type_count = (int)get_uint16(record + 16),
+      },
+      .file_offset = (long int)get_uint32(record),
+      .stored_size = (long int)get_uint32(record + 4),
+      .method = (ChunkMethod)method,
+      .buf = NULL,
+    };
+    offset += chunk_size;
+  }
+
+  if (offset != (long int)total) {
+    fprintf(stderr, "Chunks don't add up to %" PRIu32 " bytes\n", total);
+    free(chunks);
+    return NULL;
+  }
+
+  *nchunks = (int)count;
+  *size = offset;
+  return chunks;
+}
+
+static bool read_chunk(FILE * const in, long int const start,
+                       const ChunkRecord * const chunk,
+                       unsigned char * const dst)
+{
+  assert(in != NULL);
+  assert(start >= 0);
+  assert(chunk != NULL);
+  assert(dst != NULL);
+
+  if (fseek(in, start + chunk->file_offset, SEEK_SET)) {
+    return false;
+  }
+
+  switch (chunk->method) {
+    case ChunkMethod_Raw:
+      return (chunk->stored_size == chunk->info.size) &&
+             (fread(dst, (size_t)chunk->info.size, 1, in) == 1 ||
+              chunk->info.size == 0);
+
+    case ChunkMethod_GKey:
+    {
+      GKeyDec dec;
+      return gkeydec_init(&dec, in) &&
+             (gkeydec_get_size(&dec) == chunk->info.size) &&
+             (gkeydec_read(&dec, dst, (size_t)chunk->info.size) ==
+              (size_t)chunk->info.size) &&
+             !gkeydec_error(&dec);
+    }
+  }
+
+  return false;
+}
+
+_Optional void *chunks_load(FILE * const in,
+                            _Optional ChunkSelectFn * const select,
+                            void * const arg, long int * const size,
+                            _Optional ObjectNumber ** const numbers,
+                            int * const nnumbers)
+{
+  assert(in != NULL);
+  assert(size != NULL);
+  assert((select == NULL) || ((numbers != NULL) && (nnumbers != NULL)));
+
+  const long int start = ftell(in);
+  if (start < 0) {
+    fprintf(stderr, "Chunked input must be seekable\n");
+    return NULL;
+  }
+
+  int nchunks = 0;
+  long int total = 0;
+  _Optional ChunkRecord * const chunks = read_table(in, &nchunks, &total);
+  if (chunks == NULL) {
+    return NULL;
+  }
+
+  /* Chunks that aren't objects (e.g. plot type definitions and the
+     end-of-file marker) are always needed. */
+  _Optional bool * const wanted = malloc(sizeof(*wanted) * (size_t)nchunks);
+  if (wanted == NULL) {
+    fprintf(stderr, "Failed allocating memory for %d chunks\n", nchunks);
+    free(chunks);
+    return NULL;
+  }
+
+  long int out_size = 0;
+  int nobjects = 0, last_object = -1;
+  for (int c = 0; c < nchunks; ++c) {
+    const ChunkInfo * const info = &(&*chunks)[c].info;
+    if (info->index >= 0) {
+      last_object = c;
+    }
+    (&*wanted)[c] = (info->index < 0) || (select == NULL) ||
+                    select(info, arg);
+    if ((&*wanted)[c]) {
+      out_size += info->size;
+      if (info->index >= 0) {
+        ++nobjects;
+      }
+    }
+  }
+
+  /* An end-of-file marker can't immediately follow the plot type
+     definitions, so keep one object even if none was selected. */
+  if ((nobjects == 0) && (last_object >= 0)) {
+    (&*wanted)[last_object] = true;
+    out_size += (&*chunks)[last_object].info.size;
+    ++nobjects;
+  }
+
+  _Optional unsigned char * const data = malloc(out_size > 0 ?
+                                                (size_t)out_size : 1);
+  _Optional ObjectNumber *objects = NULL;
+  if ((select != NULL) && (nobjects > 0)) {
+    objects = malloc(sizeof(*objects) * (size_t)nobjects);
+  }
+
+  bool success = true;
+  if ((data == NULL) || ((select != NULL) && (nobjects > 0) &&
+                         (objects == NULL))) {
+    fprintf(stderr, "Failed allocating memory for %ld bytes of "
+            "decompressed data\n", out_size);
+    success = false;
+  }
+
+  long int pos = 0;
+  int nout = 0;
+  for (int c = 0; (c < nchunks) && success; ++c) {
+    const ChunkRecord * const chunk = &(&*chunks)[c];
+    if (!(&*wanted)[c]) {
+      continue;
+    }
+
+    if (!read_chunk(in, start, chunk, &*data + pos)) {
+      fprintf(stderr, "Failed to read chunk %d at offset %ld\n", c,
+              chunk->file_offset);
+      success = false;
+      break;
+    }
+    pos += chunk->info.size;
+
+    if ((objects != NULL) && (chunk->info.index >= 0)) {
+      (&*objects)[nout++] = (ObjectNumber){
+        .index = chunk->info.index,
+        .type_count = chunk->info.type_count,
+      };
+    }
+  }
+
+  free(wanted);
+  free(chunks);
+
+  if (!success) {
+    free(objects);
+    free(data);
+    return NULL;
+  }
+
+  if (numbers != NULL) {
+    *numbers = objects;
+  }
+  if (nnumbers != NULL) {
+    *nnumbers = nout;
+  }
+  *size = out_size;
+  return data;
+}
+
+bool chunks_write(FILE * const out, const void * const data,
+                  const ChunkInfo * const chunks, int const nchunks)
+{
+  assert(out != NULL);
+  assert(data != NULL);
+  assert(chunks != NULL);
+  assert(nchunks >= 1);
+
+  _Optional ChunkRecord * const alloc = malloc(sizeof(*alloc) *
+                                               (size_t)nchunks);
+  if (alloc == NULL) {
+    fprintf(stderr, "Failed allocating memory for %d chunks\n", nchunks);
+    return false;
+  }
+  ChunkRecord * const records = &*alloc;
+
+  /* Compress each chunk independently, but store it uncompressed if that
+     wouldn't be any bigger. */
+  bool success = true;
+  long int file_offset = HeaderSize + ((long int)nchunks * ChunkRecordSize);
+  int ncompressed = 0;
+  for (; (ncompressed < nchunks) && success; ++ncompressed) {
+    const ChunkInfo * const info = chunks + ncompressed;
+    assert(ncompressed == 0 ||
+           info->offset == chunks[ncompressed-1].offset +
+                           chunks[ncompressed-1].size);
+
+    ChunkRecord * const record = records + ncompressed;
+    *record = (ChunkRecord){
+      .info = *info,
+      .file_offset = file_offset,
+      .stored_size = info->size,
+      .method = ChunkMethod_Raw,
+      .buf = NULL,
+    };
+
+    if ((info->index > MaxUInt16) || (info->type_count > MaxUInt16)) {
+      fprintf(stderr, "Too many objects for a chunked file\n");
+      success = false;
+      break;
+    }
+
+    size_t stored_size = 0;
+    record->buf = gkeyenc_compress((const unsigned char *)data +
+                                   info->offset, (size_t)info->size,
+                                   &stored_size);
+    if (record->buf == NULL) {
+      success = false;
+      break;
+    }
+
+    if (stored_size < (size_t)info->size) {
+      record->method = ChunkMethod_GKey;
+      record->stored_size = (long int)stored_size;
+    }
+    file_offset += record->stored_size;
+  }
+
+  if (success) {
+    unsigned char header[HeaderSize] = {0};
+    memcpy(header, chunks_magic, sizeof(chunks_magic));
+    put_uint32(header + 8, ChunksVersion);
+    put_uint32(header + 12, (uint32_t)nchunks);
+    put_uint32(header + 16, (uint32_t)(chunks[nchunks-1].offset +
+                                       chunks[nchunks-1].size));
+    success = (fwrite(header, sizeof(header), 1, out) == 1);
+
+    for (int c = 0; (c < nchunks) && success; ++c) {
+      const ChunkRecord * const record = records + c;
+      const bool is_object = (record->info.index >= 0);
+      unsigned char buf[ChunkRecordSize] = {0};
+      put_uint32(buf, (uint32_t)record->file_offset);
+      put_uint32(buf + 4, (uint32_t)record->stored_size);
+      put_uint32(buf + 8, (uint32_t)record->info.size);
+      buf[12] = (unsigned char)record->method;
+      buf[13] = is_object ? (unsigned char)record->info.type : NotAnObject;
+      put_uint16(buf + 14, is_object ? (unsigned int)record->info.index :
+                                       NoIndex);
+      put_uint16(buf + 16, is_object ?
+                           (unsigned int)record->info.type_count : 0);
+      success = (fwrite(buf, sizeof(buf), 1, out) == 1);
+    }
+
+    for (int c = 0; (c < nchunks) && success; ++c) {
+      const ChunkRecord * const record = records + c;
+      const void * const src = (record->method == ChunkMethod_Raw) ?
+        (const unsigned char *)data + record->info.offset :
+        (const void *)&*record->buf;
+
+      if ((record->stored_size > 0) &&
+          (fwrite(src, (size_t)record->stored_size, 1, out) != 1)) {
+        success = false;
+      }
+    }
+
+    if (!success) {
+      fprintf(stderr, "Failed writing to output file: %s\n",
+              strerror(errno));
+    }
+  }
+
+  for (int c = 0; c < ncompressed; ++c) {
+    free(records[c].buf);
+  }
+  free(alloc);
+
+  return success;
+}
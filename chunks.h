@@ -0,0 +1,39 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Chunked file format with random access to objects
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef CHUNKS_H
+#define CHUNKS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "sfformats.h"
+#include "parser.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+typedef struct {
+  long int offset;   /* Offset of the chunk in the uncompressed data */
+  long int size;     /* Size of the chunk when uncompressed */
+  int index;         /* Object number, or -1 if the chunk isn't an object */
+  SFObjectType type;
+  int type_count;    /* Object number among objects of the same type */
+} ChunkInfo;
+
+typedef bool ChunkSelectFn(const ChunkInfo *chunk, void *arg);
+
+bool chunks_is_chunked(FILE *in);
+
+_Optional void *chunks_load(FILE *in, _Optional ChunkSelectFn *select,
+                            void *arg, long int *size,
+                            _Optional ObjectNumber **numbers, int *nnumbers);
+
+bool chunks_write(FILE *out, const void *data, const ChunkInfo *chunks,
+                  int nchunks);
+
+#endif /* CHUNKS_H */
@@ -0,0 +1,758 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Memoisation of clipped polygons
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+
+/* 3DObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+#include "Clip.h"
+
+/* Local header files */
+#include "misc.h"
+#include "byteorder.h"
+#include "hash.h"
+#include "clipcache.h"
+
+enum {
+  ClipCacheVersion = 1,
+  HeaderSize = 20,
+  HashDigits = 16,
+  InitialBuckets = 64,
+  InitialBuffer = 1024,
+};
+
+/* Upper limit on the size of clipped geometry kept in memory */
+#define MaxMemory ((size_t)64 * 1024 * 1024)
+
+static const char clip_magic[8] = {'S','F','3','K','C','L','I','P'};
+
+typedef struct {
+  _Optional unsigned char *data;
+  size_t size;
+  size_t nalloc;
+  bool failed; /* Did memory allocation fail? */
+} ByteBuffer;
+
+static void lock_cache(ClipCache * const cache)
+{
+  assert(cache != NULL);
+#ifdef USE_PTHREADS
+  pthread_mutex_lock(&cache->lock);
+#endif
+}
+
+static void unlock_cache(ClipCache * const cache)
+{
+  assert(cache != NULL);
+#ifdef USE_PTHREADS
+  pthread_mutex_unlock(&cache->lock);
+#endif
+}
+
+/* Returns a pointer to space for the given number of bytes at the end of a
+   buffer, or NULL if memory allocation failed */
+static _Optional unsigned char *extend(ByteBuffer * const b,
+                                       const size_t n)
+{
+  assert(b != NULL);
+
+  if (b->failed) {
+    return NULL;
+  }
+
+  if (b->size + n > b->nalloc) {
+    size_t nalloc = b->nalloc ? b->nalloc : InitialBuffer;
+    while (b->size + n > nalloc) {
+      nalloc *= 2;
+    }
+    _Optional unsigned char * const data = realloc(b->data, nalloc);
+    if (data == NULL) {
+      b->failed = true;
+      return NULL;
+    }
+    b->data = data;
+    b->nalloc = nalloc;
+  }
+
+  unsigned char * const p = &*b->data + b->size;
+  b->size += n;
+  return p;
+}
+
+static void append_uint32(ByteBuffer * const b, const uint32_t value)
+{
+  _Optional unsigned char * const p = extend(b, 4);
+  if (p != NULL) {
+    put_uint32(&*p, value);
+  }
+}
+
+static void append_coord(ByteBuffer * const b, const Coord value)
+{
+  /* Coordinates are stored exactly, in the host's double format */
+  const double d = value;
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  _Optional unsigned char * const p = extend(b, 8);
+  if (p != NULL) {
+    put_uint64(&*p, bits);
+  }
+}
+
+static void append_geometry(ByteBuffer * const b,
+                            const VertexArray * const varray,
+                            const Group * const groups, const int ngroups)
+{
+  assert(b != NULL);
+  assert(varray != NULL);
+  assert(groups != NULL);
+  assert(ngroups > 0);
+
+  const int nvertices = vertex_array_get_num_vertices(varray);
+  append_uint32(b, (uint32_t)nvertices);
+  for (int v = 0; v < nvertices; ++v) {
+    _Optional Coord (* const coords)[3] = vertex_array_get_coords(varray, v);
+    for (int k = 0; k < 3; ++k) {
+      append_coord(b, coords ? (*coords)[k] : 0);
+    }
+  }
+
+  append_uint32(b, (uint32_t)ngroups);
+  for (int g = 0; g < ngroups; ++g) {
+    const int nprims = group_get_num_primitives(groups + g);
+    int ncopied = 0;
+    for (int p = 0; p < nprims; ++p) {
+      if (group_get_primitive(groups + g, p) != NULL) {
+        ++ncopied;
+      }
+    }
+
+    append_uint32(b, (uint32_t)ncopied);
+    for (int p = 0; p < nprims; ++p) {
+      _Optional const Primitive * const pp = group_get_primitive(groups + g,
+                                                                 p);
+      if (pp == NULL) {
+        continue;
+      }
+
+      const int nsides = primitive_get_num_sides(&*pp);
+      append_uint32(b, (uint32_t)nsides);
+      append_uint32(b, (uint32_t)primitive_get_colour(&*pp));
+      append_uint32(b, (uint32_t)primitive_get_id(&*pp));
+      for (int s = 0; s < nsides; ++s) {
+        append_uint32(b, (uint32_t)primitive_get_side(&*pp, s));
+      }
+    }
+  }
+}
+
+static bool read_uint32(const unsigned char * const data, const size_t size,
+                        size_t * const pos, uint32_t * const value)
+{
+  assert(data != NULL);
+  assert(pos != NULL);
+  assert(value != NULL);
+
+  if (size - *pos < 4) {
+    return false;
+  }
+  *value = get_uint32(data + *pos);
+  *pos += 4;
+  return true;
+}
+
+/* Checks that clipped geometry can be restored, without changing the
+   object's geometry */
+static bool check_geometry(const unsigned char * const data,
+                           const size_t size, const int ngroups)
+{
+  assert(data != NULL);
+  assert(ngroups > 0);
+
+  size_t pos = 0;
+  uint32_t nvertices;
+  if (!read_uint32(data, size, &pos, &nvertices) ||
+      (nvertices > INT_MAX) || (nvertices > (size - pos) / 24)) {
+    return false;
+  }
+  pos += (size_t)nvertices * 24;
+
+  uint32_t ngroups_cached;
+  if (!read_uint32(data, size, &pos, &ngroups_cached) ||
+      (ngroups_cached != (uint32_t)ngroups)) {
+    return false;
+  }
+
+  for (int g = 0; g < ngroups; ++g) {
+    uint32_t nprims;
+    if (!read_uint32(data, size, &pos, &nprims)) {
+      return false;
+    }
+
+    for (uint32_t p = 0; p < nprims; ++p) {
+      uint32_t nsides, colour, id;
+      if (!read_uint32(data, size, &pos, &nsides) ||
+          !read_uint32(data, size, &pos, &colour) ||
+          !read_uint32(data, size, &pos, &id) ||
+          (nsides > (size - pos) / 4) ||
+          (colour > INT_MAX) || (id > INT_MAX)) {
+        return false;
+      }
+
+      for (uint32_t side = 0; side < nsides; ++side) {
+        uint32_t v;
+        if (!read_uint32(data, size, &pos, &v) || (v >= nvertices)) {
+          return false;
+        }
+      }
+    }
+  }
+
+  return pos == size;
+}
+
+/* Replaces an object's geometry with geometry that was previously
+   clipped and has been checked */
+static bool restore_geometry(const unsigned char * const data,
+                             const size_t size, VertexArray * const varray,
+                             Group * const groups, const int ngroups)
+{
+  assert(data != NULL);
+  assert(varray != NULL);
+  assert(groups != NULL);
+  assert(ngroups > 0);
+  assert(check_geometry(data, size, ngroups));
+  NOT_USED(size);
+
+  size_t pos = 0;
+  const uint32_t nvertices = get_uint32(data + pos);
+  pos += 4;
+
+  vertex_array_clear(varray);
+  if (vertex_array_alloc_vertices(varray, (int)nvertices) < (int)nvertices) {
+    fprintf(stderr, "Failed to allocate memory for %d vertices\n",
+            (int)nvertices);
+    return false;
+  }
+
+  for (uint32_t v = 0; v < nvertices; ++v) {
+    Coord pos3[3];
+    for (int k = 0; k < 3; ++k) {
+      const uint64_t bits = get_uint64(data + pos);
+      double d;
+      memcpy(&d, &bits, sizeof(d));
+      pos3[k] = (Coord)d;
+      pos += 8;
+    }
+    if (vertex_array_add_vertex(varray, &pos3) < 0) {
+      fprintf(stderr, "Failed to allocate vertex memory\n");
+      return false;
+    }
+  }
+
+  pos += 4; /* Number of groups */
+
+  for (int g = 0; g < ngroups; ++g) {
+    group_delete_all(groups + g);
+
+    const uint32_t nprims = get_uint32(data + pos);
+    pos += 4;
+
+    for (uint32_t p = 0; p < nprims; ++p) {
+      const uint32_t nsides = get_uint32(data + pos);
+      const uint32_t colour = get_uint32(data + pos + 4);
+      const uint32_t id = get_uint32(data + pos + 8);
+      pos += 12;
+
+      _Optional Primitive * const pp = group_add_primitive(groups + g);
+      if (pp == NULL) {
+        fprintf(stderr, "Failed to allocate primitive memory\n");
+        return false;
+      }
+
+      for (uint32_t side = 0; side < nsides; ++side) {
+        const uint32_t v = get_uint32(data + pos);
+        pos += 4;
+        if (primitive_add_side(&*pp, (int)v) < 0) {
+          fprintf(stderr, "Failed to allocate side memory\n");
+          return false;
+        }
+      }
+      primitive_set_colour(&*pp, (int)colour);
+      primitive_set_id(&*pp, (int)id);
+    }
+  }
+
+  return true;
+}
+
+static _Optional ClipCacheEntry **get_bucket(ClipCache * const cache,
+                                             const uint64_t hash)
+{
+  assert(cache != NULL);
+  assert(cache->buckets != NULL);
+  assert(cache->nbuckets > 0);
+
+  return &*cache->buckets + (size_t)(hash & (cache->nbuckets - 1));
+}
+
+static void unlink_used(ClipCache * const cache,
+                        ClipCacheEntry * const entry)
+{
+  assert(cache != NULL);
+  assert(entry != NULL);
+
+  if (entry->newer != NULL) {
+    entry->newer->older = entry->older;
+  } else {
+    cache->newest = entry->older;
+  }
+
+  if (entry->older != NULL) {
+    entry->older->newer = entry->newer;
+  } else {
+    cache->oldest = entry->newer;
+  }
+
+  entry->newer = entry->older = NULL;
+}
+
+static void link_newest(ClipCache * const cache,
+                        ClipCacheEntry * const entry)
+{
+  assert(cache != NULL);
+  assert(entry != NULL);
+
+  entry->newer = NULL;
+  entry->older = cache->newest;
+  if (cache->newest != NULL) {
+    cache->newest->newer = entry;
+  } else {
+    cache->oldest = entry;
+  }
+  cache->newest = entry;
+}
+
+static _Optional ClipCacheEntry *find_entry(ClipCache * const cache,
+                                            const uint64_t hash,
+                                            const unsigned char * const key,
+                                            const size_t key_size)
+{
+  assert(cache != NULL);
+  assert(key != NULL);
+
+  for (_Optional ClipCacheEntry *entry = *get_bucket(cache, hash);
+       entry != NULL; entry = entry->next) {
+    if ((entry->hash == hash) && (entry->key_size == key_size) &&
+        !memcmp(entry->data, key, key_size)) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+static void remove_entry(ClipCache * const cache,
+                         ClipCacheEntry * const entry)
+{
+  assert(cache != NULL);
+  assert(entry != NULL);
+
+  _Optional ClipCacheEntry **link = get_bucket(cache, entry->hash);
+  while (*link != entry) {
+    assert(*link != NULL);
+    link = &(*link)->next;
+  }
+  *link = entry->next;
+
+  unlink_used(cache, entry);
+  assert(cache->memory >= entry->size);
+  cache->memory -= entry->size;
+  --cache->nentries;
+  free(entry->data);
+  free(entry);
+}
+
+/* Doubles the number of buckets. Failure isn't an error because the
+   chains only get longer. */
+static void grow_buckets(ClipCache * const cache)
+{
+  assert(cache != NULL);
+
+  const size_t nbuckets = cache->nbuckets * 2;
+  _Optional ClipCacheEntry ** const buckets = calloc(nbuckets,
+                                                     sizeof(*buckets));
+  if (buckets == NULL) {
+    return;
+  }
+
+  for (size_t b = 0; b < cache->nbuckets; ++b) {
+    _Optional ClipCacheEntry *entry = (&*cache->buckets)[b];
+    while (entry != NULL) {
+      _Optional ClipCacheEntry * const next = entry->next;
+      const size_t nb = (size_t)(entry->hash & (nbuckets - 1));
+      entry->next = buckets[nb];
+      buckets[nb] = entry;
+      entry = next;
+    }
+  }
+
+  free(cache->buckets);
+  cache->buckets = buckets;
+  cache->nbuckets = nbuckets;
+}
+
+/* Takes ownership of the data, unless an equal entry was already added */
+static void add_entry(ClipCache * const cache, const uint64_t hash,
+                      unsigned char * const data, const size_t key_size,
+                      const size_t size)
+{
+  assert(cache != NULL);
+  assert(data != NULL);
+  assert(key_size <= size);
+
+  if (size > MaxMemory) {
+    free(data);
+    return;
+  }
+
+  _Optional ClipCacheEntry * const entry = malloc(sizeof(*entry));
+  if (entry == NULL) {
+    /* The geometry will be clipped again next time */
+    free(data);
+    return;
+  }
+
+  lock_cache(cache);
+  if (find_entry(cache, hash, data, key_size) != NULL) {
+    /* Another thread clipped the same geometry */
+    unlock_cache(cache);
+    free(data);
+    free(entry);
+    return;
+  }
+
+  /* Discard the least recently used geometry to make room */
+  while (cache->memory + size > MaxMemory) {
+    assert(cache->oldest != NULL);
+    remove_entry(cache, &*cache->oldest);
+  }
+
+  if (cache->nentries >= cache->nbuckets) {
+    grow_buckets(cache);
+  }
+
+  _Optional ClipCacheEntry ** const bucket = get_bucket(cache, hash);
+  *entry = (ClipCacheEntry){
+    .hash = hash,
+    .key_size = key_size,
+    .size = size,
+    .data = data,
+    .next = *bucket,
+  };
+  *bucket = &*entry;
+  link_newest(cache, &*entry);
+  cache->memory += size;
+  ++cache->nentries;
+  unlock_cache(cache);
+}
+
+static _Optional char *make_file_name(const char * const dir,
+                                      const uint64_t hash,
+                                      const char * const ext)
+{
+  assert(dir != NULL);
+  assert(ext != NULL);
+
+  const size_t len = strlen(dir) + 1 + HashDigits + 1 + strlen(ext) + 1;
+  _Optional char * const name = malloc(len);
+  if (name == NULL) {
+    fprintf(stderr, "Failed to allocate memory for cache file path\n");
+    return NULL;
+  }
+  snprintf(&*name, len, "%s%c%08lx%08lx%c%s", dir, PATH_SEPARATOR,
+           (unsigned long)(uint32_t)(hash >> 32),
+           (unsigned long)(uint32_t)hash, EXT_SEPARATOR, ext);
+  return name;
+}
+
+/* Reads clipped geometry from a cache file, returning a buffer holding the
+   key and geometry if the key matches, or NULL otherwise */
+static _Optional unsigned char *load_file(const char * const file_name,
+                                          const unsigned char * const key,
+                                          const size_t key_size,
+                                          const int ngroups,
+                                          size_t * const size)
+{
+  assert(file_name != NULL);
+  assert(key != NULL);
+  assert(size != NULL);
+
+  _Optional FILE * const f = fopen(file_name, "rb");
+  if (f == NULL) {
+    return NULL; /* Not an error: the geometry hasn't been cached */
+  }
+
+  _Optional unsigned char *data = NULL;
+  unsigned char header[HeaderSize];
+  if ((fread(header, sizeof(header), 1, &*f) == 1) &&
+      !memcmp(header, clip_magic, sizeof(clip_magic)) &&
+      (get_uint32(header + 8) == ClipCacheVersion) &&
+      (get_uint32(header + 12) == key_size)) {
+    const size_t total = key_size + get_uint32(header + 16);
+    data = malloc(total);
+    if ((data != NULL) &&
+        ((fread(&*data, total, 1, &*f) != 1) ||
+         memcmp(&*data, key, key_size))) {
+      /* Truncated, or a different key with the same hash */
+      free(data);
+      data = NULL;
+    } else if ((data != NULL) &&
+               !check_geometry(&*data + key_size, total - key_size,
+                               ngroups)) {
+      fprintf(stderr, "Warning: ignoring bad cache file '%s'\n",
+              file_name);
+      remove(file_name);
+      free(data);
+      data = NULL;
+    } else {
+      *size = total;
+    }
+  }
+
+  fclose(&*f);
+  return data;
+}
+
+/* Writes clipped geometry to a cache file. Failure isn't an error because
+   the geometry can be clipped again. */
+static void save_file(const char * const file_name, const uint64_t hash,
+                      const char * const dir,
+                      const unsigned char * const data,
+                      const size_t key_size, const size_t size)
+{
+  assert(file_name != NULL);
+  assert(dir != NULL);
+  assert(data != NULL);
+  assert(key_size <= size);
+
+  /* Write a temporary file and rename it, so that other processes never
+     read a partial file */
+  _Optional char * const tmp_name = make_file_name(dir, hash, "tmp");
+  if (tmp_name == NULL) {
+    return;
+  }
+
+  _Optional FILE * const f = fopen(&*tmp_name, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "Warning: failed to create cache file '%s': %s\n",
+            &*tmp_name, strerror(errno));
+    free(tmp_name);
+    return;
+  }
+
+  unsigned char header[HeaderSize] = {0};
+  memcpy(header, clip_magic, sizeof(clip_magic));
+  put_uint32(header + 8, ClipCacheVersion);
+  put_uint32(header + 12, (uint32_t)key_size);
+  put_uint32(header + 16, (uint32_t)(size - key_size));
+
+  bool success = (fwrite(header, sizeof(header), 1, &*f) == 1) &&
+                 (fwrite(data, size, 1, &*f) == 1);
+  if (fclose(&*f)) {
+    success = false;
+  }
+
+  if (success) {
+    remove(file_name);
+    success = !rename(&*tmp_name, file_name);
+  }
+
+  if (!success) {
+    fprintf(stderr, "Warning: failed to write cache file '%s': %s\n",
+            file_name, strerror(errno));
+    remove(&*tmp_name);
+  }
+  free(tmp_name);
+}
+
+bool clip_cache_init(ClipCache * const cache, const char * const dir)
+{
+  assert(cache != NULL);
+  assert(dir != NULL);
+
+  _Optional char * const dir_copy = malloc(strlen(dir) + 1);
+  _Optional ClipCacheEntry ** const buckets = calloc(InitialBuckets,
+                                                     sizeof(*buckets));
+  if ((dir_copy == NULL) || (buckets == NULL)) {
+    fprintf(stderr, "Failed to allocate memory for clipping cache\n");
+    free(dir_copy);
+    free(buckets);
+    return false;
+  }
+  strcpy(&*dir_copy, dir);
+
+  *cache = (ClipCache){
+    .buckets = buckets,
+    .nbuckets = InitialBuckets,
+    .nentries = 0,
+    .memory = 0,
+    .newest = NULL,
+    .oldest = NULL,
+    .dir = &*dir_copy,
+  };
+
+#ifdef USE_PTHREADS
+  if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+    fprintf(stderr, "Failed to create clipping cache lock\n");
+    free(cache->dir);
+    free(cache->buckets);
+    return false;
+  }
+#endif
+
+  return true;
+}
+
+bool clip_cache_clip(ClipCache * const cache, VertexArray * const varray,
+                     Group * const groups, const int ngroups,
+                     const int * const group_order,
+                     const int group_order_len, const bool verbose)
+{
+  assert(cache != NULL);
+  assert(varray != NULL);
+  assert(groups != NULL);
+  assert(ngroups > 0);
+  assert(group_order != NULL);
+  assert(group_order_len > 0);
+
+  /* The result of clipping depends only on the geometry to be clipped and
+     the order in which groups are drawn */
+  ByteBuffer b = {.data = NULL, .size = 0, .nalloc = 0, .failed = false};
+  append_geometry(&b, varray, groups, ngroups);
+  append_uint32(&b, (uint32_t)group_order_len);
+  for (int i = 0; i < group_order_len; ++i) {
+    append_uint32(&b, (uint32_t)group_order[i]);
+  }
+
+  if (b.failed) {
+    /* Clip without memoisation */
+    free(b.data);
+    return clip_polygons(varray, groups, group_order, group_order_len,
+                         verbose);
+  }
+
+  const size_t key_size = b.size;
+  const uint64_t hash = hash_bytes(&*b.data, key_size);
+
+  lock_cache(cache);
+  _Optional ClipCacheEntry * const entry =
+    find_entry(cache, hash, &*b.data, key_size);
+  bool found = false, success = true;
+  if (entry != NULL) {
+    /* Entries are only added after their geometry was checked */
+    found = true;
+    unlink_used(cache, &*entry);
+    link_newest(cache, &*entry);
+    success = restore_geometry(entry->data + entry->key_size,
+                               entry->size - entry->key_size, varray,
+                               groups, ngroups);
+  }
+  unlock_cache(cache);
+
+  if (found) {
+    free(b.data);
+    if (verbose) {
+      puts("Found clipped polygons in memory");
+    }
+    return success;
+  }
+
+  _Optional char * const file_name = make_file_name(cache->dir, hash,
+                                                   "clip");
+  if (file_name != NULL) {
+    /* Files that are unreadable or bad are ignored, so the geometry is
+       clipped as if there were no cache */
+    size_t size;
+    _Optional unsigned char * const data = load_file(&*file_name, &*b.data,
+                                                     key_size, ngroups,
+                                                     &size);
+    if (data != NULL) {
+      free(b.data);
+      if (!restore_geometry(&*data + key_size, size - key_size, varray,
+                            groups, ngroups)) {
+        free(data);
+        free(file_name);
+        return false;
+      }
+
+      if (verbose) {
+        printf("Found clipped polygons in '%s'\n", &*file_name);
+      }
+      add_entry(cache, hash, &*data, key_size, size);
+      free(file_name);
+      return true;
+    }
+  }
+
+  if (!clip_polygons(varray, groups, group_order, group_order_len,
+                     verbose)) {
+    free(b.data);
+    free(file_name);
+    return false;
+  }
+
+  /* Record the clipped geometry after the key */
+  append_geometry(&b, varray, groups, ngroups);
+  if (!b.failed) {
+    if (file_name != NULL) {
+      save_file(&*file_name, hash, cache->dir, &*b.data, key_size, b.size);
+    }
+    add_entry(cache, hash, &*b.data, key_size, b.size);
+  } else {
+    free(b.data);
+  }
+  free(file_name);
+
+  return true;
+}
+
+void clip_cache_destroy(ClipCache * const cache)
+{
+  assert(cache != NULL);
+
+  while (cache->oldest != NULL) {
+    remove_entry(cache, &*cache->oldest);
+  }
+  free(cache->buckets);
+  free(cache->dir);
+#ifdef USE_PTHREADS
+  pthread_mutex_destroy(&cache->lock);
+#endif
+}
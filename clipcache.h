@@ -0,0 +1,62 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Memoisation of clipped polygons
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef CLIPCACHE_H
+#define CLIPCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "Vertex.h"
+#include "Group.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+typedef struct ClipCacheEntry ClipCacheEntry;
+
+struct ClipCacheEntry {
+  uint64_t hash;                 /* Hash of the key */
+  size_t key_size;
+  size_t size;                   /* Size of the key and clipped geometry */
+  unsigned char *data;           /* Key followed by clipped geometry */
+  _Optional ClipCacheEntry *next;  /* Next entry with the same bucket */
+  _Optional ClipCacheEntry *newer; /* Entry that was used more recently */
+  _Optional ClipCacheEntry *older; /* Entry that was used less recently */
+};
+
+/* Clipped geometry of objects, keyed by their geometry before clipping
+   and the order in which their plot groups are drawn. Entries are kept
+   in a hash table and the least recently used are discarded to keep the
+   total size of their data within a limit. */
+typedef struct {
+  _Optional ClipCacheEntry **buckets;
+  size_t nbuckets;               /* Always a power of two */
+  size_t nentries;
+  size_t memory;                 /* Total size of the entries' data */
+  _Optional ClipCacheEntry *newest;
+  _Optional ClipCacheEntry *oldest;
+  char *dir;                     /* Directory of cache files */
+#ifdef USE_PTHREADS
+  pthread_mutex_t lock;
+#endif
+} ClipCache;
+
+bool clip_cache_init(ClipCache *cache, const char *dir);
+
+bool clip_cache_clip(ClipCache *cache, VertexArray *varray, Group *groups,
+                     int ngroups, const int *group_order,
+                     int group_order_len, bool verbose);
+
+void clip_cache_destroy(ClipCache *cache);
+
+#endif /* CLIPCACHE_H */
@@ -0,0 +1,474 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Decoding and output of collision boxes
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+/* 3DObjLib headers */
+#include "ObjFile.h"
+
+/* Local header files */
+#include "sfformats.h"
+#include "misc.h"
+#include "byteorder.h"
+#include "faces.h"
+#include "collision.h"
+
+/* All integers in a collision file are little-endian. Every table starts at
+   a multiple of 8 bytes, so that a collision file can be mapped into memory
+   and used in place. */
+enum {
+  CollisionVersion = 2,
+  HeaderSize = 32,
+  ObjectRecordSize = 16,
+  BoxRecordSize = 28,
+  NodeRecordSize = 32,
+  MaxUInt16 = 0xffff,
+  InitialObjects = 32,
+  InitialBoxes = 64,
+  FineBits = 7,    /* Least significant bits discarded from small values */
+  CoarseBits = 9,  /* Least significant bits discarded from large values */
+  NumCorners = 8,
+};
+
+#define MIN_FINE_VALUE (-32640l)
+#define MAX_FINE_VALUE (32767l)
+#define MIN_VALUE (-130560l)
+#define MAX_VALUE (131071l)
+#define LEAF_NODE UINT32_C(0xffffffff)
+
+static const char collision_magic[8] = {'S','F','3','K','C','O','L','L'};
+
+typedef struct {
+  int32_t min[3];
+  int32_t max[3];
+  uint32_t left;  /* Index of the first child node, or of a box if a leaf */
+  uint32_t right; /* Index of the second child node, or LEAF_NODE */
+} BVHNode;
+
+static long int get_int32(const unsigned char * const p)
+{
+  assert(p != NULL);
+
+  const uint32_t value = get_uint32(p);
+  return (value > INT32_MAX) ? -(long int)(~value) - 1 : (long int)value;
+}
+
+static bool quantise(long int const value, int32_t * const out)
+{
+  assert(out != NULL);
+
+  if ((value < MIN_VALUE) || (value > MAX_VALUE)) {
+    return false;
+  }
+
+  /* Coordinates are encoded as immediate constants in ARM instructions,
+     which is equivalent to division rounding toward negative infinity */
+  const int bits = ((value < MIN_FINE_VALUE) || (value > MAX_FINE_VALUE)) ?
+                   CoarseBits : FineBits;
+  const long int unit = 1l << bits;
+  const long int q = (value >= 0) ? value / unit :
+                                    -((-value + unit - 1) / unit);
+  *out = (int32_t)(q * unit);
+  return true;
+}
+
+bool collision_decode(const unsigned char * const bytes,
+                      CollisionBox * const box)
+{
+  assert(bytes != NULL);
+  assert(box != NULL);
+
+  box->type = bytes[0];
+
+  for (int k = 0; k < 3; ++k) {
+    int32_t a, b;
+    if (!quantise(get_int32(bytes + 4 + (4 * k)), &a) ||
+        !quantise(get_int32(bytes + 16 + (4 * k)), &b)) {
+      return false;
+    }
+
+    /* Reversed coordinate pairs are swapped so that no box has a negative
+       size */
+    box->min[k] = LOWEST(a, b);
+    box->max[k] = HIGHEST(a, b);
+  }
+
+  return true;
+}
+
+bool collision_output_wireframe(FILE * const out, const char * const name,
+                                const CollisionBox * const boxes,
+                                const int nboxes, const int vtotal,
+                                const VertexStyle vstyle, const bool flip_z)
+{
+  assert(out != NULL);
+  assert(name != NULL);
+  assert(boxes != NULL || nboxes == 0);
+  assert(nboxes >= 0);
+  assert(vtotal >= 0);
+
+  if (nboxes == 0) {
+    return true;
+  }
+
+  for (int b = 0; b < nboxes; ++b) {
+    for (int c = 0; c < NumCorners; ++c) {
+      const int32_t x = (c & 1) ? boxes[b].max[0] : boxes[b].min[0];
+      const int32_t y = (c & 2) ? boxes[b].max[1] : boxes[b].min[1];
+      const int32_t z = (c & 4) ? boxes[b].max[2] : boxes[b].min[2];
+      if (fprintf(out, "v %f %f %f\n", (double)x, (double)y,
+                  flip_z ? -(double)z : (double)z) < 0) {
+        return false;
+      }
+    }
+  }
+
+  if (fprintf(out, "g %s %s_collision\n", name, name) < 0) {
+    return false;
+  }
+
+  /* Each edge joins two corners which differ in one coordinate */
+  const int count = nboxes * NumCorners;
+  for (int b = 0; b < nboxes; ++b) {
+    for (int c = 0; c < NumCorners; ++c) {
+      for (int bit = 1; bit < NumCorners; bit <<= 1) {
+        if ((c & bit) == 0) {
+          const int first = (b * NumCorners) + c;
+          if ((fputs("l ", out) < 0) ||
+              !faces_output_index(out, first, vtotal, count, vstyle) ||
+              (fputc(' ', out) < 0) ||
+              !faces_output_index(out, first + bit, vtotal, count, vstyle) ||
+              (fputc('\n', out) < 0)) {
+            return false;
+          }
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+void collisions_init(Collisions * const collisions)
+{
+  assert(collisions != NULL);
+
+  *collisions = (Collisions){
+    .objects = NULL,
+    .nobjects = 0,
+    .objects_alloc = 0,
+    .boxes = NULL,
+    .nboxes = 0,
+    .boxes_alloc = 0,
+  };
+}
+
+bool collisions_add(Collisions * const collisions, const int index,
+                    const SFObjectType type, const int type_count,
+                    const int vertex_scale,
+                    const CollisionBox * const boxes, const int nboxes)
+{
+  assert(collisions != NULL);
+  assert(index >= 0);
+  assert(type_count >= 0);
+  assert(vertex_scale > 0);
+  assert(vertex_scale <= UINT8_MAX);
+  assert(boxes != NULL || nboxes == 0);
+  assert(nboxes >= 0);
+
+  if (collisions->nobjects >= collisions->objects_alloc) {
+    const int nalloc = collisions->objects_alloc > 0 ?
+                       collisions->objects_alloc * 2 : InitialObjects;
+    _Optional CollisionObject * const objects =
+      realloc(collisions->objects, sizeof(*objects) * (size_t)nalloc);
+    if (objects == NULL) {
+      fprintf(stderr, "Failed allocating memory for collision boxes\n");
+      return false;
+    }
+    collisions->objects = objects;
+    collisions->objects_alloc = nalloc;
+  }
+
+  if (collisions->nboxes + nboxes > collisions->boxes_alloc) {
+    int nalloc = collisions->boxes_alloc > 0 ?
+                 collisions->boxes_alloc : InitialBoxes;
+    while (collisions->nboxes + nboxes > nalloc) {
+      nalloc *= 2;
+    }
+    _Optional CollisionBox * const new_boxes =
+      realloc(collisions->boxes, sizeof(*new_boxes) * (size_t)nalloc);
+    if (new_boxes == NULL) {
+      fprintf(stderr, "Failed allocating memory for collision boxes\n");
+      return false;
+    }
+    collisions->boxes = new_boxes;
+    collisions->boxes_alloc = nalloc;
+  }
+
+  (&*collisions->objects)[collisions->nobjects++] = (CollisionObject){
+    .index = index,
+    .type = type,
+    .type_count = type_count,
+    .vertex_scale = vertex_scale,
+    .first_box = collisions->nboxes,
+    .nboxes = nboxes,
+  };
+
+  if (nboxes > 0) {
+    memcpy(&*collisions->boxes + collisions->nboxes, boxes,
+           sizeof(*boxes) * (size_t)nboxes);
+    collisions->nboxes += nboxes;
+  }
+  return true;
+}
+
+static long int get_centre(const CollisionBox * const box, const int axis)
+{
+  assert(box != NULL);
+  assert(axis >= 0);
+  assert(axis < 3);
+
+  /* Twice the centre, to avoid rounding */
+  return (long int)box->min[axis] + box->max[axis];
+}
+
+/* Builds a subtree for the given boxes in depth-first order, splitting them
+   in half along the axis on which their centres are most spread out.
+   Returns the index of the root of the subtree. */
+static int build_node(BVHNode * const nodes, int * const nnodes,
+                      const CollisionBox * const boxes, int * const order,
+                      const int n)
+{
+  assert(nodes != NULL);
+  assert(nnodes != NULL);
+  assert(boxes != NULL);
+  assert(order != NULL);
+  assert(n > 0);
+
+  const int index = (*nnodes)++;
+  BVHNode * const node = nodes + index;
+  long int cmin[3] = {0}, cmax[3] = {0};
+
+  for (int i = 0; i < n; ++i) {
+    const CollisionBox * const box = boxes + order[i];
+    for (int k = 0; k < 3; ++k) {
+      const long int centre = get_centre(box, k);
+      if ((i == 0) || (box->min[k] < node->min[k])) {
+        node->min[k] = box->min[k];
+      }
+      if ((i == 0) || (box->max[k] > node->max[k])) {
+        node->max[k] = box->max[k];
+      }
+      if ((i == 0) || (centre < cmin[k])) {
+        cmin[k] = centre;
+      }
+      if ((i == 0) || (centre > cmax[k])) {
+        cmax[k] = centre;
+      }
+    }
+  }
+
+  if (n == 1) {
+    node->left = (uint32_t)order[0];
+    node->right = LEAF_NODE;
+    return index;
+  }
+
+  int axis = 0;
+  for (int k = 1; k < 3; ++k) {
+    if ((cmax[k] - cmin[k]) > (cmax[axis] - cmin[axis])) {
+      axis = k;
+    }
+  }
+
+  /* Objects have few boxes, so an insertion sort is fast enough */
+  for (int i = 1; i < n; ++i) {
+    const int b = order[i];
+    int j = i;
+    for (; (j > 0) &&
+           (get_centre(boxes + order[j - 1], axis) > get_centre(boxes + b,
+                                                                axis));
+         --j) {
+      order[j] = order[j - 1];
+    }
+    order[j] = b;
+  }
+
+  const int half = n / 2;
+  node->left = (uint32_t)build_node(nodes, nnodes, boxes, order, half);
+  node->right = (uint32_t)build_node(nodes, nnodes, boxes, order + half,
+                                     n - half);
+  return index;
+}
+
+static int count_nodes(const CollisionObject * const object)
+{
+  assert(object != NULL);
+  return (object->nboxes > 0) ? (2 * object->nboxes) - 1 : 0;
+}
+
+static bool write_nodes(FILE * const out, const Collisions * const collisions)
+{
+  assert(out != NULL);
+  assert(collisions != NULL);
+
+  int max_boxes = 0;
+  for (int o = 0; o < collisions->nobjects; ++o) {
+    max_boxes = HIGHEST(max_boxes, (&*collisions->objects)[o].nboxes);
+  }
+  if (max_boxes == 0) {
+    return true;
+  }
+
+  _Optional int * const order = malloc(sizeof(int) * (size_t)max_boxes);
+  _Optional BVHNode * const nodes = malloc(sizeof(*nodes) *
+                                           ((2 * (size_t)max_boxes) - 1));
+  if ((order == NULL) || (nodes == NULL)) {
+    fprintf(stderr, "Failed allocating memory for collision boxes\n");
+    free(nodes);
+    free(order);
+    return false;
+  }
+
+  bool success = true;
+  for (int o = 0; (o < collisions->nobjects) && success; ++o) {
+    const CollisionObject * const object = &*collisions->objects + o;
+    if (object->nboxes == 0) {
+      continue;
+    }
+
+    for (int b = 0; b < object->nboxes; ++b) {
+      (&*order)[b] = b;
+    }
+    int nnodes = 0;
+    (void)build_node(&*nodes, &nnodes,
+                     &*collisions->boxes + object->first_box, &*order,
+                     object->nboxes);
+    assert(nnodes == count_nodes(object));
+
+    for (int n = 0; (n < nnodes) && success; ++n) {
+      const BVHNode * const node = &*nodes + n;
+      unsigned char record[NodeRecordSize];
+      for (int k = 0; k < 3; ++k) {
+        put_uint32(record + (4 * k), (uint32_t)node->min[k]);
+        put_uint32(record + 12 + (4 * k), (uint32_t)node->max[k]);
+      }
+      put_uint32(record + 24, node->left);
+      put_uint32(record + 28, node->right);
+      success = (fwrite(record, sizeof(record), 1, out) == 1);
+    }
+  }
+
+  free(nodes);
+  free(order);
+
+  if (!success) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+  }
+  return success;
+}
+
+bool collisions_write(FILE * const out, const Collisions * const collisions)
+{
+  assert(out != NULL);
+  assert(collisions != NULL);
+
+  uint32_t nnodes = 0;
+  for (int o = 0; o < collisions->nobjects; ++o) {
+    const CollisionObject * const object = &*collisions->objects + o;
+    if ((object->index > MaxUInt16) || (object->type_count > MaxUInt16) ||
+        (object->nboxes > MaxUInt16)) {
+      fprintf(stderr, "Object %d has too many collision boxes\n",
+              object->index);
+      return false;
+    }
+    nnodes += (uint32_t)count_nodes(object);
+  }
+
+  const uint32_t objects_offset = HeaderSize;
+  const uint32_t boxes_offset = objects_offset + ((uint32_t)
+                                collisions->nobjects * ObjectRecordSize);
+  const uint32_t boxes_end = boxes_offset + ((uint32_t)collisions->nboxes *
+                                             BoxRecordSize);
+  const uint32_t nodes_offset = (boxes_end + 7u) & ~7u;
+
+  unsigned char header[HeaderSize] = {0};
+  memcpy(header, collision_magic, sizeof(collision_magic));
+  put_uint32(header + 8, CollisionVersion);
+  put_uint32(header + 12, (uint32_t)collisions->nobjects);
+  put_uint32(header + 16, (uint32_t)collisions->nboxes);
+  put_uint32(header + 20, nnodes);
+  put_uint32(header + 24, boxes_offset);
+  put_uint32(header + 28, nodes_offset);
+  bool success = (fwrite(header, sizeof(header), 1, out) == 1);
+
+  uint32_t first_node = 0;
+  for (int o = 0; (o < collisions->nobjects) && success; ++o) {
+    const CollisionObject * const object = &*collisions->objects + o;
+    unsigned char record[ObjectRecordSize] = {0};
+    put_uint32(record, (uint32_t)object->first_box);
+    put_uint32(record + 4, first_node);
+    put_uint16(record + 8, (unsigned int)object->index);
+    put_uint16(record + 10, (unsigned int)object->type_count);
+    record[12] = (unsigned char)object->type;
+    record[13] = (unsigned char)object->vertex_scale;
+    put_uint16(record + 14, (unsigned int)object->nboxes);
+    success = (fwrite(record, sizeof(record), 1, out) == 1);
+    first_node += (uint32_t)count_nodes(object);
+  }
+
+  for (int b = 0; (b < collisions->nboxes) && success; ++b) {
+    const CollisionBox * const box = &*collisions->boxes + b;
+    unsigned char record[BoxRecordSize] = {0};
+    for (int k = 0; k < 3; ++k) {
+      put_uint32(record + (4 * k), (uint32_t)box->min[k]);
+      put_uint32(record + 12 + (4 * k), (uint32_t)box->max[k]);
+    }
+    record[24] = (unsigned char)box->type;
+    success = (fwrite(record, sizeof(record), 1, out) == 1);
+  }
+
+  if (success && (nodes_offset > boxes_end)) {
+    static const unsigned char padding[8] = {0};
+    success = (fwrite(padding, nodes_offset - boxes_end, 1, out) == 1);
+  }
+
+  if (!success) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+    return false;
+  }
+
+  return write_nodes(out, collisions);
+}
+
+void collisions_free(Collisions * const collisions)
+{
+  assert(collisions != NULL);
+
+  free(collisions->boxes);
+  free(collisions->objects);
+  collisions_init(collisions);
+}
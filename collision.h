@@ -0,0 +1,66 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Decoding and output of collision boxes
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "ObjFile.h"
+
+#include "sfformats.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+enum {
+  CollisionBoxSize = 28 /* Size of a collision box in a graphics file */
+};
+
+typedef struct {
+  int type;
+  int32_t min[3];
+  int32_t max[3];
+} CollisionBox;
+
+typedef struct {
+  int index;       /* Object number within the file */
+  SFObjectType type;
+  int type_count;  /* Object number among objects of the same type */
+  int vertex_scale; /* Factor by which vertex coordinates were multiplied */
+  int first_box;
+  int nboxes;
+} CollisionObject;
+
+typedef struct {
+  _Optional CollisionObject *objects;
+  int nobjects;
+  int objects_alloc;
+  _Optional CollisionBox *boxes;
+  int nboxes;
+  int boxes_alloc;
+} Collisions;
+
+bool collision_decode(const unsigned char *bytes, CollisionBox *box);
+
+bool collision_output_wireframe(FILE *out, const char *name,
+                                const CollisionBox *boxes, int nboxes,
+                                int vtotal, VertexStyle vstyle, bool flip_z);
+
+void collisions_init(Collisions *collisions);
+
+bool collisions_add(Collisions *collisions, int index, SFObjectType type,
+                    int type_count, int vertex_scale,
+                    const CollisionBox *boxes, int nboxes);
+
+bool collisions_write(FILE *out, const Collisions *collisions);
+
+void collisions_free(Collisions *collisions);
+
+#endif /* COLLISION_H */
@@ -18,10 +18,129 @@
  *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+/* ISO library header files */
+#include <stdio.h>
+#include <stdint.h>
+
 /* Local header files */
+#include "sfformats.h"
 #include "misc.h"
+#include "flags.h"
 #include "colours.h"
 
+#define AREA_SIZE(area) ((int)ARRAY_SIZE(((SFObjectColours *)NULL)->area))
+
+enum {
+  NTintBits = 2,
+  TLowShift = 0,
+  THighShift = 1,
+  RLowShift = 2,
+  BLowShift = 3,
+  RHighShift = 4,
+  GLowShift = 5,
+  GHighShift = 6,
+  BHighShift = 7,
+  CompMax = (1 << 4) - 1,
+  NFlashSteps = AREA_SIZE(areas.engine_colours.player_engine),
+  FirstFlashing = AREA_SIZE(areas.static_colours),
+  FirstSlowFlashing = FirstFlashing +
+                      AREA_SIZE(areas.engine_colours.player_engine) +
+                      AREA_SIZE(areas.engine_colours.fighter_engine) +
+                      AREA_SIZE(areas.engine_colours.cruiser_engine) +
+                      AREA_SIZE(areas.engine_colours.super_engine) +
+                      AREA_SIZE(areas.fast_flashing.enemy_ships) +
+                      AREA_SIZE(areas.fast_flashing.friendly_ships) +
+                      AREA_SIZE(areas.fast_flashing.player_ship),
+  EndFlashing = AREA_SIZE(colour_mappings) - AREA_SIZE(areas.player_livery),
+};
+
+int get_flash_period(const int colour)
+{
+  assert(colour >= 0);
+
+  if ((colour < FirstFlashing) || (colour >= EndFlashing)) {
+    return 0;
+  }
+
+  /* Slow flashing colours change every other frame */
+  return (colour < FirstSlowFlashing) ? NFlashSteps : NFlashSteps * 2;
+}
+
+int get_frame_colour(const int colour, const int frame)
+{
+  assert(colour >= 0);
+  assert(frame >= 0);
+
+  if ((colour < FirstFlashing) || (colour >= EndFlashing)) {
+    return colour;
+  }
+
+  /* +1 because the first change of a slow flashing colour happens on
+     the 2nd not 3rd frame */
+  const int special_frame = (colour < FirstSlowFlashing) ?
+                            frame : (frame + 1) / 2;
+  const int start_frame = colour % NFlashSteps;
+
+  return (colour - start_frame) +
+         ((start_frame + special_frame) % NFlashSteps);
+}
+
+void decode_colour(const int colour, double * const red,
+                   double * const green, double * const blue,
+                   const unsigned int flags)
+{
+  assert(colour >= 0);
+  assert(colour <= UINT8_MAX);
+  assert(red != NULL);
+  assert(green != NULL);
+  assert(blue != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  /* Get the tint bits, which are shared between all components */
+  const int t = ((colour >> TLowShift) & 1) |
+                (((colour >> THighShift) & 1) << 1);
+
+  const int r = ((colour >> RLowShift) & 1) |
+                (((colour >> RHighShift) & 1) << 1);
+
+  const int g = ((colour >> GLowShift) & 1) |
+                (((colour >> GHighShift) & 1) << 1);
+
+  const int b = ((colour >> BLowShift) & 1) |
+                (((colour >> BHighShift) & 1) << 1);
+  if (flags & FLAGS_VERBOSE) {
+    printf("red:0x%x green:0x%x blue:0x%x tint:0x%x\n", r, g, b, t);
+  }
+
+  /* Piece together the final colour component values */
+  const int rt = (r << NTintBits) | t;
+  const int gt = (g << NTintBits) | t;
+  const int bt = (b << NTintBits) | t;
+  if (flags & FLAGS_VERBOSE) {
+    printf("red:0x%x green:0x%x blue:0x%x\n", rt, gt, bt);
+  }
+
+  *red = (double)rt/CompMax;
+  *green = (double)gt/CompMax;
+  *blue = (double)bt/CompMax;
+}
+
+void atlas_get_texel(const int colour, const int rows, double * const u,
+                     double * const v)
+{
+  assert(colour >= 0);
+  assert(rows > 0);
+  assert(colour < AtlasColumns * rows);
+  assert(u != NULL);
+  assert(v != NULL);
+
+  /* Point at the centre of the texel to avoid bleeding between colours.
+     The first row is at the top of the image but texture coordinates
+     start at the bottom. */
+  *u = ((colour % AtlasColumns) + 0.5) / AtlasColumns;
+  *v = 1.0 - (((colour / AtlasColumns) + 0.5) / rows);
+}
+
 const char *get_colour_name(const int colour)
 {
   static const char * const colour_names[] =
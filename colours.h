@@ -7,6 +7,24 @@
 #ifndef COLOURS_H
 #define COLOURS_H
 
+/* A texture atlas has one texel for each physical or logical colour */
+enum {
+  AtlasColumns = 16,
+  AtlasPhysicalRows = 16,
+  AtlasLogicalRows = 20,
+};
+
+#define ATLAS_MATERIAL "atlas"
+
 const char *get_colour_name(int colour);
 
+void decode_colour(int colour, double *red, double *green, double *blue,
+                   unsigned int flags);
+
+int get_flash_period(int colour);
+
+int get_frame_colour(int colour, int frame);
+
+void atlas_get_texel(int colour, int rows, double *u, double *v);
+
 #endif /* COLOURS_H */
@@ -0,0 +1,113 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Output of faces in Wavefront format
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdbool.h>
+#include <stdio.h>
+
+/* 3DObjLib headers */
+#include "ObjFile.h"
+
+/* Local header files */
+#include "misc.h"
+#include "faces.h"
+
+bool faces_output_index(FILE * const out, const int index, const int total,
+                        const int count, const VertexStyle vstyle)
+{
+  assert(out != NULL);
+  assert(index >= 0);
+  assert(index < count);
+  assert(total >= 0);
+
+  if (vstyle == VertexStyle_Negative) {
+    return fprintf(out, "%d", index - count) >= 0;
+  }
+  return fprintf(out, "%d", total + index + 1) >= 0;
+}
+
+/* Gets the sides of the original polygon at the corners of triangle t */
+static void get_triangle(const int nsides, const int t, const MeshStyle mstyle,
+                         int * const tri)
+{
+  assert(nsides > 3);
+  assert(t >= 0);
+  assert(t < nsides - 2);
+  assert(tri != NULL);
+
+  if (mstyle == MeshStyle_TriangleFan) {
+    /* Every triangle shares the first vertex */
+    tri[0] = 0;
+    tri[1] = t + 1;
+    tri[2] = t + 2;
+    return;
+  }
+
+  /* Zig-zag between both ends of the polygon's outline, keeping the
+     same winding order for every triangle */
+  int order[3];
+  for (int k = 0; k < 3; ++k) {
+    const int n = t + k;
+    order[k] = (n % 2) ? (n + 1) / 2 : (nsides - n / 2) % nsides;
+  }
+  tri[0] = order[t % 2];
+  tri[1] = order[1 - t % 2];
+  tri[2] = order[2];
+}
+
+bool faces_output(FILE * const out, const int nsides, const MeshStyle mstyle,
+                  FacesOutputCornerFn * const output_corner, void * const arg)
+{
+  assert(out != NULL);
+  assert(nsides > 0);
+  assert(output_corner != NULL);
+
+  if ((nsides <= 3) || (mstyle == MeshStyle_NoChange)) {
+    /* Points and lines can't be split into triangles */
+    const char * const cmd = (nsides == 1) ? "p" : (nsides == 2) ? "l" : "f";
+    if (fputs(cmd, out) < 0) {
+      return false;
+    }
+    for (int s = 0; s < nsides; ++s) {
+      if (!output_corner(out, s, arg)) {
+        return false;
+      }
+    }
+    return fputc('\n', out) >= 0;
+  }
+
+  for (int t = 0; t < nsides - 2; ++t) {
+    int tri[3];
+    get_triangle(nsides, t, mstyle, tri);
+
+    if (fputs("f", out) < 0) {
+      return false;
+    }
+    for (int k = 0; k < 3; ++k) {
+      if (!output_corner(out, tri[k], arg)) {
+        return false;
+      }
+    }
+    if (fputc('\n', out) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
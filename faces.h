@@ -0,0 +1,31 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Output of faces in Wavefront format
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef FACES_H
+#define FACES_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ObjFile.h"
+
+/* Writes a reference to one of the count vertices (or texture coordinates,
+   or normals) of an object, of which total were written before the
+   object */
+bool faces_output_index(FILE *out, int index, int total, int count,
+                        VertexStyle vstyle);
+
+/* Writes a reference to a corner of a face, given the index of one of the
+   sides of the original polygon */
+typedef bool FacesOutputCornerFn(FILE *out, int side, void *arg);
+
+/* Writes a point, line or face with nsides corners, splitting polygons
+   with more than three sides into triangles if requested. The triangles
+   are the same as those written by output_primitives. */
+bool faces_output(FILE *out, int nsides, MeshStyle mstyle,
+                  FacesOutputCornerFn *output_corner, void *arg);
+
+#endif /* FACES_H */
@@ -0,0 +1,352 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Filter expressions over object attributes
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+
+/* Local header files */
+#include "sfformats.h"
+#include "misc.h"
+#include "filter.h"
+
+typedef struct {
+  Filter *filter;
+  const char *expr;
+  const char *pos;
+} FilterParser;
+
+static const char * const attribute_names[FilterAttribute_Count] = {
+  [FilterAttribute_Index] = "index",
+  [FilterAttribute_Type] = "type",
+  [FilterAttribute_TypeIndex] = "type_index",
+  [FilterAttribute_Scale] = "scale",
+  [FilterAttribute_Rotator] = "rotator",
+  [FilterAttribute_Plot] = "plot",
+  [FilterAttribute_Group] = "group",
+  [FilterAttribute_Vertices] = "vertices",
+  [FilterAttribute_Faces] = "faces",
+};
+
+/* Object types can be compared by name, using the same letters as
+   '-type' or the names output when listing objects */
+static const struct {
+  const char *name;
+  SFObjectType type;
+} type_names[] = {
+  {"g", SFObjectType_Ground},
+  {"b", SFObjectType_Bit},
+  {"s", SFObjectType_Aerial},
+  {"ground", SFObjectType_Ground},
+  {"bit", SFObjectType_Bit},
+  {"ship", SFObjectType_Aerial},
+};
+
+static bool parse_or(FilterParser *p);
+
+static void skip_space(FilterParser * const p)
+{
+  assert(p != NULL);
+  while (isspace((unsigned char)*p->pos)) {
+    ++p->pos;
+  }
+}
+
+static bool syntax_error(const FilterParser * const p,
+                         const char * const what)
+{
+  assert(p != NULL);
+  assert(what != NULL);
+
+  if (*p->pos == '\0') {
+    fprintf(stderr, "Bad filter: %s at end of '%s'\n", what, p->expr);
+  } else {
+    fprintf(stderr, "Bad filter: %s at offset %ld of '%s'\n", what,
+            (long)(p->pos - p->expr), p->expr);
+  }
+  return false;
+}
+
+static bool add_op(FilterParser * const p, FilterOpType const type,
+                   int const value)
+{
+  assert(p != NULL);
+
+  Filter * const filter = p->filter;
+  if (filter->nops >= FilterMaxOps) {
+    return syntax_error(p, "expression too long");
+  }
+  filter->ops[filter->nops++] = (FilterOp){.type = type, .value = value};
+  return true;
+}
+
+static bool match_token(FilterParser * const p, const char * const token)
+{
+  assert(p != NULL);
+  assert(token != NULL);
+
+  skip_space(p);
+  const size_t len = strlen(token);
+  if (strncmp(p->pos, token, len)) {
+    return false;
+  }
+  p->pos += len;
+  return true;
+}
+
+static bool name_equals(const char * const name, size_t const len,
+                        const char * const known)
+{
+  assert(name != NULL);
+  assert(known != NULL);
+
+  if (strlen(known) != len) {
+    return false;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    if (tolower((unsigned char)name[i]) != known[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool parse_operand(FilterParser * const p)
+{
+  assert(p != NULL);
+
+  skip_space(p);
+  const char * const start = p->pos;
+
+  if (isdigit((unsigned char)*start)) {
+    char *end;
+    errno = 0;
+    const long int num = strtol(start, &end, 10);
+    if ((errno == ERANGE) || (num > INT_MAX)) {
+      return syntax_error(p, "number out of range");
+    }
+    p->pos = end;
+    return add_op(p, FilterOp_Constant, (int)num);
+  }
+
+  size_t len = 0;
+  while (isalnum((unsigned char)start[len]) || (start[len] == '_')) {
+    ++len;
+  }
+  if (len == 0) {
+    return syntax_error(p, "expected attribute or number");
+  }
+
+  for (size_t a = 0; a < ARRAY_SIZE(attribute_names); ++a) {
+    if (name_equals(start, len, attribute_names[a])) {
+      p->pos += len;
+      p->filter->needs |= 1u << a;
+      return add_op(p, FilterOp_Attribute, (int)a);
+    }
+  }
+
+  for (size_t t = 0; t < ARRAY_SIZE(type_names); ++t) {
+    if (name_equals(start, len, type_names[t].name)) {
+      p->pos += len;
+      return add_op(p, FilterOp_Constant, (int)type_names[t].type);
+    }
+  }
+
+  return syntax_error(p, "unknown name");
+}
+
+static bool parse_comparison(FilterParser * const p)
+{
+  assert(p != NULL);
+
+  /* Two-character operators must be tried first */
+  static const struct {
+    const char *token;
+    FilterOpType type;
+  } ops[] = {
+    {"==", FilterOp_Equal},
+    {"!=", FilterOp_NotEqual},
+    {"<=", FilterOp_LessEqual},
+    {">=", FilterOp_GreaterEqual},
+    {"<", FilterOp_Less},
+    {">", FilterOp_Greater},
+  };
+
+  if (!parse_operand(p)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < ARRAY_SIZE(ops); ++i) {
+    if (match_token(p, ops[i].token)) {
+      return parse_operand(p) && add_op(p, ops[i].type, 0);
+    }
+  }
+
+  return syntax_error(p, "expected comparison");
+}
+
+static bool parse_unary(FilterParser * const p)
+{
+  assert(p != NULL);
+
+  if (match_token(p, "!")) {
+    return parse_unary(p) && add_op(p, FilterOp_Not, 0);
+  }
+
+  if (match_token(p, "(")) {
+    if (!parse_or(p)) {
+      return false;
+    }
+    if (!match_token(p, ")")) {
+      return syntax_error(p, "expected ')'");
+    }
+    return true;
+  }
+
+  return parse_comparison(p);
+}
+
+static bool parse_and(FilterParser * const p)
+{
+  assert(p != NULL);
+
+  if (!parse_unary(p)) {
+    return false;
+  }
+  while (match_token(p, "&&")) {
+    if (!parse_unary(p) || !add_op(p, FilterOp_And, 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool parse_or(FilterParser * const p)
+{
+  assert(p != NULL);
+
+  if (!parse_and(p)) {
+    return false;
+  }
+  while (match_token(p, "||")) {
+    if (!parse_and(p) || !add_op(p, FilterOp_Or, 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool filter_parse(Filter * const filter, const char * const expr)
+{
+  assert(filter != NULL);
+  assert(expr != NULL);
+
+  filter->nops = 0;
+  filter->needs = 0;
+
+  FilterParser p = {.filter = filter, .expr = expr, .pos = expr};
+  if (!parse_or(&p)) {
+    return false;
+  }
+
+  skip_space(&p);
+  if (*p.pos != '\0') {
+    return syntax_error(&p, "unexpected characters");
+  }
+  return true;
+}
+
+bool filter_match(const Filter * const filter,
+                  const int values[FilterAttribute_Count])
+{
+  assert(filter != NULL);
+  assert(filter->nops > 0);
+  assert(values != NULL);
+
+  /* Each operator pushes at most one value, so the stack can't be deeper
+     than the number of operators */
+  int stack[FilterMaxOps];
+  int depth = 0;
+
+  for (int i = 0; i < filter->nops; ++i) {
+    const FilterOp * const op = filter->ops + i;
+    switch (op->type) {
+      case FilterOp_Attribute:
+        assert(op->value >= 0 && op->value < FilterAttribute_Count);
+        stack[depth++] = values[op->value];
+        break;
+
+      case FilterOp_Constant:
+        stack[depth++] = op->value;
+        break;
+
+      case FilterOp_Not:
+        assert(depth >= 1);
+        stack[depth - 1] = !stack[depth - 1];
+        break;
+
+      default:
+      {
+        assert(depth >= 2);
+        const int a = stack[depth - 2], b = stack[depth - 1];
+        int result = 0;
+        switch (op->type) {
+          case FilterOp_Equal:
+            result = (a == b);
+            break;
+          case FilterOp_NotEqual:
+            result = (a != b);
+            break;
+          case FilterOp_Less:
+            result = (a < b);
+            break;
+          case FilterOp_LessEqual:
+            result = (a <= b);
+            break;
+          case FilterOp_Greater:
+            result = (a > b);
+            break;
+          case FilterOp_GreaterEqual:
+            result = (a >= b);
+            break;
+          case FilterOp_And:
+            result = a && b;
+            break;
+          case FilterOp_Or:
+            result = a || b;
+            break;
+          default:
+            assert(!"Unknown filter operator");
+            break;
+        }
+        stack[--depth - 1] = result;
+        break;
+      }
+    }
+  }
+
+  assert(depth == 1);
+  return stack[0] != 0;
+}
@@ -0,0 +1,72 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Filter expressions over object attributes
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+
+#include "sfformats.h"
+
+typedef enum {
+  FilterAttribute_Index,
+  FilterAttribute_Type,
+  FilterAttribute_TypeIndex,
+  FilterAttribute_Scale,
+  FilterAttribute_Rotator,
+  FilterAttribute_Plot,
+  FilterAttribute_Group,
+  FilterAttribute_Vertices,
+  FilterAttribute_Faces,
+  FilterAttribute_Count
+} FilterAttribute;
+
+/* Attributes read from an object's header (scale to vertex count) */
+#define FILTER_NEEDS_HEADER ((1u << FilterAttribute_Scale) | \
+                             (1u << FilterAttribute_Rotator) | \
+                             (1u << FilterAttribute_Plot) | \
+                             (1u << FilterAttribute_Group) | \
+                             (1u << FilterAttribute_Vertices))
+
+/* Attributes that follow an object's vertex data */
+#define FILTER_NEEDS_FACES (1u << FilterAttribute_Faces)
+
+typedef enum {
+  FilterOp_Attribute,
+  FilterOp_Constant,
+  FilterOp_Equal,
+  FilterOp_NotEqual,
+  FilterOp_Less,
+  FilterOp_LessEqual,
+  FilterOp_Greater,
+  FilterOp_GreaterEqual,
+  FilterOp_And,
+  FilterOp_Or,
+  FilterOp_Not
+} FilterOpType;
+
+typedef struct {
+  FilterOpType type;
+  int value; /* Attribute or constant */
+} FilterOp;
+
+enum {
+  FilterMaxOps = 64
+};
+
+/* An expression compiled into postfix order */
+typedef struct {
+  int nops;
+  unsigned int needs; /* Mask of attributes used by the expression */
+  FilterOp ops[FilterMaxOps];
+} Filter;
+
+bool filter_parse(Filter *filter, const char *expr);
+
+bool filter_match(const Filter *filter,
+                  const int values[FilterAttribute_Count]);
+
+#endif /* FILTER_H */
@@ -20,6 +20,16 @@
 #define FLAGS_DUPLICATE          (1u<<10) /* emit duplicate vertices */
 #define FLAGS_HUMAN_READABLE     (1u<<11) /* use human-readable material names */
 #define FLAGS_PHYSICAL_COLOUR    (1u<<12) /* use physical colours as material names */
-#define FLAGS_ALL                ((1u<<13)-1)
+#define FLAGS_CHECK              (1u<<13) /* validate objects without converting them */
+#define FLAGS_VERTEX_COLOURS     (1u<<14) /* colour vertices instead of faces */
+#define FLAGS_ATLAS              (1u<<15) /* colour faces from a texture atlas */
+#define FLAGS_SORT_COLOURS       (1u<<16) /* sort primitives by colour */
+#define FLAGS_OPTIMISE           (1u<<17) /* reorder triangles for a vertex cache */
+#define FLAGS_NORMALS            (1u<<18) /* output a normal for each face */
+#define FLAGS_VISIBILITY         (1u<<19) /* output plot group visibility */
+#define FLAGS_WIREFRAME          (1u<<20) /* output collision box wireframes */
+#define FLAGS_BOUNDS             (1u<<21) /* output bounding volumes */
+#define FLAGS_STREAM             (1u<<22) /* output a binary stream of frames */
+#define FLAGS_ALL                ((1u<<23)-1)
 
 #endif /* FLAGS_H */
@@ -0,0 +1,252 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Fast Gordon Key decompressor
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+/* Local header files */
+#include "misc.h"
+#include "gkeydec.h"
+
+enum {
+  TypeBits = 1,
+  LiteralBits = 8,
+  OffsetBits = GKeyHistoryLog2,
+  MaxDirectiveBits = TypeBits + OffsetBits + GKeyHistoryLog2,
+  HistoryMask = GKeyHistorySize - 1,
+  SizeBytes = 4,
+};
+
+/* A directive is classified by its first bit (literal or copy) and, for a
+   copy, by the most significant bit of its offset, which determines whether
+   the following byte count is encoded using 8 or 9 bits. Both bits are in
+   the bottom 10 bits of the buffer, so they can be combined into an index. */
+#define DIRECTIVE_INDEX(bits) \
+  (((unsigned int)(bits) & 1u) | \
+   ((unsigned int)((bits) >> (OffsetBits - 1)) & 2u))
+
+typedef struct {
+  bool copy;
+  unsigned char count_bits;
+} DirectiveType;
+
+static const DirectiveType directive_types[] = {
+  { false, 0 },                  /* literal */
+  { true, GKeyHistoryLog2 },     /* copy from the older half of the history */
+  { false, 0 },                  /* literal */
+  { true, GKeyHistoryLog2 - 1 }, /* copy from the last 256 bytes written */
+};
+
+static void refill(GKeyDec * const dec)
+{
+  assert(dec != NULL);
+
+  while (dec->nbits <= sizeof(dec->bits) * CHAR_BIT - CHAR_BIT) {
+    if (dec->in_pos >= dec->in_len) {
+      dec->in_pos = 0;
+      dec->in_len = fread(dec->in_buf, 1, sizeof(dec->in_buf), dec->in);
+      if (dec->in_len == 0) {
+        if (ferror(dec->in)) {
+          dec->error = true;
+        }
+        break;
+      }
+    }
+    dec->bits |= (uint64_t)dec->in_buf[dec->in_pos++] << dec->nbits;
+    dec->nbits += CHAR_BIT;
+  }
+}
+
+static void consume(GKeyDec * const dec, unsigned int const n)
+{
+  assert(dec != NULL);
+  assert(n <= dec->nbits);
+  dec->bits >>= n;
+  dec->nbits -= n;
+}
+
+static void zero_fill(GKeyDec * const dec, unsigned char * const dst,
+                      size_t const n)
+{
+  assert(dec != NULL);
+  assert(dst != NULL);
+  assert(n <= GKeyHistorySize);
+
+  /* Write zeros into the history in up to two parts (before and after the
+     end of the circular buffer). */
+  size_t const start = (size_t)dec->out_pos & HistoryMask;
+  size_t const first = LOWEST(n, GKeyHistorySize - start);
+  memset(dec->window + start, 0, first);
+  memset(dec->window, 0, n - first);
+
+  memset(dst, 0, n);
+  dec->copy_src += n;
+  dec->out_pos += n;
+}
+
+static size_t copy(GKeyDec * const dec, unsigned char * const dst,
+                   size_t const n)
+{
+  assert(dec != NULL);
+  assert(dst != NULL);
+  assert(dec->copy_left > 0);
+
+  size_t const count = LOWEST((size_t)dec->copy_left, n);
+  size_t done = 0;
+
+  if (dec->copy_src < 0) {
+    /* The read position is before the start of the output, so write zeros
+       until it becomes valid again. */
+    size_t const zeros = LOWEST((size_t)-dec->copy_src, count);
+    zero_fill(dec, dst, zeros);
+    done = zeros;
+  }
+
+  size_t src = (size_t)dec->copy_src, pos = (size_t)dec->out_pos;
+  for (; done < count; ++done) {
+    unsigned char const byte = dec->window[src++ & HistoryMask];
+    dec->window[pos++ & HistoryMask] = byte;
+    dst[done] = byte;
+  }
+
+  dec->copy_src = (long int)src;
+  dec->out_pos = (long int)pos;
+  dec->copy_left -= (int)count;
+  return count;
+}
+
+static size_t decode(GKeyDec * const dec, unsigned char * const dst,
+                     size_t const n)
+{
+  assert(dec != NULL);
+  assert(dst != NULL);
+  assert(dec->out_pos <= dec->size);
+
+  size_t const remaining = (size_t)(dec->size - dec->out_pos);
+  size_t const want = LOWEST(remaining, n);
+  size_t done = 0;
+
+  while ((done < want) && !dec->error) {
+    if (dec->copy_left > 0) {
+      done += copy(dec, dst + done, want - done);
+      continue;
+    }
+
+    if (dec->nbits < MaxDirectiveBits) {
+      refill(dec);
+    }
+
+    DirectiveType const type = directive_types[DIRECTIVE_INDEX(dec->bits)];
+    if (!type.copy) {
+      if (dec->nbits < TypeBits + LiteralBits) {
+        dec->error = true;
+        break;
+      }
+      unsigned char const byte = (unsigned char)(dec->bits >> TypeBits);
+      consume(dec, TypeBits + LiteralBits);
+
+      dec->window[(size_t)dec->out_pos++ & HistoryMask] = byte;
+      dst[done] = byte;
+      ++done;
+    } else {
+      unsigned int const nbits = TypeBits + OffsetBits + type.count_bits;
+      if (dec->nbits < nbits) {
+        dec->error = true;
+        break;
+      }
+      unsigned int const offset = (unsigned int)(dec->bits >> TypeBits) &
+                                  HistoryMask;
+      int const count = (int)(dec->bits >> (TypeBits + OffsetBits)) &
+                        ((1 << type.count_bits) - 1);
+      consume(dec, nbits);
+
+      /* Directives to copy 0 bytes are treated as invalid input */
+      if (count == 0) {
+        dec->error = true;
+        break;
+      }
+
+      dec->copy_src = dec->out_pos - GKeyHistorySize + (long int)offset;
+      dec->copy_left = count;
+    }
+  }
+
+  return done;
+}
+
+bool gkeydec_init(GKeyDec * const dec, FILE * const in)
+{
+  assert(dec != NULL);
+  assert(in != NULL);
+
+  *dec = (GKeyDec){
+    .in = in,
+    .bits = 0,
+    .nbits = 0,
+    .in_pos = 0,
+    .in_len = 0,
+    .size = 0,
+    .out_pos = 0,
+    .copy_src = 0,
+    .copy_left = 0,
+    .error = false,
+  };
+
+  unsigned char size[SizeBytes];
+  if (fread(size, sizeof(size), 1, in) != 1) {
+    dec->error = true;
+    return false;
+  }
+
+  /* FDComp rejects input where the top bit of the fourth byte is set */
+  if (size[SizeBytes - 1] & 0x80u) {
+    dec->error = true;
+    return false;
+  }
+
+  dec->size = (long int)((uint32_t)size[0] |
+                         ((uint32_t)size[1] << 8) |
+                         ((uint32_t)size[2] << 16) |
+                         ((uint32_t)size[3] << 24));
+  return true;
+}
+
+long int gkeydec_get_size(const GKeyDec * const dec)
+{
+  assert(dec != NULL);
+  return dec->size;
+}
+
+size_t gkeydec_read(GKeyDec * const dec, void * const ptr, size_t const n)
+{
+  assert(dec != NULL);
+  assert(ptr != NULL);
+  return decode(dec, ptr, n);
+}
+
+bool gkeydec_error(const GKeyDec * const dec)
+{
+  assert(dec != NULL);
+  return dec->error;
+}
@@ -0,0 +1,47 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Fast Gordon Key decompressor
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef GKEYDEC_H
+#define GKEYDEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+  GKeyHistoryLog2 = 9, /* Base 2 logarithm of the history size used by
+                          the compression algorithm */
+  GKeyHistorySize = 1 << GKeyHistoryLog2,
+  GKeyInBufferSize = 4096
+};
+
+typedef struct {
+  FILE *in;
+  uint64_t bits;      /* Unconsumed input bits, least significant first */
+  unsigned int nbits; /* Number of valid bits in 'bits' */
+  size_t in_pos, in_len;
+  long int size;      /* Expected size of the decompressed data */
+  long int out_pos;   /* Number of bytes decompressed so far */
+  long int copy_src;  /* Read position of a partially-completed copy */
+  int copy_left;      /* Number of bytes still to be copied */
+  bool error;
+  unsigned char window[GKeyHistorySize];
+  unsigned char in_buf[GKeyInBufferSize];
+} GKeyDec;
+
+bool gkeydec_init(GKeyDec *dec, FILE *in);
+
+long int gkeydec_get_size(const GKeyDec *dec);
+
+/* There is no mode to skip output without storing it. Input is always
+   decompressed into memory before it is parsed, so the parser's seeks are
+   made in memory and never reach the decoder. */
+size_t gkeydec_read(GKeyDec *dec, void *ptr, size_t n);
+
+bool gkeydec_error(const GKeyDec *dec);
+
+#endif /* GKEYDEC_H */
@@ -0,0 +1,191 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Gordon Key compressor
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+/* Local header files */
+#include "misc.h"
+#include "gkeydec.h"
+#include "gkeyenc.h"
+
+enum {
+  OffsetBits = GKeyHistoryLog2,
+  HistoryMask = GKeyHistorySize - 1,
+  NearOffset = GKeyHistorySize / 2, /* Offsets from here use short counts */
+  MaxNearCount = (1 << (GKeyHistoryLog2 - 1)) - 1,
+  MaxFarCount = (1 << GKeyHistoryLog2) - 1,
+  MinMatch = 3, /* Shorter copies are no smaller than literals */
+  HashLog2 = 12,
+  HashSize = 1 << HashLog2,
+  MaxChain = 64,
+  SizeBytes = 4,
+  MaxSize = INT32_MAX,
+};
+
+typedef struct {
+  unsigned char *out;
+  size_t pos;
+  uint64_t bits;      /* Unwritten output bits, least significant first */
+  unsigned int nbits; /* Number of valid bits in 'bits' */
+} BitWriter;
+
+typedef struct {
+  long int head[HashSize];        /* Latest position with each hash */
+  long int prev[GKeyHistorySize]; /* Previous position with the same hash */
+} MatchState;
+
+static void put_bits(BitWriter * const w, unsigned int const value,
+                     unsigned int const n)
+{
+  assert(w != NULL);
+  assert(n <= 16);
+
+  w->bits |= (uint64_t)value << w->nbits;
+  w->nbits += n;
+  while (w->nbits >= CHAR_BIT) {
+    w->out[w->pos++] = (unsigned char)w->bits;
+    w->bits >>= CHAR_BIT;
+    w->nbits -= CHAR_BIT;
+  }
+}
+
+static unsigned int hash3(const unsigned char * const p)
+{
+  assert(p != NULL);
+  const uint32_t key = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+  return (unsigned int)((key * UINT32_C(2654435761)) >> (32 - HashLog2));
+}
+
+static void insert(MatchState * const m, const unsigned char * const data,
+                   size_t const size, size_t const pos)
+{
+  assert(m != NULL);
+  assert(data != NULL);
+
+  if (pos + MinMatch <= size) {
+    const unsigned int h = hash3(data + pos);
+    m->prev[pos & HistoryMask] = m->head[h];
+    m->head[h] = (long int)pos;
+  }
+}
+
+_Optional void *gkeyenc_compress(const void * const data, size_t const size,
+                                 size_t * const out_size)
+{
+  assert(data != NULL);
+  assert(out_size != NULL);
+
+  if (size > MaxSize) {
+    fprintf(stderr, "Too much data to compress (%lu bytes)\n",
+            (unsigned long)size);
+    return NULL;
+  }
+
+  /* In the worst case, every byte is encoded as a 9-bit literal */
+  const size_t max_size = SizeBytes + size + (size + CHAR_BIT - 1) / CHAR_BIT;
+  _Optional unsigned char * const out = malloc(max_size);
+  _Optional MatchState * const m = malloc(sizeof(*m));
+  if ((out == NULL) || (m == NULL)) {
+    fprintf(stderr, "Failed allocating memory for compressed data\n");
+    free(m);
+    free(out);
+    return NULL;
+  }
+
+  BitWriter w = {.out = &*out, .pos = 0, .bits = 0, .nbits = 0};
+  for (size_t i = 0; i < SizeBytes; ++i) {
+    put_bits(&w, (unsigned int)(size >> (i * CHAR_BIT)) & UCHAR_MAX,
+             CHAR_BIT);
+  }
+
+  for (size_t h = 0; h < ARRAY_SIZE(m->head); ++h) {
+    m->head[h] = -1;
+  }
+
+  const unsigned char * const in = data;
+  size_t pos = 0;
+  while (pos < size) {
+    size_t best_len = 0, best_offset = 0;
+
+    if (pos + MinMatch <= size) {
+      long int cand = m->head[hash3(in + pos)];
+      for (int depth = 0;
+           (depth < MaxChain) && (cand >= 0) &&
+           ((size_t)cand + GKeyHistorySize >= pos + 1);
+           ++depth) {
+        /* A copy reads from an offset relative to a point 512 bytes behind
+           the current position, and the size of its count depends on that
+           offset. */
+        const size_t offset = (size_t)cand + GKeyHistorySize - pos;
+        const size_t max_len = LOWEST(size - pos, offset >= NearOffset ?
+                                      (size_t)MaxNearCount :
+                                      (size_t)MaxFarCount);
+        size_t len = 0;
+        while ((len < max_len) && (in[(size_t)cand + len] == in[pos + len])) {
+          ++len;
+        }
+        if (len > best_len) {
+          best_len = len;
+          best_offset = offset;
+          if (len == max_len) {
+            break;
+          }
+        }
+
+        const long int next = m->prev[(size_t)cand & HistoryMask];
+        if (next >= cand) {
+          break; /* Slot was reused by a newer position */
+        }
+        cand = next;
+      }
+    }
+
+    if (best_len >= MinMatch) {
+      put_bits(&w, 1, 1);
+      put_bits(&w, (unsigned int)best_offset, OffsetBits);
+      put_bits(&w, (unsigned int)best_len,
+               best_offset >= NearOffset ? OffsetBits - 1 : OffsetBits);
+      for (size_t i = 0; i < best_len; ++i) {
+        insert(&*m, in, size, pos++);
+      }
+    } else {
+      put_bits(&w, 0, 1);
+      put_bits(&w, in[pos], CHAR_BIT);
+      insert(&*m, in, size, pos++);
+    }
+  }
+
+  /* Pad the last byte with zeros */
+  if (w.nbits > 0) {
+    put_bits(&w, 0, CHAR_BIT - w.nbits);
+  }
+
+  free(m);
+
+  assert(w.pos <= max_size);
+  *out_size = w.pos;
+  return out;
+}
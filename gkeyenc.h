@@ -0,0 +1,19 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Gordon Key compressor
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef GKEYENC_H
+#define GKEYENC_H
+
+#include <stddef.h>
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+_Optional void *gkeyenc_compress(const void *data, size_t size,
+                                 size_t *out_size);
+
+#endif /* GKEYENC_H */
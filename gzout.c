@@ -0,0 +1,140 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Compression of output in gzip format
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/* Local header files */
+#include "misc.h"
+#include "gzout.h"
+
+#ifdef USE_ZLIB
+enum {
+  GzipWindowBits = 15 + 16, /* Adding 16 selects a gzip header and trailer */
+  GzipMemLevel = 8,
+};
+
+static bool deflate_buf(GzOut * const gz, const int flush)
+{
+  assert(gz != NULL);
+
+  do {
+    gz->strm.next_out = gz->buf;
+    gz->strm.avail_out = sizeof(gz->buf);
+
+    const int err = deflate(&gz->strm, flush);
+    if (err == Z_STREAM_ERROR) {
+      fprintf(stderr, "Failed to compress output\n");
+      return false;
+    }
+
+    const size_t n = sizeof(gz->buf) - gz->strm.avail_out;
+    if ((n > 0) && (fwrite(gz->buf, n, 1, gz->out) != 1)) {
+      return false; /* Caller reports the error */
+    }
+  } while (gz->strm.avail_out == 0);
+
+  return true;
+}
+#endif
+
+bool gzout_is_gz_name(const char * const name)
+{
+  assert(name != NULL);
+
+  static const char ext[] = {EXT_SEPARATOR, 'g', 'z', '\0'};
+  const size_t len = strlen(name), ext_len = sizeof(ext) - 1;
+  return (len > ext_len) && (strcmp(name + len - ext_len, ext) == 0);
+}
+
+bool gzout_init(GzOut * const gz, FILE * const out)
+{
+  assert(gz != NULL);
+  assert(out != NULL);
+
+  gz->out = out;
+  gz->error = false;
+
+#ifdef USE_ZLIB
+  gz->strm.zalloc = Z_NULL;
+  gz->strm.zfree = Z_NULL;
+  gz->strm.opaque = Z_NULL;
+  if (deflateInit2(&gz->strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                   GzipWindowBits, GzipMemLevel,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    fprintf(stderr, "Failed to initialize compression of output\n");
+    return false;
+  }
+  return true;
+#else
+  fprintf(stderr, "Compressed output is not supported by this build\n");
+  return false;
+#endif
+}
+
+bool gzout_write(GzOut * const gz, const void * const data, size_t const n)
+{
+  assert(gz != NULL);
+  assert(data != NULL || n == 0);
+
+#ifdef USE_ZLIB
+  /* Consume the data even after an error so that the caller can
+     report the error once at the end */
+  if (gz->error || (n == 0)) {
+    return !gz->error;
+  }
+
+  gz->strm.next_in = (Bytef *)data;
+  gz->strm.avail_in = (uInt)n;
+  assert(gz->strm.avail_in == n);
+
+  if (!deflate_buf(gz, Z_NO_FLUSH)) {
+    gz->error = true;
+  }
+  return !gz->error;
+#else
+  NOT_USED(data);
+  NOT_USED(n);
+  return false;
+#endif
+}
+
+bool gzout_finish(GzOut * const gz)
+{
+  assert(gz != NULL);
+
+#ifdef USE_ZLIB
+  if (!gz->error) {
+    gz->strm.next_in = Z_NULL;
+    gz->strm.avail_in = 0;
+    if (!deflate_buf(gz, Z_FINISH)) {
+      gz->error = true;
+    }
+  }
+  deflateEnd(&gz->strm);
+  return !gz->error;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,39 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Compression of output in gzip format
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef GZOUT_H
+#define GZOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+enum {
+  GzOutBufferSize = 16384
+};
+
+typedef struct {
+  FILE *out;
+  bool error;
+#ifdef USE_ZLIB
+  z_stream strm;
+  unsigned char buf[GzOutBufferSize];
+#endif
+} GzOut;
+
+bool gzout_is_gz_name(const char *name);
+
+bool gzout_init(GzOut *gz, FILE *out);
+
+bool gzout_write(GzOut *gz, const void *data, size_t n);
+
+bool gzout_finish(GzOut *gz);
+
+#endif /* GZOUT_H */
@@ -0,0 +1,45 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Hashing of byte sequences
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Local header files */
+#include "misc.h"
+#include "hash.h"
+
+uint64_t hash_update(uint64_t hash, const void * const data,
+                     size_t const size)
+{
+  assert(data != NULL || size == 0);
+
+  const unsigned char * const bytes = data;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= UINT64_C(0x100000001b3);
+  }
+  return hash;
+}
+
+uint64_t hash_bytes(const void * const data, size_t const size)
+{
+  return hash_update(HASH_INITIAL, data, size);
+}
@@ -0,0 +1,21 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Hashing of byte sequences
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Initial value for hash_update */
+#define HASH_INITIAL UINT64_C(0xcbf29ce484222325)
+
+/* Continues a 64-bit FNV-1a hash over more data */
+uint64_t hash_update(uint64_t hash, const void *data, size_t size);
+
+uint64_t hash_bytes(const void *data, size_t size);
+
+#endif /* HASH_H */
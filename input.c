@@ -0,0 +1,275 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Loading of compressed or raw input
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/* Local header files */
+#include "misc.h"
+#include "gkeydec.h"
+#include "chunks.h"
+#include "parser.h"
+#include "input.h"
+
+enum {
+  RawInitialSize = 4096,
+  GKeyInitialSize = 64 * 1024
+};
+
+static void report_stderr(const char * const message, void * const arg)
+{
+  assert(message != NULL);
+  NOT_USED(arg);
+  fputs(message, stderr);
+}
+
+static void report(ConvertDiagnosticFn * const fn, void * const arg,
+                   const char * const format, ...)
+{
+  assert(fn != NULL);
+  assert(format != NULL);
+
+  char message[ConvertMessageSize];
+  va_list args;
+  va_start(args, format);
+  (void)vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  fn(message, arg);
+}
+
+static bool over_budget(long int const size, long int const max_size,
+                        bool * const exceeded,
+                        ConvertDiagnosticFn * const fn, void * const arg)
+{
+  assert(exceeded != NULL);
+
+  if ((max_size < 0) || (size <= max_size)) {
+    return false;
+  }
+
+  *exceeded = true;
+  report(fn, arg, "Input data of %ld bytes exceeds the memory budget "
+         "of %ld bytes\n", size, max_size);
+  return true;
+}
+
+static _Optional void *load_raw(FILE * const in, long int const limit,
+                                long int const max_size,
+                                long int * const size,
+                                bool * const exceeded,
+                                ConvertDiagnosticFn * const fn,
+                                void * const arg)
+{
+  assert(in != NULL);
+  assert(size != NULL);
+
+  if (limit >= 0) {
+    /* The amount of input is known, so read it all at once */
+    if (over_budget(limit, max_size, exceeded, fn, arg)) {
+      return NULL;
+    }
+
+    _Optional unsigned char * const buf = malloc(limit > 0 ?
+                                                 (size_t)limit : 1);
+    if (buf == NULL) {
+      report(fn, arg, "Failed allocating memory for input\n");
+      return NULL;
+    }
+
+    if (fread(&*buf, 1, (size_t)limit, in) != (size_t)limit) {
+      report(fn, arg, "Failed to read input: %s\n",
+             ferror(in) ? strerror(errno) : "Unexpected end of file");
+      free(buf);
+      return NULL;
+    }
+
+    *size = limit;
+    return buf;
+  }
+
+  size_t nalloc = RawInitialSize, n = 0;
+  _Optional unsigned char *buf = malloc(nalloc);
+  if (buf == NULL) {
+    report(fn, arg, "Failed allocating memory for input\n");
+    return NULL;
+  }
+
+  for (;;) {
+    n += fread(&*buf + n, 1, nalloc - n, in);
+    if (n < nalloc) {
+      break;
+    }
+
+    /* Buffer is full, so there may be more to read */
+    if ((max_size >= 0) && (n > (size_t)max_size)) {
+      *exceeded = true;
+      report(fn, arg, "Input data of more than %ld bytes exceeds the "
+             "memory budget\n", max_size);
+      free(buf);
+      return NULL;
+    }
+
+    _Optional unsigned char * const new_buf = realloc(buf, nalloc * 2);
+    if (new_buf == NULL) {
+      report(fn, arg, "Failed allocating memory for input\n");
+      free(buf);
+      return NULL;
+    }
+    buf = new_buf;
+    nalloc *= 2;
+  }
+
+  if (ferror(in)) {
+    report(fn, arg, "Failed to read input: %s\n", strerror(errno));
+    free(buf);
+    return NULL;
+  }
+
+  if (over_budget((long int)n, max_size, exceeded, fn, arg)) {
+    free(buf);
+    return NULL;
+  }
+
+  *size = (long int)n;
+  return buf;
+}
+
+static _Optional void *load_gkey(FILE * const in, long int const max_size,
+                                 long int * const size,
+                                 bool * const exceeded,
+                                 ConvertDiagnosticFn * const fn,
+                                 void * const arg)
+{
+  assert(in != NULL);
+  assert(size != NULL);
+
+  GKeyDec dec;
+  if (!gkeydec_init(&dec, in)) {
+    report(fn, arg, "Failed to read size of compressed data\n");
+    return NULL;
+  }
+
+  /* Check the declared size before allocating memory for it */
+  long int const dsize = gkeydec_get_size(&dec);
+  if (over_budget(dsize, max_size, exceeded, fn, arg)) {
+    return NULL;
+  }
+
+  /* The declared size may be far bigger than the data, so the buffer
+     grows as data is decompressed instead of being allocated up front */
+  size_t nalloc = LOWEST((size_t)dsize, (size_t)GKeyInitialSize), n = 0;
+  _Optional unsigned char *buf = malloc(nalloc > 0 ? nalloc : 1);
+  if (buf == NULL) {
+    report(fn, arg, "Failed allocating memory for decompressed data\n");
+    return NULL;
+  }
+
+  while (n < (size_t)dsize) {
+    if (n == nalloc) {
+      size_t const new_nalloc = LOWEST((size_t)dsize, nalloc * 2);
+      _Optional unsigned char * const new_buf = realloc(buf, new_nalloc);
+      if (new_buf == NULL) {
+        report(fn, arg, "Failed allocating memory for %lu bytes of "
+               "decompressed data\n", (unsigned long)new_nalloc);
+        free(buf);
+        return NULL;
+      }
+      buf = new_buf;
+      nalloc = new_nalloc;
+    }
+
+    size_t const want = nalloc - n;
+    size_t const got = gkeydec_read(&dec, &*buf + n, want);
+    n += got;
+    if (gkeydec_error(&dec) || (got != want)) {
+      report(fn, arg, "Failed to decompress data at offset %lu\n",
+             (unsigned long)n);
+      free(buf);
+      return NULL;
+    }
+  }
+
+  *size = dsize;
+  return buf;
+}
+
+static _Optional void *load(FILE * const in, bool const raw,
+                            long int const limit, long int const max_size,
+                            long int * const size, bool * const exceeded,
+                            ConvertDiagnosticFn * const fn, void * const arg)
+{
+  assert(in != NULL);
+  assert(size != NULL);
+  assert(exceeded != NULL);
+
+  *exceeded = false;
+
+  /* Chunked files are recognised whether or not input is raw.
+     Compressed and chunked data are self-delimiting, so only raw input
+     needs the limit. */
+  if (chunks_is_chunked(in)) {
+    _Optional void * const data = chunks_load(in, NULL, NULL, size, NULL,
+                                              NULL);
+    if ((data != NULL) && over_budget(*size, max_size, exceeded, fn, arg)) {
+      free(data);
+      return NULL;
+    }
+    return data;
+  }
+
+  return raw ? load_raw(in, limit, max_size, size, exceeded, fn, arg) :
+               load_gkey(in, max_size, size, exceeded, fn, arg);
+}
+
+_Optional void *input_load_part(FILE * const in, bool const raw,
+                                long int const limit,
+                                long int const max_size,
+                                long int * const size,
+                                _Optional bool * const exceeded)
+{
+  bool over;
+  _Optional void * const data = load(in, raw, limit, max_size, size, &over,
+                                     report_stderr, NULL);
+  if (exceeded != NULL) {
+    *exceeded = over;
+  }
+  return data;
+}
+
+_Optional void *input_load(FILE * const in, bool const raw,
+                           long int * const size)
+{
+  bool exceeded;
+  return load(in, raw, -1, -1, size, &exceeded, report_stderr, NULL);
+}
+
+_Optional void *input_load_report(FILE * const in, bool const raw,
+                                  long int * const size,
+                                  ConvertDiagnosticFn * const fn,
+                                  void * const arg)
+{
+  bool exceeded;
+  return load(in, raw, -1, -1, size, &exceeded, fn, arg);
+}
@@ -0,0 +1,33 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Loading of compressed or raw input
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "parser.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+_Optional void *input_load(FILE *in, bool raw, long int *size);
+
+/* Like input_load but raw input is limited to 'limit' bytes, and loading
+   fails if there are more than 'max_size' bytes of data, unless negative.
+   If 'exceeded' isn't null then it records whether that was why. */
+_Optional void *input_load_part(FILE *in, bool raw, long int limit,
+                                long int max_size, long int *size,
+                                _Optional bool *exceeded);
+
+/* Like input_load but errors are passed to 'fn' instead of being written
+   to stderr. Errors in chunked files are still written to stderr. */
+_Optional void *input_load_report(FILE *in, bool raw, long int *size,
+                                  ConvertDiagnosticFn *fn, void *arg);
+
+#endif /* INPUT_H */
@@ -39,57 +39,178 @@
 
 enum {
   NLogicalColours = 320,
-  NTintBits = 2,
-  NTints = 1 << NTintBits,
-  TLowShift = 0,
-  THighShift = 1,
-  RLowShift = 2,
-  BLowShift = 3,
-  RHighShift = 4,
-  GLowShift = 5,
-  GHighShift = 6,
-  BHighShift = 7,
-  CompMax = (1 << 4) - 1,
+  NPhysicalColours = UCHAR_MAX + 1,
+  NTints = 1 << 2,
+  TGAImageType = 2,
+  TGAWidth = 12, /* Least significant byte only */
+  TGAHeight = 14,
+  TGAPixelDepth = 16,
+  TGAHeaderSize = 18,
+  TGAImageTypeTrueColour = 2,
+  TGABitsPerPixel = 24,
+  TGABytesPerPixel = TGABitsPerPixel / CHAR_BIT,
 };
 
-static void decode_colour(const int colour, double * const red,
-                          double * const green, double * const blue,
-                          const unsigned int flags)
+static int print_name(FILE * const out, const int colour, const int i,
+                      const unsigned int flags)
 {
+  assert(out != NULL);
   assert(colour >= 0);
   assert(colour <= UINT8_MAX);
-  assert(red != NULL);
-  assert(green != NULL);
-  assert(blue != NULL);
   assert(!(flags & ~FLAGS_ALL));
 
-  /* Get the tint bits, which are shared between all components */
-  const int t = ((colour >> TLowShift) & 1) |
-                (((colour >> THighShift) & 1) << 1);
+  if (flags & FLAGS_HUMAN_READABLE) {
+    return fprintf(out, "%s_%d", get_colour_name(colour / NTints),
+                   colour % NTints);
+  }
+  if (flags & FLAGS_PHYSICAL_COLOUR) {
+    return fprintf(out, "riscos_%d", colour);
+  }
+  return fprintf(out, "colour_%d", i);
+}
+
+static int write_properties(FILE * const out, const double red,
+                            const double green, const double blue,
+                            const double d, const int illum,
+                            _Optional double (* const ks)[3],
+                            const double ns, const int sharpness,
+                            const double ni, double (* const tf)[3])
+{
+  assert(out != NULL);
 
-  const int r = ((colour >> RLowShift) & 1) |
-                (((colour >> RHighShift) & 1) << 1);
+  int n = 0;
+  if ((illum >= 1) && (illum <= 9)) {
+    /* Diffuse illumination model includes an ambient constant term in
+       addition to the diffuse shading term for each light source */
+    n = fprintf(out, "Ka %f %f %f\n", red, green, blue);
+  }
 
-  const int g = ((colour >> GLowShift) & 1) |
-                (((colour >> GHighShift) & 1) << 1);
+  if ((n >= 0) && (illum <= 9)) {
+    /* Constant colour illumination model uses the diffuse reflectance
+       as the colour of the material */
+    n = fprintf(out, "Kd %f %f %f\n", red, green, blue);
+  }
+
+  if ((n >= 0) && (illum >= 2) && (illum <= 9)) {
+    /* Diffuse and specular illumination model requires a specular
+       shading term for each light source */
+    n = fprintf(out, "Ks %f %f %f\n",
+                ks ? (*ks)[0] : red,
+                ks ? (*ks)[1] : green,
+                ks ? (*ks)[2] : blue);
+  }
+
+  if ((n >= 0) && (illum >= 6) && (illum <= 7)) {
+    /* Refraction model requires a transmission
+       filter for refracted light passing through */
+    n = fprintf(out, "Tf %f %f %f\n",
+                (*tf)[0], (*tf)[1], (*tf)[2]);
+  }
+
+  if ((n >= 0) && (d != 1.0)) {
+    /* Dissolve works on all illumination models */
+    n = fprintf(out, "d %f\n", d);
+  }
 
-  const int b = ((colour >> BLowShift) & 1) |
-                (((colour >> BHighShift) & 1) << 1);
-  if (flags & FLAGS_VERBOSE) {
-    printf("red:0x%x green:0x%x blue:0x%x tint:0x%x\n", r, g, b, t);
+  if ((n >= 0) && (illum >= 2) && (illum <= 9)) {
+    n = fprintf(out, "Ns %f\n", ns);
   }
 
-  /* Piece together the final colour component values */
-  const int rt = (r << NTintBits) | t;
-  const int gt = (g << NTintBits) | t;
-  const int bt = (b << NTintBits) | t;
-  if (flags & FLAGS_VERBOSE) {
-    printf("red:0x%x green:0x%x blue:0x%x\n", rt, gt, bt);
+  if ((n >= 0) && (illum >= 3) && (illum <= 9) && (sharpness != 60)) {
+    /* Sharpness can be specified for the reflection map if different
+       from the default value. */
+    n = fprintf(out, "sharpness %d\n", sharpness);
   }
 
-  *red = (double)rt/CompMax;
-  *green = (double)gt/CompMax;
-  *blue = (double)bt/CompMax;
+  if ((n >= 0) && (illum >= 6) && (illum <= 7)) {
+    /* Refraction model requires optical density */
+    n = fprintf(out, "Ni %f\n", ni);
+  }
+
+  if (n >= 0) {
+    n = fprintf(out, "illum %d\n", illum);
+  }
+
+  return n;
+}
+
+static bool write_material(FILE * const out, const int colour, const int i,
+                           const double d, const int illum,
+                           _Optional double (* const ks)[3],
+                           const double ns, const int sharpness,
+                           const double ni, double (* const tf)[3],
+                           const unsigned int flags)
+{
+  assert(out != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  double red, green, blue;
+  decode_colour(colour, &red, &green, &blue, flags);
+
+  int n = fputs("\nnewmtl ", out);
+  if (n >= 0) {
+    n = print_name(out, colour, i, flags);
+  }
+  if (n >= 0) {
+    n = fputc('\n', out);
+  }
+
+  if (!(flags & FLAGS_HUMAN_READABLE) && (n >= 0) && (illum <= 9)) {
+    n = fprintf(out, "# %s tint %d\n",
+                get_colour_name(colour / NTints), colour % NTints);
+  }
+
+  if (n >= 0) {
+    n = write_properties(out, red, green, blue, d, illum, ks, ns, sharpness,
+                         ni, tf);
+  }
+
+  if (n < 0) {
+    fprintf(stderr, "Failed writing to material library file: %s\n",
+            strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+static bool write_texture(FILE * const out,
+                          const unsigned char * const colours,
+                          const int rows)
+{
+  assert(out != NULL);
+  assert(colours != NULL);
+  assert(rows > 0);
+
+  /* Uncompressed true-colour Truevision TGA image with the origin at the
+     bottom left, which is understood by almost every OBJ viewer */
+  const unsigned char header[TGAHeaderSize] = {
+    [TGAImageType] = TGAImageTypeTrueColour,
+    [TGAWidth] = AtlasColumns,
+    [TGAHeight] = (unsigned char)rows,
+    [TGAPixelDepth] = TGABitsPerPixel,
+  };
+
+  bool success = (fwrite(header, sizeof(header), 1, out) == 1);
+
+  for (int y = rows - 1; (y >= 0) && success; --y) {
+    unsigned char row[AtlasColumns * TGABytesPerPixel];
+    for (int x = 0; x < AtlasColumns; ++x) {
+      double red, green, blue;
+      decode_colour(colours[(y * AtlasColumns) + x], &red, &green, &blue, 0);
+
+      /* Components are stored in reverse order */
+      unsigned char * const pixel = row + (x * TGABytesPerPixel);
+      pixel[0] = (unsigned char)((blue * UCHAR_MAX) + 0.5);
+      pixel[1] = (unsigned char)((green * UCHAR_MAX) + 0.5);
+      pixel[2] = (unsigned char)((red * UCHAR_MAX) + 0.5);
+    }
+    success = (fwrite(row, sizeof(row), 1, out) == 1);
+  }
+
+  if (!success) {
+    fprintf(stderr, "Failed writing to texture file: %s\n", strerror(errno));
+  }
+  return success;
 }
 
 bool sf3k_to_mtl(Reader * const in, FILE * const out,
@@ -143,10 +264,6 @@ bool sf3k_to_mtl(Reader * const in, FILE * const out,
       printf("logical colour:%d physical colour:%d\n", i, colour);
     }
 
-    double red, green, blue;
-    decode_colour(colour, &red, &green, &blue, flags);
-
-    int n;
     if (flags & FLAGS_PHYSICAL_COLOUR) {
       /* Physical colour names may not be unique, so check we
          haven't output this material already */
@@ -154,80 +271,191 @@ bool sf3k_to_mtl(Reader * const in, FILE * const out,
         continue;
       }
       phys_output[colour] = true;
-      if (flags & FLAGS_HUMAN_READABLE) {
-        n = fprintf(out, "\nnewmtl %s_%d\n",
-                    get_colour_name(colour / NTints), colour % NTints);
-      } else {
-        n = fprintf(out, "\nnewmtl riscos_%d\n", colour);
-      }
-    } else {
-      n = fprintf(out, "\nnewmtl colour_%d\n", i);
     }
 
-    if (!(flags & FLAGS_HUMAN_READABLE) && (n >= 0) && (illum <= 9)) {
-      n = fprintf(out, "# %s tint %d\n",
-                  get_colour_name(colour / NTints), colour % NTints);
-    }
+    success = write_material(out, colour, i, d, illum, ks, ns, sharpness,
+                             ni, tf, flags);
+  }
 
-    if ((n >= 0) && (illum >= 1) && (illum <= 9)) {
-      /* Diffuse illumination model includes an ambient constant term in
-         addition to the diffuse shading term for each light source */
-      n = fprintf(out, "Ka %f %f %f\n", red, green, blue);
-    }
+  return success;
+}
 
-    if ((n >= 0) && (illum <= 9)) {
-      /* Constant colour illumination model uses the diffuse reflectance
-         as the colour of the material */
-      n = fprintf(out, "Kd %f %f %f\n", red, green, blue);
-    }
+bool sf3k_union_mtl(const int npalettes, Reader in[],
+                    const char * const names[], FILE * const out,
+                    const int first, const int last,
+                    const double d, const int illum,
+                    _Optional double (* const ks)[3],
+                    const double ns, const int sharpness, const double ni,
+                    double (* const tf)[3], const unsigned int flags)
+{
+  bool success = true;
+  bool phys_used[UCHAR_MAX+1] = {false};
 
-    if ((n >= 0) && (illum >= 2) && (illum <= 9)) {
-      /* Diffuse and specular illumination model requires a specular
-         shading term for each light source */
-      n = fprintf(out, "Ks %f %f %f\n",
-                  ks ? (*ks)[0] : red,
-                  ks ? (*ks)[1] : green,
-                  ks ? (*ks)[2] : blue);
-    }
+  assert(npalettes > 0);
+  assert(in != NULL);
+  assert(names != NULL);
+  assert(out != NULL);
+  assert(!ferror(out));
+  assert(first >= 0);
+  assert(last == -1 || last >= first);
+  assert(!(flags & ~FLAGS_ALL));
 
-    if ((n >= 0) && (illum >= 6) && (illum <= 7)) {
-      /* Refraction model requires a transmission
-         filter for refracted light passing through */
-      n = fprintf(out, "Tf %f %f %f\n",
-                  (*tf)[0], (*tf)[1], (*tf)[2]);
-    }
+  /* Materials in a library shared between palettes can only be named after
+     physical colours */
+  const unsigned int mtl_flags = flags | FLAGS_PHYSICAL_COLOUR;
+  const int end = (last == -1) ? NLogicalColours : last + 1;
+  const int ncolours = end - first;
 
-    if ((n >= 0) && (d != 1.0)) {
-      /* Dissolve works on all illumination models */
-      n = fprintf(out, "d %f\n", d);
+  _Optional unsigned char * const alloc = malloc((size_t)npalettes *
+                                                 (size_t)ncolours);
+  if (alloc == NULL) {
+    fprintf(stderr, "Failed allocating memory for %d palettes\n", npalettes);
+    return false;
+  }
+  unsigned char * const colours = &*alloc;
+
+  /* Find the physical colours used by any of the palettes */
+  for (int p = 0; (p < npalettes) && success; ++p) {
+    assert(names[p] != NULL);
+
+    if (reader_fseek(in + p, first, SEEK_SET)) {
+      fprintf(stderr, "Failed to seek logical colour %d in palette '%s'\n",
+              first, names[p]);
+      success = false;
+      break;
     }
 
-    if ((n >= 0) && (illum >= 2) && (illum <= 9)) {
-      n = fprintf(out, "Ns %f\n", ns);
+    for (int i = 0; i < ncolours; ++i) {
+      const int colour = reader_fgetc(in + p);
+      if (colour == EOF) {
+        fprintf(stderr, "Failed to read logical colour %d in palette '%s'\n",
+                first + i, names[p]);
+        success = false;
+        break;
+      }
+      colours[(p * ncolours) + i] = (unsigned char)colour;
+      phys_used[colour] = true;
     }
+  }
+
+  if (success &&
+      fprintf(out, "# Star Fighter 3000 material library\n"
+                   "# Converted by SF3KtoMtl "VERSION_STRING"\n"
+                   "# Union of %d palette%s\n", npalettes,
+                   npalettes == 1 ? "" : "s") < 0) {
+    fprintf(stderr, "Failed writing to material library file: %s\n",
+            strerror(errno));
+    success = false;
+  }
 
-    if ((n >= 0) && (illum >= 3) && (illum <= 9) && (sharpness != 60)) {
-      /* Sharpness can be specified for the reflection map if different
-         from the default value. */
-      n = fprintf(out, "sharpness %d\n", sharpness);
+  for (int colour = 0; (colour <= UCHAR_MAX) && success; ++colour) {
+    if (phys_used[colour]) {
+      success = write_material(out, colour, colour, d, illum, ks, ns,
+                               sharpness, ni, tf, mtl_flags);
     }
+  }
 
-    if ((n >= 0) && (illum >= 6) && (illum <= 7)) {
-      /* Refraction model requires optical density */
-      n = fprintf(out, "Ni %f\n", ni);
+  /* Append a table mapping each logical colour of each palette to a
+     material, disguised as comments so that the library remains valid */
+  if (success && fputs("\n# Map from palette and logical colour to material\n",
+                       out) < 0) {
+    fprintf(stderr, "Failed writing to material library file: %s\n",
+            strerror(errno));
+    success = false;
+  }
+
+  for (int p = 0; (p < npalettes) && success; ++p) {
+    for (int i = 0; i < ncolours; ++i) {
+      int n = fprintf(out, "#map %s %d ", names[p], first + i);
+      if (n >= 0) {
+        n = print_name(out, colours[(p * ncolours) + i], first + i,
+                       mtl_flags);
+      }
+      if (n >= 0) {
+        n = fputc('\n', out);
+      }
+      if (n < 0) {
+        fprintf(stderr, "Failed writing to material library file: %s\n",
+                strerror(errno));
+        success = false;
+        break;
+      }
     }
+  }
+
+  free(alloc);
+  return success;
+}
+
+bool sf3k_to_atlas(Reader * const in, FILE * const out,
+                   FILE * const texture, const char * const texture_name,
+                   const double d, const int illum,
+                   _Optional double (* const ks)[3],
+                   const double ns, const int sharpness, const double ni,
+                   double (* const tf)[3], const unsigned int flags)
+{
+  assert(in != NULL);
+  assert(!reader_ferror(in));
+  assert(out != NULL);
+  assert(!ferror(out));
+  assert(texture != NULL);
+  assert(texture_name != NULL);
+  assert(!(flags & ~FLAGS_ALL));
 
-    if (n >= 0) {
-      n = fprintf(out, "illum %d\n", illum);
+  /* Either every physical colour or every logical colour of one palette
+     has a texel, in the same order as texture coordinates emitted by
+     SF3KtoObj */
+  unsigned char colours[NLogicalColours];
+  int rows = AtlasPhysicalRows;
+  if (flags & FLAGS_PHYSICAL_COLOUR) {
+    for (int i = 0; i < NPhysicalColours; ++i) {
+      colours[i] = (unsigned char)i;
     }
+  } else {
+    rows = AtlasLogicalRows;
+    for (int i = 0; i < NLogicalColours; ++i) {
+      const int colour = reader_fgetc(in);
+      if (colour == EOF) {
+        fprintf(stderr, "Failed to read logical colour %d\n", i);
+        return false;
+      }
 
-    if (n < 0) {
-      fprintf(stderr, "Failed writing to material library file: %s\n",
-              strerror(errno));
-      success = false;
-      break;
+      if (flags & FLAGS_VERBOSE) {
+        printf("logical colour:%d physical colour:%d\n", i, colour);
+      }
+      colours[i] = (unsigned char)colour;
     }
   }
 
-  return success;
+  if (!write_texture(texture, colours, rows)) {
+    return false;
+  }
+
+  /* The texture supplies colour to be modulated by the material's white
+     reflectance */
+  int n = fprintf(out, "# Star Fighter 3000 material library\n"
+                       "# Converted by SF3KtoMtl "VERSION_STRING"\n"
+                       "# Texture atlas of %s colours\n"
+                       "\nnewmtl "ATLAS_MATERIAL"\n",
+                  (flags & FLAGS_PHYSICAL_COLOUR) ? "physical" : "logical");
+
+  if (n >= 0) {
+    n = write_properties(out, 1.0, 1.0, 1.0, d, illum, ks, ns, sharpness,
+                         ni, tf);
+  }
+
+  if ((n >= 0) && (illum >= 1) && (illum <= 9)) {
+    n = fprintf(out, "map_Ka %s\n", texture_name);
+  }
+
+  if ((n >= 0) && (illum <= 9)) {
+    n = fprintf(out, "map_Kd %s\n", texture_name);
+  }
+
+  if (n < 0) {
+    fprintf(stderr, "Failed writing to material library file: %s\n",
+            strerror(errno));
+    return false;
+  }
+  return true;
 }
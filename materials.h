@@ -21,4 +21,15 @@ bool sf3k_to_mtl(Reader *in, FILE *out, int first, int last, double d,
                  int illum, _Optional double (*ks)[3], double ns, int sharpness,
                  double ni, double (*tf)[3], unsigned int flags);
 
+bool sf3k_union_mtl(int npalettes, Reader in[],
+                    const char *const names[], FILE *out, int first,
+                    int last, double d, int illum, _Optional double (*ks)[3],
+                    double ns, int sharpness, double ni, double (*tf)[3],
+                    unsigned int flags);
+
+bool sf3k_to_atlas(Reader *in, FILE *out, FILE *texture,
+                   const char *texture_name, double d, int illum,
+                   _Optional double (*ks)[3], double ns, int sharpness,
+                   double ni, double (*tf)[3], unsigned int flags);
+
 #endif /* MATERIALS_H */
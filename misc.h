@@ -39,6 +39,15 @@
 #define NOT_USED(x) ((void)(x))
 
 #define HIGHEST(a, b) ((a) > (b) ? (a) : (b))
+#define LOWEST(a, b) ((a) < (b) ? (a) : (b))
+
+/* Inline a function even if it is large, so that each call with constant
+   arguments produces a copy specialised for them. */
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
 
 #ifdef FORTIFY
 #include "Fortify.h"
@@ -20,6 +20,9 @@
 
 /* ISO library header files */
 #include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
 
 /* Local header files */
 #include "sfformats.h"
@@ -34,55 +37,59 @@ const char *get_type_name(const SFObjectType type)
   return type_names[type];
 }
 
-const char *get_obj_name(const SFObjectType type, const int index)
+/* Although many other object meshes are recognizable, these are
+   the only objects with the same role in every mission. */
+static const char * const ship_names[] =
+{
+  "player",    /* Appearance differs between missions */
+  "fighter_1", /*     "         "       "        "    */
+  "fighter_2", /*     "         "       "        "    */
+  "fighter_3", /*     "         "       "        "    */
+  "fighter_4", /*     "         "       "        "    */
+  "three_coin",
+  "ten_coin",
+  "life_coin",
+  "fifty_coin",
+  "twenty_coin",
+  "atg_coin",
+  "ata_coin",
+  "damage_coin",
+  "big_ship_1", /* Appearance differs between missions */
+  "mothership",
+  "big_ship_2", /* Appearance differs between missions */
+  "atg_missile",
+  "ata_missile",
+  "mine",
+  "bomb",
+  "parachute",
+  "satellite",
+  "dock"
+};
+
+/* Although many other object meshes are recognizable, these are
+   the only objects with the same role in every game map. Their
+   appearance varies between maps. */
+static const char * const ground_names[] =
+{
+  "none",
+  "gun_1",
+  "gun_2",
+  "gun_3",
+  "sam_1",
+  "sam_2",
+  "sam_3",
+  "hangar_1",
+  "hangar_2"
+};
+
+const char *get_obj_name(const SFObjectType type, const int index,
+                         char * const buffer, const size_t buffer_size)
 {
-  static char buffer[64];
-  static const char * const ship_names[] =
-  {
-    /* Although many other object meshes are recognizable, these are
-       the only objects with the same role in every mission. */
-    "player",    /* Appearance differs between missions */
-    "fighter_1", /*     "         "       "        "    */
-    "fighter_2", /*     "         "       "        "    */
-    "fighter_3", /*     "         "       "        "    */
-    "fighter_4", /*     "         "       "        "    */
-    "three_coin",
-    "ten_coin",
-    "life_coin",
-    "fifty_coin",
-    "twenty_coin",
-    "atg_coin",
-    "ata_coin",
-    "damage_coin",
-    "big_ship_1", /* Appearance differs between missions */
-    "mothership",
-    "big_ship_2", /* Appearance differs between missions */
-    "atg_missile",
-    "ata_missile",
-    "mine",
-    "bomb",
-    "parachute",
-    "satellite",
-    "dock"
-  };
-  static const char * const ground_names[] =
-  {
-    /* Although many other object meshes are recognizable, these are
-       the only objects with the same role in every game map. Their
-       appearance varies between maps. */
-    "none",
-    "gun_1",
-    "gun_2",
-    "gun_3",
-    "sam_1",
-    "sam_2",
-    "sam_3",
-    "hangar_1",
-    "hangar_2"
-  };
   const char *n;
 
   assert(index >= 0);
+  assert(buffer != NULL);
+  assert(buffer_size > 0);
   assert((type == SFObjectType_Ground) ||
          (type == SFObjectType_Bit) ||
          (type == SFObjectType_Aerial));
@@ -92,13 +99,13 @@ const char *get_obj_name(const SFObjectType type, const int index)
     if ((size_t)index < ARRAY_SIZE(ground_names)) {
       n = ground_names[index];
     } else {
-      sprintf(buffer, "ground_%d", index);
+      snprintf(buffer, buffer_size, "ground_%d", index);
       n = buffer;
     }
     break;
 
   case SFObjectType_Bit:
-    sprintf(buffer, "bit_%d", index);
+    snprintf(buffer, buffer_size, "bit_%d", index);
     n = buffer;
     break;
 
@@ -106,7 +113,7 @@ const char *get_obj_name(const SFObjectType type, const int index)
     if ((size_t)index < ARRAY_SIZE(ship_names)) {
       n = ship_names[index];
     } else {
-      sprintf(buffer, "ship_%d", index);
+      snprintf(buffer, buffer_size, "ship_%d", index);
       n = buffer;
     }
     break;
@@ -118,3 +125,83 @@ const char *get_obj_name(const SFObjectType type, const int index)
 
   return n;
 }
+
+/* Parses a generated name such as "ship_30", which must be written
+   exactly as get_obj_name would write it */
+static bool parse_numbered(const char * const name, const char * const prefix,
+                           const int min, int * const index)
+{
+  assert(name != NULL);
+  assert(prefix != NULL);
+  assert(min >= 0);
+  assert(index != NULL);
+
+  const size_t len = strlen(prefix);
+  if (strncmp(name, prefix, len)) {
+    return false;
+  }
+
+  const char *s = name + len;
+  if ((s[0] < '0') || (s[0] > '9') || ((s[0] == '0') && (s[1] != '\0'))) {
+    return false;
+  }
+
+  long int n = 0;
+  for (; *s != '\0'; ++s) {
+    if ((*s < '0') || (*s > '9')) {
+      return false;
+    }
+    n = (n * 10) + (*s - '0');
+    if (n > INT_MAX) {
+      return false;
+    }
+  }
+
+  if (n < min) {
+    return false;
+  }
+  *index = (int)n;
+  return true;
+}
+
+bool find_obj_name(const char * const name, SFObjectType * const type,
+                   int * const index)
+{
+  assert(name != NULL);
+  assert(type != NULL);
+  assert(index != NULL);
+
+  for (size_t i = 0; i < ARRAY_SIZE(ship_names); ++i) {
+    if (!strcmp(name, ship_names[i])) {
+      *type = SFObjectType_Aerial;
+      *index = (int)i;
+      return true;
+    }
+  }
+
+  for (size_t i = 0; i < ARRAY_SIZE(ground_names); ++i) {
+    if (!strcmp(name, ground_names[i])) {
+      *type = SFObjectType_Ground;
+      *index = (int)i;
+      return true;
+    }
+  }
+
+  if (parse_numbered(name, "ship_", (int)ARRAY_SIZE(ship_names), index)) {
+    *type = SFObjectType_Aerial;
+    return true;
+  }
+
+  if (parse_numbered(name, "ground_", (int)ARRAY_SIZE(ground_names),
+                     index)) {
+    *type = SFObjectType_Ground;
+    return true;
+  }
+
+  if (parse_numbered(name, "bit_", 0, index)) {
+    *type = SFObjectType_Bit;
+    return true;
+  }
+
+  return false;
+}
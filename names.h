@@ -7,10 +7,23 @@
 #ifndef NAMES_H
 #define NAMES_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
 #include "sfformats.h"
 
+/* Size of a buffer big enough for any generated object name */
+enum {
+  ObjNameSize = 24
+};
+
 const char *get_type_name(SFObjectType type);
 
-const char *get_obj_name(SFObjectType type, int index);
+const char *get_obj_name(SFObjectType type, int index, char *buffer,
+                         size_t buffer_size);
+
+/* Finds the type and index of the object that get_obj_name would give
+   the specified name, without using any shared state */
+bool find_obj_name(const char *name, SFObjectType *type, int *index);
 
 #endif /* NAMES_H */
@@ -19,6 +19,7 @@
  */
 
 /* ISO library header files */
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -48,6 +49,17 @@
 #include "version.h"
 #include "names.h"
 #include "colours.h"
+#include "vcolours.h"
+#include "batches.h"
+#include "vcache.h"
+#include "visibility.h"
+#include "collision.h"
+#include "animation.h"
+#include "bounds.h"
+#include "filter.h"
+#include "stream.h"
+#include "clipcache.h"
+#include "budget.h"
 
 /* Unless we do something about it, all of the objects appear reflected in
    the Z axis. */
@@ -62,9 +74,11 @@
 
 enum {
   MaxPlotType = 10,
-  MaxPlotCommands = 16, /* unknown what the game limit is */
+  MaxPlotCommands = VisibilityMaxCommands,
   NColours = 256,
   NTints = 1 << 2, /* bits per tint */
+  MaxCollisionBoxes = 0xffff, /* unknown what the game limit is */
+  CollisionCorners = 8,
 };
 
 typedef struct {
@@ -72,6 +86,7 @@ typedef struct {
   int num_commands;
   uint8_t group_mask;
   int group_order[MaxPlotCommands];
+  VisibilityCommand commands[MaxPlotCommands];
 } PlotType;
 
 typedef struct {
@@ -94,13 +109,77 @@ typedef struct
   int false_colour;
 } ColourInfo;
 
-static int parse_vertices(Reader * const r, const int object_count,
-                          const SFCoordinateScale scale,
-                          const SFObjectType object_type,
-                          VertexArray * const varray, const int rot,
-                          const bool convert, const int frame,
-                          const unsigned int flags)
+static void report_stderr(const char * const message, void * const arg)
+{
+  assert(message != NULL);
+  NOT_USED(arg);
+  fputs(message, stderr);
+}
+
+static void report(ConvertContext * const ctx, const char * const format,
+                   ...)
+{
+  assert(ctx != NULL);
+  assert(format != NULL);
+
+  va_list args;
+  va_start(args, format);
+  const int len = vsnprintf(ctx->message, sizeof(ctx->message), format,
+                            args);
+  va_end(args);
+
+  if ((len >= 0) && ((size_t)len >= sizeof(ctx->message))) {
+    /* Keep the terminating newline of a truncated message */
+    ctx->message[sizeof(ctx->message) - 2] = '\n';
+  }
+  ctx->diagnostic(ctx->message, ctx->diagnostic_arg);
+}
+
+/* Returns the factor by which an object's vertex coordinates are
+   multiplied */
+static int get_vertex_scale(const SFCoordinateScale scale,
+                            const SFObjectType object_type)
 {
+  switch (scale) {
+    case SFCoordinateScale_Small:
+      return (object_type == SFObjectType_Ground) ? 4 : 1;
+    case SFCoordinateScale_Medium:
+      return (object_type == SFObjectType_Ground) ? 8 : 2;
+    case SFCoordinateScale_Large:
+      return (object_type == SFObjectType_Ground) ? 16 : 8 /* not log2 */;
+  }
+  return 1;
+}
+
+typedef int ParseVerticesFn(Reader *r, int object_count,
+                            SFCoordinateScale scale, SFObjectType object_type,
+                            VertexArray *varray, int rot, bool convert,
+                            int frame, ConvertContext *ctx);
+
+typedef int ParsePolygonsFn(Reader *r, int object_count, int nvertices,
+                            VertexArray *varray,
+                            Group (*groups)[SFObjectFacet_VectorsGroup+1],
+                            int (*npolygons)[SFObjectFacet_VectorsGroup+1],
+                            int expected_max_group, bool convert,
+                            ConvertContext *ctx);
+
+/* The 'verbose' and 'keep_unused' arguments are constant in every caller
+   except parse_vertices_any, so that the per-vertex tests of them are
+   removed from parse_vertices_quiet */
+static ALWAYS_INLINE int parse_vertices_with(Reader * const r,
+                                             const int object_count,
+                                             const SFCoordinateScale scale,
+                                             const SFObjectType object_type,
+                                             VertexArray * const varray,
+                                             const int rot, const bool convert,
+                                             const int frame,
+                                             ConvertContext * const ctx,
+                                             const bool verbose,
+                                             const bool keep_unused)
+{
+  assert(ctx != NULL);
+  assert(verbose == ((ctx->flags & FLAGS_VERBOSE) != 0));
+  assert(keep_unused == ((ctx->flags & FLAGS_UNUSED) != 0));
   assert(r != NULL);
   assert(!reader_ferror(r));
   assert(object_count >= 0);
@@ -110,43 +189,31 @@ static int parse_vertices(Reader * const r, const int object_count,
 
   assert(varray != NULL);
   assert(frame >= 0);
-  assert(!(flags & ~FLAGS_ALL));
 
   const int nvertices = reader_fgetc(r);
   if (nvertices == EOF) {
-    fprintf(stderr, "Failed to read no. of vertices (object %d)\n",
-            object_count);
+    report(ctx, "Failed to read no. of vertices (object %d)\n",
+           object_count);
     return -1;
   }
   if (nvertices < 1) {
-    fprintf(stderr, "Bad vertex count %d (object %d)\n", nvertices,
-            object_count);
+    report(ctx, "Bad vertex count %d (object %d)\n", nvertices,
+           object_count);
     return -1;
   }
-  if (flags & FLAGS_VERBOSE) {
+  if (verbose) {
     long int const pos = reader_ftell(r);
     printf("Found %d vertices at offset %ld (0x%lx)\n", nvertices, pos, pos);
   }
 
   if (convert) {
     if (vertex_array_alloc_vertices(varray, nvertices) < nvertices) {
-      fprintf(stderr, "Failed to allocate memory for %d vertices "
-              "(object %d)\n", nvertices, object_count);
+      report(ctx, "Failed to allocate memory for %d vertices "
+             "(object %d)\n", nvertices, object_count);
       return -1;
     }
 
-    int s = 1;
-    switch (scale) {
-      case SFCoordinateScale_Small:
-        s = (object_type == SFObjectType_Ground) ? 4 : 1;
-        break;
-      case SFCoordinateScale_Medium:
-        s = (object_type == SFObjectType_Ground) ? 8 : 2;
-        break;
-      case SFCoordinateScale_Large:
-        s = (object_type == SFObjectType_Ground) ? 16 : 8 /* not log2 */;
-        break;
-    }
+    const int s = get_vertex_scale(scale, object_type);
 
     Coord transform[3][3] = {
       {s, 0, 0}, /* coefficients for x dimension */
@@ -162,7 +229,7 @@ static int parse_vertices(Reader * const r, const int object_count,
     for (int v = 0; v < nvertices; ++v) {
       char vbytes[3];
       if (reader_fread(vbytes, sizeof(vbytes), 1, r) != 1) {
-        fprintf(stderr, "Failed to read vertex %d\n", v);
+        report(ctx, "Failed to read vertex %d\n", v);
         return -1;
       }
 
@@ -198,19 +265,19 @@ static int parse_vertices(Reader * const r, const int object_count,
       } /* next dimension */
 
       if (vertex_array_add_vertex(varray, &pos) < 0) {
-        fprintf(stderr,
-                "Failed to allocate vertex memory "
-                "(vertex %d of object %d)\n", v, object_count);
+        report(ctx,
+               "Failed to allocate vertex memory "
+               "(vertex %d of object %d)\n", v, object_count);
         return -1;
       }
 
       /* If we're keeping unused vertices then we need to mark them upon
          creation because otherwise they will never be marked. */
-      if (flags & FLAGS_UNUSED) {
+      if (keep_unused) {
         vertex_array_set_used(varray, v);
       }
 
-      if (flags & FLAGS_VERBOSE) {
+      if (verbose) {
         vertex_array_print_vertex(varray, v);
         puts("");
       }
@@ -219,8 +286,8 @@ static int parse_vertices(Reader * const r, const int object_count,
   } else {
     /* Skip the vertex data */
     if (reader_fseek(r, 3l * nvertices, SEEK_CUR)) {
-      fprintf(stderr, "Failed to seek end of vertices (object %d)\n",
-              object_count);
+      report(ctx, "Failed to seek end of vertices (object %d)\n",
+             object_count);
       return -1;
     }
   }
@@ -228,49 +295,111 @@ static int parse_vertices(Reader * const r, const int object_count,
   return nvertices;
 }
 
-static int parse_polygons(Reader * const r, const int object_count,
-                          VertexArray * const varray,
-                          Group (* const groups)[
-                            SFObjectFacet_VectorsGroup+1],
-                          int (* const npolygons)[
-                            SFObjectFacet_VectorsGroup+1],
-                          const int expected_max_group, const bool convert,
-                          const unsigned int flags)
+static int parse_vertices_quiet(Reader * const r, const int object_count,
+                                const SFCoordinateScale scale,
+                                const SFObjectType object_type,
+                                VertexArray * const varray, const int rot,
+                                const bool convert, const int frame,
+                                ConvertContext * const ctx)
+{
+  return parse_vertices_with(r, object_count, scale, object_type, varray,
+                             rot, convert, frame, ctx, false, false);
+}
+
+static int parse_vertices_any(Reader * const r, const int object_count,
+                              const SFCoordinateScale scale,
+                              const SFObjectType object_type,
+                              VertexArray * const varray, const int rot,
+                              const bool convert, const int frame,
+                              ConvertContext * const ctx)
+{
+  assert(ctx != NULL);
+  return parse_vertices_with(r, object_count, scale, object_type, varray,
+                             rot, convert, frame, ctx,
+                             (ctx->flags & FLAGS_VERBOSE) != 0,
+                             (ctx->flags & FLAGS_UNUSED) != 0);
+}
+
+static int read_side(Reader * const r, const int object_count,
+                     const int nvertices, const int p, const int s,
+                     ConvertContext * const ctx)
+{
+  assert(r != NULL);
+  assert(object_count >= 0);
+  assert(nvertices >= 0);
+  assert(ctx != NULL);
+
+  const int v = reader_fgetc(r);
+  if (v == EOF) {
+    report(ctx, "Failed to read side %d of polygon %d "
+           "of object %d\n", s, p, object_count);
+    return -1;
+  }
+
+  /* Validate the vertex indices */
+  if (v < 1 || v > nvertices) {
+    report(ctx, "Bad vertex %lld "
+           "(side %d of polygon %d of object %d)\n",
+           (long long signed)v - 1, s, p, object_count);
+    return -1;
+  }
+
+  /* Vertex indices are stored using offset-1 encoding */
+  return v - 1;
+}
+
+/* As for parse_vertices_with, 'verbose' is constant in every caller
+   except parse_polygons_any */
+static ALWAYS_INLINE int parse_polygons_with(Reader * const r,
+                                             const int object_count,
+                                             const int nvertices,
+                                             VertexArray * const varray,
+                                             Group (* const groups)[
+                                               SFObjectFacet_VectorsGroup+1],
+                                             int (* const npolygons)[
+                                               SFObjectFacet_VectorsGroup+1],
+                                             const int expected_max_group,
+                                             const bool convert,
+                                             ConvertContext * const ctx,
+                                             const bool verbose)
 {
+  assert(ctx != NULL);
+  const unsigned int flags = ctx->flags;
+  assert(verbose == ((flags & FLAGS_VERBOSE) != 0));
   assert(r != NULL);
   assert(object_count >= 0);
   assert(!reader_ferror(r));
   assert(groups != NULL);
   assert(npolygons != NULL);
+  assert(nvertices >= 1);
   assert(expected_max_group < SFObjectFacet_VectorsGroup);
   assert(!(flags & ~FLAGS_ALL));
 
   /* Get number of polygons */
   const int num_polygons = reader_fgetc(r);
   if (num_polygons == EOF) {
-    fprintf(stderr, "Failed to read no. of polygons (object %d)\n",
-            object_count);
+    report(ctx, "Failed to read no. of polygons (object %d)\n",
+           object_count);
     return -1;
   }
   if (num_polygons < 1) {
-    fprintf(stderr, "Bad polygon count %d (object %d)\n",
-            num_polygons, object_count);
+    report(ctx, "Bad polygon count %d (object %d)\n",
+           num_polygons, object_count);
     return -1;
   }
-  if (flags & FLAGS_VERBOSE) {
+  if (verbose) {
     long int const pos = reader_ftell(r);
     printf("Found %d polygons at offset %ld (0x%lx)\n", num_polygons,
            pos, pos);
   }
 
   int max_group = 0;
-  const int nvertices = vertex_array_get_num_vertices(varray);
 
   for (int p = 0; p < num_polygons; ++p) {
     const int num_sides_and_group = reader_fgetc(r);
     if (num_sides_and_group == EOF) {
-      fprintf(stderr, "Failed to read no. of sides and plot group "
-                      "(polygon %d of object %d)\n", p, object_count);
+      report(ctx, "Failed to read no. of sides and plot group "
+                  "(polygon %d of object %d)\n", p, object_count);
       return -1;
     }
 
@@ -285,19 +414,19 @@ static int parse_polygons(Reader * const r, const int object_count,
     if (group != SFObjectFacet_VectorsGroup) {
       max_group = HIGHEST(group, max_group);
       if (group < 0 || group > expected_max_group) {
-        fprintf(stderr, "Bad plot group %d (polygon %d of object %d)\n",
-                group, p, object_count);
+        report(ctx, "Bad plot group %d (polygon %d of object %d)\n",
+               group, p, object_count);
         return -1;
       }
     }
 
     if (num_sides < 3) {
-      fprintf(stderr, "Bad side count %d (polygon %d of object %d)\n",
-              num_sides, p, object_count);
+      report(ctx, "Bad side count %d (polygon %d of object %d)\n",
+             num_sides, p, object_count);
       return -1;
     }
 
-    if (flags & FLAGS_VERBOSE) {
+    if (verbose) {
       long int const pos = reader_ftell(r);
       printf("Found %d sides in group %d at offset %ld (0x%lx)\n",
              num_sides, group, pos, pos);
@@ -310,8 +439,8 @@ static int parse_polygons(Reader * const r, const int object_count,
     if (convert) {
       _Optional Primitive * const pp = group_add_primitive((*groups) + group);
       if (pp == NULL) {
-        fprintf(stderr, "Failed to allocate primitive memory "
-                "(polygon %d of object %d)\n", p, object_count);
+        report(ctx, "Failed to allocate primitive memory "
+               "(polygon %d of object %d)\n", p, object_count);
         return -1;
       }
       primitive_set_id(&*pp, group_get_num_primitives((*groups) + group));
@@ -322,28 +451,15 @@ static int parse_polygons(Reader * const r, const int object_count,
 
       /* Get the vertex indices and colour byte */
       for (int s = 0; s < num_sides; ++s) {
-        int v = reader_fgetc(r);
-        if (v == EOF) {
-          fprintf(stderr, "Failed to read side %d of polygon %d "
-                  "of object %d\n", s, p, object_count);
-          return -1;
-        }
-
-        /* Validate the vertex indices */
-        if (v < 1 || v > nvertices) {
-          fprintf(stderr, "Bad vertex %lld "
-                  "(side %d of polygon %d of object %d)\n",
-                  (long long signed)v - 1, s, p, object_count);
+        const int v = read_side(r, object_count, nvertices, p, s, ctx);
+        if (v < 0) {
           return -1;
         }
 
-        /* Vertex indices are stored using offset-1 encoding */
-        --v;
-
         if (primitive_add_side(&*pp, v) < 0) {
-          fprintf(stderr, "Failed to add side: too many sides? "
-                          "(side %d of polygon %d of object %d)\n",
-                  s, p, object_count);
+          report(ctx, "Failed to add side: too many sides? "
+                      "(side %d of polygon %d of object %d)\n",
+                 s, p, object_count);
           return -1;
         }
       }
@@ -355,7 +471,7 @@ static int parse_polygons(Reader * const r, const int object_count,
       primitive_reverse_sides(&*pp);
 #endif
 
-      if (flags & FLAGS_VERBOSE) {
+      if (verbose) {
         printf("Primitive %d in group %d:\n",
                group_get_num_primitives((*groups) + group), group);
         primitive_print(&*pp, varray);
@@ -364,37 +480,101 @@ static int parse_polygons(Reader * const r, const int object_count,
 
       int const side = primitive_get_skew_side(&*pp, varray);
       if (side >= 0) {
-        fprintf(stderr, "Warning: skew polygon detected "
-                        "(side %d of primitive %d of object %d)\n",
-                side, p, object_count);
+        report(ctx, "Warning: skew polygon detected "
+                    "(side %d of primitive %d of object %d)\n",
+               side, p, object_count);
       }
 
       const int colour_low = reader_fgetc(r);
       if (colour_low == EOF) {
-        fprintf(stderr, "Failed to read colour "
-                "(polygon %d of object %d)\n", p, object_count);
+        report(ctx, "Failed to read colour "
+               "(polygon %d of object %d)\n", p, object_count);
         return -1;
       }
 
       primitive_set_colour(&*pp, colour_low + (colour_high ? 256 : 0));
+    } else if (flags & FLAGS_CHECK) {
+      /* Validate the vertex indices without storing them */
+      for (int s = 0; s < num_sides; ++s) {
+        if (read_side(r, object_count, nvertices, p, s, ctx) < 0) {
+          return -1;
+        }
+      }
+
+      /* Skip the colour byte */
+      if (reader_fseek(r, 1, SEEK_CUR)) {
+        report(ctx, "Failed to seek end of polygon "
+               "(polygon %d of object %d)\n", p, object_count);
+        return -1;
+      }
     } else {
       /* Skip the vertex indices and colour byte */
       if (reader_fseek(r, num_sides + (long int)1, SEEK_CUR)) {
-        fprintf(stderr, "Failed to seek end of polygon "
-                "(polygon %d of object %d)\n", p, object_count);
+        report(ctx, "Failed to seek end of polygon "
+               "(polygon %d of object %d)\n", p, object_count);
         return -1;
       }
     }
   } /* next polygon */
 
   if (max_group < expected_max_group) {
-    fprintf(stderr, "Warning: highest plot group is %d not %d (object %d)\n",
-            max_group, expected_max_group, object_count);
+    report(ctx, "Warning: highest plot group is %d not %d (object %d)\n",
+           max_group, expected_max_group, object_count);
   }
 
   return num_polygons;
 }
 
+static int parse_polygons_quiet(Reader * const r, const int object_count,
+                                const int nvertices,
+                                VertexArray * const varray,
+                                Group (* const groups)[
+                                  SFObjectFacet_VectorsGroup+1],
+                                int (* const npolygons)[
+                                  SFObjectFacet_VectorsGroup+1],
+                                const int expected_max_group,
+                                const bool convert,
+                                ConvertContext * const ctx)
+{
+  return parse_polygons_with(r, object_count, nvertices, varray, groups,
+                             npolygons, expected_max_group, convert, ctx,
+                             false);
+}
+
+static int parse_polygons_any(Reader * const r, const int object_count,
+                              const int nvertices,
+                              VertexArray * const varray,
+                              Group (* const groups)[
+                                SFObjectFacet_VectorsGroup+1],
+                              int (* const npolygons)[
+                                SFObjectFacet_VectorsGroup+1],
+                              const int expected_max_group,
+                              const bool convert,
+                              ConvertContext * const ctx)
+{
+  assert(ctx != NULL);
+  return parse_polygons_with(r, object_count, nvertices, varray, groups,
+                             npolygons, expected_max_group, convert, ctx,
+                             (ctx->flags & FLAGS_VERBOSE) != 0);
+}
+
+/* Instances of the parsing loops for the flags of a conversion. Only
+   verbose mode and keeping unused vertices need the generic instances. */
+struct ParseKernels {
+  ParseVerticesFn *parse_vertices;
+  ParsePolygonsFn *parse_polygons;
+};
+
+static const ParseKernels quiet_kernels = {
+  .parse_vertices = parse_vertices_quiet,
+  .parse_polygons = parse_polygons_quiet,
+};
+
+static const ParseKernels any_kernels = {
+  .parse_vertices = parse_vertices_any,
+  .parse_polygons = parse_polygons_any,
+};
+
 static int get_false_colour(const Primitive *pp, void *arg)
 {
   NOT_USED(pp);
@@ -417,38 +597,8 @@ static int get_colour(const Primitive *const pp, void *arg)
   assert(info->frame >= 0);
   _Optional const SFObjectColours * const pal = info->pal;
 
-  if ((colour >= (int)ARRAY_SIZE(pal->areas.static_colours)) &&
-      (colour < (int)ARRAY_SIZE(pal->colour_mappings) -
-                (int)ARRAY_SIZE(pal->areas.player_livery))) {
-    const int start_frame =
-        colour % (int)ARRAY_SIZE(pal->areas.engine_colours.player_engine);
-    unsigned int special_frame = 0;
-    const int special_colour =
-        colour - (int)ARRAY_SIZE(pal->areas.static_colours);
-
-    if (special_colour < (int)
-        (ARRAY_SIZE(pal->areas.engine_colours.player_engine) +
-         ARRAY_SIZE(pal->areas.engine_colours.fighter_engine) +
-         ARRAY_SIZE(pal->areas.engine_colours.cruiser_engine) +
-         ARRAY_SIZE(pal->areas.engine_colours.super_engine) +
-         ARRAY_SIZE(pal->areas.fast_flashing.enemy_ships) +
-         ARRAY_SIZE(pal->areas.fast_flashing.friendly_ships) +
-         ARRAY_SIZE(pal->areas.fast_flashing.player_ship))) {
-      /* Fast flashing colours */
-      special_frame = info->frame;
-    } else {
-      /* Slow flashing colours
-         +1 because the first change happens on the 2nd not 3rd frame */
-      special_frame = (info->frame + 1) / 2;
-    }
-
-    DEBUGF("Frame number for flashing colour %d is %d\n",
-           colour, special_frame);
-
-    colour = (colour - start_frame) +
-             ((start_frame + special_frame) %
-              (int)ARRAY_SIZE(pal->areas.engine_colours.player_engine));
-
+  if (get_flash_period(colour) > 0) {
+    colour = get_frame_colour(colour, info->frame);
     DEBUGF("Updated colour is %d\n", colour);
   }
   if (pal) {
@@ -482,6 +632,46 @@ static int get_human_material(char *const buf, size_t const buf_size,
                   get_colour_name(colour / NTints), colour % NTints);
 }
 
+static bool add_rotator(Animation * const animation,
+                        const VertexArray * const varray, const int rot,
+                        const int object_count, const SFObjectType type,
+                        const int type_count, const int vtotal,
+                        ConvertContext * const ctx)
+{
+  assert(animation != NULL);
+  assert(varray != NULL);
+  assert(rot > 0);
+  assert(vtotal >= 0);
+
+  /* Rotating vertices are output last, so they end at the total so far */
+  int nrot = 0;
+  const int nvertices = vertex_array_get_num_vertices(varray);
+  for (int v = rot; v < nvertices; ++v) {
+    if (vertex_array_is_used(varray, v)) {
+      ++nrot;
+    }
+  }
+
+  /* Vertices rotate about the Z axis through the last one that doesn't */
+  _Optional Coord (* const coords)[3] = vertex_array_get_coords(varray,
+                                                                rot - 1);
+  if (!coords) {
+    report(ctx, "Bad rotator %d (object %d)\n", rot, object_count);
+    return false;
+  }
+
+  const Rotator rotator = {
+    .index = object_count,
+    .type = type,
+    .type_count = type_count,
+    .first_vertex = vtotal - nrot + 1,
+    .nvertices = nrot,
+    .pivot = {(*coords)[0], (*coords)[1], (*coords)[2]},
+    .angle = ROTATION_SPEED,
+  };
+  return animation_add_rotator(animation, &rotator);
+}
+
 static bool output_object(FILE * const out, const int type_count,
                           const char *const object_name,
                           const ObjectInfo *const o)
@@ -550,8 +740,10 @@ static bool output_object(FILE * const out, const int type_count,
 
 static int parse_plot_types(Reader * const r,
                             PlotType (* const plot_types)[MaxPlotType+1],
-                            const unsigned int flags)
+                            ConvertContext * const ctx)
 {
+  assert(ctx != NULL);
+  const unsigned int flags = ctx->flags;
   assert(r != NULL);
   assert(!reader_ferror(r));
   assert(plot_types != NULL);
@@ -560,7 +752,7 @@ static int parse_plot_types(Reader * const r,
   /* Read plot type definitions */
   int command = reader_fgetc(r);
   if (command == EOF) {
-    fprintf(stderr, "Failed to read plot type definition\n");
+    report(ctx, "Failed to read plot type definition\n");
     return -1;
   }
 
@@ -571,7 +763,7 @@ static int parse_plot_types(Reader * const r,
     int command_count = 0;
 
     if (plot_type_count > MaxPlotType) {
-      fprintf(stderr, "Too many plot types (max %d)\n", MaxPlotType);
+      report(ctx, "Too many plot types (max %d)\n", MaxPlotType);
       return -1;
     }
 
@@ -588,8 +780,8 @@ static int parse_plot_types(Reader * const r,
        There must be at least one. */
     do {
       if (command_count >= MaxPlotCommands) {
-        fprintf(stderr, "Too many commands (max %d) for plot type %d\n",
-                MaxPlotCommands, plot_type_count);
+        report(ctx, "Too many commands (max %d) for plot type %d\n",
+               MaxPlotCommands, plot_type_count);
         return -1;
       }
 
@@ -614,16 +806,16 @@ static int parse_plot_types(Reader * const r,
         /* Next byte is a group number */
         group = reader_fgetc(r);
         if (group == EOF) {
-          fprintf(stderr, "Failed to read plot group "
-                  "(command %d of plot type %d)\n", command_count,
-                  plot_type_count);
+          report(ctx, "Failed to read plot group "
+                 "(command %d of plot type %d)\n", command_count,
+                 plot_type_count);
           return -1;
         }
       }
 
       if ((group < 0) || (group >= SFObjectFacet_VectorsGroup)) {
-        fprintf(stderr, "Bad plot group %d (command %d of plot type %d)\n",
-                group, command_count, plot_type_count);
+        report(ctx, "Bad plot group %d (command %d of plot type %d)\n",
+               group, command_count, plot_type_count);
         return -1;
       }
 
@@ -654,19 +846,25 @@ static int parse_plot_types(Reader * const r,
                     "back-facing\n", group, polygon);
              break;
            default:
-             fprintf(stderr, "Bad plot action %d "
-                     "(command %d of plot type %d)\n",
-                     action, command_count, plot_type_count);
+             report(ctx, "Bad plot action %d "
+                    "(command %d of plot type %d)\n",
+                    action, command_count, plot_type_count);
              return -1;
         }
       }
 
       (*plot_types)[plot_type_count].group_order[command_count] = group;
+      (*plot_types)[plot_type_count].commands[command_count] =
+        (VisibilityCommand){
+          .action = action,
+          .test = (action == SFPlotAction_FacingAlways) ? -1 : polygon,
+          .group = group
+        };
 
       command = reader_fgetc(r);
       if (command == EOF) {
-        fprintf(stderr, "Failed to read command or terminator "
-                "(plot type %d)\n", plot_type_count);
+        report(ctx, "Failed to read command or terminator "
+               "(plot type %d)\n", plot_type_count);
         return -1;
       }
       ++command_count;
@@ -676,7 +874,7 @@ static int parse_plot_types(Reader * const r,
 
     command = reader_fgetc(r);
     if (command == EOF) {
-      fprintf(stderr, "Failed to read plot type definition or terminator\n");
+      report(ctx, "Failed to read plot type definition or terminator\n");
       return -1;
     }
     ++plot_type_count;
@@ -685,6 +883,44 @@ static int parse_plot_types(Reader * const r,
   return plot_type_count;
 }
 
+static void check_clip_size(const ObjectInfo * const o,
+                            const Bounds * const bounds,
+                            const int object_count,
+                            ConvertContext * const ctx)
+{
+  assert(o != NULL);
+  assert(bounds != NULL);
+  assert(object_count >= 0);
+
+  if ((o->type != SFObjectType_Ground) && (o->type != SFObjectType_Aerial)) {
+    return;
+  }
+
+  /* The clip size is stored as half of the width and height of the
+     rectangle that the game uses to cull objects */
+  for (int k = 0; k < 2; ++k) {
+    const double extent = HIGHEST(fabs(bounds->min[k]),
+                                  fabs(bounds->max[k]));
+    if (extent > o->clip_size[k]) {
+      report(ctx, "Warning: clip size %d is smaller than the %c extent "
+             "%g of the vertices (object %d)\n", o->clip_size[k] << 1,
+             "xy"[k], extent * 2, object_count);
+    }
+  }
+}
+
+static int count_polygons(
+                       Group (* const groups)[SFObjectFacet_VectorsGroup+1])
+{
+  assert(groups != NULL);
+
+  int count = 0;
+  for (int g = 0; g <= SFObjectFacet_VectorsGroup; ++g) {
+    count += group_get_num_primitives((*groups) + g);
+  }
+  return count;
+}
+
 static void mark_vertices(
                        VertexArray * const varray,
                        Group (* const groups)[SFObjectFacet_VectorsGroup+1],
@@ -723,17 +959,83 @@ static void mark_vertices(
   }
 }
 
+static bool peek_attributes(Reader * const r, const unsigned int needs,
+                            int (* const values)[FilterAttribute_Count])
+{
+  assert(r != NULL);
+  assert(values != NULL);
+
+  /* The attributes following an object's type are read without
+     validating them, then the position is restored. Any errors are
+     reported when the object is parsed. */
+  const long int pos = reader_ftell(r);
+  bool success = true;
+
+  if (needs & (FILTER_NEEDS_HEADER | FILTER_NEEDS_FACES)) {
+    /* Scale, rotator, 8 bytes of other attributes, plot type and highest
+       plot group, and vertex count */
+    unsigned char header[12];
+    success = (reader_fread(header, sizeof(header), 1, r) == 1);
+    if (success) {
+      (*values)[FilterAttribute_Scale] = header[0];
+      (*values)[FilterAttribute_Rotator] = header[1];
+      (*values)[FilterAttribute_Plot] = (header[10] &
+                                         SFObject_PlotTypeMask) >>
+                                        SFObject_PlotTypeShift;
+      (*values)[FilterAttribute_Group] = (header[10] &
+                                          SFObject_LastGroupMask) >>
+                                         SFObject_LastGroupShift;
+      (*values)[FilterAttribute_Vertices] = header[11];
+    }
+  }
+
+  if (success && (needs & FILTER_NEEDS_FACES)) {
+    /* Skip the vertices and clip distance to get the polygon count */
+    const long int vend = reader_ftell(r) +
+                          3l * (*values)[FilterAttribute_Vertices];
+    int num_polygons = EOF;
+    if (!reader_fseek(r, WORD_ALIGN(vend) + 4, SEEK_SET)) {
+      num_polygons = reader_fgetc(r);
+    }
+    if (num_polygons == EOF) {
+      success = false;
+    } else {
+      (*values)[FilterAttribute_Faces] = num_polygons;
+    }
+  }
+
+  if (reader_fseek(r, pos, SEEK_SET)) {
+    success = false;
+  }
+  return success;
+}
+
 static bool parse_objects(Reader * const r, _Optional FILE * const out,
                           const int first, const int last,
                           const SFObjectType type,
                           _Optional const char * const name,
+                          _Optional const Filter * const filter,
                           _Optional const SFObjectColours * const pal,
                           const int frame,
-                          const unsigned int flags,
                           PlotType (* const plot_types)[MaxPlotType+1],
-                          const int num_plot_types)
+                          const int num_plot_types,
+                          _Optional const ObjectNumber * const numbers,
+                          const int nnumbers,
+                          _Optional ObjectSummaryFn * const summary_fn,
+                          void * const summary_arg,
+                          ConvertContext * const ctx)
 {
-  int object_count = 0, vtotal = 0, max_plot_type = -1;
+  assert(ctx != NULL);
+  const unsigned int flags = ctx->flags;
+  _Optional Collisions * const collisions = ctx->collisions;
+  _Optional Animation * const animation = ctx->animation;
+  _Optional BoundsList * const bounds_list = ctx->bounds_list;
+  _Optional VisibilityList * const visibility_list = ctx->visibility_list;
+  _Optional ClipCache * const clip_cache = ctx->clip_cache;
+  _Optional BudgetMeter * const meter = ctx->meter;
+  int object_count = 0, max_plot_type = -1, nparsed = 0, boxes_alloc = 0;
+  VColoursCounts totals = {.vertices = 0, .texels = 0, .normals = 0};
+  _Optional CollisionBox *boxes = NULL;
   int type_counts[SFObjectType_Aerial+1] = {0, 0, 0};
   long int obj_start = 0;
   bool success = false, list_title = false;
@@ -749,6 +1051,8 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
   assert(plot_types != NULL);
   assert(num_plot_types >= 1);
   assert(num_plot_types <= MaxPlotType+1);
+  assert(numbers != NULL || nnumbers == 0);
+  assert(nnumbers >= 0);
 
   Group groups[SFObjectFacet_VectorsGroup+1];
   for (int g = 0; g <= SFObjectFacet_VectorsGroup; ++g) {
@@ -757,20 +1061,38 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
   VertexArray varray;
   vertex_array_init(&varray);
 
-  if (flags & FLAGS_LIST) {
-    obj_start = reader_ftell(r);
-  }
+  obj_start = reader_ftell(r);
 
   int32_t last_explosion_num;
   if (!reader_fread_int32(&last_explosion_num, r)) {
-    fprintf(stderr, "Failed to read no. of explosions (object %d)\n",
-            object_count);
+    report(ctx, "Failed to read no. of explosions (object %d)\n",
+           object_count);
     return false;
   }
 
   /* Parse each object definition in turn until finding an end marker.
      There must be at least one. */
   do {
+    if (numbers != NULL) {
+      /* Only some of the original file's objects are present */
+      if (nparsed >= nnumbers) {
+        report(ctx, "Unexpected object after object %d\n",
+               object_count);
+        break;
+      }
+      object_count = (&*numbers)[nparsed].index;
+    }
+
+    if (meter != NULL) {
+      /* Give up on the file if earlier objects used all of its budget */
+      budget_meter_start_object(&*meter);
+      if (budget_meter_check(&*meter, object_count, -1, -1) !=
+          BudgetStatus_OK) {
+        ctx->over_budget = true;
+        break;
+      }
+    }
+
     ObjectInfo o = {
       .type = SFObjectType_Ground,
       .coll_x = 0,
@@ -796,23 +1118,23 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
 
     /* Skip the explosions data */
     if (reader_fseek(r, expl_size, SEEK_CUR)) {
-      fprintf(stderr, "Failed to seek object attributes (object %d)\n",
-              object_count);
+      report(ctx, "Failed to seek object attributes (object %d)\n",
+             object_count);
       break;
     }
 
     /* Get object type */
     const int byte = reader_fgetc(r);
     if (byte == EOF) {
-      fprintf(stderr, "Failed to read object type (object %d)\n",
-              object_count);
+      report(ctx, "Failed to read object type (object %d)\n",
+             object_count);
       break;
     }
     if ((byte != SFObjectType_Aerial) &&
         (byte != SFObjectType_Ground) &&
         (byte != SFObjectType_Bit)) {
-      fprintf(stderr, "Bad object type %d (object %d)\n", byte,
-              object_count);
+      report(ctx, "Bad object type %d (object %d)\n", byte,
+             object_count);
       break;
     }
     o.type = (SFObjectType)byte;
@@ -823,8 +1145,13 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
     }
 
     assert((size_t)o.type < ARRAY_SIZE(type_counts));
-    const int type_count = type_counts[o.type];
-    const char * const object_name = get_obj_name(o.type, type_count);
+    const int type_count = (numbers != NULL) ?
+                           (&*numbers)[nparsed].type_count :
+                           type_counts[o.type];
+
+    const char * const object_name = get_obj_name(o.type, type_count,
+                                                  ctx->name,
+                                                  sizeof(ctx->name));
 
     if (type == SFObjectType_Invalid || o.type == type) {
       int req_index = object_count;
@@ -852,28 +1179,44 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
       }
     }
 
+    if (match && (filter != NULL)) {
+      /* Objects that fail the filter are skipped like unselected objects,
+         without decoding their geometry */
+      int values[FilterAttribute_Count] = {
+        [FilterAttribute_Index] = object_count,
+        [FilterAttribute_Type] = o.type,
+        [FilterAttribute_TypeIndex] = type_count,
+      };
+      if (peek_attributes(r, filter->needs, &values)) {
+        match = filter_match(&*filter, values);
+        if (!match && (flags & FLAGS_VERBOSE)) {
+          printf("Object %d does not pass the filter\n", object_count);
+        }
+      }
+    }
+
     if (match && (out != NULL)) {
       convert = true;
 
       const int byte = reader_fgetc(r);
       if (byte == EOF) {
-        fprintf(stderr, "Failed to read scale (object %d)\n", object_count);
+        report(ctx, "Failed to read scale (object %d)\n", object_count);
         break;
       }
       scale = (SFCoordinateScale)byte;
 
       rot = reader_fgetc(r);
       if (rot == EOF) {
-        fprintf(stderr, "Failed to read rotator (object %d)\n",
-                object_count);
+        report(ctx, "Failed to read rotator (object %d)\n",
+               object_count);
         break;
       }
 
       const int gr_obj_coll_size = reader_fgetc(r);
       if (gr_obj_coll_size == EOF) {
-        fprintf(stderr,
-                "Failed to read packed collision size (object %d)\n",
-                object_count);
+        report(ctx,
+               "Failed to read packed collision size (object %d)\n",
+               object_count);
         break;
       }
 
@@ -886,52 +1229,73 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
 
       if (!reader_fread_uint16(o.clip_size, r) ||
           !reader_fread_uint16(o.clip_size + 1, r)) {
-        fprintf(stderr, "Failed to read clip size (object %d)\n",
-                object_count);
+        report(ctx, "Failed to read clip size (object %d)\n",
+               object_count);
         break;
       }
 
       o.score = reader_fgetc(r) * 25;
       if (o.score == EOF) {
-        fprintf(stderr, "Failed to read score (object %d)\n", object_count);
+        report(ctx, "Failed to read score (object %d)\n", object_count);
         break;
       }
 
       o.hits_or_min_z = reader_fgetc(r);
       if (o.hits_or_min_z == EOF) {
-        fprintf(stderr, "Failed to read hitpoints (object %d)\n",
-                object_count);
+        report(ctx, "Failed to read hitpoints (object %d)\n",
+               object_count);
         break;
       }
 
       o.explosion_style = reader_fgetc(r);
       if (o.explosion_style == EOF) {
-        fprintf(stderr, "Failed to read explosion style (object %d)\n",
-                object_count);
+        report(ctx, "Failed to read explosion style (object %d)\n",
+               object_count);
+        break;
+      }
+    } else if (flags & FLAGS_CHECK) {
+      /* Skip the scale but get the rotator so that it can be validated */
+      if (reader_fseek(r, 1, SEEK_CUR)) {
+        report(ctx, "Failed to seek rotator (object %d)\n",
+               object_count);
+        break;
+      }
+
+      rot = reader_fgetc(r);
+      if (rot == EOF) {
+        report(ctx, "Failed to read rotator (object %d)\n",
+               object_count);
+        break;
+      }
+
+      /* Skip the rest of the object attributes */
+      if (reader_fseek(r, 8, SEEK_CUR)) {
+        report(ctx, "Failed to seek vertex data (object %d)\n",
+               object_count);
         break;
       }
     } else {
       /* Skip the rest of the object attributes */
       if (reader_fseek(r, 10, SEEK_CUR)) {
-        fprintf(stderr, "Failed to seek vertex data (object %d)\n",
-                object_count);
+        report(ctx, "Failed to seek vertex data (object %d)\n",
+               object_count);
         break;
       }
     }
 
     const int plot_type_and_last_group = reader_fgetc(r);
     if (plot_type_and_last_group == EOF) {
-      fprintf(stderr,
-              "Failed to read plot type and max plot group (object %d)\n",
-              object_count);
+      report(ctx,
+             "Failed to read plot type and max plot group (object %d)\n",
+             object_count);
       break;
     }
     o.plot_type = (plot_type_and_last_group &
                    SFObject_PlotTypeMask) >> SFObject_PlotTypeShift;
 
     if (o.plot_type >= num_plot_types) {
-      fprintf(stderr, "Bad plot type %d (object %d)\n", o.plot_type,
-              object_count);
+      report(ctx, "Bad plot type %d (object %d)\n", o.plot_type,
+             object_count);
       break;
     }
     if (o.plot_type > max_plot_type) {
@@ -944,41 +1308,42 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
 
     if ((o.expected_max_group < 0) ||
         (o.expected_max_group >= SFObjectFacet_VectorsGroup)) {
-      fprintf(stderr, "Bad highest plot group %d (object %d)\n",
-              o.expected_max_group, object_count);
+      report(ctx, "Bad highest plot group %d (object %d)\n",
+             o.expected_max_group, object_count);
       break;
     }
     if ((o.expected_max_group > 0) && (o.plot_type == 0)) {
-      fprintf(stderr, "Warning: highest plot group %d is higher than "
-                      "expected for plot type 0 (object %d)\n",
-                      o.expected_max_group, object_count);
+      report(ctx, "Warning: highest plot group %d is higher than "
+                  "expected for plot type 0 (object %d)\n",
+                  o.expected_max_group, object_count);
     }
 
     vertex_array_clear(&varray);
 
     /* Get number of vertices */
-    const int nvertices = parse_vertices(r, object_count, scale, o.type,
-                                         &varray, rot, convert, frame,
-                                         flags);
+    const int nvertices = ctx->kernels->parse_vertices(r, object_count,
+                                                       scale, o.type,
+                                                       &varray, rot,
+                                                       convert, frame, ctx);
     if (nvertices == -1) {
       break;
     }
 
     if (rot >= nvertices) {
-      fprintf(stderr, "Bad rotator %d (object %d)\n", rot, object_count);
+      report(ctx, "Bad rotator %d (object %d)\n", rot, object_count);
       break;
     }
 
     /* Find the first word-aligned offset ahead of the vertex data */
     if (reader_fseek(r, WORD_ALIGN(reader_ftell(r)), SEEK_SET)) {
-      fprintf(stderr, "Failed to seek clip distance (object %d)\n",
-              object_count);
+      report(ctx, "Failed to seek clip distance (object %d)\n",
+             object_count);
       break;
     }
 
     if (!reader_fread_int32(&o.clip_dist, r)) {
-      fprintf(stderr, "Failed to read clip distance (object %d)\n",
-              object_count);
+      report(ctx, "Failed to read clip distance (object %d)\n",
+             object_count);
       break;
     }
 
@@ -989,23 +1354,33 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
       }
     }
 
-    const int num_polygons = parse_polygons(r, object_count, &varray,
-                                            &groups, &npolygons,
-                                            o.expected_max_group,
-                                            convert, flags);
+    const int num_polygons = ctx->kernels->parse_polygons(
+                               r, object_count, nvertices, &varray, &groups,
+                               &npolygons, o.expected_max_group, convert,
+                               ctx);
     if (num_polygons == -1) {
       break;
     }
 
     /* Validate the object's plot type. We can do this even if we didn't
        read its vertex coordinates or polygon sides. */
+    VisibilityTests tests = {.ntests = 0};
     if (o.plot_type != 0) {
       /* Check that the referenced polygons exist */
       const int max_polygon = (*plot_types)[o.plot_type].max_polygon;
       if (max_polygon >= npolygons[SFObjectFacet_VectorsGroup]) {
-        fprintf(stderr,
-                "Plot type %d is predicated on undefined polygon %d "
-                "(object %d)\n", o.plot_type, max_polygon, object_count);
+        report(ctx,
+               "Plot type %d is predicated on undefined polygon %d "
+               "(object %d)\n", o.plot_type, max_polygon, object_count);
+        break;
+      }
+
+      /* Record the tested surface normals before the vector test
+         polygons are hidden */
+      if (convert &&
+          ((flags & FLAGS_VISIBILITY) || (visibility_list != NULL)) &&
+          !visibility_get_tests(&varray, groups + SFObjectFacet_VectorsGroup,
+                                max_polygon + 1, &tests)) {
         break;
       }
 
@@ -1022,9 +1397,9 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
           /* This group cannot be plotted */
           if (npolygons[g] > 0) {
             if (g != SFObjectFacet_VectorsGroup) {
-              fprintf(stderr,
-                      "Warning: plot type %d hides group %d (object %d)\n",
-                      o.plot_type, g, object_count);
+              report(ctx,
+                     "Warning: plot type %d hides group %d (object %d)\n",
+                     o.plot_type, g, object_count);
             }
             if ((flags & FLAGS_HIDDEN_POLYGONS) == 0) {
               group_delete_all(groups + g);
@@ -1033,14 +1408,23 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
         }
       }
       if (g <= SFObjectFacet_VectorsGroup) {
-        fprintf(stderr,
-                "Plot type %d references undefined group %d (object %d)\n",
-                o.plot_type, g, object_count);
+        report(ctx,
+               "Plot type %d references undefined group %d (object %d)\n",
+               o.plot_type, g, object_count);
         break;
       }
     }
 
-    if (convert) {
+    BudgetStatus status = BudgetStatus_OK;
+    if (convert && (meter != NULL)) {
+      /* Refuse an object that is already too big before the expensive
+         stages of converting it */
+      status = budget_meter_check(&*meter, object_count,
+                                  count_polygons(&groups),
+                                  vertex_array_get_num_vertices(&varray));
+    }
+
+    if (convert && (status == BudgetStatus_OK)) {
       /* In cases of overlapping coplanar polygons,
          split the underlying polygon */
       if (flags & FLAGS_CLIP_POLYGONS) {
@@ -1058,26 +1442,58 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
           group_order_len = (*plot_types)[o.plot_type].num_commands;
         }
 
-        if (!clip_polygons(&varray, groups, group_order, group_order_len,
+        /* Objects are often clipped repeatedly with the same result,
+           e.g. for different palettes or output styles */
+        if ((clip_cache != NULL) ?
+            !clip_cache_clip(&*clip_cache, &varray, groups,
+                             ARRAY_SIZE(groups), group_order,
+                             group_order_len, (flags & FLAGS_VERBOSE) != 0) :
+            !clip_polygons(&varray, groups, group_order, group_order_len,
                            (flags & FLAGS_VERBOSE) != 0)) {
-          fprintf(stderr,
-                  "Clipping of overlapping coplanar polygons failed\n");
+          report(ctx,
+                 "Clipping of overlapping coplanar polygons failed\n");
           break;
         }
       }
 
-      /* Mark the vertices in preparation for culling unused ones. */
-      mark_vertices(&varray, &groups, object_count, flags);
+      if (meter != NULL) {
+        /* Clipping can multiply the number of polygons */
+        status = budget_meter_check(&*meter, object_count,
+                                    count_polygons(&groups),
+                                    vertex_array_get_num_vertices(&varray));
+      }
+
+      if (status == BudgetStatus_OK) {
+        /* Mark the vertices in preparation for culling unused ones. */
+        mark_vertices(&varray, &groups, object_count, flags);
 
-      if (!(flags & FLAGS_DUPLICATE)) {
-        /* Unmark duplicate vertices in preparation for culling them. */
-        if (vertex_array_find_duplicates(&varray,
-                                         (flags & FLAGS_VERBOSE) != 0) < 0) {
-          fprintf(stderr, "Detection of duplicate vertices failed\n");
-          break;
+        if (!(flags & FLAGS_DUPLICATE)) {
+          /* Unmark duplicate vertices in preparation for culling them. */
+          const bool verbose = (flags & FLAGS_VERBOSE) != 0;
+          if (vertex_array_find_duplicates(&varray, verbose) < 0) {
+            report(ctx, "Detection of duplicate vertices failed\n");
+            break;
+          }
+        }
+
+        if (meter != NULL) {
+          status = budget_meter_check(&*meter, object_count, -1, -1);
         }
       }
+    }
 
+    if (status == BudgetStatus_FileExceeded) {
+      ctx->over_budget = true;
+      break;
+    }
+
+    if (status == BudgetStatus_ObjectExceeded) {
+      /* Nothing is output for the object but the rest of the file is
+         still converted */
+      convert = false;
+    }
+
+    if (convert) {
       int vobject;
       if (!(flags & FLAGS_UNUSED) || !(flags & FLAGS_DUPLICATE)) {
         /* Cull unused and/or duplicate vertices */
@@ -1119,27 +1535,149 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
         get_material_cb = get_material;
       }
 
-      if (!output_object(&*out, type_count, object_name, &o) ||
-          !output_vertices(&*out, vobject, &varray, (rot > 0) ? rot : -1) ||
-          !output_primitives(&*out, object_name, vtotal, vobject,
+      OutputPrimitivesGetColourFn * const get_colour_cb =
+        (flags & FLAGS_FALSE_COLOUR) ? get_false_colour : get_colour;
+
+      if ((flags & FLAGS_SORT_COLOURS) &&
+          !batches_sort(&varray, groups, ARRAY_SIZE(groups), get_colour_cb,
+                        &info, (flags & FLAGS_VERBOSE) != 0)) {
+        report(ctx, "Sorting of primitives by colour failed\n");
+        break;
+      }
+
+      VCacheStats stats = {.triangles = 0};
+      if ((flags & FLAGS_OPTIMISE) &&
+          !vcache_optimise(&varray, groups, ARRAY_SIZE(groups),
+                           (flags & FLAGS_DUPLICATE) != 0, rot, &stats)) {
+        report(ctx, "Vertex cache optimisation failed\n");
+        break;
+      }
+
+      if (!(flags & FLAGS_STREAM) &&
+          (!output_object(&*out, type_count, object_name, &o) ||
+           ((stats.triangles > 0) &&
+            fprintf(&*out, "# Vertex cache miss ratio: %.3f before, "
+                           "%.3f after optimisation\n",
+                    (double)stats.misses_before / stats.triangles,
+                    (double)stats.misses_after / stats.triangles) < 0))) {
+        report(ctx,
+               "Failed writing to output file: %s\n",
+               strerror(errno));
+        break;
+      }
+
+      if ((flags & FLAGS_VISIBILITY) &&
+          !visibility_output(&*out, groups, ARRAY_SIZE(groups),
+                             (*plot_types)[o.plot_type].commands,
+                             (o.plot_type != 0) ?
+                               (*plot_types)[o.plot_type].num_commands : 0,
+                             &tests)) {
+        report(ctx,
+               "Failed writing to output file: %s\n",
+               strerror(errno));
+        break;
+      }
+
+      if ((visibility_list != NULL) &&
+          !visibility_list_add(&*visibility_list, object_count, o.type,
+                               type_count, o.plot_type, groups,
+                               ARRAY_SIZE(groups),
+                               (*plot_types)[o.plot_type].commands,
+                               (o.plot_type != 0) ?
+                                 (*plot_types)[o.plot_type].num_commands : 0,
+                               &tests)) {
+        break;
+      }
+
+      if (flags & FLAGS_STREAM) {
+        /* The object's attributes, vertices and faces form one frame */
+        const StreamObject object = {
+          .index = object_count,
+          .type = o.type,
+          .type_count = type_count,
+          .name = object_name,
+          .plot_type = o.plot_type,
+          .max_group = o.expected_max_group,
+          .coll_x = o.coll_x,
+          .coll_y = o.coll_y,
+          .clip_size = {o.clip_size[0] << 1, o.clip_size[1] << 1},
+          .score = o.score,
+          .hits_or_min_z = o.hits_or_min_z,
+          .explosion_style = o.explosion_style,
+          .clip_dist = o.clip_dist,
+        };
+        if (!stream_write_object(&*out, &object, &varray, groups,
+                                 ARRAY_SIZE(groups), get_colour_cb, &info,
+                                 (flags & (FLAGS_PHYSICAL_COLOUR|
+                                           FLAGS_FALSE_COLOUR)) != 0,
+                                 (flags & FLAGS_DUPLICATE) != 0, rot)) {
+          break;
+        }
+      } else if (flags & (FLAGS_VERTEX_COLOURS|FLAGS_ATLAS|FLAGS_NORMALS)) {
+        /* Faces are coloured by their vertices, a texture or one material
+           per colour, optionally with a normal for each face */
+        ColourStyle cstyle = ColourStyle_Material;
+        if (flags & FLAGS_ATLAS) {
+          cstyle = (flags & (FLAGS_PHYSICAL_COLOUR|FLAGS_FALSE_COLOUR)) ?
+                   ColourStyle_PhysicalAtlas : ColourStyle_LogicalAtlas;
+        } else if (flags & FLAGS_VERTEX_COLOURS) {
+          cstyle = ColourStyle_Vertex;
+        }
+
+        if (!vcolours_output(&*out, object_name, &totals, &varray,
+                             groups, ARRAY_SIZE(groups), get_colour_cb,
+                             get_material_cb, &info, vstyle, mstyle, cstyle,
+                             (flags & FLAGS_NORMALS) != 0,
+                             (flags & FLAGS_DUPLICATE) != 0, rot)) {
+          break;
+        }
+      } else if (!output_vertices(&*out, vobject, &varray,
+                                  (rot > 0) ? rot : -1) ||
+          !output_primitives(&*out, object_name, totals.vertices, vobject,
                              &varray, groups, ARRAY_SIZE(groups),
-                             (flags & FLAGS_FALSE_COLOUR) ?
-                               get_false_colour : get_colour,
-                             get_material_cb,
+                             get_colour_cb, get_material_cb,
                              &info, vstyle, mstyle)) {
-        fprintf(stderr,
-                "Failed writing to output file: %s\n",
-                strerror(errno));
+        report(ctx,
+               "Failed writing to output file: %s\n",
+               strerror(errno));
+        break;
+      } else {
+        totals.vertices += vobject;
+      }
+
+      if ((animation != NULL) && (rot > 0) &&
+          !add_rotator(&*animation, &varray, rot, object_count, o.type,
+                       type_count, totals.vertices, ctx)) {
         break;
       }
 
-      vtotal += vobject;
+      if ((flags & FLAGS_BOUNDS) || (bounds_list != NULL)) {
+        Bounds bounds;
+        if (!bounds_compute(&varray, &bounds)) {
+          break;
+        }
+
+        if ((flags & FLAGS_BOUNDS) && !bounds_output(&*out, &bounds)) {
+          report(ctx,
+                 "Failed writing to output file: %s\n",
+                 strerror(errno));
+          break;
+        }
+
+        if ((bounds_list != NULL) &&
+            !bounds_list_add(&*bounds_list, object_count, o.type, type_count,
+                             &bounds)) {
+          break;
+        }
+
+        check_clip_size(&o, &bounds, object_count, ctx);
+      }
     }
 
     /* Find the first word-aligned offset ahead of the polygons data */
     if (reader_fseek(r, WORD_ALIGN(reader_ftell(r)), SEEK_SET)) {
-      fprintf(stderr, "Failed to seek collision data (object %d)\n",
-              object_count);
+      report(ctx, "Failed to seek collision data (object %d)\n",
+             object_count);
       break;
     }
 
@@ -1150,8 +1688,8 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
 
     int32_t last_collision_num;
     if (!reader_fread_int32(&last_collision_num, r)) {
-      fprintf(stderr, "Failed to read no. of collision boxes (object %d)\n",
-              object_count);
+      report(ctx, "Failed to read no. of collision boxes (object %d)\n",
+             object_count);
       break;
     }
 
@@ -1163,13 +1701,87 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
              pos, pos);
     }
 
-    /* Skip the collision boxes */
-    if (reader_fseek(r, 8 + coll_size + 4, SEEK_CUR)) {
-      fprintf(stderr, "Failed to seek end of object (object %d)\n",
-              object_count);
+    if (convert && ((collisions != NULL) || (flags & FLAGS_WIREFRAME))) {
+      /* Decode the collision boxes */
+      const int nboxes = last_collision_num + 1;
+      if ((last_collision_num < -1) ||
+          (last_collision_num >= MaxCollisionBoxes)) {
+        report(ctx, "Bad collision box count %" PRId32 " (object %d)\n",
+               last_collision_num + 1, object_count);
+        break;
+      }
+
+      if (nboxes > boxes_alloc) {
+        _Optional CollisionBox * const new_boxes =
+          realloc(boxes, sizeof(*new_boxes) * (size_t)nboxes);
+        if (new_boxes == NULL) {
+          report(ctx, "Failed to allocate memory for %d collision boxes "
+                 "(object %d)\n", nboxes, object_count);
+          break;
+        }
+        boxes = new_boxes;
+        boxes_alloc = nboxes;
+      }
+
+      if (reader_fseek(r, 8, SEEK_CUR)) {
+        report(ctx, "Failed to seek collision boxes (object %d)\n",
+               object_count);
+        break;
+      }
+
+      int b;
+      for (b = 0; b < nboxes; ++b) {
+        unsigned char bytes[CollisionBoxSize];
+        if (reader_fread(bytes, sizeof(bytes), 1, r) != 1) {
+          report(ctx, "Failed to read collision box %d (object %d)\n",
+                 b, object_count);
+          break;
+        }
+        if (!collision_decode(bytes, &*boxes + b)) {
+          report(ctx, "Bad collision box %d (object %d)\n", b,
+                 object_count);
+          break;
+        }
+      }
+      if (b < nboxes) {
+        break;
+      }
+
+      if ((collisions != NULL) &&
+          !collisions_add(&*collisions, object_count, o.type, type_count,
+                          get_vertex_scale(scale, o.type), &*boxes,
+                          nboxes)) {
+        break;
+      }
+
+      if (flags & FLAGS_WIREFRAME) {
+        if (!collision_output_wireframe(&*out, object_name, &*boxes, nboxes,
+                                        totals.vertices,
+                                        (flags & FLAGS_NEGATIVE_INDICES) ?
+                                          VertexStyle_Negative :
+                                          VertexStyle_Positive,
+                                        FLIP_Z)) {
+          report(ctx,
+                 "Failed writing to output file: %s\n",
+                 strerror(errno));
+          break;
+        }
+        totals.vertices += nboxes * CollisionCorners;
+      }
+
+      if (reader_fseek(r, 4, SEEK_CUR)) {
+        report(ctx, "Failed to seek end of object (object %d)\n",
+               object_count);
+        break;
+      }
+    } else if (reader_fseek(r, 8 + coll_size + 4, SEEK_CUR)) {
+      /* Skip the collision boxes */
+      report(ctx, "Failed to seek end of object (object %d)\n",
+             object_count);
       break;
     }
 
+    const long int obj_size = reader_ftell(r) - obj_start;
     if (flags & FLAGS_LIST) {
       if (match && !list_title) {
         puts("\nIndex  Type    Index  Name          Verts  "
@@ -1177,20 +1789,35 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
         list_title = true;
       }
 
-      const long int obj_size = reader_ftell(r) - obj_start;
       if (match) {
         printf("%5d  %-6.6s  %5d  %-12.12s  %5d  %5d  %10ld  %10ld\n",
                object_count, get_type_name(o.type), type_count,
                object_name, nvertices, num_polygons, obj_start,
                obj_size);
       }
+    }
 
-      obj_start += obj_size;
+    if (match && (summary_fn != NULL)) {
+      const ObjectSummary summary = {
+        .index = object_count,
+        .type = o.type,
+        .type_count = type_count,
+        .nvertices = nvertices,
+        .npolygons = num_polygons,
+        .plot_type = o.plot_type,
+        .offset = obj_start,
+        .size = obj_size,
+      };
+      if (!summary_fn(&summary, summary_arg)) {
+        break;
+      }
     }
 
+    obj_start += obj_size;
+
     if (!reader_fread_int32(&last_explosion_num, r)) {
-      fprintf(stderr, "Failed to read no. of explosions (object %d)\n",
-              object_count);
+      report(ctx, "Failed to read no. of explosions (object %d)\n",
+             object_count);
       break;
     }
 
@@ -1209,12 +1836,14 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
 
     ++object_count;
     ++type_counts[o.type];
+    ++nparsed;
   } while (last_explosion_num != SFObjects_EndOfData);
 
   for (int g = 0; g <= SFObjectFacet_VectorsGroup; ++g) {
     group_free(groups + g);
   }
   vertex_array_free(&varray);
+  free(boxes);
 
   if (success && (flags & FLAGS_SUMMARY)) {
     printf("\nFound %d object definition%s, comprising:\n",
@@ -1227,26 +1856,82 @@ static bool parse_objects(Reader * const r, _Optional FILE * const out,
     }
   }
 
-  if (last_explosion_num == SFObjects_EndOfData) {
+  /* Plot types may be used by objects that weren't parsed */
+  if ((last_explosion_num == SFObjects_EndOfData) && (numbers == NULL)) {
     if ((max_plot_type + 1) < num_plot_types) {
-      fprintf(stderr, "Warning: plot types %d .. %d are unused\n",
-              max_plot_type + 1, num_plot_types - 1);
+      report(ctx, "Warning: plot types %d .. %d are unused\n",
+             max_plot_type + 1, num_plot_types - 1);
     }
   }
 
   return success;
 }
 
-bool sf3k_to_obj(Reader * const in, _Optional FILE * const out,
-                 const int first, const int last, const SFObjectType type,
-                 _Optional const char * const name,
+static bool parse_file(Reader * const in, _Optional FILE * const out,
+                       const int first, const int last,
+                       const SFObjectType type,
+                       _Optional const char * const name,
+                       _Optional const Filter * const filter,
+                       _Optional const SFObjectColours * const pal,
+                       const int frame,
+                       _Optional const ObjectNumber * const numbers,
+                       const int nnumbers,
+                       _Optional ObjectSummaryFn * const summary_fn,
+                       void * const summary_arg,
+                       ConvertContext * const ctx)
+{
+  PlotType plot_types[MaxPlotType+1];
+  const int num_plot_types = parse_plot_types(in, &plot_types, ctx);
+  if (num_plot_types == -1) {
+    return false;
+  }
+
+  /* Find the first word-aligned offset at least 4 bytes ahead of the
+     plot type definitions terminator */
+  if (reader_fseek(in, WORD_ALIGN(reader_ftell(in)+3), SEEK_SET)) {
+    report(ctx, "Failed to seek first object\n");
+    return false;
+  }
+
+  return parse_objects(in, out, first, last, type, name, filter, pal, frame,
+                       &plot_types, num_plot_types, numbers, nnumbers,
+                       summary_fn, summary_arg, ctx);
+}
+
+void convert_context_init(ConvertContext * const ctx,
+                          const unsigned int flags)
+{
+  assert(ctx != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  *ctx = (ConvertContext){
+    .flags = flags,
+    .kernels = (flags & (FLAGS_VERBOSE|FLAGS_UNUSED)) ? &any_kernels :
+                                                        &quiet_kernels,
+    .diagnostic = report_stderr,
+    .diagnostic_arg = NULL,
+    .collisions = NULL,
+    .animation = NULL,
+    .bounds_list = NULL,
+    .visibility_list = NULL,
+    .clip_cache = NULL,
+    .meter = NULL,
+    .over_budget = false,
+  };
+}
+
+bool sf3k_to_obj(ConvertContext * const ctx, Reader * const in,
+                 _Optional FILE * const out, const int first, const int last,
+                 const SFObjectType type, _Optional const char * const name,
+                 _Optional const Filter * const filter,
                  _Optional const SFObjectColours * const pal,
                  const int frame, const char * const mtl_file,
-                 const unsigned int flags)
+                 _Optional const ObjectNumber * const numbers,
+                 const int nnumbers)
 {
-  bool success = true;
-  int num_plot_types = 0;
-
+  assert(ctx != NULL);
+  assert(ctx->diagnostic != NULL);
+  const unsigned int flags = ctx->flags;
   assert(in != NULL);
   assert(!reader_ferror(in));
   assert(!reader_feof(in));
@@ -1258,30 +1943,49 @@ bool sf3k_to_obj(Reader * const in, _Optional FILE * const out,
   assert(mtl_file != NULL);
   assert(!(flags & ~FLAGS_ALL));
 
-  if ((out != NULL) &&
-      fprintf(&*out, "# Star Fighter 3000 graphics\n"
-                     "# Converted by SF3KtoObj "VERSION_STRING"\n"
-                     "# Animation frame: %d\n\n"
-                     "mtllib %s\n", frame, mtl_file) < 0) {
-    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
-    success = false;
-  } else {
-    PlotType plot_types[MaxPlotType+1];
-    num_plot_types = parse_plot_types(in, &plot_types, flags);
-    if (num_plot_types == -1) {
-      success = false;
-    } else {
-      /* Find the first word-aligned offset at least 4 bytes ahead of the
-         plot type definitions terminator */
-      if (reader_fseek(in, WORD_ALIGN(reader_ftell(in)+3), SEEK_SET)) {
-        fprintf(stderr, "Failed to seek first object\n");
-        success = false;
-      } else {
-        success = parse_objects(in, out, first, last,  type, name, pal,
-                                frame, flags, &plot_types, num_plot_types);
-      }
+  if (flags & FLAGS_STREAM) {
+    /* Binary frames are written instead of text */
+    assert(out != NULL);
+    if (!stream_write_header(&*out, frame,
+                             (flags & (FLAGS_PHYSICAL_COLOUR|
+                                       FLAGS_FALSE_COLOUR)) != 0)) {
+      return false;
     }
+
+    const bool success = parse_file(in, out, first, last, type, name,
+                                    filter, pal, frame, numbers, nnumbers,
+                                    NULL, NULL, ctx);
+
+    /* The end frame tells consumers whether any objects are missing */
+    return stream_write_end(&*out, success) && success;
   }
 
-  return success;
+  if ((out != NULL) &&
+      (fprintf(&*out, "# Star Fighter 3000 graphics\n"
+                      "# Converted by SF3KtoObj "VERSION_STRING"\n"
+                      "# Animation frame: %d\n", frame) < 0 ||
+       (!(flags & FLAGS_VERTEX_COLOURS) &&
+        fprintf(&*out, "\nmtllib %s\n", mtl_file) < 0))) {
+    report(ctx, "Failed writing to output file: %s\n", strerror(errno));
+    return false;
+  }
+
+  return parse_file(in, out, first, last, type, name, filter, pal, frame,
+                    numbers, nnumbers, NULL, NULL, ctx);
+}
+
+bool sf3k_scan(ConvertContext * const ctx, Reader * const in,
+               ObjectSummaryFn * const fn, void * const arg)
+{
+  assert(ctx != NULL);
+  assert(ctx->diagnostic != NULL);
+  assert(in != NULL);
+  assert(!reader_ferror(in));
+  assert(!reader_feof(in));
+  assert(fn != NULL);
+  assert(!(ctx->flags & ~FLAGS_ALL));
+  assert(!(ctx->flags & (FLAGS_LIST|FLAGS_SUMMARY)));
+
+  return parse_file(in, NULL, 0, -1, SFObjectType_Invalid, NULL, NULL, NULL,
+                    0, NULL, 0, fn, arg, ctx);
 }
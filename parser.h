@@ -11,6 +11,14 @@
 #include <stdio.h>
 
 #include "sfformats.h"
+#include "collision.h"
+#include "animation.h"
+#include "bounds.h"
+#include "visibility.h"
+#include "filter.h"
+#include "clipcache.h"
+#include "budget.h"
+#include "names.h"
 
 #include "Reader.h"
 
@@ -18,9 +26,68 @@
 #define _Optional
 #endif
 
-bool sf3k_to_obj(Reader *in, _Optional FILE *out, int first, int last,
-                 SFObjectType type, _Optional const char *name,
+typedef struct {
+  int index;       /* Object number within the file */
+  SFObjectType type;
+  int type_count;  /* Object number among objects of the same type */
+  int nvertices;
+  int npolygons;
+  int plot_type;
+  long int offset; /* Offset of the object's explosion data */
+  long int size;
+} ObjectSummary;
+
+typedef bool ObjectSummaryFn(const ObjectSummary *summary, void *arg);
+
+/* Numbers of objects parsed from a subset of a file's object definitions */
+typedef struct {
+  int index;       /* Object number within the original file */
+  int type_count;  /* Object number among objects of the same type */
+} ObjectNumber;
+
+enum {
+  ConvertMessageSize = 256
+};
+
+/* Receives an error or warning reported during a conversion, including
+   its terminating newline */
+typedef void ConvertDiagnosticFn(const char *message, void *arg);
+
+/* Parsing loops specialised for a set of flags */
+typedef struct ParseKernels ParseKernels;
+
+/* State of one conversion or scan. Conversions that run at the same time
+   each need their own context. */
+typedef struct {
+  unsigned int flags;
+  const ParseKernels *kernels; /* Chosen from the flags on initialisation */
+  ConvertDiagnosticFn *diagnostic;
+  void *diagnostic_arg;
+  _Optional Collisions *collisions;
+  _Optional Animation *animation;
+  _Optional BoundsList *bounds_list;
+  _Optional VisibilityList *visibility_list;
+  _Optional ClipCache *clip_cache;
+  _Optional BudgetMeter *meter;
+  bool over_budget;                /* Gave up because the file exceeded
+                                      its budget */
+  char name[ObjNameSize];          /* Name of the current object */
+  char message[ConvertMessageSize]; /* Diagnostic being reported */
+} ConvertContext;
+
+/* Initialises a context that reports diagnostics on stderr and produces
+   no output other than the converted file */
+void convert_context_init(ConvertContext *ctx, unsigned int flags);
+
+bool sf3k_to_obj(ConvertContext *ctx, Reader *in, _Optional FILE *out,
+                 int first, int last, SFObjectType type,
+                 _Optional const char *name,
+                 _Optional const Filter *filter,
                  _Optional const SFObjectColours *pal, int frame,
-                 const char *mtl_file, unsigned int flags);
+                 const char *mtl_file,
+                 _Optional const ObjectNumber *numbers, int nnumbers);
+
+bool sf3k_scan(ConvertContext *ctx, Reader *in, ObjectSummaryFn *fn,
+               void *arg);
 
 #endif /* PARSER_H */
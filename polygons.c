@@ -0,0 +1,59 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Geometry of polygons
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdbool.h>
+
+/* 3DObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+
+/* Local header files */
+#include "misc.h"
+#include "polygons.h"
+
+bool polygon_normal(const VertexArray * const varray,
+                    const Primitive * const pp, double normal[3])
+{
+  assert(varray != NULL);
+  assert(pp != NULL);
+  assert(normal != NULL);
+
+  normal[0] = normal[1] = normal[2] = 0.0;
+
+  const int nsides = primitive_get_num_sides(pp);
+  for (int s = 0; s < nsides; ++s) {
+    _Optional Coord (* const a)[3] =
+      vertex_array_get_coords(varray, primitive_get_side(pp, s));
+    _Optional Coord (* const b)[3] =
+      vertex_array_get_coords(varray,
+                              primitive_get_side(pp, (s + 1) % nsides));
+    if (!a || !b) {
+      return false;
+    }
+
+    normal[0] += ((*a)[1] - (*b)[1]) * ((*a)[2] + (*b)[2]);
+    normal[1] += ((*a)[2] - (*b)[2]) * ((*a)[0] + (*b)[0]);
+    normal[2] += ((*a)[0] - (*b)[0]) * ((*a)[1] + (*b)[1]);
+  }
+
+  return true;
+}
@@ -0,0 +1,22 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Geometry of polygons
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef POLYGONS_H
+#define POLYGONS_H
+
+#include <stdbool.h>
+
+#include "Vertex.h"
+#include "Primitive.h"
+
+/* Calculates the normal of a primitive using Newell's method, which is
+   robust for concave and nearly-degenerate polygons. The normal isn't
+   scaled to unit length: its length is twice the area of the polygon.
+   Returns false if the primitive refers to a vertex that doesn't exist. */
+bool polygon_normal(const VertexArray *varray, const Primitive *pp,
+                    double normal[3]);
+
+#endif /* POLYGONS_H */
@@ -18,6 +18,11 @@
  *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#ifdef _WIN32
+#include <io.h>     /* Required for _setmode and _fileno */
+#include <fcntl.h>  /* Required for _O_BINARY */
+#endif
+
 /* ISO library header files */
 #include <limits.h>
 #include <float.h>
@@ -29,8 +34,7 @@
 #include <time.h>
 
 /* StreamLib headers */
-#include "ReaderGKey.h"
-#include "ReaderRaw.h"
+#include "ReaderMem.h"
 
 /* CBUtilLib headers */
 #include "ArgUtils.h"
@@ -42,13 +46,131 @@
 #include "flags.h"
 #include "materials.h"
 #include "version.h"
+#include "input.h"
+#include "workers.h"
+#include "stages.h"
+#include "gzout.h"
+#include "tar.h"
 
 enum {
   NColours = 320,
-  HistoryLog2 = 9 /* Base 2 logarithm of the history size used by
-                     the compression algorithm */
 };
 
+typedef struct {
+  _Optional unsigned char *data;
+  long int size;
+} Palette;
+
+typedef struct {
+  const char **input_files;
+  Palette *palettes;
+  int first;
+  int last;
+  double d;
+  int illum;
+  _Optional double (*ksp)[3];
+  double ns;
+  int sharpness;
+  double ni;
+  double (*tf)[3];
+  unsigned int flags;
+  bool time;
+  bool raw;
+  bool compress;
+} UnionJob;
+
+typedef struct {
+  int first;
+  int last;
+  double d;
+  int illum;
+  _Optional double (*ksp)[3];
+  double ns;
+  int sharpness;
+  double ni;
+  double (*tf)[3];
+  unsigned int flags;
+  bool raw;
+  bool compress;
+} TarJob;
+
+static bool write_atlas(Reader * const in, FILE * const out,
+                        const char * const atlas_file,
+                        const double d, const int illum,
+                        _Optional double (* const ksp)[3],
+                        const double ns, const int sharpness, const double ni,
+                        double (* const tf)[3], const unsigned int flags)
+{
+  assert(in != NULL);
+  assert(out != NULL);
+  assert(atlas_file != NULL);
+
+  if (flags & FLAGS_VERBOSE)
+    printf("Opening texture file '%s'\n", atlas_file);
+
+  _Optional FILE * const texture = fopen(atlas_file, "wb");
+  if (texture == NULL) {
+    fprintf(stderr, "Failed to open texture file '%s': %s\n",
+            atlas_file, strerror(errno));
+    return false;
+  }
+
+  bool success = sf3k_to_atlas(in, out, &*texture, atlas_file, d, illum, ksp,
+                               ns, sharpness, ni, tf, flags);
+
+  if (flags & FLAGS_VERBOSE)
+    puts("Closing texture file");
+
+  if (fclose(&*texture)) {
+    fprintf(stderr, "Failed to close texture file '%s': %s\n",
+            atlas_file, strerror(errno));
+    success = false;
+  }
+
+  /* Delete malformed output unless debugging is enabled */
+  if (!success && !(flags & FLAGS_VERBOSE)) {
+    remove(atlas_file);
+  }
+
+  return success;
+}
+
+static bool write_mtl(Reader * const in, FILE * const out, const bool gz,
+                      const int first, const int last,
+                      const double d, const int illum,
+                      _Optional double (* const ksp)[3],
+                      const double ns, const int sharpness, const double ni,
+                      double (* const tf)[3], const unsigned int flags,
+                      _Optional const char * const atlas_file)
+{
+  assert(in != NULL);
+  assert(out != NULL);
+
+  /* Compress output on a separate thread, if possible */
+  OutputStage stage;
+  _Optional FILE *formatted = out;
+  if (gz) {
+    formatted = output_stage_start(&stage, out, true);
+    if (formatted == NULL) {
+      return false;
+    }
+  }
+
+  bool success;
+  if (atlas_file != NULL) {
+    success = write_atlas(in, &*formatted, &*atlas_file, d, illum, ksp, ns,
+                          sharpness, ni, tf, flags);
+  } else {
+    success = sf3k_to_mtl(in, &*formatted, first, last, d, illum, ksp, ns,
+                          sharpness, ni, tf, flags);
+  }
+
+  if (gz && !output_stage_finish(&stage)) {
+    success = false;
+  }
+  return success;
+}
+
 static bool process_file(_Optional const char * const input_file,
                          _Optional const char * const output_file,
                          const int first, const int last,
@@ -57,13 +179,21 @@ static bool process_file(_Optional const char * const input_file,
                          const double ns, const int sharpness, const double ni,
                          double (* const tf)[3],
                          const unsigned int flags, const bool time,
-                         const bool raw)
+                         const bool raw, const bool compress,
+                         _Optional const char * const atlas_file,
+                         _Optional Palette * const keep)
 {
   _Optional FILE *out = NULL, *in = NULL;
+  _Optional unsigned char *data = NULL;
+  long int size = 0;
   bool success = true;
 
   assert(!(flags & ~FLAGS_ALL));
 
+  /* Output is also compressed if the file name has a gzip extension */
+  const bool gz = compress ||
+                  ((output_file != NULL) && gzout_is_gz_name(&*output_file));
+
   if (input_file != NULL) {
     /* An explicit input file name was specified, so open it */
     if (flags & FLAGS_VERBOSE)
@@ -87,7 +217,7 @@ static bool process_file(_Optional const char * const input_file,
       if (flags & FLAGS_VERBOSE)
         printf("Opening output file '%s'\n", output_file);
 
-      out = fopen(&*output_file, "w");
+      out = fopen(&*output_file, gz ? "wb" : "w");
       if (out == NULL) {
         fprintf(stderr, "Failed to open output file '%s': %s\n",
                 output_file, strerror(errno));
@@ -96,22 +226,26 @@ static bool process_file(_Optional const char * const input_file,
     } else {
       /* Default output is to standard output stream */
       out = stdout;
+#ifdef _WIN32
+      if (gz) {
+        /* Force binary mode on Windows to prevent corruption */
+        _setmode(_fileno(stdout), _O_BINARY);
+      }
+#endif
     }
   }
 
   if (success && in && out) {
     const clock_t start_time = time ? clock() : 0;
 
-    Reader r;
-    if (raw) {
-      reader_raw_init(&r, &*in);
+    data = input_load(&*in, raw, &size);
+    if (data == NULL) {
+      success = false;
     } else {
-      success = reader_gkey_init(&r, HistoryLog2, &*in);
-    }
-
-    if (success) {
-      success = sf3k_to_mtl(&r, &*out, first, last, d, illum, ksp, ns,
-                            sharpness, ni, tf, flags);
+      Reader r;
+      reader_mem_init(&r, &*data, (size_t)size);
+      success = write_mtl(&r, &*out, gz, first, last, d, illum, ksp, ns,
+                          sharpness, ni, tf, flags, atlas_file);
       reader_destroy(&r);
     }
 
@@ -145,9 +279,261 @@ static bool process_file(_Optional const char * const input_file,
     remove(&*output_file);
   }
 
+  /* Keep the palette if the caller wants to reuse it, but only if its
+     output was written successfully */
+  if (success && (keep != NULL)) {
+    keep->data = data;
+    keep->size = size;
+  } else {
+    free(data);
+  }
+
+  return success;
+}
+
+static bool process_batch_file(const char * const input_file,
+                               const int first, const int last,
+                               const double d, const int illum,
+                               _Optional double (* const ksp)[3],
+                               const double ns, const int sharpness,
+                               const double ni, double (* const tf)[3],
+                               const unsigned int flags, const bool time,
+                               const bool raw, const bool compress,
+                               _Optional Palette * const keep)
+{
+  assert(input_file != NULL);
+
+  /* Invent an output file name */
+  bool success = false;
+  StringBuffer default_output;
+  stringbuffer_init(&default_output);
+  if (!stringbuffer_append(&default_output, input_file, SIZE_MAX) ||
+      !stringbuffer_append_separated(&default_output, EXT_SEPARATOR, "mtl") ||
+      (compress &&
+       !stringbuffer_append_separated(&default_output, EXT_SEPARATOR, "gz"))) {
+    fprintf(stderr, "Failed to allocate memory for output file path\n");
+  } else {
+    success = process_file(input_file,
+                           stringbuffer_get_pointer(&default_output),
+                           first, last, d, illum, ksp, ns, sharpness, ni,
+                           tf, flags, time, raw, compress, NULL, keep);
+  }
+  stringbuffer_destroy(&default_output);
   return success;
 }
 
+static bool union_one(const int index, void * const arg)
+{
+  const UnionJob * const job = arg;
+  assert(job != NULL);
+  assert(index >= 0);
+
+  return process_batch_file(job->input_files[index], job->first, job->last,
+                            job->d, job->illum, job->ksp, job->ns,
+                            job->sharpness, job->ni, job->tf, job->flags,
+                            job->time, job->raw, job->compress,
+                            job->palettes + index);
+}
+
+static bool write_union(const char * const union_file, const int nfiles,
+                        const UnionJob * const job)
+{
+  assert(union_file != NULL);
+  assert(nfiles > 0);
+  assert(job != NULL);
+
+  /* A union of fewer palettes than were named would silently omit
+     materials, so it isn't written if any batch member failed */
+  for (int i = 0; i < nfiles; ++i) {
+    if (job->palettes[i].data == NULL) {
+      fprintf(stderr, "Not writing union output file '%s' because '%s' "
+              "failed\n", union_file, job->input_files[i]);
+      return false;
+    }
+  }
+
+  _Optional Reader * const alloc = malloc(sizeof(*alloc) * (size_t)nfiles);
+  if (alloc == NULL) {
+    fprintf(stderr, "Failed allocating memory for %d palettes\n", nfiles);
+    return false;
+  }
+  Reader * const in = &*alloc;
+
+  for (int i = 0; i < nfiles; ++i) {
+    const Palette * const palette = job->palettes + i;
+    reader_mem_init(in + i, &*palette->data, (size_t)palette->size);
+  }
+
+  if (job->flags & FLAGS_VERBOSE)
+    printf("Opening union output file '%s'\n", union_file);
+
+  bool success = true;
+  const bool gz = job->compress || gzout_is_gz_name(union_file);
+  _Optional FILE * const out = fopen(union_file, gz ? "wb" : "w");
+  if (out == NULL) {
+    fprintf(stderr, "Failed to open output file '%s': %s\n",
+            union_file, strerror(errno));
+    success = false;
+  } else {
+    OutputStage stage;
+    _Optional FILE *formatted = out;
+    if (gz) {
+      formatted = output_stage_start(&stage, &*out, true);
+    }
+
+    if (formatted == NULL) {
+      success = false;
+    } else {
+      success = sf3k_union_mtl(nfiles, in, job->input_files, &*formatted,
+                               job->first, job->last, job->d, job->illum,
+                               job->ksp, job->ns, job->sharpness, job->ni,
+                               job->tf, job->flags);
+      if (gz && !output_stage_finish(&stage)) {
+        success = false;
+      }
+    }
+
+    if (job->flags & FLAGS_VERBOSE)
+      puts("Closing union output file");
+
+    if (fclose(&*out)) {
+      fprintf(stderr, "Failed to close output file '%s': %s\n",
+              union_file, strerror(errno));
+      success = false;
+    }
+
+    /* Delete malformed output unless debugging is enabled */
+    if (!success && !(job->flags & FLAGS_VERBOSE)) {
+      remove(union_file);
+    }
+  }
+
+  for (int i = 0; i < nfiles; ++i) {
+    reader_destroy(in + i);
+  }
+  free(alloc);
+  return success;
+}
+
+static bool convert_member(FILE * const in, const long int size,
+                           const char * const name, FILE * const out,
+                           void * const arg)
+{
+  NOT_USED(name);
+  const TarJob * const job = arg;
+  assert(in != NULL);
+  assert(size >= 0);
+  assert(out != NULL);
+  assert(job != NULL);
+
+  long int dsize = 0;
+  _Optional unsigned char * const data = input_load_part(in, job->raw, size,
+                                                         -1, &dsize, NULL);
+  if (data == NULL) {
+    return false;
+  }
+
+  Reader r;
+  reader_mem_init(&r, &*data, (size_t)dsize);
+  const bool success = write_mtl(&r, out, job->compress, job->first,
+                                 job->last, job->d, job->illum, job->ksp,
+                                 job->ns, job->sharpness, job->ni, job->tf,
+                                 job->flags, NULL);
+  reader_destroy(&r);
+  free(data);
+  return success;
+}
+
+static bool process_tar(_Optional const char * const input_file,
+                        const char * const tar_output,
+                        const TarJob * const job, const bool time)
+{
+  _Optional FILE *in = NULL;
+
+  assert(tar_output != NULL);
+  assert(job != NULL);
+  assert(!(job->flags & ~FLAGS_ALL));
+
+  const clock_t start_time = time ? clock() : 0;
+
+  if (input_file != NULL) {
+    if (job->flags & FLAGS_VERBOSE)
+      printf("Opening input file '%s'\n", input_file);
+
+    in = fopen(&*input_file, "rb");
+    if (in == NULL) {
+      fprintf(stderr, "Failed to open input file '%s': %s\n",
+              input_file, strerror(errno));
+      return false;
+    }
+  } else {
+    fprintf(stderr, "Reading from stdin...\n");
+    in = stdin;
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+  }
+
+  if (job->flags & FLAGS_VERBOSE)
+    printf("Opening output file '%s'\n", tar_output);
+
+  bool success = false;
+  int nfailed = 0;
+  _Optional FILE * const out = fopen(tar_output, "wb");
+  if (out == NULL) {
+    fprintf(stderr, "Failed to open output file '%s': %s\n",
+            tar_output, strerror(errno));
+  } else {
+    /* The whole archive is compressed if its name has a gzip extension */
+    OutputStage stage;
+    _Optional FILE *archive = out;
+    const bool gz = gzout_is_gz_name(tar_output);
+    if (gz) {
+      archive = output_stage_start(&stage, &*out, true);
+    }
+
+    if (archive != NULL) {
+      nfailed = tar_convert(&*in, &*archive,
+                            job->compress ? ".mtl.gz" : ".mtl",
+                            convert_member, (void *)job,
+                            job->flags & FLAGS_VERBOSE);
+      success = (nfailed >= 0);
+
+      if (gz && !output_stage_finish(&stage)) {
+        success = false;
+      }
+    }
+
+    if (job->flags & FLAGS_VERBOSE)
+      puts("Closing output file");
+
+    if (fclose(&*out)) {
+      fprintf(stderr, "Failed to close output file '%s': %s\n",
+              tar_output, strerror(errno));
+      success = false;
+    }
+
+    /* Delete malformed output unless debugging is enabled */
+    if (!success && !(job->flags & FLAGS_VERBOSE)) {
+      remove(tar_output);
+    }
+  }
+
+  if (in != stdin) {
+    if (job->flags & FLAGS_VERBOSE)
+      puts("Closing input file");
+    fclose(&*in);
+  }
+
+  if (success && time) {
+    printf("Time taken: %.2f seconds\n",
+           (double)(clock_t)(clock() - start_time) / CLOCKS_PER_SEC);
+  }
+
+  /* The archive is kept even if some members couldn't be converted */
+  return success && (nfailed == 0);
+}
+
 static int syntax_msg(FILE * const f, const char * const path)
 {
   assert(f != NULL);
@@ -157,20 +543,30 @@ static int syntax_msg(FILE * const f, const char * const path)
   fprintf(f,
           "usage: %s [switches] [<input-file> [<output-file>]]\n"
           "or     %s -batch [switches] <file1> [<file2> .. <fileN>]\n"
+          "or     %s -union <union-file> [switches] <file1> [<file2> .. <fileN>]\n"
+          "or     %s -atlas <texture-file> [switches] [<input-file> [<output-file>]]\n"
+          "or     %s -tar <output-archive> [switches] [<input-archive>]\n"
           "If no input file is specified, it reads from stdin.\n"
           "If no output file is specified, it writes to stdout.\n"
           "In batch processing mode, output file names are generated by appending\n"
-          "extension 'mtl' to the input file names.\n", leaf, leaf);
+          "extension 'mtl' to the input file names, and likewise for the names of\n"
+          "members of an output archive.\n", leaf, leaf, leaf, leaf, leaf);
 
   fputs("Switches (names may be abbreviated):\n"
         "  -help               Display this text\n"
+        "  -atlas <name>       Write a texture atlas and one material using it\n"
         "  -batch              Process a batch of files (see above)\n"
+        "  -compress           Compress output in gzip format\n"
         "  -index N            Logical colour to convert (N=0..319, default all)\n"
         "  -first N            First logical colour to convert\n"
         "  -last N             Last logical colour to convert\n"
         "  -outfile <name>     Write output to the named file instead of stdout\n"
         "  -raw                Input is uncompressed raw data\n"
+        "  -tar <name>         Convert each file in an input tar archive to a file in\n"
+        "                      the named output archive (see above)\n"
+        "  -threads N          Number of files to convert in parallel\n"
         "  -time               Show the total time for each file processed\n"
+        "  -union <name>       Also write a library combining all input files\n"
         "  -verbose or -debug  Emit debug information (and keep bad output)\n", f);
 
   fputs("Switches to customize the output:\n"
@@ -237,12 +633,14 @@ int real_main(int argc, const char *argv[])
 int main(int argc, const char *argv[])
 #endif
 {
-  int n, first = -1, last = -1, illum = 0, sharpness = 60;
-  bool time = false, batch = false, raw = false;
+  int n, first = -1, last = -1, illum = 0, sharpness = 60, nthreads = 1;
+  bool time = false, batch = false, raw = false, compress = false;
   unsigned int flags = 0;
   bool specular = false, reflection_map = false, refraction = false;
   int rtn = EXIT_SUCCESS;
   _Optional const char *output_file = NULL, *input_file = NULL;
+  _Optional const char *union_file = NULL, *atlas_file = NULL;
+  _Optional const char *tar_output = NULL;
   double ks[3], ns = 200.0, ni = 1.0, tf[3] = {1.0, 1.0, 1.0}, d = 1.0;
   _Optional double (*ksp)[3] = NULL; /* default is to use material colour */
 
@@ -255,9 +653,19 @@ int main(int argc, const char *argv[])
   for (n = 1; n < argc && argv[n][0] == '-'; n++) {
     const char *opt = argv[n] + 1;
 
-    if (is_switch(opt, "batch", 1)) {
+    if (is_switch(opt, "atlas", 1)) {
+      /* Texture atlas file path was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing texture file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      atlas_file = argv[n];
+    } else if (is_switch(opt, "batch", 1)) {
       /* Enable batch processing mode */
       batch = true;
+    } else if (is_switch(opt, "compress", 1)) {
+      /* Enable compression of output */
+      compress = true;
     } else if (is_switch(opt, "d", 1)) {
       /* Dissolve factor was specified */
       if (!get_double_arg("dissolve factor", &d, 0.0, 1.0, argc, argv, ++n)) {
@@ -368,6 +776,13 @@ int main(int argc, const char *argv[])
         return syntax_msg(stderr, argv[0]);
       }
       sharpness = (int)tmp;
+    } else if (is_switch(opt, "tar", 2)) {
+      /* Output archive path was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing archive file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      tar_output = argv[n];
     } else if (is_switch(opt, "tf", 2)) {
       /* Transmission filter was specified */
       refraction = true;
@@ -404,9 +819,24 @@ int main(int argc, const char *argv[])
           }
         }
       }
+    } else if (is_switch(opt, "threads", 2)) {
+      /* Number of files to convert in parallel was specified */
+      long int num;
+      if (!get_long_arg("threads", &num, 1, INT_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      nthreads = (int)num;
     } else if (is_switch(opt, "time", 2)) {
       /* Enable timing */
       time = true;
+    } else if (is_switch(opt, "union", 1)) {
+      /* Union library file path was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing union file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      union_file = argv[n];
+      batch = true;
     } else if (is_switch(opt, "verbose", 1) || is_switch(opt, "debug", 2)) {
       /* Enable debugging output */
       flags |= FLAGS_VERBOSE;
@@ -420,6 +850,19 @@ int main(int argc, const char *argv[])
     fputs("First colour number must not exceed last colour number\n", stderr);
     return EXIT_FAILURE;
   }
+  if ((atlas_file != NULL) &&
+      (batch || (first != -1) || (last != -1) ||
+       (flags & FLAGS_HUMAN_READABLE))) {
+    fputs("Cannot select colours, use human-readable names or process a "
+          "batch with -atlas\n", stderr);
+    return syntax_msg(stderr, argv[0]);
+  }
+  if ((tar_output != NULL) &&
+      (batch || (atlas_file != NULL) || (output_file != NULL))) {
+    fputs("Cannot process a batch, write an atlas or specify an output "
+          "file with -tar\n", stderr);
+    return syntax_msg(stderr, argv[0]);
+  }
   if (first == -1) {
     first = 0;
   }
@@ -440,7 +883,22 @@ int main(int argc, const char *argv[])
     return syntax_msg(stderr, argv[0]);
   }
 
-  if (batch) {
+  if (tar_output != NULL) {
+    /* The input archive may be specified, otherwise stdin is read */
+    if (n < argc) {
+      input_file = argv[n++];
+    }
+    if (n < argc) {
+      fputs("Too many arguments (an archive is converted from one input "
+            "archive)\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+  } else if (batch) {
+    /* Ensure that debug output from different files isn't mixed up */
+    if ((nthreads > 1) && (flags & FLAGS_VERBOSE)) {
+      fputs("Cannot use more than one thread in verbose mode\n", stderr);
+      return EXIT_FAILURE;
+    }
     if (output_file != NULL) {
       fputs("Cannot specify an output file in batch processing mode\n", stderr);
       return syntax_msg(stderr, argv[0]);
@@ -481,28 +939,82 @@ int main(int argc, const char *argv[])
            "Copyright (C) 2016, Christopher Bazley\n");
   }
 
-  if (batch) {
+  if (tar_output != NULL) {
+    const TarJob job = {
+      .first = first,
+      .last = last,
+      .d = d,
+      .illum = illum,
+      .ksp = ksp,
+      .ns = ns,
+      .sharpness = sharpness,
+      .ni = ni,
+      .tf = &tf,
+      .flags = flags,
+      .raw = raw,
+      .compress = compress,
+    };
+    if (!process_tar(input_file, &*tar_output, &job, time)) {
+      rtn = EXIT_FAILURE;
+    }
+  } else if (batch) {
     /* In batch processing mode, there remaining arguments are treated as a
        list of file names (output to default file names) */
-    for (; n < argc && rtn == EXIT_SUCCESS; n++) {
-      /* Invent an output file name */
-      assert(argv[n] != NULL);
-      StringBuffer default_output;
-      stringbuffer_init(&default_output);
-      if (!stringbuffer_append(&default_output, argv[n], SIZE_MAX) ||
-          !stringbuffer_append_separated(&default_output, EXT_SEPARATOR, "mtl")) {
-        fprintf(stderr, "Failed to allocate memory for output file path\n");
+    const int nfiles = argc - n;
+    _Optional Palette * const palettes = union_file == NULL ? NULL :
+                                         calloc((size_t)nfiles,
+                                                sizeof(*palettes));
+    if ((union_file != NULL) && (palettes == NULL)) {
+      fprintf(stderr, "Failed allocating memory for %d palettes\n", nfiles);
+      return EXIT_FAILURE;
+    }
+
+    UnionJob job = {
+      .input_files = argv + n,
+      .palettes = &*palettes,
+      .first = first,
+      .last = last,
+      .d = d,
+      .illum = illum,
+      .ksp = ksp,
+      .ns = ns,
+      .sharpness = sharpness,
+      .ni = ni,
+      .tf = &tf,
+      .flags = flags,
+      .time = time,
+      .raw = raw,
+      .compress = compress,
+    };
+
+    if (union_file != NULL) {
+      /* Palettes are independent until their union is written.
+         write_union also checks that every palette was kept. */
+      if (!workers_run(nthreads, nfiles, union_one, &job)) {
         rtn = EXIT_FAILURE;
-      } else if (!process_file(argv[n], stringbuffer_get_pointer(&default_output),
-                               first, last, d, illum, ksp, ns, sharpness, ni,
-                               &tf, flags, time, raw)) {
+      }
+      if (!write_union(&*union_file, nfiles, &job)) {
         rtn = EXIT_FAILURE;
       }
-      stringbuffer_destroy(&default_output);
+
+      for (int i = 0; i < nfiles; ++i) {
+        free((&*palettes)[i].data);
+      }
+      free(palettes);
+    } else {
+      for (; n < argc && rtn == EXIT_SUCCESS; n++) {
+        assert(argv[n] != NULL);
+        if (!process_batch_file(argv[n], first, last, d, illum, ksp, ns,
+                                sharpness, ni, &tf, flags, time, raw,
+                                compress, NULL)) {
+          rtn = EXIT_FAILURE;
+        }
+      }
     }
   } else {
     if (!process_file(input_file, output_file, first, last, d, illum, ksp, ns,
-                      sharpness, ni, &tf, flags, time, raw)) {
+                      sharpness, ni, &tf, flags, time, raw, compress,
+                      atlas_file, NULL)) {
       rtn = EXIT_FAILURE;
     }
   }
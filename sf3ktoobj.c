@@ -25,6 +25,7 @@
 
 /* ISO library header files */
 #include <limits.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,8 +34,7 @@
 #include <time.h>
 
 /* StreamLib headers */
-#include "ReaderGKey.h"
-#include "ReaderRaw.h"
+#include "ReaderMem.h"
 
 /* CBUtilLib headers */
 #include "ArgUtils.h"
@@ -47,115 +47,1343 @@
 #include "flags.h"
 #include "parser.h"
 #include "version.h"
+#include "input.h"
+#include "workers.h"
+#include "catalog.h"
+#include "chunks.h"
+#include "names.h"
+#include "stages.h"
+#include "gzout.h"
+#include "tar.h"
+#include "filter.h"
+#include "watch.h"
 
 enum {
-  HistoryLog2 = 9 /* Base 2 logarithm of the history size used by
-                     the compression algorithm */
+  PipelineDepth = 2, /* Number of input files to load in advance */
+  InitialRanges = 64,
+  InitialWatched = 16,
+  InitialTargets = 16,
 };
 
-static bool process_file(_Optional const char * const input_file,
-                         _Optional const char * const output_file,
-                         const int first, const int last,
-                         const SFObjectType type, _Optional const char * const name,
-                         _Optional SFObjectColours * const pal, const int frame,
-                         const char * const mtl_file,
-                         const unsigned int flags, const bool time,
-                         const bool raw)
+typedef struct {
+  bool success;
+  long int offset; /* Offset at which validation stopped, or -1 */
+  StringBuffer messages; /* Diagnostics to be shown with the result */
+} CheckResult;
+
+typedef struct {
+  const char **input_files;
+  CheckResult *results;
+  const char *mtl_file;
+  unsigned int flags;
+  bool raw;
+} CheckJob;
+
+typedef struct {
+  char name[ObjNameSize]; /* Object name, or empty if selected by number */
+  int index;              /* Object number, or -1 if not yet found */
+  SFObjectType type;      /* Type of the named object, if the name is valid */
+  int type_count;         /* Index of the named object within its type */
+  bool found;
+} Target;
+
+typedef struct {
+  _Optional Target *targets;
+  int ntargets;
+  int nalloc;
+} TargetList;
+
+typedef struct {
+  int first;
+  int last;
+  SFObjectType type;
+  _Optional const char *name;
+  _Optional const Filter *filter;
+  _Optional const TargetList *targets; /* Objects to extract, if any */
+} Selection;
+
+typedef struct {
+  _Optional unsigned char *data;
+  long int size;
+  _Optional ObjectNumber *numbers; /* Numbers of the objects in a chunked
+                                      file, or NULL if all are present */
+  int nnumbers;
+  bool over_budget; /* Loading failed because of the memory budget */
+} LoadedInput;
+
+typedef enum {
+  ConvertResult_OK,
+  ConvertResult_Failed,
+  ConvertResult_OverBudget /* The file exceeded its budget */
+} ConvertResult;
+
+typedef struct {
+  const char **input_files;
+  LoadedInput *inputs;
+  const Selection *sel;
+  _Optional const Budget *budget;
+  unsigned int flags;
+  bool raw;
+} LoadJob;
+
+typedef struct {
+  const char **input_files;
+  const Selection *sel;
+  _Optional SFObjectColours *pal;
+  _Optional ClipCache *clip_cache;
+  _Optional const Budget *budget;
+  int frame;
+  const char *mtl_file;
+  unsigned int flags;
+  bool raw;
+  bool compress;
+} ConvertJob;
+
+typedef struct {
+  const Selection *sel;
+  _Optional SFObjectColours *pal;
+  _Optional ClipCache *clip_cache;
+  _Optional const Budget *budget;
+  int frame;
+  const char *mtl_file;
+  unsigned int flags;
+  bool raw;
+  bool compress;
+} TarJob;
+
+typedef struct {
+  long int offset;
+  long int size;
+} ObjectRange;
+
+typedef struct {
+  _Optional ObjectRange *objects;
+  int nobjects;
+  int nalloc;
+} RangeList;
+
+typedef struct {
+  _Optional char *input_file;
+  LoadedInput loaded;  /* Input data from which the output was converted */
+  RangeList ranges;    /* Location of each object in the input data */
+  bool converted;
+} WatchedFile;
+
+typedef struct {
+  const Selection *sel;
+  _Optional SFObjectColours *pal;
+  _Optional ClipCache *clip_cache;
+  _Optional const Budget *budget;
+  int frame;
+  const char *mtl_file;
+  unsigned int flags;
+  bool time;
+  bool raw;
+  bool compress;
+  _Optional WatchedFile *files;
+  int nfiles;
+  int nalloc;
+} WatchJob;
+
+enum {
+  WatchTag_Input,
+  WatchTag_Palette,
+};
+
+typedef bool WriteFn(FILE *out, const void *data);
+
+typedef struct {
+  _Optional ChunkInfo *chunks;
+  int nchunks;
+  int nalloc;
+} ChunkList;
+
+/* Finds the first target that is the given object and hasn't already been
+   found, or returns -1 */
+static int is_target(const TargetList * const list, const int index,
+                     const char * const obj_name)
+{
+  assert(list != NULL);
+  assert(index >= 0);
+  assert(obj_name != NULL);
+
+  for (int t = 0; t < list->ntargets; ++t) {
+    const Target * const target = &*list->targets + t;
+    if (!target->found &&
+        (target->name[0] != '\0' ? !strcmp(target->name, obj_name) :
+                                     (target->index == index))) {
+      return t;
+    }
+  }
+  return -1;
+}
+
+/* Chunks are selected on the thread that loads them, so object names
+   are found beforehand instead of being generated for each chunk */
+typedef struct {
+  const Selection *sel;
+  SFObjectType name_type; /* Invalid if no object has the selected name */
+  int name_count;
+} ChunkSelection;
+
+static bool is_chunk_target(const TargetList * const list,
+                            const ChunkInfo * const chunk)
+{
+  assert(list != NULL);
+  assert(chunk != NULL);
+
+  for (int t = 0; t < list->ntargets; ++t) {
+    const Target * const target = &*list->targets + t;
+    if (!target->found &&
+        (target->name[0] != '\0' ?
+           ((target->type == chunk->type) &&
+            (target->type_count == chunk->type_count)) :
+           (target->index == chunk->index))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool select_chunk(const ChunkInfo * const chunk, void * const arg)
+{
+  const ChunkSelection * const chunk_sel = arg;
+  assert(chunk != NULL);
+  assert(chunk->index >= 0);
+  assert(chunk_sel != NULL);
+
+  const Selection * const sel = chunk_sel->sel;
+  if (sel->targets != NULL) {
+    return is_chunk_target(&*sel->targets, chunk);
+  }
+
+  /* Objects are selected in the same way as by the parser */
+  if ((sel->type != SFObjectType_Invalid) && (chunk->type != sel->type)) {
+    return false;
+  }
+
+  const int req_index = (sel->type != SFObjectType_Invalid) ?
+                        chunk->type_count : chunk->index;
+  if ((req_index < sel->first) ||
+      ((sel->last != -1) && (req_index > sel->last))) {
+    return false;
+  }
+
+  return (sel->name == NULL) ||
+         ((chunk->type == chunk_sel->name_type) &&
+          (chunk->type_count == chunk_sel->name_count));
+}
+
+static void free_input(LoadedInput * const loaded)
+{
+  assert(loaded != NULL);
+  free(loaded->data);
+  loaded->data = NULL;
+  free(loaded->numbers);
+  loaded->numbers = NULL;
+}
+
+static bool load_stream(FILE * const in, const long int limit,
+                        const Selection * const sel,
+                        _Optional const Budget * const budget,
+                        const unsigned int flags, const bool raw,
+                        LoadedInput * const loaded)
+{
+  assert(in != NULL);
+  assert(sel != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+  assert(loaded != NULL);
+
+  *loaded = (LoadedInput){
+    .data = NULL,
+    .size = 0,
+    .numbers = NULL,
+    .nnumbers = 0,
+    .over_budget = false,
+  };
+
+  const long int max_size = ((budget != NULL) && (budget->memory > 0)) ?
+                            budget->memory : -1;
+
+  if (!(flags & (FLAGS_LIST|FLAGS_SUMMARY)) && chunks_is_chunked(in)) {
+    /* Only decompress the chunks containing selected objects. Listing
+       shows offsets and summaries count objects, so they need all. */
+    ChunkSelection chunk_sel = {
+      .sel = sel,
+      .name_type = SFObjectType_Invalid,
+      .name_count = 0,
+    };
+    if ((sel->name != NULL) &&
+        !find_obj_name(&*sel->name, &chunk_sel.name_type,
+                       &chunk_sel.name_count)) {
+      chunk_sel.name_type = SFObjectType_Invalid;
+    }
+    loaded->data = chunks_load(in, select_chunk, &chunk_sel, &loaded->size,
+                               &loaded->numbers, &loaded->nnumbers);
+    if ((loaded->data != NULL) && (max_size >= 0) &&
+        (loaded->size > max_size)) {
+      fprintf(stderr, "Input data of %ld bytes exceeds the memory budget "
+              "of %ld bytes\n", loaded->size, max_size);
+      free_input(loaded);
+      loaded->over_budget = true;
+    }
+  } else {
+    loaded->data = input_load_part(in, raw, limit, max_size, &loaded->size,
+                                   &loaded->over_budget);
+  }
+
+  return loaded->data != NULL;
+}
+
+static bool load_input(_Optional const char * const input_file,
+                       const Selection * const sel,
+                       _Optional const Budget * const budget,
+                       const unsigned int flags, const bool raw,
+                       LoadedInput * const loaded)
+{
+  _Optional FILE *in = NULL;
+
+  assert(sel != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+  assert(loaded != NULL);
+
+  *loaded = (LoadedInput){
+    .data = NULL,
+    .size = 0,
+    .numbers = NULL,
+    .nnumbers = 0,
+    .over_budget = false,
+  };
+
+  if (input_file != NULL) {
+    /* An explicit input file name was specified, so open it */
+    if (flags & FLAGS_VERBOSE)
+      printf("Opening input file '%s'\n", input_file);
+
+    in = fopen(&*input_file, "rb");
+    if (in == NULL) {
+      fprintf(stderr, "Failed to open input file '%s': %s\n",
+              input_file, strerror(errno));
+      return false;
+    }
+  } else {
+    /* Default input is from standard input stream */
+    fprintf(stderr, "Reading from stdin...\n");
+    in = stdin;
+#ifdef _WIN32
+    /* Force binary mode on Windows to prevent corruption */
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+  }
+
+  const bool success = load_stream(&*in, -1, sel, budget, flags, raw,
+                                   loaded);
+
+  if (in != stdin) {
+    if (flags & FLAGS_VERBOSE)
+      puts("Closing input file");
+    fclose(&*in);
+  }
+
+  return success;
+}
+
+/* Writes data to a named file by calling a function, and deletes the file
+   if that fails */
+static bool write_file(const char * const file_name, WriteFn * const fn,
+                       const void * const data, const unsigned int flags)
+{
+  assert(file_name != NULL);
+  assert(fn != NULL);
+  assert(data != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (flags & FLAGS_VERBOSE)
+    printf("Opening output file '%s'\n", file_name);
+
+  _Optional FILE * const out = fopen(file_name, "wb");
+  if (out == NULL) {
+    fprintf(stderr, "Failed to open output file '%s': %s\n",
+            file_name, strerror(errno));
+    return false;
+  }
+
+  bool success = fn(&*out, data);
+
+  if (flags & FLAGS_VERBOSE)
+    puts("Closing output file");
+
+  if (fclose(&*out)) {
+    fprintf(stderr, "Failed to close output file '%s': %s\n",
+            file_name, strerror(errno));
+    success = false;
+  }
+
+  /* Delete malformed output unless debugging is enabled */
+  if (!success && !(flags & FLAGS_VERBOSE)) {
+    remove(file_name);
+  }
+
+  return success;
+}
+
+static bool write_collisions(FILE * const out, const void * const data)
+{
+  return collisions_write(out, data);
+}
+
+static bool write_animation(FILE * const out, const void * const data)
+{
+  return animation_write(out, data);
+}
+
+static bool write_bounds(FILE * const out, const void * const data)
+{
+  return bounds_list_write(out, data);
+}
+
+static bool write_visibility(FILE * const out, const void * const data)
+{
+  return visibility_list_write(out, data);
+}
+
+static ConvertResult convert_input(const LoadedInput * const loaded,
+                                  _Optional const char * const output_file,
+                                  const Selection * const sel,
+                                  _Optional SFObjectColours * const pal,
+                                  _Optional ClipCache * const clip_cache,
+                                  _Optional const Budget * const budget,
+                                  const int frame, const char * const mtl_file,
+                                  const unsigned int flags, const bool pipeline,
+                                  const bool compress,
+                                  _Optional const char * const collision_file,
+                                  _Optional const char * const animation_file,
+                                  _Optional const char * const bounds_file,
+                                  _Optional const char * const visibility_file)
+{
+  _Optional FILE *out = NULL;
+  bool success = true, over_budget = false;
+
+  assert(loaded != NULL);
+  assert(loaded->data != NULL);
+  assert(sel != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  /* Output is also compressed if the file name has a gzip extension */
+  const bool gz = compress ||
+                  ((output_file != NULL) && gzout_is_gz_name(&*output_file));
+
+  if (flags & (FLAGS_LIST|FLAGS_SUMMARY)) {
+    out = NULL; /* No OBJ-format output */
+  } else if (output_file != NULL) {
+    if (flags & FLAGS_VERBOSE)
+      printf("Opening output file '%s'\n", output_file);
+
+    out = fopen(&*output_file, (gz || (flags & FLAGS_STREAM)) ? "wb" : "w");
+    if (out == NULL) {
+      fprintf(stderr, "Failed to open output file '%s': %s\n",
+              output_file, strerror(errno));
+      return ConvertResult_Failed;
+    }
+  } else {
+    /* Default output is to standard output stream */
+    out = stdout;
+#ifdef _WIN32
+    if (gz || (flags & FLAGS_STREAM)) {
+      /* Force binary mode on Windows to prevent corruption */
+      _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+  }
+
+  /* Formatting can overlap with writing (and compression) if output is
+     handed over to a separate thread */
+  OutputStage stage;
+  _Optional FILE *formatted = out;
+  const bool staged = (pipeline || gz) && (out != NULL);
+  if (staged) {
+    formatted = output_stage_start(&stage, &*out, gz);
+    if (formatted == NULL) {
+      success = false;
+    }
+  }
+
+  Collisions collisions;
+  collisions_init(&collisions);
+  Animation animation;
+  animation_init(&animation);
+  BoundsList bounds_list;
+  bounds_list_init(&bounds_list);
+  VisibilityList visibility_list;
+  visibility_list_init(&visibility_list);
+
+  if (success) {
+    /* Time spent loading input is not charged to the budget because its
+       size is limited separately */
+    BudgetMeter meter;
+    if (budget != NULL) {
+      budget_meter_start(&meter, &*budget);
+    }
+
+    ConvertContext ctx;
+    convert_context_init(&ctx, flags);
+    ctx.collisions = collision_file ? &collisions : NULL;
+    ctx.animation = animation_file ? &animation : NULL;
+    ctx.bounds_list = bounds_file ? &bounds_list : NULL;
+    ctx.visibility_list = visibility_file ? &visibility_list : NULL;
+    ctx.clip_cache = clip_cache;
+    ctx.meter = (budget != NULL) ? &meter : NULL;
+
+    Reader r;
+    reader_mem_init(&r, &*loaded->data, (size_t)loaded->size);
+    success = sf3k_to_obj(&ctx, &r, formatted, sel->first, sel->last,
+                          sel->type, sel->name, sel->filter, pal, frame,
+                          mtl_file, loaded->numbers, loaded->nnumbers);
+    over_budget = ctx.over_budget;
+    reader_destroy(&r);
+
+    if (staged && !output_stage_finish(&stage)) {
+      success = false;
+    }
+  }
+
+  if (success && (collision_file != NULL)) {
+    success = write_file(&*collision_file, write_collisions,
+                         &collisions, flags);
+  }
+  collisions_free(&collisions);
+
+  if (success && (animation_file != NULL)) {
+    success = write_file(&*animation_file, write_animation, &animation, flags);
+  }
+  animation_free(&animation);
+
+  if (success && (bounds_file != NULL)) {
+    success = write_file(&*bounds_file, write_bounds, &bounds_list, flags);
+  }
+  bounds_list_free(&bounds_list);
+
+  if (success && (visibility_file != NULL)) {
+    success = write_file(&*visibility_file, write_visibility,
+                         &visibility_list, flags);
+  }
+  visibility_list_free(&visibility_list);
+
+  if (out != NULL && out != stdout) {
+    if (flags & FLAGS_VERBOSE)
+      puts("Closing output file");
+
+    if (fclose(&*out)) {
+      fprintf(stderr, "Failed to close output file '%s': %s\n",
+                      output_file, strerror(errno));
+      success = false;
+    }
+  }
+
+  /* Delete malformed output unless debugging is enabled */
+  if (!success && !(flags & FLAGS_VERBOSE) && out != NULL && out != stdout &&
+      output_file) {
+    remove(&*output_file);
+  }
+
+  if (success) {
+    return ConvertResult_OK;
+  }
+  return over_budget ? ConvertResult_OverBudget : ConvertResult_Failed;
+}
+
+static void print_time(const clock_t start_time)
+{
+  printf("Time taken: %.2f seconds\n",
+         (double)(clock_t)(clock() - start_time) / CLOCKS_PER_SEC);
+}
+
+static ConvertResult process_file(_Optional const char * const input_file,
+                                  _Optional const char * const output_file,
+                                  const Selection * const sel,
+                                  _Optional SFObjectColours * const pal,
+                                  _Optional ClipCache * const clip_cache,
+                                  _Optional const Budget * const budget,
+                                  const int frame, const char * const mtl_file,
+                                  const unsigned int flags, const bool time,
+                                  const bool raw, const bool pipeline,
+                                  const bool compress,
+                                  _Optional const char * const collision_file,
+                                  _Optional const char * const animation_file,
+                                  _Optional const char * const bounds_file,
+                                  _Optional const char * const visibility_file)
+{
+  assert(sel != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  const clock_t start_time = time ? clock() : 0;
+
+  LoadedInput loaded;
+  ConvertResult result = ConvertResult_Failed;
+  if (load_input(input_file, sel, budget, flags, raw, &loaded)) {
+    result = convert_input(&loaded, output_file, sel, pal, clip_cache,
+                           budget, frame, mtl_file, flags, pipeline,
+                           compress, collision_file, animation_file,
+                           bounds_file, visibility_file);
+  } else if (loaded.over_budget) {
+    result = ConvertResult_OverBudget;
+  }
+  free_input(&loaded);
+
+  if ((result == ConvertResult_OK) && time) {
+    print_time(start_time);
+  }
+
+  return result;
+}
+
+static ConvertResult convert_batch_file(const char * const input_file,
+                                        const Selection * const sel,
+                                        _Optional SFObjectColours * const pal,
+                                        _Optional ClipCache * const clip_cache,
+                                        _Optional const Budget * const budget,
+                                        const int frame,
+                                        const char * const mtl_file,
+                                        const unsigned int flags,
+                                        const bool time, const bool raw,
+                                        const bool compress)
+{
+  assert(input_file != NULL);
+  assert(sel != NULL);
+  assert(mtl_file != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  /* Invent an output file name */
+  StringBuffer default_output;
+  stringbuffer_init(&default_output);
+  ConvertResult result = ConvertResult_Failed;
+  if (!stringbuffer_append(&default_output, input_file, SIZE_MAX) ||
+      !stringbuffer_append_separated(&default_output, EXT_SEPARATOR,
+                                     "obj") ||
+      (compress &&
+       !stringbuffer_append_separated(&default_output, EXT_SEPARATOR,
+                                      "gz"))) {
+    fprintf(stderr, "Failed to allocate memory for output file path\n");
+  } else {
+    result = process_file(input_file,
+                          stringbuffer_get_pointer(&default_output),
+                          sel, pal, clip_cache, budget, frame, mtl_file,
+                          flags, time, raw, false, compress, NULL, NULL,
+                          NULL, NULL);
+  }
+  stringbuffer_destroy(&default_output);
+  return result;
+}
+
+static bool convert_one(const int index, void * const arg)
+{
+  const ConvertJob * const job = arg;
+  assert(job != NULL);
+  assert(index >= 0);
+
+  return convert_batch_file(job->input_files[index], job->sel, job->pal,
+                            job->clip_cache, job->budget, job->frame,
+                            job->mtl_file, job->flags, false, job->raw,
+                            job->compress) == ConvertResult_OK;
+}
+
+static bool load_one(const int index, void * const arg)
+{
+  const LoadJob * const job = arg;
+  assert(job != NULL);
+  assert(index >= 0);
+
+  return load_input(job->input_files[index], job->sel, job->budget,
+                    job->flags, job->raw, job->inputs + index);
+}
+
+/* Holds back a diagnostic until the result of a check is printed, so that
+   messages about files checked at the same time aren't mixed up */
+static void add_message(const char * const message, void * const arg)
+{
+  StringBuffer * const messages = arg;
+  assert(message != NULL);
+  assert(messages != NULL);
+
+  if (!stringbuffer_append(messages, message, SIZE_MAX)) {
+    fputs(message, stderr);
+  }
+}
+
+static bool check_file(_Optional const char * const input_file,
+                       const char * const mtl_file,
+                       const unsigned int flags, const bool raw,
+                       CheckResult * const result)
+{
+  _Optional FILE *in = NULL;
+
+  assert(mtl_file != NULL);
+  assert(flags & FLAGS_CHECK);
+  assert(!(flags & ~FLAGS_ALL));
+  assert(result != NULL);
+
+  *result = (CheckResult){.success = false, .offset = -1};
+  stringbuffer_init(&result->messages);
+
+  if (input_file != NULL) {
+    if (flags & FLAGS_VERBOSE)
+      printf("Opening input file '%s'\n", input_file);
+
+    in = fopen(&*input_file, "rb");
+    if (in == NULL) {
+      char message[ConvertMessageSize];
+      snprintf(message, sizeof(message),
+               "Failed to open input file '%s': %s\n", input_file,
+               strerror(errno));
+      add_message(message, &result->messages);
+    }
+  } else {
+    fprintf(stderr, "Reading from stdin...\n");
+    in = stdin;
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+  }
+
+  if (in != NULL) {
+    long int size = 0;
+    _Optional unsigned char * const data =
+      input_load_report(&*in, raw, &size, add_message, &result->messages);
+    if (data != NULL) {
+      ConvertContext ctx;
+      convert_context_init(&ctx, flags);
+      ctx.diagnostic = add_message;
+      ctx.diagnostic_arg = &result->messages;
+      Reader r;
+      reader_mem_init(&r, &*data, (size_t)size);
+      result->success = sf3k_to_obj(&ctx, &r, NULL, 0, -1,
+                                    SFObjectType_Invalid, NULL, NULL, NULL, 0,
+                                    mtl_file, NULL, 0);
+      if (!result->success) {
+        result->offset = reader_ftell(&r);
+      }
+      reader_destroy(&r);
+      free(data);
+    }
+
+    if (in != stdin) {
+      if (flags & FLAGS_VERBOSE)
+        puts("Closing input file");
+      fclose(&*in);
+    }
+  }
+
+  return result->success;
+}
+
+static bool add_chunk(ChunkList * const list, const ChunkInfo * const info)
+{
+  assert(list != NULL);
+  assert(info != NULL);
+
+  if (list->nchunks >= list->nalloc) {
+    const int nalloc = list->nalloc > 0 ? list->nalloc * 2 : 32;
+    _Optional ChunkInfo * const chunks = realloc(list->chunks,
+                                                 sizeof(*chunks) *
+                                                 (size_t)nalloc);
+    if (chunks == NULL) {
+      fprintf(stderr, "Failed allocating memory for chunks\n");
+      return false;
+    }
+    list->chunks = chunks;
+    list->nalloc = nalloc;
+  }
+
+  (&*list->chunks)[list->nchunks++] = *info;
+  return true;
+}
+
+static bool add_object_chunk(const ObjectSummary * const summary,
+                             void * const arg)
+{
+  ChunkList * const list = arg;
+  assert(summary != NULL);
+  assert(list != NULL);
+
+  /* The plot type definitions precede the first object */
+  if (list->nchunks == 0) {
+    const ChunkInfo header = {
+      .offset = 0,
+      .size = summary->offset,
+      .index = -1,
+      .type = SFObjectType_Invalid,
+      .type_count = 0,
+    };
+    if (!add_chunk(list, &header)) {
+      return false;
+    }
+  }
+
+  const ChunkInfo object = {
+    .offset = summary->offset,
+    .size = summary->size,
+    .index = summary->index,
+    .type = summary->type,
+    .type_count = summary->type_count,
+  };
+  return add_chunk(list, &object);
+}
+
+static bool chunk_file(_Optional const char * const input_file,
+                       const char * const chunk_file,
+                       const unsigned int flags, const bool raw)
+{
+  _Optional FILE *in = NULL;
+  bool success = false;
+
+  assert(chunk_file != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (input_file != NULL) {
+    if (flags & FLAGS_VERBOSE)
+      printf("Opening input file '%s'\n", input_file);
+
+    in = fopen(&*input_file, "rb");
+    if (in == NULL) {
+      fprintf(stderr, "Failed to open input file '%s': %s\n",
+              input_file, strerror(errno));
+      return false;
+    }
+  } else {
+    fprintf(stderr, "Reading from stdin...\n");
+    in = stdin;
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+  }
+
+  long int size = 0;
+  _Optional unsigned char * const data = input_load(&*in, raw, &size);
+
+  if (in != stdin) {
+    if (flags & FLAGS_VERBOSE)
+      puts("Closing input file");
+    fclose(&*in);
+  }
+
+  if (data == NULL) {
+    return false;
+  }
+
+  /* Find the boundaries of every object (and validate them) */
+  ChunkList list = {.chunks = NULL, .nchunks = 0, .nalloc = 0};
+  ConvertContext ctx;
+  convert_context_init(&ctx, flags | FLAGS_CHECK);
+  Reader r;
+  reader_mem_init(&r, &*data, (size_t)size);
+  const bool scanned = sf3k_scan(&ctx, &r, add_object_chunk, &list);
+  reader_destroy(&r);
+
+  if (scanned && (list.chunks != NULL)) {
+    /* The end-of-file marker (and anything after it) follows the last
+       object */
+    const ChunkInfo * const last = &*list.chunks + list.nchunks - 1;
+    const ChunkInfo trailer = {
+      .offset = last->offset + last->size,
+      .size = size - (last->offset + last->size),
+      .index = -1,
+      .type = SFObjectType_Invalid,
+      .type_count = 0,
+    };
+
+    if (add_chunk(&list, &trailer)) {
+      if (flags & FLAGS_VERBOSE)
+        printf("Opening output file '%s'\n", chunk_file);
+
+      _Optional FILE * const out = fopen(chunk_file, "wb");
+      if (out == NULL) {
+        fprintf(stderr, "Failed to open output file '%s': %s\n",
+                chunk_file, strerror(errno));
+      } else {
+        success = chunks_write(&*out, &*data, &*list.chunks, list.nchunks);
+
+        if (flags & FLAGS_VERBOSE)
+          puts("Closing output file");
+
+        if (fclose(&*out)) {
+          fprintf(stderr, "Failed to close output file '%s': %s\n",
+                  chunk_file, strerror(errno));
+          success = false;
+        }
+
+        /* Delete malformed output unless debugging is enabled */
+        if (!success && !(flags & FLAGS_VERBOSE)) {
+          remove(chunk_file);
+        }
+      }
+    }
+  }
+
+  free(list.chunks);
+  free(data);
+  return success;
+}
+
+static bool convert_member(FILE * const in, const long int size,
+                           const char * const name, FILE * const out,
+                           void * const arg)
+{
+  NOT_USED(name);
+  const TarJob * const job = arg;
+  assert(in != NULL);
+  assert(size >= 0);
+  assert(out != NULL);
+  assert(job != NULL);
+
+  LoadedInput loaded;
+  bool success = load_stream(in, size, job->sel, job->budget, job->flags,
+                             job->raw, &loaded);
+  if (success) {
+    OutputStage stage;
+    _Optional FILE *formatted = out;
+    if (job->compress) {
+      formatted = output_stage_start(&stage, out, true);
+      if (formatted == NULL) {
+        success = false;
+      }
+    }
+
+    if (success) {
+      BudgetMeter meter;
+      if (job->budget != NULL) {
+        budget_meter_start(&meter, &*job->budget);
+      }
+
+      ConvertContext ctx;
+      convert_context_init(&ctx, job->flags);
+      ctx.clip_cache = job->clip_cache;
+      ctx.meter = (job->budget != NULL) ? &meter : NULL;
+
+      Reader r;
+      reader_mem_init(&r, &*loaded.data, (size_t)loaded.size);
+      success = sf3k_to_obj(&ctx, &r, formatted, job->sel->first,
+                            job->sel->last, job->sel->type, job->sel->name,
+                            job->sel->filter, job->pal, job->frame,
+                            job->mtl_file, loaded.numbers, loaded.nnumbers);
+      reader_destroy(&r);
+
+      if (job->compress && !output_stage_finish(&stage)) {
+        success = false;
+      }
+    }
+  }
+  free_input(&loaded);
+
+  return success;
+}
+
+static bool tar_file(_Optional const char * const input_file,
+                     const char * const tar_output,
+                     const TarJob * const job, const bool time)
 {
-  _Optional FILE *out = NULL, *in = NULL;
-  bool success = true;
+  _Optional FILE *in = NULL;
 
-  assert(!(flags & ~FLAGS_ALL));
+  assert(tar_output != NULL);
+  assert(job != NULL);
+  assert(!(job->flags & ~FLAGS_ALL));
+
+  const clock_t start_time = time ? clock() : 0;
 
   if (input_file != NULL) {
-    /* An explicit input file name was specified, so open it */
-    if (flags & FLAGS_VERBOSE)
+    if (job->flags & FLAGS_VERBOSE)
       printf("Opening input file '%s'\n", input_file);
 
     in = fopen(&*input_file, "rb");
     if (in == NULL) {
       fprintf(stderr, "Failed to open input file '%s': %s\n",
               input_file, strerror(errno));
-      success = false;
+      return false;
     }
   } else {
-    /* Default input is from standard input stream */
     fprintf(stderr, "Reading from stdin...\n");
     in = stdin;
 #ifdef _WIN32
-    /* Force binary mode on Windows to prevent corruption */
     _setmode(_fileno(stdin), _O_BINARY);
 #endif
   }
 
-  if (success) {
-    if (flags & (FLAGS_LIST|FLAGS_SUMMARY)) {
-      out = NULL; /* No OBJ-format output */
-    } else if (output_file != NULL) {
-      if (flags & FLAGS_VERBOSE)
-        printf("Opening output file '%s'\n", output_file);
+  if (job->flags & FLAGS_VERBOSE)
+    printf("Opening output file '%s'\n", tar_output);
 
-      out = fopen(&*output_file, "w");
-      if (out == NULL) {
-        fprintf(stderr, "Failed to open output file '%s': %s\n",
-                output_file, strerror(errno));
+  bool success = false;
+  int nfailed = 0;
+  _Optional FILE * const out = fopen(tar_output, "wb");
+  if (out == NULL) {
+    fprintf(stderr, "Failed to open output file '%s': %s\n",
+            tar_output, strerror(errno));
+  } else {
+    /* The whole archive is compressed if its name has a gzip extension */
+    OutputStage stage;
+    _Optional FILE *archive = out;
+    const bool gz = gzout_is_gz_name(tar_output);
+    if (gz) {
+      archive = output_stage_start(&stage, &*out, true);
+    }
+
+    if (archive != NULL) {
+      nfailed = tar_convert(&*in, &*archive,
+                            job->compress ? ".obj.gz" : ".obj",
+                            convert_member, (void *)job,
+                            job->flags & FLAGS_VERBOSE);
+      success = (nfailed >= 0);
+
+      if (gz && !output_stage_finish(&stage)) {
         success = false;
       }
-    } else {
-      /* Default output is to standard output stream */
-      out = stdout;
+    }
+
+    if (job->flags & FLAGS_VERBOSE)
+      puts("Closing output file");
+
+    if (fclose(&*out)) {
+      fprintf(stderr, "Failed to close output file '%s': %s\n",
+              tar_output, strerror(errno));
+      success = false;
+    }
+
+    /* Delete malformed output unless debugging is enabled */
+    if (!success && !(job->flags & FLAGS_VERBOSE)) {
+      remove(tar_output);
     }
   }
 
-  if (success && in) {
-    const clock_t start_time = time ? clock() : 0;
+  if (in != stdin) {
+    if (job->flags & FLAGS_VERBOSE)
+      puts("Closing input file");
+    fclose(&*in);
+  }
 
-    Reader r;
-    if (raw) {
-      reader_raw_init(&r, &*in);
-    } else {
-      success = reader_gkey_init(&r, HistoryLog2, &*in);
+  if (success && time) {
+    print_time(start_time);
+  }
+
+  /* The archive is kept even if some members couldn't be converted */
+  return success && (nfailed == 0);
+}
+
+static bool add_target(TargetList * const list, const char * const token,
+                       size_t const len)
+{
+  assert(list != NULL);
+  assert(token != NULL);
+
+  if (len == 0) {
+    return true;
+  }
+
+  if (len >= ObjNameSize) {
+    fprintf(stderr, "Object name '%.*s' is too long\n", (int)len, token);
+    return false;
+  }
+
+  if (list->ntargets >= list->nalloc) {
+    const int nalloc = list->nalloc > 0 ? list->nalloc * 2 : InitialTargets;
+    _Optional Target * const targets = realloc(list->targets,
+                                               sizeof(*targets) *
+                                               (size_t)nalloc);
+    if (targets == NULL) {
+      fprintf(stderr, "Failed allocating memory for object names\n");
+      return false;
     }
+    list->targets = targets;
+    list->nalloc = nalloc;
+  }
 
-    if (success) {
-      success = sf3k_to_obj(&r, out, first, last, type, name,
-                            pal, frame, mtl_file, flags);
-      reader_destroy(&r);
+  Target * const target = &*list->targets + list->ntargets++;
+  *target = (Target){.name = "", .index = -1,
+                     .type = SFObjectType_Invalid, .type_count = 0,
+                     .found = false};
+
+  /* A token consisting only of digits is an object number */
+  size_t i = 0;
+  while ((i < len) && (token[i] >= '0') && (token[i] <= '9')) {
+    ++i;
+  }
+  if (i == len) {
+    const long int index = strtol(token, NULL, 10);
+    if (index > INT_MAX) {
+      fprintf(stderr, "Object number %.*s is too high\n", (int)len, token);
+      return false;
+    }
+    target->index = (int)index;
+  } else {
+    memcpy(target->name, token, len);
+    target->name[len] = '\0';
+    if (!find_obj_name(target->name, &target->type, &target->type_count)) {
+      target->type = SFObjectType_Invalid;
     }
+  }
+  return true;
+}
+
+/* Adds comma-separated object names or numbers to a list */
+static bool add_target_list(TargetList * const list, const char * const s)
+{
+  assert(list != NULL);
+  assert(s != NULL);
 
-    if (success && time)
-    {
-      printf("Time taken: %.2f seconds\n",
-             (double)(clock_t)(clock() - start_time) / CLOCKS_PER_SEC);
+  const char *token = s;
+  for (;;) {
+    const size_t len = strcspn(token, ",");
+    if (!add_target(list, token, len)) {
+      return false;
     }
+    if (token[len] == '\0') {
+      return true;
+    }
+    token += len + 1;
   }
+}
 
-  if (in != NULL && in != stdin) {
-    if (flags & FLAGS_VERBOSE)
-      puts("Closing input file");
-    fclose(&*in);
+/* Adds object names or numbers separated by commas or white space in a
+   file to a list */
+static bool load_targets(TargetList * const list, const char * const names_file,
+                         const unsigned int flags)
+{
+  assert(list != NULL);
+  assert(names_file != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  if (flags & FLAGS_VERBOSE)
+    printf("Opening names file '%s'\n", names_file);
+
+  _Optional FILE * const in = fopen(names_file, "r");
+  if (in == NULL) {
+    fprintf(stderr, "Failed to open names file '%s': %s\n",
+            names_file, strerror(errno));
+    return false;
   }
 
-  if (out != NULL && out != stdout) {
-    if (flags & FLAGS_VERBOSE)
-      puts("Closing output file");
+  bool success = true;
+  char token[ObjNameSize];
+  size_t len = 0;
+  int c;
+  do {
+    c = fgetc(&*in);
+    if ((c == EOF) || (c == ',') || isspace(c)) {
+      success = add_target(list, token, len);
+      len = 0;
+    } else if (len < sizeof(token)) {
+      token[len++] = (char)c;
+    } else {
+      fprintf(stderr, "Object name '%.*s...' is too long\n", (int)len,
+              token);
+      success = false;
+    }
+  } while (success && (c != EOF));
 
-    if (fclose(&*out)) {
-      fprintf(stderr, "Failed to close output file '%s': %s\n",
-                      output_file, strerror(errno));
+  if (ferror(&*in)) {
+    fprintf(stderr, "Failed to read names file '%s': %s\n",
+            names_file, strerror(errno));
+    success = false;
+  }
+
+  if (flags & FLAGS_VERBOSE)
+    puts("Closing names file");
+
+  fclose(&*in);
+  return success;
+}
+
+typedef struct {
+  TargetList *list;
+  _Optional const ObjectNumber *numbers;
+  int nnumbers;
+  int nscanned;
+} TargetScan;
+
+static bool find_targets(const ObjectSummary * const summary,
+                         void * const arg)
+{
+  TargetScan * const scan = arg;
+  assert(summary != NULL);
+  assert(scan != NULL);
+
+  /* Objects in a chunked file are numbered as in the original file */
+  int index = summary->index, type_count = summary->type_count;
+  if (scan->numbers != NULL) {
+    assert(scan->nscanned < scan->nnumbers);
+    index = (&*scan->numbers)[scan->nscanned].index;
+    type_count = (&*scan->numbers)[scan->nscanned].type_count;
+  }
+  ++scan->nscanned;
+
+  char buffer[ObjNameSize];
+  const char * const obj_name = get_obj_name(summary->type, type_count,
+                                             buffer, sizeof(buffer));
+  int t;
+  while ((t = is_target(scan->list, index, obj_name)) >= 0) {
+    Target * const target = &*scan->list->targets + t;
+    target->found = true;
+    target->index = index;
+    strcpy(target->name, obj_name);
+  }
+  return true;
+}
+
+static bool extract_objects(_Optional const char * const input_file,
+                            _Optional const char * const name_list,
+                            _Optional const char * const names_file,
+                            _Optional SFObjectColours * const pal,
+                            _Optional ClipCache * const clip_cache,
+                            _Optional const Budget * const budget,
+                            const int frame, const char * const mtl_file,
+                            const unsigned int flags, const bool time,
+                            const bool raw, const bool compress)
+{
+  assert(mtl_file != NULL);
+  assert(!(flags & ~FLAGS_ALL));
+
+  const clock_t start_time = time ? clock() : 0;
+
+  TargetList list = {.targets = NULL, .ntargets = 0, .nalloc = 0};
+  bool success = ((name_list == NULL) ||
+                  add_target_list(&list, &*name_list)) &&
+                 ((names_file == NULL) ||
+                  load_targets(&list, &*names_file, flags));
+
+  if (success && (list.ntargets == 0)) {
+    fprintf(stderr, "No objects to extract\n");
+    success = false;
+  }
+
+  /* Only the chunks of a chunked file that contain targets are loaded */
+  LoadedInput loaded = {.data = NULL, .size = 0, .numbers = NULL,
+                        .nnumbers = 0, .over_budget = false};
+  if (success) {
+    const Selection sel = {
+      .first = 0,
+      .last = -1,
+      .type = SFObjectType_Invalid,
+      .name = NULL,
+      .filter = NULL,
+      .targets = &list,
+    };
+    success = load_input(input_file, &sel, budget, flags, raw, &loaded);
+  }
+
+  /* Find every target in one pass before converting any of them */
+  if (success) {
+    TargetScan scan = {
+      .list = &list,
+      .numbers = loaded.numbers,
+      .nnumbers = loaded.nnumbers,
+      .nscanned = 0,
+    };
+    ConvertContext ctx;
+    convert_context_init(&ctx, flags);
+    Reader r;
+    reader_mem_init(&r, &*loaded.data, (size_t)loaded.size);
+    success = sf3k_scan(&ctx, &r, find_targets, &scan);
+    reader_destroy(&r);
+  }
+
+  const bool scanned = success;
+  for (int t = 0; scanned && (t < list.ntargets); ++t) {
+    const Target * const target = &*list.targets + t;
+    if (!target->found) {
+      if (target->name[0] != '\0') {
+        fprintf(stderr, "Object '%s' not found\n", target->name);
+      } else {
+        fprintf(stderr, "Object %d not found\n", target->index);
+      }
       success = false;
     }
   }
 
-  /* Delete malformed output unless debugging is enabled */
-  if (!success && !(flags & FLAGS_VERBOSE) && out != NULL && out != stdout &&
-      output_file) {
-    remove(&*output_file);
+  /* Each target is converted from the data in memory, so the input is
+     only decompressed once */
+  for (int t = 0; success && (t < list.ntargets); ++t) {
+    const Target * const target = &*list.targets + t;
+    const Selection sel = {
+      .first = target->index,
+      .last = target->index,
+      .type = SFObjectType_Invalid,
+      .name = NULL,
+      .filter = NULL,
+      .targets = NULL,
+    };
+
+    StringBuffer output_file;
+    stringbuffer_init(&output_file);
+    if (!stringbuffer_append(&output_file, target->name, SIZE_MAX) ||
+        !stringbuffer_append_separated(&output_file, EXT_SEPARATOR,
+                                       "obj") ||
+        (compress &&
+         !stringbuffer_append_separated(&output_file, EXT_SEPARATOR,
+                                        "gz"))) {
+      fprintf(stderr, "Failed to allocate memory for output file path\n");
+      success = false;
+    } else {
+      success = convert_input(&loaded, stringbuffer_get_pointer(&output_file),
+                              &sel, pal, clip_cache, budget, frame, mtl_file,
+                              flags, false, compress, NULL, NULL, NULL,
+                              NULL) == ConvertResult_OK;
+    }
+    stringbuffer_destroy(&output_file);
+  }
+
+  free_input(&loaded);
+  free(list.targets);
+
+  if (success && time) {
+    print_time(start_time);
   }
 
   return success;
 }
 
+static bool check_one(const int index, void * const arg)
+{
+  const CheckJob * const job = arg;
+  assert(job != NULL);
+  assert(index >= 0);
+
+  return check_file(job->input_files[index], job->mtl_file, job->flags,
+                    job->raw, job->results + index);
+}
+
+static void print_result(const char * const input_file,
+                         CheckResult * const result)
+{
+  assert(input_file != NULL);
+  assert(result != NULL);
+
+  if (stringbuffer_get_length(&result->messages) > 0) {
+    fflush(stdout);
+    fputs(stringbuffer_get_pointer(&result->messages), stderr);
+  }
+  stringbuffer_destroy(&result->messages);
+
+  if (result->success) {
+    printf("%s: OK\n", input_file);
+  } else if (result->offset >= 0) {
+    printf("%s: FAILED at offset %ld (0x%lx)\n", input_file,
+           result->offset, result->offset);
+  } else {
+    printf("%s: FAILED\n", input_file);
+  }
+}
+
+/* Checks that a file which is written once for all converted objects is
+   only requested when converting one file */
+static bool check_one_file(_Optional const char * const file_name,
+                           const char * const what, const bool one_file)
+{
+  assert(what != NULL);
+
+  if ((file_name != NULL) && !one_file) {
+    fprintf(stderr, "Can only write %s when converting one file\n", what);
+    return false;
+  }
+  return true;
+}
+
 static int syntax_msg(FILE * const f, const char * const path)
 {
   assert(f != NULL);
@@ -165,33 +1393,67 @@ static int syntax_msg(FILE * const f, const char * const path)
   fprintf(f,
           "usage: %s [switches] [<input-file> [<output-file>]]\n"
           "or     %s -batch [switches] <file1> [<file2> .. <fileN>]\n"
+          "or     %s -check [switches] [<file1> [<file2> .. <fileN>]]\n"
+          "or     %s -catalog-build <catalog> [switches] <file1> [<file2> .. <fileN>]\n"
+          "or     %s -catalog-query <catalog> [switches]\n"
+          "or     %s -chunked <output-file> [switches] [<input-file>]\n"
+          "or     %s -tar <output-archive> [switches] [<input-archive>]\n"
+          "or     %s -watch <dir> [switches]\n"
           "If no input file is specified, it reads from stdin.\n"
           "If no output file is specified, it writes to stdout.\n"
           "In batch processing mode, output file names are generated by appending\n"
-          "extension 'obj' to the input file names.\n"
+          "extension 'obj' to the input file names, and likewise for the names of\n"
+          "members of an output archive or files in a monitored directory.\n"
           "If a material library file is specified then a reference to it will be\n"
           "inserted in the output. This file is not created, read or written.\n"
           "If a palette file is specified then it can be used to translate logical\n"
           "colour numbers into human-readable material names; otherwise, material\n"
           "names are logical colour numbers.\n",
-          leaf, leaf);
+          leaf, leaf, leaf, leaf, leaf, leaf, leaf, leaf);
 
   fputs("Switches (names may be abbreviated):\n"
         "  -help               Display this text\n"
         "  -batch              Process a batch of files (see above)\n"
+        "  -catalog-build <catalog>\n"
+        "                      Record objects in a catalog file (see above)\n"
+        "  -catalog-query <catalog>\n"
+        "                      List matching objects in a catalog file\n"
+        "  -check              Validate files instead of converting them\n"
+        "  -chunked <name>     Write input to a chunked file instead of converting it\n"
+        "  -tar <name>         Convert each file in an input tar archive to a file in\n"
+        "                      the named output archive (see above)\n"
+        "  -watch <dir>        Convert each file in a directory whenever it changes\n"
+        "                      (see above)\n"
         "  -list               List objects instead of converting them\n"
         "  -summary            Summarize objects instead of converting them\n"
         "  -index N            Object number to convert or list (default is all)\n"
         "  -first N            First object number to convert or list\n"
         "  -last N             Last object number to convert or list\n"
         "  -type G|B|S         Object type to convert or list (default is all)\n"
-        "  -name <name>        Object name to convert or list (default is all)\n"
+        "  -name <name>        Object name to convert or list (default is all),\n"
+        "                      or a comma-separated list of objects to extract\n"
+        "  -names <file>       File of object names or numbers to extract\n"
+        "  -where <expr>       Filter expression that objects to convert, list\n"
+        "                      or query must satisfy (default is none)\n"
+        "  -vertices N         Vertex count to query (default is any)\n"
+        "  -faces N            Face count to query (default is any)\n"
+        "  -plot N             Plot type to query (default is any)\n"
         "  -outfile <name>     Write output to the named file instead of stdout\n"
+        "  -pipeline           Read, convert and write files concurrently\n"
+        "                      (batch processing mode only)\n"
+        "  -compress           Compress output in gzip format\n"
         "  -raw                Input is uncompressed raw data\n"
+        "  -threads N          Number of files to check, catalog or convert in\n"
+        "                      parallel\n"
         "  -time               Show the total time for each file processed\n"
+        "  -budget <limits>    Resources allowed for each file or object, e.g.\n"
+        "                      time=10,cpu=5,object_time=2,object_cpu=1,\n"
+        "                      memory=64M,polygons=5000 (default is no limits)\n"
         "  -verbose or -debug  Emit debug information (and keep bad output)\n", f);
 
   fputs("Switches to customize the output:\n"
+        "  -format obj|stream  Output Wavefront text or a binary stream of frames\n"
+        "                      (default obj)\n"
         "  -mtllib name        Specify a material library file (default sf3k.mtl)\n"
         "  -palette name       Specify a palette file in which to look up\n"
         "                      physical colours (default is none)\n"
@@ -203,8 +1465,25 @@ static int syntax_msg(FILE * const f, const char * const path)
         "  -duplicate          Include duplicate vertices in the output\n"
         "  -negative           Output negative vertex indices\n"
         "  -clip               Clip overlapping coplanar polygons\n"
+        "  -clip-cache <dir>   Keep clipped polygons in the named directory\n"
         "  -fans               Split complex polygons into triangle fans\n"
-        "  -strips             Split complex polygons into triangle strips\n", f);
+        "  -strips             Split complex polygons into triangle strips\n"
+        "  -sort               Sort polygons by colour within each plot group\n"
+        "  -optimise           Reorder triangles for a post-transform vertex cache\n"
+        "  -vertex-colours     Output colours with vertices instead of\n"
+        "                      materials (needs -palette or -false)\n"
+        "  -atlas              Output texture coordinates in a palette atlas\n"
+        "                      instead of one material per colour\n"
+        "  -normals            Output a normal for each face\n"
+        "  -visibility         Output the program that selects plot groups\n"
+        "  -visibility-file <name>\n"
+        "                      Write plot group visibility to the named file\n"
+        "  -collision <name>   Write collision boxes to the named file\n"
+        "  -animation <name>   Write rotator and flashing colour animation\n"
+        "                      channels to the named file\n"
+        "  -wireframe          Output collision boxes as wireframes\n"
+        "  -bounds             Output a bounding box and sphere for each object\n"
+        "  -bounds-file <name> Write bounding volumes to the named file\n", f);
 
   return EXIT_FAILURE;
 }
@@ -222,23 +1501,15 @@ static _Optional SFObjectColours *load_palette(const char * const filename,
   if (palette == NULL) {
     fprintf(stderr, "Failed to open palette file: %s\n", strerror(errno));
   } else {
-    pal = malloc(sizeof(SFObjectColours));
-    if (pal == NULL) {
-      fprintf(stderr, "Failed allocating memory for palette\n");
-    } else {
-      Reader p;
-      bool success = true;
-
-      if (raw) {
-        reader_raw_init(&p, &*palette);
-      } else {
-        success = reader_gkey_init(&p, HistoryLog2, &*palette);
-      }
-
-      if (!success) {
-        free(pal);
-        pal = NULL;
+    long int size = 0;
+    _Optional unsigned char * const data = input_load(&*palette, raw, &size);
+    if (data != NULL) {
+      pal = malloc(sizeof(SFObjectColours));
+      if (pal == NULL) {
+        fprintf(stderr, "Failed allocating memory for palette\n");
       } else {
+        Reader p;
+        reader_mem_init(&p, &*data, (size_t)size);
         if (reader_fread(&*pal, sizeof(SFObjectColours), 1, &p) != 1) {
           fprintf(stderr, "Failed to read palette\n");
           free(pal);
@@ -246,6 +1517,7 @@ static _Optional SFObjectColours *load_palette(const char * const filename,
         }
         reader_destroy(&p);
       }
+      free(data);
     }
 
     if (flags & FLAGS_VERBOSE) {
@@ -258,6 +1530,340 @@ static _Optional SFObjectColours *load_palette(const char * const filename,
   return pal;
 }
 
+static bool add_range(const ObjectSummary * const summary, void * const arg)
+{
+  RangeList * const list = arg;
+  assert(summary != NULL);
+  assert(list != NULL);
+
+  if (list->nobjects >= list->nalloc) {
+    const int nalloc = list->nalloc > 0 ? list->nalloc * 2 : InitialRanges;
+    _Optional ObjectRange * const objects = realloc(list->objects,
+                                                    sizeof(*objects) *
+                                                    (size_t)nalloc);
+    if (objects == NULL) {
+      fprintf(stderr, "Failed allocating memory for object locations\n");
+      return false;
+    }
+    list->objects = objects;
+    list->nalloc = nalloc;
+  }
+
+  (&*list->objects)[list->nobjects++] = (ObjectRange){
+    .offset = summary->offset,
+    .size = summary->size,
+  };
+  return true;
+}
+
+static bool same_bytes(const LoadedInput * const a, const long int a_offset,
+                       const LoadedInput * const b, const long int b_offset,
+                       const long int size)
+{
+  assert(a != NULL);
+  assert(b != NULL);
+  assert(a_offset >= 0);
+  assert(b_offset >= 0);
+  assert(size >= 0);
+
+  return (a_offset + size <= a->size) && (b_offset + size <= b->size) &&
+         !memcmp(&*a->data + a_offset, &*b->data + b_offset, (size_t)size);
+}
+
+/* Counts the objects in 'loaded' that differ from those of 'file', or
+   returns -1 if the data preceding the first object differs */
+static int count_changes(const WatchedFile * const file,
+                         const LoadedInput * const loaded,
+                         const RangeList * const ranges)
+{
+  assert(file != NULL);
+  assert(loaded != NULL);
+  assert(ranges != NULL);
+
+  const RangeList * const old = &file->ranges;
+  if ((old->nobjects == 0) || (ranges->nobjects == 0)) {
+    return -1;
+  }
+
+  /* Plot types precede the first object */
+  const long int start = (&*ranges->objects)[0].offset;
+  if ((start != (&*old->objects)[0].offset) ||
+      !same_bytes(loaded, 0, &file->loaded, 0, start)) {
+    return -1;
+  }
+
+  int nchanged = 0;
+  for (int i = 0; i < ranges->nobjects; ++i) {
+    const ObjectRange * const range = &*ranges->objects + i;
+    if ((i >= old->nobjects) ||
+        (range->size != (&*old->objects)[i].size) ||
+        !same_bytes(loaded, range->offset, &file->loaded,
+                    (&*old->objects)[i].offset, range->size)) {
+      ++nchanged;
+    }
+  }
+
+  /* Deleted objects also change the output */
+  if (old->nobjects > ranges->nobjects) {
+    nchanged += old->nobjects - ranges->nobjects;
+  }
+  return nchanged;
+}
+
+static bool convert_watched(const WatchJob * const job,
+                            const WatchedFile * const file,
+                            const LoadedInput * const loaded)
+{
+  assert(job != NULL);
+  assert(file != NULL);
+  assert(file->input_file != NULL);
+  assert(loaded != NULL);
+
+  /* Invent an output file name */
+  StringBuffer default_output;
+  stringbuffer_init(&default_output);
+  bool success = false;
+  if (!stringbuffer_append(&default_output, &*file->input_file, SIZE_MAX) ||
+      !stringbuffer_append_separated(&default_output, EXT_SEPARATOR,
+                                     "obj") ||
+      (job->compress &&
+       !stringbuffer_append_separated(&default_output, EXT_SEPARATOR,
+                                      "gz"))) {
+    fprintf(stderr, "Failed to allocate memory for output file path\n");
+  } else {
+    success = convert_input(loaded,
+                            stringbuffer_get_pointer(&default_output),
+                            job->sel, job->pal, job->clip_cache, job->budget,
+                            job->frame, job->mtl_file, job->flags, false,
+                            job->compress, NULL, NULL, NULL,
+                            NULL) == ConvertResult_OK;
+    if (success) {
+      printf("Converted '%s' to '%s'\n", file->input_file,
+             stringbuffer_get_pointer(&default_output));
+    }
+  }
+  stringbuffer_destroy(&default_output);
+  return success;
+}
+
+static bool is_input_name(const char * const leaf)
+{
+  assert(leaf != NULL);
+
+  /* Ignore hidden files, backups and files written by these programs */
+  const size_t len = strlen(leaf);
+  if ((len == 0) || (leaf[0] == '.') || (leaf[len - 1] == '~')) {
+    return false;
+  }
+
+  const char * const ext = strrchr(leaf, EXT_SEPARATOR);
+  return (ext == NULL) ||
+         (strcmp(ext + 1, "obj") && strcmp(ext + 1, "gz") &&
+          strcmp(ext + 1, "mtl"));
+}
+
+static _Optional WatchedFile *find_watched(WatchJob * const job,
+                                           const char * const input_file)
+{
+  assert(job != NULL);
+  assert(input_file != NULL);
+
+  for (int i = 0; i < job->nfiles; ++i) {
+    WatchedFile * const file = &*job->files + i;
+    if (!strcmp(&*file->input_file, input_file)) {
+      return file;
+    }
+  }
+
+  if (job->nfiles >= job->nalloc) {
+    const int nalloc = job->nalloc > 0 ? job->nalloc * 2 : InitialWatched;
+    _Optional WatchedFile * const files = realloc(job->files,
+                                                  sizeof(*files) *
+                                                  (size_t)nalloc);
+    if (files == NULL) {
+      fprintf(stderr, "Failed allocating memory for monitored files\n");
+      return NULL;
+    }
+    job->files = files;
+    job->nalloc = nalloc;
+  }
+
+  _Optional char * const copy = malloc(strlen(input_file) + 1);
+  if (copy == NULL) {
+    fprintf(stderr, "Failed allocating memory for monitored files\n");
+    return NULL;
+  }
+  strcpy(&*copy, input_file);
+
+  WatchedFile * const file = &*job->files + job->nfiles++;
+  *file = (WatchedFile){
+    .input_file = copy,
+    .loaded = {.data = NULL, .size = 0, .numbers = NULL, .nnumbers = 0,
+               .over_budget = false},
+    .ranges = {.objects = NULL, .nobjects = 0, .nalloc = 0},
+    .converted = false,
+  };
+  return file;
+}
+
+static bool input_changed(WatchJob * const job, const char * const path,
+                          const char * const leaf)
+{
+  assert(job != NULL);
+  assert(path != NULL);
+  assert(leaf != NULL);
+
+  if (!is_input_name(leaf)) {
+    return true;
+  }
+
+  _Optional WatchedFile * const file = find_watched(job, path);
+  if (file == NULL) {
+    return false;
+  }
+
+  const clock_t start_time = job->time ? clock() : 0;
+
+  /* Find the objects in the new data so that they can be compared with
+     the data that was last converted. Objects are validated as in check
+     mode. */
+  LoadedInput loaded;
+  RangeList ranges = {.objects = NULL, .nobjects = 0, .nalloc = 0};
+  bool success = load_input(path, job->sel, job->budget, job->flags,
+                            job->raw, &loaded);
+  if (success) {
+    ConvertContext ctx;
+    convert_context_init(&ctx, job->flags | FLAGS_CHECK);
+    Reader r;
+    reader_mem_init(&r, &*loaded.data, (size_t)loaded.size);
+    success = sf3k_scan(&ctx, &r, add_range, &ranges);
+    reader_destroy(&r);
+  }
+
+  int nchanged = -1;
+  if (success && file->converted) {
+    nchanged = count_changes(&*file, &loaded, &ranges);
+  }
+
+  if (nchanged == 0) {
+    if (job->flags & FLAGS_VERBOSE) {
+      printf("No objects in '%s' changed\n", path);
+    }
+  } else if (success) {
+    if (nchanged > 0) {
+      printf("%d of %d objects in '%s' changed\n", nchanged,
+             HIGHEST(ranges.nobjects, file->ranges.nobjects), path);
+    }
+    success = convert_watched(job, &*file, &loaded);
+  }
+
+  if (success && (nchanged != 0)) {
+    /* Keep the new data to compare with the next version */
+    free_input(&file->loaded);
+    free(file->ranges.objects);
+    file->loaded = loaded;
+    file->ranges = ranges;
+    file->converted = true;
+    if (job->time) {
+      print_time(start_time);
+    }
+  } else {
+    free_input(&loaded);
+    free(ranges.objects);
+    if (!success) {
+      /* Convert the file again when it next changes */
+      file->converted = false;
+    }
+  }
+
+  /* Errors in a file being edited don't stop monitoring */
+  return true;
+}
+
+static bool palette_changed(WatchJob * const job, const char * const path)
+{
+  assert(job != NULL);
+  assert(path != NULL);
+
+  _Optional SFObjectColours * const pal = load_palette(path, job->flags,
+                                                       job->raw);
+  if (pal == NULL) {
+    return true;
+  }
+
+  if ((job->pal != NULL) && !memcmp(&*job->pal, &*pal, sizeof(*pal))) {
+    if (job->flags & FLAGS_VERBOSE) {
+      printf("Palette '%s' is unchanged\n", path);
+    }
+    free(pal);
+    return true;
+  }
+
+  free(job->pal);
+  job->pal = pal;
+  printf("Palette '%s' changed\n", path);
+
+  /* Every object's materials depend on the palette, so convert all of the
+     input data again without reloading it */
+  for (int i = 0; i < job->nfiles; ++i) {
+    WatchedFile * const file = &*job->files + i;
+    if (!file->converted) {
+      continue;
+    }
+
+    const clock_t start_time = job->time ? clock() : 0;
+    file->converted = convert_watched(job, file, &file->loaded);
+    if (file->converted && job->time) {
+      print_time(start_time);
+    }
+  }
+
+  return true;
+}
+
+static bool file_changed(const int tag, const char * const path,
+                         const char * const leaf, void * const arg)
+{
+  WatchJob * const job = arg;
+  assert(path != NULL);
+  assert(leaf != NULL);
+  assert(job != NULL);
+
+  return (tag == WatchTag_Palette) ? palette_changed(job, path) :
+                                     input_changed(job, path, leaf);
+}
+
+static bool watch_files(const char * const watch_dir,
+                        _Optional const char * const palette_file,
+                        WatchJob * const job)
+{
+  assert(watch_dir != NULL);
+  assert(job != NULL);
+
+  Watch watch;
+  bool success = watch_init(&watch) &&
+                 watch_add_dir(&watch, watch_dir, WatchTag_Input) &&
+                 ((palette_file == NULL) ||
+                  watch_add_file(&watch, &*palette_file, WatchTag_Palette));
+  if (success) {
+    success = watch_run(&watch, file_changed, job,
+                        (job->flags & FLAGS_VERBOSE) != 0);
+  }
+  watch_destroy(&watch);
+
+  for (int i = 0; i < job->nfiles; ++i) {
+    WatchedFile * const file = &*job->files + i;
+    free_input(&file->loaded);
+    free(file->ranges.objects);
+    free(file->input_file);
+  }
+  free(job->files);
+  job->files = NULL;
+  job->nfiles = 0;
+
+  return success;
+}
+
 #ifdef FORTIFY
 int real_main(int argc, const char *argv[]);
 
@@ -284,15 +1890,25 @@ int real_main(int argc, const char *argv[])
 int main(int argc, const char *argv[])
 #endif
 {
-  int n, first = -1, last = -1, frame = 0;
+  int n, first = -1, last = -1, frame = 0, nthreads = 1;
+  int nvertices = -1, npolygons = -1, plot_type = -1;
   unsigned int flags = 0;
   _Optional const char *name = NULL;
   SFObjectType type = SFObjectType_Invalid;
-  bool time = false, batch = false, raw = false;
+  bool time = false, batch = false, raw = false, pipeline = false;
+  bool compress = false, has_filter = false, has_budget = false;
   int rtn = EXIT_SUCCESS;
   _Optional const char *output_file = NULL, *input_file = NULL, *palette_file = NULL;
+  _Optional const char *build_file = NULL, *query_file = NULL;
+  _Optional const char *chunk_output = NULL, *collision_file = NULL;
+  _Optional const char *animation_file = NULL, *tar_output = NULL;
+  _Optional const char *bounds_file = NULL, *watch_dir = NULL;
+  _Optional const char *visibility_file = NULL;
+  _Optional const char *names_file = NULL, *clip_dir = NULL;
   const char *mtl_file = "sf3k.mtl";
   _Optional SFObjectColours *pal = NULL;
+  Filter filter;
+  Budget budget;
 
   assert(argc > 0);
   assert(argv != NULL);
@@ -303,18 +1919,96 @@ int main(int argc, const char *argv[])
   for (n = 1; n < argc && argv[n][0] == '-'; n++) {
     const char *opt = argv[n] + 1;
 
-    if (is_switch(opt, "batch", 1)) {
+    if (is_switch(opt, "animation", 2)) {
+      /* Animation output file path was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing animation file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      animation_file = argv[n];
+    } else if (is_switch(opt, "atlas", 1)) {
+      /* Enable output of texture coordinates instead of materials */
+      flags |= FLAGS_ATLAS;
+    } else if (is_switch(opt, "batch", 1)) {
       /* Enable batch processing mode */
       batch = true;
+    } else if (is_switch(opt, "bounds", 2)) {
+      /* Enable output of bounding volumes */
+      flags |= FLAGS_BOUNDS;
+    } else if (is_switch(opt, "bounds-file", 7)) {
+      /* Bounding volume output file path was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing bounds file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      bounds_file = argv[n];
+    } else if (is_switch(opt, "budget", 2)) {
+      /* Limits on the resources used for each file or object */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing budget\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      if (!budget_parse(&budget, argv[n])) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      has_budget = true;
+    } else if (is_switch(opt, "catalog-build", 9)) {
+      /* Catalog file to build was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing catalog file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      build_file = argv[n];
+    } else if (is_switch(opt, "catalog-query", 9)) {
+      /* Catalog file to query was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing catalog file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      query_file = argv[n];
+    } else if (is_switch(opt, "check", 2)) {
+      /* Validate files instead of converting them */
+      flags |= FLAGS_CHECK;
+    } else if (is_switch(opt, "chunked", 3)) {
+      /* Chunked output file path was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing chunked file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      chunk_output = argv[n];
     } else if (is_switch(opt, "clip", 1)) {
       /* Enable clipping of coplanar polygons */
       flags |= FLAGS_CLIP_POLYGONS;
+    } else if (is_switch(opt, "clip-cache", 6)) {
+      /* Directory of clipped polygons was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing directory name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      clip_dir = argv[n];
+    } else if (is_switch(opt, "collision", 3)) {
+      /* Collision output file path was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing collision file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      collision_file = argv[n];
+    } else if (is_switch(opt, "compress", 3)) {
+      /* Enable compression of output */
+      compress = true;
     } else if (is_switch(opt, "debug", 2)) {
       /* Enable debugging output */
       flags |= FLAGS_VERBOSE;
     } else if (is_switch(opt, "duplicate", 2)) {
       /* Enable output of duplicate vertices */
       flags |= FLAGS_DUPLICATE;
+    } else if (is_switch(opt, "faces", 3)) {
+      /* Number of faces to query was specified */
+      long int num;
+      if (!get_long_arg("faces", &num, 1, UCHAR_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      npolygons = (int)num;
     } else if (is_switch(opt, "false", 3)) {
       /* Enable false polygon colours */
       flags |= FLAGS_FALSE_COLOUR;
@@ -328,6 +2022,20 @@ int main(int argc, const char *argv[])
         return syntax_msg(stderr, argv[0]);
       }
       first = (int)num;
+    } else if (is_switch(opt, "format", 2)) {
+      /* Output format was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing output format\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      if (!strcmp(argv[n], "stream")) {
+        flags |= FLAGS_STREAM;
+      } else if (!strcmp(argv[n], "obj")) {
+        flags &= ~FLAGS_STREAM;
+      } else {
+        fputs("Bad output format\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
     } else if (is_switch(opt, "frame", 2)) {
       /* Object number to convert was specified */
       long int num;
@@ -377,9 +2085,22 @@ int main(int argc, const char *argv[])
       } else {
         name = argv[n];
       }
+    } else if (is_switch(opt, "names", 5)) {
+      /* File of object names to extract was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing names file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      names_file = argv[n];
     } else if (is_switch(opt, "negative", 2)) {
       /* Enable negative vertex indices */
       flags |= FLAGS_NEGATIVE_INDICES;
+    } else if (is_switch(opt, "normals", 2)) {
+      /* Enable output of a normal for each face */
+      flags |= FLAGS_NORMALS;
+    } else if (is_switch(opt, "optimise", 2)) {
+      /* Enable reordering of triangles for a vertex cache */
+      flags |= FLAGS_OPTIMISE;
     } else if (is_switch(opt, "outfile", 1)) {
       /* Output file path was specified */
       if (++n >= argc || argv[n][0] == '-') {
@@ -395,15 +2116,42 @@ int main(int argc, const char *argv[])
       }
       palette_file = argv[n];
       flags |= FLAGS_PHYSICAL_COLOUR;
+    } else if (is_switch(opt, "pipeline", 2)) {
+      /* Enable overlapping of input, conversion and output */
+      pipeline = true;
+    } else if (is_switch(opt, "plot", 2)) {
+      /* Plot type to query was specified */
+      long int num;
+      if (!get_long_arg("plot", &num, 0, INT_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      plot_type = (int)num;
     } else if (is_switch(opt, "raw", 1)) {
       /* Enable raw input */
       raw = true;
+    } else if (is_switch(opt, "sort", 2)) {
+      /* Enable sorting of primitives by colour */
+      flags |= FLAGS_SORT_COLOURS;
     } else if (is_switch(opt, "strips", 2)) {
       /* Enable decomposition of complex polygons into triangle strips */
       flags |= FLAGS_TRIANGLE_STRIPS;
     } else if (is_switch(opt, "summary", 2)) {
       /* List contents of file */
       flags |= FLAGS_SUMMARY;
+    } else if (is_switch(opt, "tar", 2)) {
+      /* Output archive path was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing archive file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      tar_output = argv[n];
+    } else if (is_switch(opt, "threads", 2)) {
+      /* Number of files to process in parallel was specified */
+      long int num;
+      if (!get_long_arg("threads", &num, 1, INT_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      nthreads = (int)num;
     } else if (is_switch(opt, "time", 2)) {
       /* Enable timing */
       time = true;
@@ -437,9 +2185,49 @@ int main(int argc, const char *argv[])
     } else if (is_switch(opt, "unused", 1)) {
       /* Enable output of unused vertices */
       flags |= FLAGS_UNUSED;
+    } else if (is_switch(opt, "vertices", 4)) {
+      /* Number of vertices to query was specified */
+      long int num;
+      if (!get_long_arg("vertices", &num, 1, UCHAR_MAX, argc, argv, ++n)) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      nvertices = (int)num;
+    } else if (is_switch(opt, "vertex-colours", 5)) {
+      /* Enable output of colours with vertices instead of materials */
+      flags |= FLAGS_VERTEX_COLOURS;
+    } else if (is_switch(opt, "visibility", 2)) {
+      /* Enable output of plot groups and the program to select them */
+      flags |= FLAGS_VISIBILITY;
+    } else if (is_switch(opt, "visibility-file", 11)) {
+      /* Plot group visibility output file path was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing visibility file name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      visibility_file = argv[n];
     } else if (is_switch(opt, "verbose", 1)) {
       /* Enable debugging output */
       flags |= FLAGS_VERBOSE;
+    } else if (is_switch(opt, "watch", 2)) {
+      /* Directory to monitor was specified */
+      if (++n >= argc || argv[n][0] == '-') {
+        fputs("Missing directory name\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      watch_dir = argv[n];
+    } else if (is_switch(opt, "where", 2)) {
+      /* Filter expression over object attributes was specified */
+      if (++n >= argc) {
+        fputs("Missing filter expression\n", stderr);
+        return syntax_msg(stderr, argv[0]);
+      }
+      if (!filter_parse(&filter, argv[n])) {
+        return syntax_msg(stderr, argv[0]);
+      }
+      has_filter = true;
+    } else if (is_switch(opt, "wireframe", 1)) {
+      /* Enable output of collision boxes as wireframes */
+      flags |= FLAGS_WIREFRAME;
     } else {
       fprintf(stderr, "Unrecognised switch '%s'\n", opt);
       return syntax_msg(stderr, argv[0]);
@@ -451,6 +2239,279 @@ int main(int argc, const char *argv[])
           stderr);
     return EXIT_FAILURE;
   }
+
+  if (compress && ((build_file != NULL) || (query_file != NULL) ||
+                   (chunk_output != NULL) ||
+                   (flags & (FLAGS_CHECK|FLAGS_LIST|FLAGS_SUMMARY)))) {
+    fputs("Can only compress output when converting objects\n", stderr);
+    return syntax_msg(stderr, argv[0]);
+  }
+
+  /* Some output files are written once for all converted objects */
+  const bool one_file = !batch && (build_file == NULL) &&
+                        (query_file == NULL) && (chunk_output == NULL) &&
+                        !(flags & (FLAGS_CHECK|FLAGS_LIST|FLAGS_SUMMARY));
+
+  /* Collision boxes of all converted objects go in one file. */
+  if (!check_one_file(collision_file, "collision boxes", one_file)) {
+    return syntax_msg(stderr, argv[0]);
+  }
+
+  /* Animation channels are likewise written once for all objects. */
+  if (!check_one_file(animation_file, "animation channels", one_file)) {
+    return syntax_msg(stderr, argv[0]);
+  }
+
+  /* Bounding volumes are likewise written once for all objects. */
+  if (!check_one_file(bounds_file, "bounding volumes", one_file)) {
+    return syntax_msg(stderr, argv[0]);
+  }
+
+  /* Plot group visibility is likewise written once for all objects. */
+  if (!check_one_file(visibility_file, "plot group visibility", one_file)) {
+    return syntax_msg(stderr, argv[0]);
+  }
+
+  /* Primitives are numbered as they are output, but triangulation splits
+     them into several faces */
+  if (((flags & FLAGS_VISIBILITY) || (visibility_file != NULL)) &&
+      (flags & (FLAGS_TRIANGLE_FANS|FLAGS_TRIANGLE_STRIPS))) {
+    fputs("Cannot use -visibility or -visibility-file with -fans or "
+          "-strips\n", stderr);
+    return syntax_msg(stderr, argv[0]);
+  }
+
+  /* Every member of an archive is converted to a member of another. */
+  if (tar_output != NULL) {
+    if (batch || (output_file != NULL) || (build_file != NULL) ||
+        (query_file != NULL) || (chunk_output != NULL) ||
+        (flags & (FLAGS_CHECK|FLAGS_LIST|FLAGS_SUMMARY))) {
+      fputs("Cannot check, list, summarize, catalog or chunk objects, or "
+            "specify an output file, when writing an archive\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    if ((collision_file != NULL) || (animation_file != NULL) ||
+        (bounds_file != NULL) || (visibility_file != NULL) || pipeline) {
+      fputs("Cannot use -collision, -animation, -bounds-file, "
+            "-visibility-file or -pipeline with -tar\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+  }
+
+  /* Each of several objects is extracted to a file named after it. */
+  const bool extract = (names_file != NULL) ||
+                       ((name != NULL) && (strchr(&*name, ',') != NULL));
+  if (extract) {
+    if (batch || (output_file != NULL) || (build_file != NULL) ||
+        (query_file != NULL) || (chunk_output != NULL) ||
+        (tar_output != NULL) || (watch_dir != NULL) ||
+        (flags & (FLAGS_CHECK|FLAGS_LIST|FLAGS_SUMMARY))) {
+      fputs("Cannot check, list, summarize, catalog, chunk, archive or "
+            "monitor objects, or specify an output file, when extracting "
+            "several objects\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    if ((first != -1) || (last != -1) || (type != SFObjectType_Invalid) ||
+        has_filter) {
+      fputs("Cannot select objects by number, type or filter when "
+            "extracting several objects\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    if ((collision_file != NULL) || (animation_file != NULL) ||
+        (bounds_file != NULL) || (visibility_file != NULL) || pipeline) {
+      fputs("Cannot use -collision, -animation, -bounds-file, "
+            "-visibility-file or -pipeline when extracting several "
+            "objects\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+  }
+
+  /* Every file in a directory is converted to a file of the same name. */
+  if (watch_dir != NULL) {
+    if (batch || (output_file != NULL) || (build_file != NULL) ||
+        (query_file != NULL) || (chunk_output != NULL) ||
+        (tar_output != NULL) ||
+        (flags & (FLAGS_CHECK|FLAGS_LIST|FLAGS_SUMMARY))) {
+      fputs("Cannot check, list, summarize, catalog, chunk or archive "
+            "objects, or specify an output file, when monitoring a "
+            "directory\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    if ((collision_file != NULL) || (animation_file != NULL) ||
+        (bounds_file != NULL) || (visibility_file != NULL) || pipeline) {
+      fputs("Cannot use -collision, -animation, -bounds-file, "
+            "-visibility-file or -pipeline with -watch\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+  }
+
+  /* Binary frames are written to one output file or stdout. */
+  if (flags & FLAGS_STREAM) {
+    if (batch || (build_file != NULL) || (query_file != NULL) ||
+        (chunk_output != NULL) || (tar_output != NULL) ||
+        (watch_dir != NULL) || extract ||
+        (flags & (FLAGS_CHECK|FLAGS_LIST|FLAGS_SUMMARY))) {
+      fputs("Can only write a stream when converting one file\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    if ((animation_file != NULL) ||
+        (flags & (FLAGS_NEGATIVE_INDICES|FLAGS_TRIANGLE_FANS|
+                  FLAGS_TRIANGLE_STRIPS|FLAGS_HUMAN_READABLE|
+                  FLAGS_VERTEX_COLOURS|FLAGS_ATLAS|FLAGS_NORMALS|
+                  FLAGS_VISIBILITY|FLAGS_WIREFRAME|FLAGS_BOUNDS))) {
+      fputs("Cannot use -animation, -atlas, -bounds, -fans, -human, "
+            "-negative, -normals, -strips, -vertex-colours, -visibility or "
+            "-wireframe with -format stream\n", stderr);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (pipeline) {
+    /* Objects are converted from memory, so only whole files can be
+       read in advance. A single file still benefits from writing its
+       output on a separate thread. */
+    if ((build_file != NULL) || (query_file != NULL) ||
+        (chunk_output != NULL) || (flags & FLAGS_CHECK)) {
+      fputs("Can only use a pipeline when converting, listing or "
+            "summarizing objects\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    /* Ensure that debug output from different stages isn't mixed up */
+    if (flags & FLAGS_VERBOSE) {
+      fputs("Cannot use a pipeline in verbose mode\n", stderr);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (flags & FLAGS_CHECK) {
+    /* Every object is validated, so no selection criteria are allowed */
+    if ((first != -1) || (last != -1) || (type != SFObjectType_Invalid) ||
+        (name != NULL) || has_filter) {
+      fputs("Cannot select objects in check mode\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+  }
+
+  if ((clip_dir != NULL) && !(flags & FLAGS_CLIP_POLYGONS)) {
+    fputs("Must specify -clip to enable -clip-cache\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  if (has_budget && ((build_file != NULL) || (query_file != NULL) ||
+                     (chunk_output != NULL) || (flags & FLAGS_CHECK))) {
+    fputs("Can only use a budget when converting, listing or summarizing "
+          "objects\n", stderr);
+    return syntax_msg(stderr, argv[0]);
+  }
+
+  if ((nvertices != -1 || npolygons != -1 || plot_type != -1) &&
+      (query_file == NULL)) {
+    fputs("Can only select objects by vertex count, face count or plot type "
+          "when querying a catalog\n", stderr);
+    return syntax_msg(stderr, argv[0]);
+  }
+
+  if ((build_file != NULL) || (query_file != NULL)) {
+    if ((build_file != NULL) && (query_file != NULL)) {
+      fputs("Cannot build and query a catalog at the same time\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    if (batch || time || (output_file != NULL) ||
+        (flags & (FLAGS_LIST|FLAGS_SUMMARY|FLAGS_CHECK))) {
+      fputs("Cannot convert, check, list or summarize objects in catalog "
+            "mode\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+  }
+
+  if (chunk_output != NULL) {
+    if (batch || time || (output_file != NULL) ||
+        (build_file != NULL) || (query_file != NULL) ||
+        (flags & (FLAGS_LIST|FLAGS_SUMMARY|FLAGS_CHECK))) {
+      fputs("Cannot convert, check, list, summarize or catalog objects "
+            "when writing a chunked file\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    /* Every object is copied, so no selection criteria are allowed */
+    if ((first != -1) || (last != -1) || (type != SFObjectType_Invalid) ||
+        (name != NULL) || has_filter) {
+      fputs("Cannot select objects when writing a chunked file\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    if (n < argc) {
+      input_file = argv[n++];
+    }
+    if (n < argc) {
+      fputs("Too many arguments (a chunked file is written from one "
+            "input file)\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    return chunk_file(input_file, &*chunk_output, flags, raw) ?
+           EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if (build_file != NULL) {
+    /* Every object is recorded, so no selection criteria are allowed */
+    if ((first != -1) || (last != -1) || (type != SFObjectType_Invalid) ||
+        (name != NULL) || has_filter) {
+      fputs("Cannot select objects when building a catalog\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    if (n >= argc) {
+      fputs("Must specify file(s) to catalog\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    /* Ensure that debug output from different files isn't mixed up */
+    if ((nthreads > 1) && (flags & FLAGS_VERBOSE)) {
+      fputs("Cannot use more than one thread in verbose mode\n", stderr);
+      return EXIT_FAILURE;
+    }
+
+    return catalog_build(&*build_file, argc - n, argv + n, nthreads, flags,
+                         raw) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if (query_file != NULL) {
+    /* Catalogs don't record every attribute that a filter can test */
+    if (has_filter && (filter.needs & ~CATALOG_FILTER_ATTRIBUTES)) {
+      fputs("Can only test index, type, type_index, plot, vertices and "
+            "faces when querying a catalog\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    /* The original graphics files aren't read */
+    if (n < argc) {
+      fputs("Too many arguments (a catalog query takes no input files)\n",
+            stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    const CatalogFilter query = {
+      .first = first,
+      .last = last,
+      .type = type,
+      .name = name,
+      .nvertices = nvertices,
+      .npolygons = npolygons,
+      .plot_type = plot_type,
+      .filter = has_filter ? &filter : NULL,
+    };
+    return catalog_query(&*query_file, &query, flags) ?
+           EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
   if (first == -1) {
     first = 0;
   }
@@ -468,7 +2529,100 @@ int main(int argc, const char *argv[])
     return EXIT_FAILURE;
   }
 
-  if (batch) {
+  /* Vertex colours are red, green and blue values, not material names. */
+  if (flags & FLAGS_VERTEX_COLOURS) {
+    if (!(flags & (FLAGS_PHYSICAL_COLOUR|FLAGS_FALSE_COLOUR))) {
+      fputs("Must specify a palette or -false to enable -vertex-colours\n",
+            stderr);
+      return EXIT_FAILURE;
+    }
+
+    if (flags & (FLAGS_HUMAN_READABLE|FLAGS_UNUSED)) {
+      fputs("Cannot use -human or -unused with -vertex-colours\n", stderr);
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* False colours are different for every primitive. */
+  if ((flags & FLAGS_SORT_COLOURS) && (flags & FLAGS_FALSE_COLOUR)) {
+    fputs("Cannot sort primitives by false colour\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  if ((flags & FLAGS_OPTIMISE) && (flags & FLAGS_FALSE_COLOUR)) {
+    fputs("Cannot optimise triangles with false colours\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  /* A texture atlas has one texel per colour rather than named materials. */
+  if (flags & FLAGS_ATLAS) {
+    if (flags & (FLAGS_HUMAN_READABLE|FLAGS_UNUSED|FLAGS_VERTEX_COLOURS)) {
+      fputs("Cannot use -human, -unused or -vertex-colours with -atlas\n",
+            stderr);
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* Animation channels apply to the geometry and logical colours of the
+     first frame. */
+  if ((animation_file != NULL) &&
+      ((frame != 0) ||
+       (flags & (FLAGS_PHYSICAL_COLOUR|FLAGS_FALSE_COLOUR)))) {
+    fputs("Cannot use -frame, -palette or -false with -animation\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  /* Only vertices referenced by faces are output with normals. */
+  if ((flags & FLAGS_NORMALS) && (flags & FLAGS_UNUSED)) {
+    fputs("Cannot use -unused with -normals\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  if (flags & FLAGS_CHECK) {
+    if (batch || (output_file != NULL) ||
+        (flags & (FLAGS_LIST|FLAGS_SUMMARY))) {
+      fputs("Cannot convert, list or summarize objects in check mode\n",
+            stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+
+    if (time) {
+      fputs("Cannot use the timer in check mode\n", stderr);
+      return EXIT_FAILURE;
+    }
+
+    /* Ensure that debug output from different files isn't mixed up */
+    if ((nthreads > 1) && (flags & FLAGS_VERBOSE)) {
+      fputs("Cannot use more than one thread in verbose mode\n", stderr);
+      return EXIT_FAILURE;
+    }
+  } else if (tar_output != NULL) {
+    /* The input archive may be specified, otherwise stdin is read */
+    if (n < argc) {
+      input_file = argv[n++];
+    }
+    if (n < argc) {
+      fputs("Too many arguments (an archive is converted from one input "
+            "archive)\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+  } else if (extract) {
+    /* The input file may be specified, otherwise stdin is read */
+    if (n < argc) {
+      input_file = argv[n++];
+    }
+    if (n < argc) {
+      fputs("Too many arguments (objects are extracted from one input "
+            "file)\n", stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+  } else if (watch_dir != NULL) {
+    if (n < argc) {
+      fputs("Cannot specify input files when monitoring a directory\n",
+            stderr);
+      return syntax_msg(stderr, argv[0]);
+    }
+  } else if (batch) {
     if (output_file != NULL) {
       fputs("Cannot specify an output file in batch processing mode\n",
             stderr);
@@ -478,6 +2632,27 @@ int main(int argc, const char *argv[])
       fputs("Must specify file(s) in batch processing mode\n", stderr);
       return syntax_msg(stderr, argv[0]);
     }
+
+    if (nthreads > 1) {
+      /* Ensure that debug output from different files isn't mixed up */
+      if (flags & FLAGS_VERBOSE) {
+        fputs("Cannot use more than one thread in verbose mode\n", stderr);
+        return EXIT_FAILURE;
+      }
+
+      /* Likewise, the tables listing or summarizing each file's objects */
+      if (flags & (FLAGS_LIST|FLAGS_SUMMARY)) {
+        fputs("Cannot use more than one thread in list or summary mode\n",
+              stderr);
+        return EXIT_FAILURE;
+      }
+
+      if (time || pipeline) {
+        fputs("Cannot use the timer or a pipeline with more than one "
+              "thread\n", stderr);
+        return EXIT_FAILURE;
+      }
+    }
   } else {
     /* If an input file was specified, it should follow the switches */
     if (n < argc) {
@@ -519,6 +2694,43 @@ int main(int argc, const char *argv[])
            "Copyright (C) 2016, Christopher Bazley\n");
   }
 
+  if (flags & FLAGS_CHECK) {
+    /* In check mode, the remaining arguments are treated as a list of
+       file names (or stdin if there are none) */
+    if (n >= argc) {
+      CheckResult result;
+      (void)check_file(NULL, mtl_file, flags, raw, &result);
+      print_result("stdin", &result);
+      return result.success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const int nfiles = argc - n;
+    _Optional CheckResult * const results = malloc(sizeof(*results) *
+                                                   (size_t)nfiles);
+    if (results == NULL) {
+      fputs("Failed allocating memory for results\n", stderr);
+      return EXIT_FAILURE;
+    }
+
+    CheckJob job = {
+      .input_files = argv + n,
+      .results = &*results,
+      .mtl_file = mtl_file,
+      .flags = flags,
+      .raw = raw,
+    };
+    if (!workers_run(nthreads, nfiles, check_one, &job)) {
+      rtn = EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < nfiles; ++i) {
+      print_result(argv[n + i], &*results + i);
+    }
+
+    free(results);
+    return rtn;
+  }
+
   if (palette_file != NULL) {
     /* A palette file name was specified, so open it */
     pal = load_palette(&*palette_file, flags, raw);
@@ -527,32 +2739,184 @@ int main(int argc, const char *argv[])
     }
   }
 
-  if (batch) {
-    /* In batch processing mode, the remaining arguments are treated as a
-       list of file names (output to default file names) */
-    for (; n < argc && rtn == EXIT_SUCCESS; n++) {
+  const Selection sel = {
+    .first = first,
+    .last = last,
+    .type = type,
+    .name = name,
+    .filter = has_filter ? &filter : NULL,
+  };
+
+  /* Objects that are clipped more than once (e.g. in files converted by
+     the same batch, or again when a file changes) are only clipped once */
+  ClipCache clip_cache;
+  const bool memoise = (clip_dir != NULL);
+  if (memoise && !clip_cache_init(&clip_cache, &*clip_dir)) {
+    free(pal);
+    return EXIT_FAILURE;
+  }
+  _Optional ClipCache * const cache = memoise ? &clip_cache : NULL;
+  _Optional const Budget * const limits = has_budget ? &budget : NULL;
+
+  if (tar_output != NULL) {
+    const TarJob job = {
+      .sel = &sel,
+      .pal = pal,
+      .clip_cache = cache,
+      .budget = limits,
+      .frame = frame,
+      .mtl_file = mtl_file,
+      .flags = flags,
+      .raw = raw,
+      .compress = compress,
+    };
+    if (!tar_file(input_file, &*tar_output, &job, time)) {
+      rtn = EXIT_FAILURE;
+    }
+  } else if (extract) {
+    if (!extract_objects(input_file, name, names_file, pal, cache, limits,
+                         frame, mtl_file, flags, time, raw, compress)) {
+      rtn = EXIT_FAILURE;
+    }
+  } else if (watch_dir != NULL) {
+    WatchJob job = {
+      .sel = &sel,
+      .pal = pal,
+      .clip_cache = cache,
+      .budget = limits,
+      .frame = frame,
+      .mtl_file = mtl_file,
+      .flags = flags,
+      .time = time,
+      .raw = raw,
+      .compress = compress,
+      .files = NULL,
+      .nfiles = 0,
+      .nalloc = 0,
+    };
+    if (!watch_files(&*watch_dir, palette_file, &job)) {
+      rtn = EXIT_FAILURE;
+    }
+    /* The palette may have been reloaded */
+    pal = job.pal;
+  } else if (batch && pipeline) {
+    /* Load input files in advance, in the same order as they are
+       converted */
+    const int nfiles = argc - n;
+    _Optional LoadedInput * const inputs = calloc((size_t)nfiles,
+                                                  sizeof(*inputs));
+    if (inputs == NULL) {
+      fputs("Failed allocating memory for input files\n", stderr);
+      if (memoise) {
+        clip_cache_destroy(&clip_cache);
+      }
+      free(pal);
+      return EXIT_FAILURE;
+    }
+
+    LoadJob job = {
+      .input_files = argv + n,
+      .inputs = &*inputs,
+      .sel = &sel,
+      .budget = limits,
+      .flags = flags,
+      .raw = raw,
+    };
+    InputStage stage;
+    input_stage_start(&stage, nfiles, PipelineDepth, load_one, &job);
+
+    /* A file that exceeds its budget doesn't stop the rest of the batch */
+    bool stop = false;
+    for (int i = 0; i < nfiles && !stop; i++) {
+      const clock_t start_time = time ? clock() : 0;
+      ConvertResult result = ConvertResult_Failed;
+
       /* Invent an output file name */
-      assert(argv[n] != NULL);
       StringBuffer default_output;
       stringbuffer_init(&default_output);
-      if (!stringbuffer_append(&default_output, argv[n], SIZE_MAX) ||
-          !stringbuffer_append_separated(&default_output, EXT_SEPARATOR,
-                                         "obj")) {
+      if (!input_stage_wait(&stage, i)) {
+        if ((&*inputs)[i].over_budget) {
+          result = ConvertResult_OverBudget;
+        }
+      } else if (!stringbuffer_append(&default_output, argv[n + i],
+                                      SIZE_MAX) ||
+                 !stringbuffer_append_separated(&default_output,
+                                                EXT_SEPARATOR, "obj") ||
+                 (compress &&
+                  !stringbuffer_append_separated(&default_output,
+                                                 EXT_SEPARATOR, "gz"))) {
         fprintf(stderr, "Failed to allocate memory for output file path\n");
-        rtn = EXIT_FAILURE;
-      } else if (!process_file(argv[n],
+      } else {
+        result = convert_input(&*inputs + i,
                                stringbuffer_get_pointer(&default_output),
-                               first, last, type, name, pal, frame, mtl_file,
-                               flags, time, raw)) {
-        rtn = EXIT_FAILURE;
+                               &sel, pal, cache, limits, frame, mtl_file,
+                               flags, true, compress, NULL, NULL, NULL,
+                               NULL);
+        if ((result == ConvertResult_OK) && time) {
+          print_time(start_time);
+        }
       }
       stringbuffer_destroy(&default_output);
+      free_input(&*inputs + i);
+
+      if (result != ConvertResult_OK) {
+        rtn = EXIT_FAILURE;
+        stop = (result != ConvertResult_OverBudget);
+      }
+    }
+
+    /* Discard any input files that were loaded in advance but not
+       converted because of an error */
+    input_stage_stop(&stage);
+    for (int i = 0; i < nfiles; i++) {
+      free_input(&*inputs + i);
+    }
+    free(inputs);
+  } else if (batch && (nthreads > 1)) {
+    /* Each conversion has its own state (apart from the clipping cache,
+       which is locked), so files can be converted in parallel */
+    ConvertJob job = {
+      .input_files = argv + n,
+      .sel = &sel,
+      .pal = pal,
+      .clip_cache = cache,
+      .budget = limits,
+      .frame = frame,
+      .mtl_file = mtl_file,
+      .flags = flags,
+      .raw = raw,
+      .compress = compress,
+    };
+    if (!workers_run(nthreads, argc - n, convert_one, &job)) {
+      rtn = EXIT_FAILURE;
+    }
+  } else if (batch) {
+    /* In batch processing mode, the remaining arguments are treated as a
+       list of file names (output to default file names).
+       A file that exceeds its budget doesn't stop the rest of the batch */
+    bool stop = false;
+    for (; n < argc && !stop; n++) {
+      assert(argv[n] != NULL);
+      const ConvertResult result = convert_batch_file(argv[n], &sel, pal,
+                                                      cache, limits, frame,
+                                                      mtl_file, flags, time,
+                                                      raw, compress);
+      if (result != ConvertResult_OK) {
+        rtn = EXIT_FAILURE;
+        stop = (result != ConvertResult_OverBudget);
+      }
     }
-  } else if (!process_file(input_file, output_file, first, last, type,
-                           name, pal, frame, mtl_file, flags, time, raw)) {
+  } else if (process_file(input_file, output_file, &sel, pal, cache,
+                          limits, frame, mtl_file, flags, time, raw,
+                          pipeline, compress, collision_file,
+                          animation_file, bounds_file, visibility_file) !=
+             ConvertResult_OK) {
     rtn = EXIT_FAILURE;
   }
 
+  if (memoise) {
+    clip_cache_destroy(&clip_cache);
+  }
   free(pal);
 
   return rtn;
@@ -0,0 +1,364 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Pipelined input and output stages
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if defined(USE_PTHREADS) && !defined(_WIN32)
+/* Needed for pipe() and fdopen() when compiling as strict ISO C */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#define USE_PIPES
+#endif
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef USE_PIPES
+#include <unistd.h>
+#endif
+
+/* Local header files */
+#include "misc.h"
+#include "stages.h"
+
+enum {
+  PipeBufferSize = 16384,
+};
+
+#ifdef USE_PTHREADS
+static void *input_stage(void * const arg)
+{
+  InputStage * const s = arg;
+  assert(s != NULL);
+
+  for (int index = 0; index < s->nitems; ++index) {
+    /* Don't get more than 'depth' items ahead of the consumer */
+    pthread_mutex_lock(&s->lock);
+    while (!s->stop && (index >= s->nclaimed + s->depth)) {
+      pthread_cond_wait(&s->cond, &s->lock);
+    }
+    const bool stop = s->stop;
+    pthread_mutex_unlock(&s->lock);
+
+    if (stop) {
+      break;
+    }
+
+    const bool success = s->fn(index, s->arg);
+
+    pthread_mutex_lock(&s->lock);
+    (&*s->results)[index] = success;
+    s->nloaded = index + 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+  }
+
+  return NULL;
+}
+#endif
+
+void input_stage_start(InputStage * const s, const int nitems,
+                       const int depth, WorkerFn * const fn, void * const arg)
+{
+  assert(s != NULL);
+  assert(nitems >= 0);
+  assert(depth >= 1);
+  assert(fn != NULL);
+
+  *s = (InputStage){
+    .nitems = nitems,
+    .depth = depth,
+    .nclaimed = 0,
+    .fn = fn,
+    .arg = arg,
+  };
+
+#ifdef USE_PTHREADS
+  s->threaded = false;
+  s->stop = false;
+  s->nloaded = 0;
+  s->results = malloc(sizeof(bool) * (size_t)(nitems > 0 ? nitems : 1));
+  if (s->results == NULL) {
+    return;
+  }
+
+  if (pthread_mutex_init(&s->lock, NULL) != 0) {
+    free(s->results);
+    return;
+  }
+
+  if (pthread_cond_init(&s->cond, NULL) != 0) {
+    pthread_mutex_destroy(&s->lock);
+    free(s->results);
+    return;
+  }
+
+  if (pthread_create(&s->thread, NULL, input_stage, s) != 0) {
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s->results);
+    return;
+  }
+
+  s->threaded = true;
+#endif
+}
+
+bool input_stage_wait(InputStage * const s, const int index)
+{
+  assert(s != NULL);
+  assert(index == s->nclaimed);
+  assert(index < s->nitems);
+
+#ifdef USE_PTHREADS
+  if (s->threaded) {
+    pthread_mutex_lock(&s->lock);
+    s->nclaimed = index + 1;
+    pthread_cond_broadcast(&s->cond);
+    while (s->nloaded <= index) {
+      pthread_cond_wait(&s->cond, &s->lock);
+    }
+    const bool success = (&*s->results)[index];
+    pthread_mutex_unlock(&s->lock);
+    return success;
+  }
+#endif
+
+  /* Fall back to getting each item when it is needed */
+  s->nclaimed = index + 1;
+  return s->fn(index, s->arg);
+}
+
+void input_stage_stop(InputStage * const s)
+{
+  assert(s != NULL);
+
+#ifdef USE_PTHREADS
+  if (s->threaded) {
+    pthread_mutex_lock(&s->lock);
+    s->stop = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    pthread_join(s->thread, NULL);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s->results);
+    s->threaded = false;
+  }
+#endif
+}
+
+#ifdef USE_PIPES
+static bool copy_out(OutputStage * const s, const void * const buf,
+                     size_t const n)
+{
+  assert(s != NULL);
+
+  if (s->compress) {
+    return gzout_write(&s->gz, buf, n);
+  }
+  return fwrite(buf, n, 1, s->out) == 1;
+}
+
+static void *output_stage(void * const arg)
+{
+  OutputStage * const s = arg;
+  assert(s != NULL);
+
+  unsigned char buf[PipeBufferSize];
+
+  for (;;) {
+    const ssize_t n = read(s->read_fd, buf, sizeof(buf));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      s->error = errno;
+      break;
+    }
+    if (n == 0) {
+      break; /* Write end of the pipe was closed */
+    }
+
+    /* Keep draining the pipe after an error, otherwise the thread
+       writing to it might block forever */
+    if ((s->error == 0) && !copy_out(s, buf, (size_t)n)) {
+      s->error = errno ? errno : EIO;
+    }
+  }
+
+  return NULL;
+}
+#endif
+
+_Optional FILE *output_stage_start(OutputStage * const s, FILE * const out,
+                                   bool const compress)
+{
+  assert(s != NULL);
+  assert(out != NULL);
+
+  *s = (OutputStage){
+    .out = out,
+    .compress = compress,
+    .threaded = false,
+    .pipe = NULL,
+  };
+
+  /* Flush anything already written so that it precedes the
+     output of the writer thread */
+  if (fflush(out)) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+    return NULL;
+  }
+
+  if (compress && !gzout_init(&s->gz, out)) {
+    return NULL;
+  }
+
+#ifdef USE_PIPES
+  s->error = 0;
+
+  int fds[2];
+  if (pipe(fds) == 0) {
+    s->read_fd = fds[0];
+    s->pipe = fdopen(fds[1], "w");
+    if (s->pipe == NULL) {
+      close(fds[1]);
+      close(fds[0]);
+    } else if (pthread_create(&s->thread, NULL, output_stage, s) != 0) {
+      fclose(&*s->pipe);
+      s->pipe = NULL;
+      close(fds[0]);
+    } else {
+      s->threaded = true;
+      return s->pipe;
+    }
+  }
+#endif
+
+  if (!compress) {
+    /* Fall back to writing output directly */
+    return out;
+  }
+
+  /* Fall back to compressing all of the output at the end */
+  s->pipe = tmpfile();
+  if (s->pipe == NULL) {
+    fprintf(stderr, "Failed to create temporary file: %s\n",
+            strerror(errno));
+    (void)gzout_finish(&s->gz);
+  }
+  return s->pipe;
+}
+
+static bool compress_tmp(OutputStage * const s)
+{
+  assert(s != NULL);
+  assert(s->pipe != NULL);
+
+  unsigned char buf[PipeBufferSize];
+  bool success = true;
+
+  if (fflush(&*s->pipe) || fseek(&*s->pipe, 0, SEEK_SET)) {
+    fprintf(stderr, "Failed writing to temporary file: %s\n",
+            strerror(errno));
+    success = false;
+  }
+
+  while (success) {
+    const size_t n = fread(buf, 1, sizeof(buf), &*s->pipe);
+    if (n == 0) {
+      if (ferror(&*s->pipe)) {
+        fprintf(stderr, "Failed reading temporary file: %s\n",
+                strerror(errno));
+        success = false;
+      }
+      break;
+    }
+    if (!gzout_write(&s->gz, buf, n)) {
+      fprintf(stderr, "Failed writing to output file: %s\n",
+              strerror(errno));
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+bool output_stage_finish(OutputStage * const s)
+{
+  assert(s != NULL);
+
+  bool success = true;
+
+#ifdef USE_PIPES
+  if (s->threaded) {
+    /* Closing the write end of the pipe tells the writer to finish */
+    const bool closed = (fclose(&*s->pipe) == 0);
+    const int close_error = errno;
+    s->pipe = NULL;
+
+    pthread_join(s->thread, NULL);
+    close(s->read_fd);
+    s->threaded = false;
+
+    if (!closed) {
+      fprintf(stderr, "Failed writing to output pipe: %s\n",
+              strerror(close_error));
+      success = false;
+    } else if (s->error != 0) {
+      fprintf(stderr, "Failed writing to output file: %s\n",
+              strerror(s->error));
+      success = false;
+    }
+  }
+#endif
+
+  if (s->compress) {
+    if (success && (s->pipe != NULL)) {
+      success = compress_tmp(s);
+    }
+
+    const bool finished = gzout_finish(&s->gz);
+    if (success && !finished) {
+      fprintf(stderr, "Failed writing to output file: %s\n",
+              strerror(errno));
+      success = false;
+    }
+  }
+
+  if (s->pipe != NULL) {
+    fclose(&*s->pipe);
+    s->pipe = NULL;
+  }
+
+  /* Errors writing buffered output would otherwise go unnoticed if
+     output is to stdout, which is never closed */
+  if (success && fflush(s->out)) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+    success = false;
+  }
+
+  return success;
+}
@@ -0,0 +1,69 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Pipelined input and output stages
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef STAGES_H
+#define STAGES_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "workers.h"
+#include "gzout.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+/* Gets items in order on a separate thread, up to a fixed number of items
+   ahead of the thread that consumes them */
+typedef struct {
+  int nitems;
+  int depth;      /* Maximum number of items to get in advance */
+  int nclaimed;   /* Number of items the consumer has waited for */
+  WorkerFn *fn;
+  void *arg;
+#ifdef USE_PTHREADS
+  bool threaded;
+  bool stop;
+  int nloaded;    /* Number of items got so far */
+  _Optional bool *results;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+} InputStage;
+
+void input_stage_start(InputStage *s, int nitems, int depth, WorkerFn *fn,
+                       void *arg);
+
+bool input_stage_wait(InputStage *s, int index);
+
+void input_stage_stop(InputStage *s);
+
+/* Writes output on a separate thread, receiving it through a pipe, and
+   optionally compresses it */
+typedef struct {
+  FILE *out;
+  bool compress;
+  bool threaded;
+  _Optional FILE *pipe; /* Pipe to the writer thread, or temporary file */
+#if defined(USE_PTHREADS) && !defined(_WIN32)
+  int read_fd;
+  int error;
+  pthread_t thread;
+#endif
+  GzOut gz;
+} OutputStage;
+
+_Optional FILE *output_stage_start(OutputStage *s, FILE *out, bool compress);
+
+bool output_stage_finish(OutputStage *s);
+
+#endif /* STAGES_H */
@@ -0,0 +1,342 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Framed binary stream of converted meshes
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <stdint.h>
+
+/* 3DObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local header files */
+#include "misc.h"
+#include "byteorder.h"
+#include "colours.h"
+#include "names.h"
+#include "vmerge.h"
+#include "stream.h"
+
+enum {
+  StreamVersion = 1,
+  HeaderSize = 16,
+  FrameHeaderSize = 8,
+  ObjectHeaderSize = 80,
+  VertexSize = 12,
+  FaceSize = 8,
+  IndexSize = 2,
+  EndSize = 4,
+  MaxUInt8 = 0xff,
+  MaxUInt16 = 0xffff,
+  StreamFlag_Physical = 1 << 0, /* Colours are physical, with components */
+};
+
+typedef enum {
+  FrameKind_End,
+  FrameKind_Object,
+} FrameKind;
+
+static const char stream_magic[8] = {'S','F','3','K','S','T','R','M'};
+
+/* Assigns an output index to each vertex that is output, or -1 to each
+   vertex that isn't, and returns the number of output vertices or -1 if
+   memory allocation failed */
+static int map_vertices(const VertexArray * const varray,
+                        const Group * const groups, const int ngroups,
+                        int * const map, int * const order,
+                        const bool duplicate, const int rot)
+{
+  assert(varray != NULL);
+  assert(groups != NULL);
+  assert(map != NULL);
+  assert(order != NULL);
+
+  /* Duplicate vertices are marked as unused but faces may still refer to
+     them, so find every vertex that is referenced */
+  const int nvertices = vertex_array_get_num_vertices(varray);
+  for (int v = 0; v < nvertices; ++v) {
+    map[v] = vertex_array_is_used(varray, v) ? 0 : -1;
+  }
+
+  for (int g = 0; g < ngroups; ++g) {
+    const int nprims = group_get_num_primitives(groups + g);
+    for (int p = 0; p < nprims; ++p) {
+      _Optional const Primitive * const pp = group_get_primitive(groups + g,
+                                                                 p);
+      const int nsides = pp ? primitive_get_num_sides(&*pp) : 0;
+      for (int s = 0; s < nsides; ++s) {
+        const int v = primitive_get_side(&*pp, s);
+        if ((v >= 0) && (v < nvertices)) {
+          map[v] = 0;
+        }
+      }
+    }
+  }
+
+  if (!duplicate && !vmerge_find_ids(varray, map, rot)) {
+    return -1;
+  }
+
+  /* Each vertex that is merged with an earlier vertex has the same output
+     index, which was assigned first */
+  int nout = 0;
+  for (int v = 0; v < nvertices; ++v) {
+    if (map[v] < 0) {
+      continue;
+    }
+
+    if (duplicate || (map[v] == v)) {
+      map[v] = nout;
+      order[nout++] = v;
+    } else {
+      assert(map[v] < v);
+      map[v] = map[map[v]];
+    }
+  }
+  return nout;
+}
+
+static void put_int32(unsigned char * const p, const long int value)
+{
+  put_uint32(p, (uint32_t)value);
+}
+
+static bool write_frame(FILE * const out, unsigned char * const frame,
+                        const FrameKind kind, const size_t size)
+{
+  assert(out != NULL);
+  assert(frame != NULL);
+  assert(size >= FrameHeaderSize);
+
+  put_uint32(frame, (uint32_t)kind);
+  put_uint32(frame + 4, (uint32_t)(size - FrameHeaderSize));
+
+  /* Consumers can start work on each frame as soon as it is complete */
+  if ((fwrite(frame, size, 1, out) != 1) || fflush(out)) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool stream_write_header(FILE * const out, const int frame,
+                         const bool physical)
+{
+  assert(out != NULL);
+  assert(!ferror(out));
+  assert(frame >= 0);
+
+  unsigned char header[HeaderSize] = {0};
+  memcpy(header, stream_magic, sizeof(stream_magic));
+  put_uint32(header + 8, StreamVersion);
+  put_uint16(header + 12, (unsigned int)LOWEST(frame, MaxUInt16));
+  put_uint16(header + 14, physical ? StreamFlag_Physical : 0);
+
+  if (fwrite(header, sizeof(header), 1, out) != 1) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool stream_write_object(FILE * const out, const StreamObject * const object,
+                         const VertexArray * const varray,
+                         const Group * const groups, const int ngroups,
+                         OutputPrimitivesGetColourFn * const get_colour,
+                         void * const arg, const bool physical,
+                         const bool duplicate, const int rot)
+{
+  assert(out != NULL);
+  assert(!ferror(out));
+  assert(object != NULL);
+  assert(object->name != NULL);
+  assert(varray != NULL);
+  assert(groups != NULL);
+  assert(ngroups > 0);
+  assert(ngroups <= MaxUInt8 + 1);
+  assert(get_colour != NULL);
+  assert(rot >= 0);
+
+  if ((object->index > MaxUInt16) || (object->type_count > MaxUInt16)) {
+    fprintf(stderr, "Object %d has too high a number\n", object->index);
+    return false;
+  }
+
+  const int nvertices = vertex_array_get_num_vertices(varray);
+  _Optional int * const map = malloc(sizeof(*map) *
+                                     (size_t)HIGHEST(nvertices, 1) * 2);
+  if (map == NULL) {
+    fprintf(stderr, "Failed to allocate memory for %d vertices "
+            "(object %d)\n", nvertices, object->index);
+    return false;
+  }
+  int * const order = &*map + nvertices;
+
+  const int nout = map_vertices(varray, groups, ngroups, &*map, order,
+                                duplicate, rot);
+  if (nout < 0) {
+    fprintf(stderr, "Failed to allocate memory for %d vertices "
+            "(object %d)\n", nvertices, object->index);
+    free(map);
+    return false;
+  }
+
+  int nrotating = 0;
+  if (rot > 0) {
+    for (int i = 0; i < nout; ++i) {
+      if (order[i] >= rot) {
+        ++nrotating;
+      }
+    }
+  }
+
+  long int nfaces = 0, nindices = 0;
+  for (int g = 0; g < ngroups; ++g) {
+    const int nprims = group_get_num_primitives(groups + g);
+    for (int p = 0; p < nprims; ++p) {
+      _Optional const Primitive * const pp = group_get_primitive(groups + g,
+                                                                 p);
+      if (pp != NULL) {
+        ++nfaces;
+        nindices += primitive_get_num_sides(&*pp);
+      }
+    }
+  }
+
+  if (nout > MaxUInt16) {
+    fprintf(stderr, "Object %d has too many vertices (%d)\n",
+            object->index, nout);
+    free(map);
+    return false;
+  }
+
+  const size_t faces_offset = FrameHeaderSize + ObjectHeaderSize +
+                              ((size_t)nout * VertexSize);
+  const size_t indices_offset = faces_offset + ((size_t)nfaces * FaceSize);
+  const size_t size = WORD_ALIGN(indices_offset +
+                                 ((size_t)nindices * IndexSize));
+
+  _Optional unsigned char * const frame = calloc(size, 1);
+  if (frame == NULL) {
+    fprintf(stderr, "Failed to allocate memory for a frame of %lu bytes "
+            "(object %d)\n", (unsigned long)size, object->index);
+    free(map);
+    return false;
+  }
+
+  unsigned char * const h = &*frame + FrameHeaderSize;
+  put_uint16(h, (unsigned int)object->index);
+  put_uint16(h + 2, (unsigned int)object->type_count);
+  h[4] = (unsigned char)object->type;
+  h[5] = (unsigned char)object->plot_type;
+  h[6] = (unsigned char)object->max_group;
+  strncpy((char *)h + 8, object->name, ObjNameSize - 1);
+  put_int32(h + 32, object->coll_x);
+  put_int32(h + 36, object->coll_y);
+  put_int32(h + 40, object->clip_size[0]);
+  put_int32(h + 44, object->clip_size[1]);
+  put_int32(h + 48, object->score);
+  put_int32(h + 52, object->hits_or_min_z);
+  put_int32(h + 56, object->explosion_style);
+  put_int32(h + 60, object->clip_dist);
+  put_uint32(h + 64, (uint32_t)nout);
+  put_uint32(h + 68, (uint32_t)nrotating);
+  put_uint32(h + 72, (uint32_t)nfaces);
+  put_uint32(h + 76, (uint32_t)nindices);
+
+  bool success = true;
+  for (int i = 0; (i < nout) && success; ++i) {
+    _Optional Coord (* const coords)[3] = vertex_array_get_coords(varray,
+                                                                  order[i]);
+    if (!coords) {
+      fprintf(stderr, "Bad vertex %d (object %d)\n", order[i],
+              object->index);
+      success = false;
+    } else {
+      unsigned char * const vp = h + ObjectHeaderSize + (i * VertexSize);
+      for (int k = 0; k < 3; ++k) {
+        put_float32(vp + (4 * k), (*coords)[k]);
+      }
+    }
+  }
+
+  unsigned char *fp = &*frame + faces_offset;
+  unsigned char *ip = &*frame + indices_offset;
+  for (int g = 0; (g < ngroups) && success; ++g) {
+    const int nprims = group_get_num_primitives(groups + g);
+    for (int p = 0; (p < nprims) && success; ++p) {
+      _Optional const Primitive * const pp = group_get_primitive(groups + g,
+                                                                 p);
+      if (pp == NULL) {
+        continue;
+      }
+
+      const int nsides = primitive_get_num_sides(&*pp);
+      const int colour = get_colour(&*pp, arg);
+      fp[0] = (unsigned char)nsides;
+      fp[1] = (unsigned char)g;
+      put_uint16(fp + 2, (unsigned int)colour);
+      if (physical) {
+        double rgb[3];
+        decode_colour(colour, rgb, rgb + 1, rgb + 2, 0);
+        for (int k = 0; k < 3; ++k) {
+          fp[4 + k] = (unsigned char)lround(rgb[k] * MaxUInt8);
+        }
+      }
+      fp += FaceSize;
+
+      for (int s = 0; s < nsides; ++s) {
+        const int v = primitive_get_side(&*pp, s);
+        if ((v < 0) || (v >= nvertices) || ((&*map)[v] < 0)) {
+          fprintf(stderr, "Bad vertex %d (object %d)\n", v, object->index);
+          success = false;
+          break;
+        }
+        put_uint16(ip, (unsigned int)(&*map)[v]);
+        ip += IndexSize;
+      }
+    }
+  }
+
+  if (success) {
+    success = write_frame(out, &*frame, FrameKind_Object, size);
+  }
+
+  free(frame);
+  free(map);
+  return success;
+}
+
+bool stream_write_end(FILE * const out, const bool success)
+{
+  assert(out != NULL);
+
+  unsigned char frame[FrameHeaderSize + EndSize] = {0};
+  put_uint32(frame + FrameHeaderSize, success ? 0 : 1);
+  return write_frame(out, frame, FrameKind_End, sizeof(frame));
+}
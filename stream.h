@@ -0,0 +1,47 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Framed binary stream of converted meshes
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Vertex.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+#include "sfformats.h"
+
+/* Attributes of an object that are written at the start of its frame */
+typedef struct {
+  int index;       /* Object number within the file */
+  SFObjectType type;
+  int type_count;  /* Object number among objects of the same type */
+  const char *name;
+  int plot_type;
+  int max_group;   /* Highest plot group */
+  int coll_x;
+  int coll_y;
+  int clip_size[2];
+  int score;
+  int hits_or_min_z;
+  int explosion_style;
+  int32_t clip_dist;
+} StreamObject;
+
+bool stream_write_header(FILE *out, int frame, bool physical);
+
+bool stream_write_object(FILE *out, const StreamObject *object,
+                         const VertexArray *varray, const Group *groups,
+                         int ngroups,
+                         OutputPrimitivesGetColourFn *get_colour,
+                         void *arg, bool physical, bool duplicate, int rot);
+
+bool stream_write_end(FILE *out, bool success);
+
+#endif /* STREAM_H */
@@ -0,0 +1,656 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Conversion of files in tar archives
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+
+/* Local header files */
+#include "misc.h"
+#include "tar.h"
+
+/* Archives are read and written in POSIX ustar format. Names too long for
+   a ustar header are read from GNU or pax extended headers, and written
+   as GNU extended headers. */
+enum {
+  NameOffset = 0,
+  NameSize = 100,
+  ModeOffset = 100,
+  UidOffset = 108,
+  GidOffset = 116,
+  IdSize = 8,
+  SizeOffset = 124,
+  MTimeOffset = 136,
+  NumberSize = 12,
+  ChecksumOffset = 148,
+  ChecksumSize = 8,
+  TypeOffset = 156,
+  MagicOffset = 257,
+  VersionOffset = 263,
+  PrefixOffset = 345,
+  PrefixSize = 155,
+  MaxExtendedSize = 1 << 16, /* Longest extended header to be read */
+  CopyBufferSize = 4096,
+};
+
+#define MAX_MEMBER_SIZE (077777777777l)
+
+static const char long_link_name[] = "././@LongLink";
+
+static bool get_number(const unsigned char * const field, size_t const len,
+                       long int * const value)
+{
+  assert(field != NULL);
+  assert(len > 0);
+  assert(value != NULL);
+
+  long int v = 0;
+  size_t i = 0;
+
+  if (field[0] & 0x80) {
+    /* GNU base-256 encoding of a number too big for octal digits */
+    if (field[0] & 0x40) {
+      return false; /* Negative */
+    }
+    v = field[0] & 0x3f;
+    for (i = 1; i < len; ++i) {
+      if (v > (LONG_MAX >> CHAR_BIT)) {
+        return false;
+      }
+      v = (v << CHAR_BIT) | field[i];
+    }
+    *value = v;
+    return true;
+  }
+
+  while ((i < len) && (field[i] == ' ')) {
+    ++i;
+  }
+  for (; (i < len) && (field[i] >= '0') && (field[i] <= '7'); ++i) {
+    if (v > (LONG_MAX >> 3)) {
+      return false;
+    }
+    v = (v << 3) | (field[i] - '0');
+  }
+  for (; i < len; ++i) {
+    if ((field[i] != ' ') && (field[i] != '\0')) {
+      return false;
+    }
+  }
+  *value = v;
+  return true;
+}
+
+static void put_number(unsigned char * const field, size_t const len,
+                       unsigned long int value)
+{
+  assert(field != NULL);
+  assert(len > 1);
+
+  /* Octal digits with leading zeros, followed by a null terminator */
+  field[len - 1] = '\0';
+  for (size_t i = len - 1; i > 0; --i) {
+    field[i - 1] = (unsigned char)('0' + (value & 7));
+    value >>= 3;
+  }
+}
+
+static unsigned long int get_checksum(const unsigned char * const header)
+{
+  assert(header != NULL);
+
+  /* The checksum field itself is counted as if it were spaces */
+  unsigned long int sum = 0;
+  for (int i = 0; i < TarBlockSize; ++i) {
+    if ((i >= ChecksumOffset) && (i < ChecksumOffset + ChecksumSize)) {
+      sum += ' ';
+    } else {
+      sum += header[i];
+    }
+  }
+  return sum;
+}
+
+static size_t field_len(const unsigned char * const field, size_t const size)
+{
+  assert(field != NULL);
+
+  const unsigned char * const end = memchr(field, '\0', size);
+  return end ? (size_t)(end - field) : size;
+}
+
+static _Optional char *read_extended(FILE * const in, long int const size)
+{
+  assert(in != NULL);
+
+  if ((size < 0) || (size > MaxExtendedSize)) {
+    fprintf(stderr, "Bad size %ld of extended tar header\n", size);
+    return NULL;
+  }
+
+  _Optional char * const data = malloc((size_t)size + 1);
+  if (data == NULL) {
+    fprintf(stderr, "Failed allocating memory for extended tar header\n");
+    return NULL;
+  }
+
+  if (fread(&*data, 1, (size_t)size, in) != (size_t)size) {
+    fprintf(stderr, "Failed to read extended tar header\n");
+    free(data);
+    return NULL;
+  }
+  data[size] = '\0';
+  return data;
+}
+
+static _Optional char *get_pax_path(const char * const data,
+                                    long int const size)
+{
+  assert(data != NULL);
+  assert(size >= 0);
+
+  /* Each record is "<length> <keyword>=<value>\n" */
+  static const char keyword[] = "path=";
+  _Optional char *path = NULL;
+  long int pos = 0;
+  while (pos < size) {
+    char *end;
+    const long int len = strtol(data + pos, &end, 10);
+    if ((len <= 0) || (len > size - pos) || (*end != ' ')) {
+      fprintf(stderr, "Bad record in pax extended tar header\n");
+      free(path);
+      return NULL;
+    }
+
+    const char * const record = end + 1;
+    const long int rlen = pos + len - 1 - (record - data);
+    if ((rlen >= (long int)sizeof(keyword) - 1) &&
+        !strncmp(record, keyword, sizeof(keyword) - 1)) {
+      const size_t vlen = (size_t)rlen - (sizeof(keyword) - 1);
+      free(path);
+      path = malloc(vlen + 1);
+      if (path == NULL) {
+        fprintf(stderr, "Failed allocating memory for tar member name\n");
+        return NULL;
+      }
+      memcpy(&*path, record + sizeof(keyword) - 1, vlen);
+      path[vlen] = '\0';
+    }
+    pos += len;
+  }
+
+  if (path == NULL) {
+    /* No name in this header, so use the one in the next header */
+    path = malloc(1);
+    if (path != NULL) {
+      *path = '\0';
+    }
+  }
+  return path;
+}
+
+static _Optional char *get_header_name(const unsigned char * const header)
+{
+  assert(header != NULL);
+
+  /* Only ustar archives have a prefix for long names */
+  const bool ustar = !memcmp(header + MagicOffset, "ustar", 5);
+  const size_t plen = ustar ? field_len(header + PrefixOffset, PrefixSize) :
+                      0;
+  const size_t nlen = field_len(header + NameOffset, NameSize);
+
+  _Optional char * const name = malloc(plen + 1 + nlen + 1);
+  if (name == NULL) {
+    fprintf(stderr, "Failed allocating memory for tar member name\n");
+    return NULL;
+  }
+
+  size_t len = 0;
+  if (plen > 0) {
+    memcpy(&*name, header + PrefixOffset, plen);
+    name[plen] = '/';
+    len = plen + 1;
+  }
+  memcpy(&*name + len, header + NameOffset, nlen);
+  name[len + nlen] = '\0';
+  return name;
+}
+
+/* Reads and discards 'size' bytes, so that input needn't be seekable */
+static bool skip_bytes(FILE * const in, long int size)
+{
+  assert(in != NULL);
+  assert(size >= 0);
+
+  unsigned char buffer[TarBlockSize];
+  while (size > 0) {
+    const size_t n = (size_t)LOWEST(size, (long int)sizeof(buffer));
+    if (fread(buffer, n, 1, in) != 1) {
+      return false;
+    }
+    size -= (long int)n;
+  }
+  return true;
+}
+
+void tar_reader_init(TarReader * const reader, FILE * const in)
+{
+  assert(reader != NULL);
+  assert(in != NULL);
+
+  *reader = (TarReader){
+    .in = in,
+    .next = 0,
+    .size = 0,
+    .unread = 0,
+    .padding = 0,
+    .name = NULL,
+    .long_name = NULL,
+  };
+}
+
+int tar_reader_next(TarReader * const reader)
+{
+  assert(reader != NULL);
+
+  free(reader->name);
+  reader->name = NULL;
+
+  /* Discard whatever is left of the current member */
+  if (!skip_bytes(reader->in, reader->unread + reader->padding)) {
+    fprintf(stderr, "Failed to read tar member ending at offset %ld\n",
+            reader->next);
+    return -1;
+  }
+  reader->unread = reader->padding = 0;
+
+  for (;;) {
+    const long int offset = reader->next;
+    unsigned char header[TarBlockSize];
+    const size_t n = fread(header, 1, sizeof(header), reader->in);
+    if (n == 0 && feof(reader->in)) {
+      return 0; /* Tolerate a missing end-of-archive marker */
+    }
+    if (n != sizeof(header)) {
+      fprintf(stderr, "Failed to read tar header at offset %ld\n", offset);
+      return -1;
+    }
+
+    size_t i = 0;
+    while ((i < sizeof(header)) && (header[i] == 0)) {
+      ++i;
+    }
+    if (i == sizeof(header)) {
+      return 0; /* End-of-archive marker */
+    }
+
+    long int checksum, size;
+    if (!get_number(header + ChecksumOffset, ChecksumSize, &checksum) ||
+        ((unsigned long int)checksum != get_checksum(header)) ||
+        !get_number(header + SizeOffset, NumberSize, &size) ||
+        (size > LONG_MAX - offset - 2 * TarBlockSize)) {
+      fprintf(stderr, "Bad tar header at offset %ld\n", offset);
+      return -1;
+    }
+
+    const long int padding = (TarBlockSize - (size % TarBlockSize)) %
+                             TarBlockSize;
+    reader->next = offset + TarBlockSize + size + padding;
+
+    switch (header[TypeOffset]) {
+      case 'L': /* GNU long name of the next member */
+      case 'x': /* pax extended header of the next member */
+      {
+        _Optional char * const data = read_extended(reader->in, size);
+        if (data == NULL) {
+          return -1;
+        }
+        free(reader->long_name);
+        if (header[TypeOffset] == 'L') {
+          reader->long_name = data;
+        } else {
+          reader->long_name = get_pax_path(&*data, size);
+          free(data);
+          if (reader->long_name == NULL) {
+            return -1;
+          }
+        }
+
+        if (!skip_bytes(reader->in, padding)) {
+          fprintf(stderr, "Failed to read tar header at offset %ld\n",
+                  offset);
+          return -1;
+        }
+        break;
+      }
+
+      case '0':
+      case '\0':
+      case '7': /* Contiguous file */
+        if ((reader->long_name != NULL) && (*reader->long_name != '\0')) {
+          reader->name = reader->long_name;
+        } else {
+          free(reader->long_name);
+          reader->name = get_header_name(header);
+          if (reader->name == NULL) {
+            reader->long_name = NULL;
+            return -1;
+          }
+        }
+        reader->long_name = NULL;
+        reader->size = reader->unread = size;
+        reader->padding = padding;
+        return 1;
+
+      default:
+        /* Skip directories, links and other special members */
+        free(reader->long_name);
+        reader->long_name = NULL;
+
+        if (!skip_bytes(reader->in, size + padding)) {
+          fprintf(stderr, "Failed to read tar member at offset %ld\n",
+                  offset + TarBlockSize);
+          return -1;
+        }
+        break;
+    }
+  }
+}
+
+size_t tar_reader_read(TarReader * const reader, void * const buffer,
+                       size_t const size)
+{
+  assert(reader != NULL);
+  assert(buffer != NULL);
+
+  const size_t n = (size_t)LOWEST((unsigned long int)size,
+                                  (unsigned long int)reader->unread);
+  const size_t got = (n > 0) ? fread(buffer, 1, n, reader->in) : 0;
+  reader->unread -= (long int)got;
+  return got;
+}
+
+void tar_reader_destroy(TarReader * const reader)
+{
+  assert(reader != NULL);
+
+  free(reader->name);
+  reader->name = NULL;
+  free(reader->long_name);
+  reader->long_name = NULL;
+}
+
+void tar_writer_init(TarWriter * const writer, FILE * const out)
+{
+  assert(writer != NULL);
+  assert(out != NULL);
+
+  const time_t now = time(NULL);
+  *writer = (TarWriter){
+    .out = out,
+    .mtime = (now == (time_t)-1) ? 0 : (long int)now,
+  };
+}
+
+static bool write_padding(FILE * const out, long int const size)
+{
+  assert(out != NULL);
+  assert(size >= 0);
+
+  static const unsigned char zeros[TarBlockSize] = {0};
+  const long int npad = (TarBlockSize - (size % TarBlockSize)) % TarBlockSize;
+  return (npad == 0) || (fwrite(zeros, (size_t)npad, 1, out) == 1);
+}
+
+static bool write_header(TarWriter * const writer, const char * const name,
+                         size_t const nlen, const char * const prefix,
+                         size_t const plen, long int const size,
+                         char const type)
+{
+  assert(writer != NULL);
+  assert(name != NULL);
+  assert(nlen <= NameSize);
+  assert(prefix != NULL);
+  assert(plen <= PrefixSize);
+  assert(size >= 0);
+
+  unsigned char header[TarBlockSize] = {0};
+  memcpy(header + NameOffset, name, nlen);
+  put_number(header + ModeOffset, IdSize, 0644);
+  put_number(header + UidOffset, IdSize, 0);
+  put_number(header + GidOffset, IdSize, 0);
+  put_number(header + SizeOffset, NumberSize, (unsigned long int)size);
+  put_number(header + MTimeOffset, NumberSize,
+             (unsigned long int)writer->mtime);
+  header[TypeOffset] = (unsigned char)type;
+  memcpy(header + MagicOffset, "ustar", 6);
+  memcpy(header + VersionOffset, "00", 2);
+  memcpy(header + PrefixOffset, prefix, plen);
+
+  /* The checksum is six octal digits, a null terminator and a space */
+  put_number(header + ChecksumOffset, ChecksumSize - 1,
+             get_checksum(header));
+  header[ChecksumOffset + ChecksumSize - 1] = ' ';
+
+  return fwrite(header, sizeof(header), 1, writer->out) == 1;
+}
+
+bool tar_writer_add(TarWriter * const writer, const char * const name,
+                    FILE * const data, long int const size)
+{
+  assert(writer != NULL);
+  assert(name != NULL);
+  assert(data != NULL);
+  assert(size >= 0);
+
+  if (size > MAX_MEMBER_SIZE) {
+    fprintf(stderr, "Tar member '%s' is too big\n", name);
+    return false;
+  }
+
+  const size_t len = strlen(name);
+  bool success = true;
+  if (len <= NameSize) {
+    success = write_header(writer, name, len, "", 0, size, '0');
+  } else {
+    /* Split the name between the prefix and name fields if possible */
+    size_t split = len - NameSize - 1;
+    while ((split < len) && (name[split] != '/')) {
+      ++split;
+    }
+
+    if ((split <= PrefixSize) && (split + 1 < len)) {
+      success = write_header(writer, name + split + 1, len - split - 1,
+                             name, split, size, '0');
+    } else {
+      /* A GNU extended header holds the name, including its terminator */
+      success = write_header(writer, long_link_name,
+                             sizeof(long_link_name) - 1, "", 0,
+                             (long int)len + 1, 'L') &&
+                (fwrite(name, len + 1, 1, writer->out) == 1) &&
+                write_padding(writer->out, (long int)len + 1) &&
+                write_header(writer, name, NameSize, "", 0, size, '0');
+    }
+  }
+
+  unsigned char buffer[CopyBufferSize];
+  for (long int copied = 0; success && (copied < size); ) {
+    const size_t n = (size_t)LOWEST(size - copied, (long int)sizeof(buffer));
+    if (fread(buffer, n, 1, data) != 1) {
+      fprintf(stderr, "Failed to read output for tar member '%s'\n", name);
+      return false;
+    }
+    success = (fwrite(buffer, n, 1, writer->out) == 1);
+    copied += (long int)n;
+  }
+
+  if (success) {
+    success = write_padding(writer->out, size);
+  }
+
+  if (!success) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+  }
+  return success;
+}
+
+bool tar_writer_finish(TarWriter * const writer)
+{
+  assert(writer != NULL);
+
+  /* Two blocks of zeros mark the end of the archive */
+  static const unsigned char zeros[TarBlockSize * 2] = {0};
+  if (fwrite(zeros, sizeof(zeros), 1, writer->out) != 1) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+/* Copies the current member of an archive to a temporary file, so that it
+   can be converted from a seekable stream of known length */
+static bool copy_member(TarReader * const reader, FILE * const tmp)
+{
+  assert(reader != NULL);
+  assert(tmp != NULL);
+
+  rewind(tmp);
+  unsigned char buffer[CopyBufferSize];
+  for (long int copied = 0; copied < reader->size; ) {
+    const size_t n = tar_reader_read(reader, buffer, sizeof(buffer));
+    if (n == 0) {
+      fprintf(stderr, "Failed to read tar member '%s'\n",
+              &*reader->name);
+      return false;
+    }
+    if (fwrite(buffer, n, 1, tmp) != 1) {
+      fprintf(stderr, "Failed writing to temporary file: %s\n",
+              strerror(errno));
+      return false;
+    }
+    copied += (long int)n;
+  }
+
+  if (fflush(tmp) || fseek(tmp, 0, SEEK_SET)) {
+    fprintf(stderr, "Failed to read temporary file: %s\n", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+int tar_convert(FILE * const in, FILE * const out, const char * const suffix,
+                TarConvertFn * const fn, void * const arg,
+                bool const verbose)
+{
+  assert(in != NULL);
+  assert(out != NULL);
+  assert(suffix != NULL);
+  assert(fn != NULL);
+
+  TarReader reader;
+  tar_reader_init(&reader, in);
+
+  /* Each member is copied to a temporary file first because the archive
+     may not be seekable, and output is written to another because the
+     size of each member must be known before its data is written. The
+     temporary files are reused without truncating them because only the
+     part written for each member is read. */
+  _Optional FILE * const tmp_in = tmpfile(), * const tmp = tmpfile();
+  if ((tmp_in == NULL) || (tmp == NULL)) {
+    fprintf(stderr, "Failed to create temporary file: %s\n",
+            strerror(errno));
+    if (tmp_in != NULL) {
+      fclose(&*tmp_in);
+    }
+    if (tmp != NULL) {
+      fclose(&*tmp);
+    }
+    return -1;
+  }
+
+  TarWriter writer;
+  tar_writer_init(&writer, out);
+
+  bool success = true;
+  int nfailed = 0;
+  for (;;) {
+    const int found = tar_reader_next(&reader);
+    if (found <= 0) {
+      success = (found == 0);
+      break;
+    }
+
+    const char * const name = &*reader.name;
+    if (verbose) {
+      printf("Converting tar member '%s' (%ld bytes)\n", name, reader.size);
+    }
+
+    if (!copy_member(&reader, &*tmp_in)) {
+      success = false;
+      break;
+    }
+
+    /* A member that can't be converted is left out of the output archive
+       but doesn't stop the others from being converted */
+    rewind(&*tmp);
+    if (!fn(&*tmp_in, reader.size, name, &*tmp, arg)) {
+      fprintf(stderr, "Failed to convert tar member '%s'\n", name);
+      ++nfailed;
+      continue;
+    }
+
+    const long int size = ftell(&*tmp);
+    const size_t len = strlen(name), slen = strlen(suffix);
+    _Optional char * const out_name = malloc(len + slen + 1);
+    if (out_name == NULL) {
+      fprintf(stderr, "Failed allocating memory for tar member name\n");
+      success = false;
+      break;
+    }
+    memcpy(&*out_name, name, len);
+    memcpy(&*out_name + len, suffix, slen + 1);
+
+    if ((size < 0) || fflush(&*tmp) || fseek(&*tmp, 0, SEEK_SET)) {
+      fprintf(stderr, "Failed to read temporary file: %s\n",
+              strerror(errno));
+      success = false;
+    } else {
+      success = tar_writer_add(&writer, &*out_name, &*tmp, size);
+    }
+    free(out_name);
+    if (!success) {
+      break;
+    }
+  }
+
+  if (success) {
+    success = tar_writer_finish(&writer);
+  }
+
+  fclose(&*tmp);
+  fclose(&*tmp_in);
+  tar_reader_destroy(&reader);
+  return success ? nfailed : -1;
+}
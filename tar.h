@@ -0,0 +1,69 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Conversion of files in tar archives
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef TAR_H
+#define TAR_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+enum {
+  TarBlockSize = 512
+};
+
+/* Converts 'size' bytes of input read from 'in', writing to 'out'. The
+   input is a seekable copy of the member. */
+typedef bool TarConvertFn(FILE *in, long int size, const char *name,
+                          FILE *out, void *arg);
+
+typedef struct {
+  FILE *in;
+  long int next;          /* Offset of the next header in the archive */
+  long int size;          /* Size of the current member */
+  long int unread;        /* Bytes of the current member not yet read */
+  long int padding;       /* Bytes of padding after the current member */
+  _Optional char *name;   /* Name of the current member */
+  _Optional char *long_name; /* Name of the next member, if too long for
+                                its header */
+} TarReader;
+
+typedef struct {
+  FILE *out;
+  long int mtime;         /* Modification time of every member */
+} TarWriter;
+
+/* The archive is read sequentially, so it needn't be seekable. */
+void tar_reader_init(TarReader *reader, FILE *in);
+
+/* Finds the next regular file in the archive, discarding any data of the
+   current one that hasn't been read. Returns 1 if found, 0 at the end of
+   the archive, or -1 on error. */
+int tar_reader_next(TarReader *reader);
+
+/* Reads up to 'size' bytes of the current member's data. */
+size_t tar_reader_read(TarReader *reader, void *buffer, size_t size);
+
+void tar_reader_destroy(TarReader *reader);
+
+void tar_writer_init(TarWriter *writer, FILE *out);
+
+bool tar_writer_add(TarWriter *writer, const char *name, FILE *data,
+                    long int size);
+
+bool tar_writer_finish(TarWriter *writer);
+
+/* Converts each regular file in the archive read from 'in' to a member of
+   the archive written to 'out'. Members that can't be converted are left
+   out. Returns the number of such members, or -1 if the output archive
+   couldn't be written. */
+int tar_convert(FILE *in, FILE *out, const char *suffix,
+                TarConvertFn *fn, void *arg, bool verbose);
+
+#endif /* TAR_H */
@@ -0,0 +1,361 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Unit tests for the catalog of objects in many graphics files
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Local header files */
+#include "sfformats.h"
+#include "misc.h"
+#include "flags.h"
+#include "catalog.h"
+#include "check.h"
+
+/* Files are created in the working directory */
+static const char graphics_file[] = "catalog_test_obj";
+static const char catalog_file[] = "catalog_test.cat";
+static const char output_file[] = "catalog_test.txt";
+
+enum {
+  NumObjects = 5,
+  MaxFileSize = 2048,
+  MaxPolygons = 7
+};
+
+typedef struct {
+  SFObjectType type;
+  int type_count;
+  int nvertices;
+  int npolygons;
+  int plot_type;
+  long int offset;
+  long int size;
+} Expected;
+
+typedef struct {
+  unsigned char data[MaxFileSize];
+  long int size;
+} Buffer;
+
+static void put_byte(Buffer * const buf, int const value)
+{
+  assert(buf != NULL);
+  assert(buf->size < MaxFileSize);
+  buf->data[buf->size++] = (unsigned char)value;
+}
+
+static void put_int32(Buffer * const buf, long int const value)
+{
+  for (int i = 0; i < 4; ++i) {
+    put_byte(buf, (int)((unsigned long int)value >> (8 * i)) & 0xff);
+  }
+}
+
+static void put_zeros(Buffer * const buf, int const n)
+{
+  for (int i = 0; i < n; ++i) {
+    put_byte(buf, 0);
+  }
+}
+
+static void align(Buffer * const buf)
+{
+  while (buf->size % 4) {
+    put_byte(buf, 0);
+  }
+}
+
+/* A cube, with extra vertices in the plane of one face. Plot type 1 also
+   needs a polygon in the vectors group and one in group 1. */
+static void put_object(Buffer * const buf, SFObjectType const type,
+                       int const nextra, int const npolygons,
+                       int const plot_type)
+{
+  static const unsigned char cube[][3] = {
+    {110, 110, 110}, {100, 85, 100}, {85, 100, 100}, {100, 115, 100},
+    {100, 100, 85}, {100, 85, 100}, {115, 100, 100}, {100, 115, 100},
+  };
+  static const struct {
+    int nsides;
+    unsigned char sides[4];
+    int colour;
+  } polygons[MaxPolygons] = {
+    {4, {1, 2, 3, 4}, 7}, {4, {5, 6, 7, 8}, 300}, {4, {1, 2, 6, 5}, 7},
+    {4, {3, 4, 8, 7}, 300}, {3, {1, 2, 3}, 42}, {3, {2, 3, 4}, 7},
+    {3, {6, 7, 8}, 300},
+  };
+
+  assert(npolygons >= 1 && npolygons <= MaxPolygons);
+  assert(plot_type == 0 || plot_type == 1);
+
+  /* No explosion and an unused header */
+  put_int32(buf, 0);
+  put_zeros(buf, 36);
+
+  /* Type, scale, rotation, clip distance and so on, then the plot type
+     and highest plot group */
+  static const unsigned char header[] = {1, 0, 0x23, 100, 0, 60, 0, 4, 10,
+                                         2};
+  put_byte(buf, (int)type);
+  for (size_t i = 0; i < ARRAY_SIZE(header); ++i) {
+    put_byte(buf, header[i]);
+  }
+  put_byte(buf, plot_type | (plot_type << 4));
+
+  put_byte(buf, (int)ARRAY_SIZE(cube) + nextra);
+  for (size_t v = 0; v < ARRAY_SIZE(cube); ++v) {
+    for (size_t c = 0; c < ARRAY_SIZE(cube[v]); ++c) {
+      put_byte(buf, cube[v][c]);
+    }
+  }
+  for (int v = 0; v < nextra; ++v) {
+    put_byte(buf, 100 + v);
+    put_byte(buf, 96);
+    put_byte(buf, 100);
+  }
+  align(buf);
+
+  put_int32(buf, 1234);
+  put_byte(buf, npolygons + (plot_type * 2));
+  if (plot_type == 1) {
+    static const int groups[] = {SFObjectFacet_VectorsGroup, 1};
+    for (size_t g = 0; g < ARRAY_SIZE(groups); ++g) {
+      put_byte(buf, 3 | (groups[g] << 4));
+      put_byte(buf, 1);
+      put_byte(buf, 2);
+      put_byte(buf, 3);
+      put_byte(buf, 9);
+    }
+  }
+  for (int p = 0; p < npolygons; ++p) {
+    put_byte(buf, polygons[p].nsides |
+                  (polygons[p].colour >= 256 ? 0x80 : 0));
+    for (int s = 0; s < polygons[p].nsides; ++s) {
+      put_byte(buf, polygons[p].sides[s]);
+    }
+    put_byte(buf, polygons[p].colour & 0xff);
+  }
+  align(buf);
+
+  /* No collision boxes */
+  put_int32(buf, 0);
+  put_zeros(buf, 8 + 28 + 4);
+}
+
+static bool make_graphics(Expected * const expected)
+{
+  static const SFObjectType types[NumObjects] = {
+    SFObjectType_Aerial, SFObjectType_Ground, SFObjectType_Bit,
+    SFObjectType_Ground, SFObjectType_Aerial,
+  };
+
+  static Buffer buf;
+  buf.size = 0;
+
+  /* Plot type 1 always plots group 0, and group 1 if polygon 0 faces the
+     viewer */
+  static const unsigned char plot_types[] = {0x00, 0x20, 1, 255, 254, 0, 0,
+                                             0};
+  for (size_t i = 0; i < ARRAY_SIZE(plot_types); ++i) {
+    put_byte(&buf, plot_types[i]);
+  }
+
+  int type_counts[SFObjectType_Aerial + 1] = {0};
+  for (int o = 0; o < NumObjects; ++o) {
+    const long int offset = buf.size;
+    const int npolygons = 3 + o, plot_type = (o == 3);
+    put_object(&buf, types[o], o * 2, npolygons, plot_type);
+    expected[o] = (Expected){
+      .type = types[o],
+      .type_count = type_counts[types[o]]++,
+      .nvertices = 8 + o * 2,
+      .npolygons = npolygons + (plot_type * 2),
+      .plot_type = plot_type,
+      .offset = offset,
+      .size = buf.size - offset,
+    };
+  }
+  put_int32(&buf, 99);
+
+  _Optional FILE * const f = fopen(graphics_file, "wb");
+  if (f == NULL) {
+    perror(graphics_file);
+    return false;
+  }
+  const bool success = (fwrite(buf.data, (size_t)buf.size, 1, &*f) == 1);
+  return !fclose(&*f) && success;
+}
+
+/* Runs a query and checks that it lists the expected objects */
+static void check_query(const CatalogFilter * const filter,
+                        const Expected * const expected,
+                        unsigned int const wanted)
+{
+  assert(filter != NULL);
+  assert(expected != NULL);
+
+  if (freopen(output_file, "w", stdout) == NULL) {
+    perror(output_file);
+    ++check_failures;
+    return;
+  }
+  CHECK(catalog_query(catalog_file, filter, 0));
+  CHECK(fflush(stdout) == 0);
+
+  _Optional FILE * const f = fopen(output_file, "r");
+  CHECK(f != NULL);
+  if (f == NULL) {
+    return;
+  }
+
+  unsigned int found = 0;
+  int nmatches = -1;
+  char line[256];
+  while (fgets(line, sizeof(line), &*f)) {
+    int index, type_count, nvertices, npolygons, plot_type;
+    long int offset, size;
+    char type[16], name[16], hash[17], file[64];
+    if (sscanf(line, "%d %15s %d %15s %d %d %d %ld %ld %16s %63s",
+               &index, type, &type_count, name, &nvertices, &npolygons,
+               &plot_type, &offset, &size, hash, file) == 11) {
+      CHECK(index >= 0 && index < NumObjects);
+      if (index < 0 || index >= NumObjects) {
+        continue;
+      }
+      const Expected * const e = expected + index;
+      CHECK(!(found & (1u << index)));
+      found |= 1u << index;
+      CHECK(type_count == e->type_count);
+      CHECK(nvertices == e->nvertices);
+      CHECK(npolygons == e->npolygons);
+      CHECK(plot_type == e->plot_type);
+      CHECK(offset == e->offset);
+      CHECK(size == e->size);
+      CHECK(!strcmp(file, graphics_file));
+    } else {
+      sscanf(line, "Found %d matching", &nmatches);
+    }
+  }
+  fclose(&*f);
+
+  CHECK(found == wanted);
+  if (found != wanted) {
+    fprintf(stderr, "Found objects 0x%x instead of 0x%x\n", found, wanted);
+  }
+
+  unsigned int nwanted = 0;
+  for (unsigned int w = wanted; w != 0; w >>= 1) {
+    nwanted += w & 1;
+  }
+  CHECK(nmatches == (int)nwanted);
+}
+
+static CatalogFilter any(void)
+{
+  return (CatalogFilter){
+    .first = -1,
+    .last = -1,
+    .type = SFObjectType_Invalid,
+    .name = NULL,
+    .nvertices = -1,
+    .npolygons = -1,
+    .plot_type = -1,
+    .filter = NULL,
+  };
+}
+
+static void test_queries(const Expected * const expected)
+{
+  CatalogFilter filter = any();
+  check_query(&filter, expected, 0x1f);
+
+  filter.first = 1;
+  filter.last = 3;
+  check_query(&filter, expected, 0x0e);
+
+  /* Objects are numbered among objects of the same type */
+  filter = any();
+  filter.type = SFObjectType_Ground;
+  check_query(&filter, expected, 0x0a);
+  filter.first = 1;
+  check_query(&filter, expected, 0x08);
+
+  filter = any();
+  filter.nvertices = 12;
+  check_query(&filter, expected, 0x04);
+
+  filter = any();
+  filter.npolygons = 7;
+  check_query(&filter, expected, 0x10);
+
+  filter = any();
+  filter.name = "player";
+  check_query(&filter, expected, 0x01);
+
+  filter = any();
+  filter.plot_type = 1;
+  check_query(&filter, expected, 0x08);
+
+  /* Ranges of vertex and face counts, using a filter expression */
+  static const struct {
+    const char *expr;
+    unsigned int wanted;
+  } exprs[] = {
+    {"vertices > 10", 0x1c},
+    {"vertices >= 10 && vertices < 14", 0x06},
+    {"faces <= 4 || faces == 8", 0x0b},
+    {"type == g && type_index > 0", 0x08},
+    {"plot != 0 || index == 0", 0x09},
+    {"!(vertices < 16)", 0x10},
+  };
+  for (size_t i = 0; i < ARRAY_SIZE(exprs); ++i) {
+    Filter expr;
+    CHECK(filter_parse(&expr, exprs[i].expr));
+    filter = any();
+    filter.filter = &expr;
+    check_query(&filter, expected, exprs[i].wanted);
+  }
+
+  /* A filter expression as well as other criteria */
+  Filter expr;
+  CHECK(filter_parse(&expr, "faces < 7"));
+  filter = any();
+  filter.type = SFObjectType_Aerial;
+  filter.filter = &expr;
+  check_query(&filter, expected, 0x01);
+}
+
+int main(void)
+{
+  Expected expected[NumObjects];
+  CHECK(make_graphics(expected));
+
+  const char * const input_files[] = {graphics_file};
+  CHECK(catalog_build(catalog_file, 1, input_files, 1, 0, true));
+  test_queries(expected);
+
+  remove(graphics_file);
+  remove(catalog_file);
+  remove(output_file);
+  return CHECK_STATUS();
+}
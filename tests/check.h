@@ -0,0 +1,24 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Reporting of failed checks by the unit tests
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Unlike assert, a check is still made if NDEBUG is defined and a failure
+   doesn't stop the remaining checks. */
+static int check_failures;
+
+#define CHECK(expr) \
+  ((expr) ? (void)0 : \
+   ((void)fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, \
+                  __LINE__, #expr), (void)++check_failures))
+
+#define CHECK_STATUS() (check_failures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+#endif /* CHECK_H */
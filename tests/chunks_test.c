@@ -0,0 +1,179 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Unit tests for the chunked file format
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Local header files */
+#include "sfformats.h"
+#include "misc.h"
+#include "chunks.h"
+#include "check.h"
+
+enum {
+  DataSize = 3000
+};
+
+/* Plot type definitions, three objects and an end-of-file marker. The
+   second object is incompressible, so it must be stored raw. */
+static const ChunkInfo chunks[] = {
+  {0, 12, -1, SFObjectType_Invalid, 0},
+  {12, 1000, 0, SFObjectType_Ground, 0},
+  {1012, 700, 1, SFObjectType_Aerial, 0},
+  {1712, 1284, 2, SFObjectType_Ground, 1},
+  {2996, 4, -1, SFObjectType_Invalid, 0},
+};
+
+static unsigned char data[DataSize];
+
+static void make_data(void)
+{
+  unsigned long int seed = 1;
+  for (long int i = 0; i < DataSize; ++i) {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    const bool random = (i >= chunks[2].offset) &&
+                        (i < chunks[3].offset);
+    data[i] = random ? (unsigned char)(seed >> 16) :
+                       (unsigned char)(i % 17);
+  }
+}
+
+static bool select_index(const ChunkInfo * const chunk, void * const arg)
+{
+  assert(chunk != NULL);
+  assert(arg != NULL);
+  const int * const index = arg;
+  return chunk->index == *index;
+}
+
+/* Checks that loaded data is the concatenation of the given chunks */
+static void check_data(const unsigned char * const loaded,
+                       long int const size, const int * const wanted,
+                       size_t const nwanted)
+{
+  assert(loaded != NULL);
+  assert(wanted != NULL);
+
+  long int pos = 0;
+  for (size_t w = 0; w < nwanted; ++w) {
+    const ChunkInfo * const chunk = chunks + wanted[w];
+    CHECK(pos + chunk->size <= size);
+    if (pos + chunk->size > size) {
+      return;
+    }
+    CHECK(!memcmp(loaded + pos, data + chunk->offset, (size_t)chunk->size));
+    pos += chunk->size;
+  }
+  CHECK(pos == size);
+}
+
+static void test_not_chunked(void)
+{
+  _Optional FILE * const f = tmpfile();
+  CHECK(f != NULL);
+  if (f == NULL) {
+    return;
+  }
+
+  CHECK(fwrite(data, DataSize, 1, &*f) == 1);
+  CHECK(!fseek(&*f, 0, SEEK_SET));
+  CHECK(!chunks_is_chunked(&*f));
+  CHECK(ftell(&*f) == 0);
+  fclose(&*f);
+}
+
+static void test_load(FILE * const f)
+{
+  assert(f != NULL);
+
+  /* Everything */
+  CHECK(!fseek(f, 0, SEEK_SET));
+  CHECK(chunks_is_chunked(f));
+  CHECK(ftell(f) == 0);
+
+  long int size = 0;
+  _Optional unsigned char *loaded = chunks_load(f, NULL, NULL, &size, NULL,
+                                                NULL);
+  CHECK(loaded != NULL);
+  if (loaded != NULL) {
+    CHECK(size == DataSize);
+    CHECK(!memcmp(&*loaded, data, DataSize));
+    free(loaded);
+  }
+
+  /* One object */
+  int index = 2;
+  _Optional ObjectNumber *numbers = NULL;
+  int nnumbers = 0;
+  CHECK(!fseek(f, 0, SEEK_SET));
+  loaded = chunks_load(f, select_index, &index, &size, &numbers, &nnumbers);
+  CHECK(loaded != NULL);
+  if (loaded != NULL) {
+    static const int wanted[] = {0, 3, 4};
+    check_data(&*loaded, size, wanted, ARRAY_SIZE(wanted));
+    free(loaded);
+  }
+  CHECK(nnumbers == 1);
+  CHECK(numbers != NULL);
+  if (numbers != NULL) {
+    CHECK(numbers[0].index == 2);
+    CHECK(numbers[0].type_count == 1);
+  }
+  free(numbers);
+
+  /* No object, in which case the last object is kept */
+  index = 99;
+  numbers = NULL;
+  CHECK(!fseek(f, 0, SEEK_SET));
+  loaded = chunks_load(f, select_index, &index, &size, &numbers, &nnumbers);
+  CHECK(loaded != NULL);
+  if (loaded != NULL) {
+    static const int wanted[] = {0, 3, 4};
+    check_data(&*loaded, size, wanted, ARRAY_SIZE(wanted));
+    free(loaded);
+  }
+  CHECK(nnumbers == 1);
+  free(numbers);
+}
+
+static void test_round_trip(void)
+{
+  _Optional FILE * const f = tmpfile();
+  CHECK(f != NULL);
+  if (f == NULL) {
+    return;
+  }
+
+  CHECK(chunks_write(&*f, data, chunks, (int)ARRAY_SIZE(chunks)));
+  CHECK(ftell(&*f) < DataSize);
+  test_load(&*f);
+  fclose(&*f);
+}
+
+int main(void)
+{
+  make_data();
+  test_not_chunked();
+  test_round_trip();
+  return CHECK_STATUS();
+}
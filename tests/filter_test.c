@@ -0,0 +1,156 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Unit tests for filter expressions
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Local header files */
+#include "sfformats.h"
+#include "misc.h"
+#include "filter.h"
+#include "check.h"
+
+/* Parses an expression and matches it against one object */
+static bool match(const char * const expr, int const index,
+                  SFObjectType const type, int const nvertices)
+{
+  assert(expr != NULL);
+
+  Filter filter;
+  if (!filter_parse(&filter, expr)) {
+    fprintf(stderr, "Failed to parse '%s'\n", expr);
+    ++check_failures;
+    return false;
+  }
+
+  const int values[FilterAttribute_Count] = {
+    [FilterAttribute_Index] = index,
+    [FilterAttribute_Type] = (int)type,
+    [FilterAttribute_TypeIndex] = index,
+    [FilterAttribute_Vertices] = nvertices,
+    [FilterAttribute_Faces] = 6,
+  };
+  return filter_match(&filter, values);
+}
+
+static void test_comparisons(void)
+{
+  CHECK(match("index == 3", 3, SFObjectType_Ground, 8));
+  CHECK(!match("index != 3", 3, SFObjectType_Ground, 8));
+  CHECK(match("index < 4", 3, SFObjectType_Ground, 8));
+  CHECK(!match("index < 3", 3, SFObjectType_Ground, 8));
+  CHECK(match("index <= 3", 3, SFObjectType_Ground, 8));
+  CHECK(!match("index > 3", 3, SFObjectType_Ground, 8));
+  CHECK(match("index >= 3", 3, SFObjectType_Ground, 8));
+  CHECK(match("3 == index", 3, SFObjectType_Ground, 8));
+  CHECK(match("vertices>=8&&faces<7", 0, SFObjectType_Ground, 8));
+
+  /* Object types can be named in either case, in full or as a letter */
+  CHECK(match("type == ship", 0, SFObjectType_Aerial, 8));
+  CHECK(match("TYPE == S", 0, SFObjectType_Aerial, 8));
+  CHECK(!match("type == bit", 0, SFObjectType_Aerial, 8));
+}
+
+static void test_precedence(void)
+{
+  /* && binds more tightly than || */
+  CHECK(match("index == 1 || index == 2 && type == g", 1,
+              SFObjectType_Aerial, 8));
+  CHECK(!match("(index == 1 || index == 2) && type == g", 1,
+               SFObjectType_Aerial, 8));
+  CHECK(match("type == g && index == 2 || index == 1", 1,
+              SFObjectType_Aerial, 8));
+
+  /* ! binds more tightly than && */
+  CHECK(match("!index == 1 && type == g", 2, SFObjectType_Ground, 8));
+  CHECK(!match("!(index == 2 && type == g)", 2, SFObjectType_Ground, 8));
+  CHECK(match("!!index == 2", 2, SFObjectType_Ground, 8));
+
+  /* Operators of the same precedence associate to the left */
+  CHECK(match("index == 1 || index == 2 || index == 3", 3,
+              SFObjectType_Ground, 8));
+  CHECK(!match("index > 1 && index < 3 && type == s", 2,
+               SFObjectType_Ground, 8));
+}
+
+static void test_needs(void)
+{
+  Filter filter;
+  CHECK(filter_parse(&filter, "index == 1 || type == g"));
+  CHECK(!(filter.needs & (FILTER_NEEDS_HEADER | FILTER_NEEDS_FACES)));
+
+  CHECK(filter_parse(&filter, "vertices > 4"));
+  CHECK(filter.needs & FILTER_NEEDS_HEADER);
+  CHECK(!(filter.needs & FILTER_NEEDS_FACES));
+
+  CHECK(filter_parse(&filter, "faces > 4"));
+  CHECK(filter.needs & FILTER_NEEDS_FACES);
+}
+
+static void test_errors(void)
+{
+  static const char * const bad[] = {
+    "",
+    "index",
+    "index ==",
+    "index = 1",
+    "index == 1 &&",
+    "index == 1 & type == g",
+    "(index == 1",
+    "index == 1)",
+    "index == 1 type == g",
+    "colour == 1",
+    "index == -1",
+    "index == 99999999999",
+    "!",
+    "()",
+  };
+
+  for (size_t i = 0; i < ARRAY_SIZE(bad); ++i) {
+    Filter filter;
+    if (filter_parse(&filter, bad[i])) {
+      fprintf(stderr, "Parsed bad filter '%s'\n", bad[i]);
+      ++check_failures;
+    }
+  }
+
+  /* Each comparison compiles to three operators, and each && to one */
+  char expr[512] = "index == 0";
+  for (int i = 1; i < FilterMaxOps / 4; ++i) {
+    char term[32];
+    sprintf(term, " && index != %d", i);
+    strcat(expr, term);
+  }
+  Filter filter;
+  CHECK(filter_parse(&filter, expr));
+  strcat(expr, " && index != 99");
+  CHECK(!filter_parse(&filter, expr));
+}
+
+int main(void)
+{
+  test_comparisons();
+  test_precedence();
+  test_needs();
+  test_errors();
+  return CHECK_STATUS();
+}
@@ -0,0 +1,249 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Unit tests for GKey decompression
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* StreamLib headers */
+#include "ReaderGKey.h"
+
+/* Local header files */
+#include "misc.h"
+#include "gkeydec.h"
+#include "gkeyenc.h"
+#include "check.h"
+
+typedef struct {
+  const unsigned char *expected;
+  size_t expected_size;
+  const unsigned char *compressed;
+  size_t compressed_size;
+} Vector;
+
+/* Compressed by an independent implementation of the algorithm */
+static const unsigned char empty_in[] = {0x00, 0x00, 0x00, 0x00};
+
+static const unsigned char literals_in[] = {
+  0x04, 0x00, 0x00, 0x00, 0xa6, 0x18, 0x99, 0xb1, 0x04
+};
+
+static const unsigned char overlap_in[] = {
+  0x0c, 0x00, 0x00, 0x00, 0xc2, 0x88, 0x19, 0xdb, 0x3f, 0x01
+};
+
+/* Copies from before the start of the data, which reads as zeros */
+static const unsigned char zeros_in[] = {
+  0x10, 0x00, 0x00, 0x00, 0x01, 0x40, 0x00
+};
+
+static const unsigned char repeat_in[] = {
+  0x23, 0x00, 0x00, 0x00, 0xa6, 0xd0, 0x09, 0x23, 0x07, 0x84, 0x91, 0x34,
+  0x67, 0xd0, 0xd0, 0x29, 0x23, 0x07, 0xc4, 0x0c, 0x18, 0x30, 0x60, 0x80,
+  0x74, 0x1f, 0x01
+};
+
+static const unsigned char zeros_out[16] = {0};
+
+/* The expected output is a string literal without its terminator */
+#define VECTOR(out, in) \
+  {(const unsigned char *)out, sizeof(out) - 1, in, sizeof(in)}
+
+static const Vector vectors[] = {
+  VECTOR("", empty_in),
+  VECTOR("SF3K", literals_in),
+  VECTOR("abcabcabcabc", overlap_in),
+  {zeros_out, sizeof(zeros_out), zeros_in, sizeof(zeros_in)},
+  VECTOR("Star Fighter 3000 Star Fighter 3000", repeat_in),
+};
+
+static _Optional FILE *make_input(const unsigned char * const data,
+                                  size_t const size)
+{
+  assert(data != NULL);
+
+  _Optional FILE * const f = tmpfile();
+  if (f == NULL) {
+    perror("tmpfile");
+    return NULL;
+  }
+  if ((fwrite(data, size, 1, &*f) != 1) || fseek(&*f, 0, SEEK_SET)) {
+    perror("tmpfile");
+    fclose(&*f);
+    return NULL;
+  }
+  return f;
+}
+
+/* Decompresses data in pieces of the given size */
+static bool decompress(const unsigned char * const data, size_t const size,
+                       size_t const piece, unsigned char * const out,
+                       size_t const out_size, size_t * const nout)
+{
+  assert(data != NULL);
+  assert(piece > 0);
+  assert(out != NULL);
+  assert(nout != NULL);
+
+  *nout = 0;
+  _Optional FILE * const f = make_input(data, size);
+  if (f == NULL) {
+    return false;
+  }
+
+  GKeyDec dec;
+  bool success = gkeydec_init(&dec, &*f);
+  if (success) {
+    const long int expected = gkeydec_get_size(&dec);
+    success = (expected >= 0) && ((size_t)expected <= out_size);
+    while (success && (*nout < (size_t)expected)) {
+      const size_t n = gkeydec_read(&dec, out + *nout,
+                                    LOWEST(piece, out_size - *nout));
+      if (n == 0) {
+        break;
+      }
+      *nout += n;
+    }
+    success = success && (*nout == (size_t)expected) &&
+              !gkeydec_error(&dec);
+  }
+
+  fclose(&*f);
+  return success;
+}
+
+/* Checks that GKeyLib decompresses data to the same bytes */
+static bool matches_gkeylib(const unsigned char * const data,
+                            size_t const size,
+                            const unsigned char * const expected,
+                            size_t const expected_size)
+{
+  assert(data != NULL);
+  assert(expected != NULL);
+
+  _Optional FILE * const f = make_input(data, size);
+  if (f == NULL) {
+    return false;
+  }
+
+  Reader r;
+  bool match = reader_gkey_init(&r, GKeyHistoryLog2, &*f);
+  if (match) {
+    for (size_t i = 0; (i < expected_size) && match; ++i) {
+      const int c = reader_fgetc(&r);
+      if (c != expected[i]) {
+        fprintf(stderr, "GKeyLib output differs at offset %zu (%d, "
+                "expected %d)\n", i, c, expected[i]);
+        match = false;
+      }
+    }
+    if (match && (reader_fgetc(&r) != EOF)) {
+      fputs("GKeyLib output is longer\n", stderr);
+      match = false;
+    }
+    reader_destroy(&r);
+  }
+
+  fclose(&*f);
+  return match;
+}
+
+static void test_vectors(void)
+{
+  static const size_t pieces[] = {1, 3, 512};
+
+  for (size_t v = 0; v < ARRAY_SIZE(vectors); ++v) {
+    const Vector * const vec = vectors + v;
+    for (size_t p = 0; p < ARRAY_SIZE(pieces); ++p) {
+      unsigned char out[64];
+      size_t nout;
+      CHECK(decompress(vec->compressed, vec->compressed_size, pieces[p],
+                       out, sizeof(out), &nout));
+      CHECK(nout == vec->expected_size);
+      CHECK(!memcmp(out, vec->expected, vec->expected_size));
+    }
+    CHECK(matches_gkeylib(vec->compressed, vec->compressed_size,
+                          vec->expected, vec->expected_size));
+  }
+}
+
+static void test_bad_input(void)
+{
+  /* The top bit of the size is set */
+  static const unsigned char negative[] = {0x00, 0x00, 0x00, 0x80};
+  /* The size is incomplete */
+  static const unsigned char short_size[] = {0x04, 0x00};
+  /* Two literals are missing */
+  static const unsigned char truncated[] = {0x04, 0x00, 0x00, 0x00, 0xa6, 0x18};
+  /* A directive to copy no bytes */
+  static const unsigned char zero_copy[] = {0x01, 0x00, 0x00, 0x00, 0x01,
+                                            0x00, 0x00};
+
+  unsigned char out[64];
+  size_t nout;
+  CHECK(!decompress(negative, sizeof(negative), 1, out, sizeof(out), &nout));
+  CHECK(!decompress(short_size, sizeof(short_size), 1, out, sizeof(out),
+                    &nout));
+  CHECK(!decompress(truncated, sizeof(truncated), 1, out, sizeof(out),
+                    &nout));
+  CHECK(nout < 4);
+  CHECK(!decompress(zero_copy, sizeof(zero_copy), 1, out, sizeof(out),
+                    &nout));
+  CHECK(nout == 0);
+}
+
+static void test_round_trip(void)
+{
+  /* More than the history size, with repeats both near and far apart */
+  enum { Size = 5000 };
+  static unsigned char data[Size], out[Size];
+  unsigned long int seed = 1;
+  for (size_t i = 0; i < Size; ++i) {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    data[i] = (i % 700 < 300) ? (unsigned char)(i % 13) :
+                                (unsigned char)(seed >> 16);
+  }
+
+  size_t size = 0;
+  _Optional unsigned char * const compressed = gkeyenc_compress(data, Size,
+                                                                &size);
+  CHECK(compressed != NULL);
+  if (compressed == NULL) {
+    return;
+  }
+  CHECK(size < Size);
+
+  size_t nout;
+  CHECK(decompress(&*compressed, size, 100, out, sizeof(out), &nout));
+  CHECK(nout == Size);
+  CHECK(!memcmp(out, data, Size));
+  CHECK(matches_gkeylib(&*compressed, size, out, nout));
+  free(compressed);
+}
+
+int main(void)
+{
+  test_vectors();
+  test_bad_input();
+  test_round_trip();
+  return CHECK_STATUS();
+}
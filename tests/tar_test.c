@@ -0,0 +1,313 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Unit tests for reading and writing tar archives
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _WIN32
+/* Needed for pipe() and fdopen() when compiling as strict ISO C */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#define USE_PIPES
+#endif
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef USE_PIPES
+#include <unistd.h>
+#endif
+
+/* Local header files */
+#include "misc.h"
+#include "tar.h"
+#include "check.h"
+
+typedef struct {
+  const char *name;
+  long int size;
+} Member;
+
+static const Member members[] = {
+  {"Earth1/obj.obj", 1000},
+  {"empty.obj", 0},
+  {"exact.obj", TarBlockSize},
+  /* Split between the prefix and name fields of the header */
+  {"Graphics/Academy1/Graphics/Academy2/Graphics/Academy3/Graphics/"
+   "Academy4/Graphics/Academy5/Graphics/Academy6/obj.obj", 3},
+  /* Too long for the name field, and without a directory separator, so
+     it needs an extended header */
+  {"a_name_much_too_long_to_fit_in_the_name_field_of_a_ustar_header_"
+   "even_though_it_contains_no_directory_separators.obj", 700},
+};
+
+static unsigned char member_byte(size_t const m, long int const i)
+{
+  return (unsigned char)((m * 31 + (size_t)i * 7) & 0xff);
+}
+
+static bool add_member(TarWriter * const writer, size_t const m)
+{
+  assert(writer != NULL);
+  assert(m < ARRAY_SIZE(members));
+
+  _Optional FILE * const data = tmpfile();
+  if (data == NULL) {
+    perror("tmpfile");
+    return false;
+  }
+
+  bool success = true;
+  for (long int i = 0; success && (i < members[m].size); ++i) {
+    success = (fputc(member_byte(m, i), &*data) != EOF);
+  }
+
+  success = success && !fseek(&*data, 0, SEEK_SET) &&
+            tar_writer_add(writer, members[m].name, &*data, members[m].size);
+  fclose(&*data);
+  return success;
+}
+
+static bool check_member(TarReader * const reader, size_t const m)
+{
+  assert(reader != NULL);
+  assert(m < ARRAY_SIZE(members));
+
+  for (long int i = 0; i < members[m].size; ++i) {
+    unsigned char byte;
+    if ((tar_reader_read(reader, &byte, 1) != 1) ||
+        (byte != member_byte(m, i))) {
+      fprintf(stderr, "Member %zu differs at offset %ld\n", m, i);
+      return false;
+    }
+  }
+
+  /* Reading must stop at the end of the member */
+  unsigned char byte;
+  return tar_reader_read(reader, &byte, 1) == 0;
+}
+
+static bool check_name(const TarReader * const reader, const char * const name,
+                       const char * const suffix)
+{
+  assert(reader != NULL);
+  assert(name != NULL);
+  assert(suffix != NULL);
+
+  const size_t len = strlen(name);
+  return (reader->name != NULL) && !strncmp(&*reader->name, name, len) &&
+         !strcmp(&*reader->name + len, suffix);
+}
+
+static _Optional FILE *write_archive(void)
+{
+  _Optional FILE * const f = tmpfile();
+  if (f == NULL) {
+    perror("tmpfile");
+    return NULL;
+  }
+
+  TarWriter writer;
+  tar_writer_init(&writer, &*f);
+  bool success = true;
+  for (size_t m = 0; success && (m < ARRAY_SIZE(members)); ++m) {
+    success = add_member(&writer, m);
+  }
+  if (!success || !tar_writer_finish(&writer) || fseek(&*f, 0, SEEK_SET)) {
+    fclose(&*f);
+    return NULL;
+  }
+  return f;
+}
+
+static void test_round_trip(void)
+{
+  _Optional FILE * const f = tmpfile();
+  CHECK(f != NULL);
+  if (f == NULL) {
+    return;
+  }
+
+  TarWriter writer;
+  tar_writer_init(&writer, &*f);
+  for (size_t m = 0; m < ARRAY_SIZE(members); ++m) {
+    CHECK(add_member(&writer, m));
+  }
+  CHECK(tar_writer_finish(&writer));
+
+  /* Every member must start on a block boundary */
+  const long int size = ftell(&*f);
+  CHECK((size % TarBlockSize) == 0);
+
+  CHECK(!fseek(&*f, 0, SEEK_SET));
+  TarReader reader;
+  tar_reader_init(&reader, &*f);
+
+  for (size_t m = 0; m < ARRAY_SIZE(members); ++m) {
+    CHECK(tar_reader_next(&reader) == 1);
+    CHECK(check_name(&reader, members[m].name, ""));
+    CHECK(reader.size == members[m].size);
+    CHECK(check_member(&reader, m));
+  }
+  CHECK(tar_reader_next(&reader) == 0);
+
+  tar_reader_destroy(&reader);
+  fclose(&*f);
+}
+
+static void test_bad_header(void)
+{
+  _Optional FILE * const f = tmpfile();
+  CHECK(f != NULL);
+  if (f == NULL) {
+    return;
+  }
+
+  TarWriter writer;
+  tar_writer_init(&writer, &*f);
+  CHECK(add_member(&writer, 0));
+  CHECK(tar_writer_finish(&writer));
+
+  /* Corrupt the name, which is covered by the checksum */
+  CHECK(!fseek(&*f, 0, SEEK_SET));
+  CHECK(fputc('X', &*f) != EOF);
+
+  CHECK(!fseek(&*f, 0, SEEK_SET));
+  TarReader reader;
+  tar_reader_init(&reader, &*f);
+  CHECK(tar_reader_next(&reader) == -1);
+
+  tar_reader_destroy(&reader);
+  fclose(&*f);
+}
+
+#ifdef USE_PIPES
+static void test_pipe(void)
+{
+  /* The archive is small enough to fit in a pipe's buffer, so it can be
+     written before it is read */
+  _Optional FILE * const f = write_archive();
+  CHECK(f != NULL);
+  int fds[2];
+  if ((f == NULL) || pipe(fds)) {
+    return;
+  }
+
+  int c;
+  while ((c = fgetc(&*f)) != EOF) {
+    const unsigned char byte = (unsigned char)c;
+    CHECK(write(fds[1], &byte, 1) == 1);
+  }
+  fclose(&*f);
+  close(fds[1]);
+
+  _Optional FILE * const in = fdopen(fds[0], "rb");
+  CHECK(in != NULL);
+  if (in == NULL) {
+    close(fds[0]);
+    return;
+  }
+
+  /* Members that aren't read, or are only partly read, are skipped */
+  TarReader reader;
+  tar_reader_init(&reader, &*in);
+  for (size_t m = 0; m < ARRAY_SIZE(members); ++m) {
+    CHECK(tar_reader_next(&reader) == 1);
+    CHECK(check_name(&reader, members[m].name, ""));
+    if (m % 3 == 0) {
+      CHECK(check_member(&reader, m));
+    } else if (m % 3 == 1) {
+      unsigned char byte;
+      CHECK(tar_reader_read(&reader, &byte, 1) ==
+            (members[m].size > 0 ? 1u : 0u));
+    }
+  }
+  CHECK(tar_reader_next(&reader) == 0);
+
+  tar_reader_destroy(&reader);
+  fclose(&*in);
+}
+#endif
+
+static bool copy_unless_empty(FILE * const in, long int const size,
+                              const char * const name, FILE * const out,
+                              void * const arg)
+{
+  NOT_USED(name);
+  NOT_USED(arg);
+  assert(in != NULL);
+  assert(out != NULL);
+
+  if (size == 0) {
+    return false;
+  }
+
+  for (long int i = 0; i < size; ++i) {
+    const int c = fgetc(in);
+    if ((c == EOF) || (fputc(c, out) == EOF)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void test_convert(void)
+{
+  _Optional FILE * const in = write_archive(), * const out = tmpfile();
+  CHECK(in != NULL);
+  CHECK(out != NULL);
+  if ((in != NULL) && (out != NULL)) {
+    /* The empty member fails but the others are still converted */
+    CHECK(tar_convert(&*in, &*out, ".out", copy_unless_empty, NULL,
+                      false) == 1);
+
+    CHECK(!fseek(&*out, 0, SEEK_SET));
+    TarReader reader;
+    tar_reader_init(&reader, &*out);
+    for (size_t m = 0; m < ARRAY_SIZE(members); ++m) {
+      if (members[m].size > 0) {
+        CHECK(tar_reader_next(&reader) == 1);
+        CHECK(check_name(&reader, members[m].name, ".out"));
+        CHECK(check_member(&reader, m));
+      }
+    }
+    CHECK(tar_reader_next(&reader) == 0);
+    tar_reader_destroy(&reader);
+  }
+
+  if (in != NULL) {
+    fclose(&*in);
+  }
+  if (out != NULL) {
+    fclose(&*out);
+  }
+}
+
+int main(void)
+{
+  test_round_trip();
+  test_bad_header();
+#ifdef USE_PIPES
+  test_pipe();
+#endif
+  test_convert();
+  return CHECK_STATUS();
+}
@@ -0,0 +1,635 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Triangle ordering for a post-transform vertex cache
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/* 3DObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+
+/* Local header files */
+#include "misc.h"
+#include "vmerge.h"
+#include "vcache.h"
+
+/* Parameters of the vertex scoring function from Tom Forsyth's "Linear-Speed
+   Vertex Cache Optimisation" */
+#define CACHE_DECAY_POWER (1.5)
+#define LAST_TRI_SCORE (0.75)
+#define VALENCE_BOOST_SCALE (2.0)
+#define VALENCE_BOOST_POWER (0.5)
+
+enum {
+  CacheSize = 32, /* Size of the simulated least-recently-used cache */
+  NoTriangle = -1,
+};
+
+typedef struct {
+  int v[3];  /* Vertex indices to be output */
+  int id[3]; /* Vertex identities for adjacency and caching */
+  int colour;
+  int prim_id;
+} Triangle;
+
+typedef struct {
+  int lo, hi; /* Vertex identities at each end, in ascending order */
+  int tri;
+  int side;
+  bool forward; /* Does the triangle's winding go from lo to hi? */
+} Edge;
+
+typedef struct {
+  int remaining; /* Number of triangles not yet added that use the vertex */
+  int cache_pos; /* Position in the cache, or -1 if not cached */
+  double score;
+  int first;     /* Index of the first entry in the triangle list */
+} VertexInfo;
+
+static long int count_misses(const Triangle * const tris, const int ntris)
+{
+  assert(tris != NULL || ntris == 0);
+
+  int cache[CacheSize];
+  int ncached = 0;
+  long int misses = 0;
+
+  for (int t = 0; t < ntris; ++t) {
+    for (int k = 0; k < 3; ++k) {
+      const int id = tris[t].id[k];
+      int pos = 0;
+      while ((pos < ncached) && (cache[pos] != id)) {
+        ++pos;
+      }
+      if (pos == ncached) {
+        ++misses;
+        if (ncached < CacheSize) {
+          ++ncached;
+        }
+        pos = ncached - 1;
+      }
+      /* Move the vertex to the front of the cache */
+      memmove(cache + 1, cache, sizeof(cache[0]) * (size_t)pos);
+      cache[0] = id;
+    }
+  }
+  return misses;
+}
+
+static int compare_edges(const void * const a, const void * const b)
+{
+  const Edge * const ea = a, * const eb = b;
+
+  if (ea->lo != eb->lo) {
+    return (ea->lo > eb->lo) - (ea->lo < eb->lo);
+  }
+  return (ea->hi > eb->hi) - (ea->hi < eb->hi);
+}
+
+/* Finds the neighbour across each side of each triangle, where the
+   neighbour shares the same edge with the opposite winding */
+static bool find_neighbours(const Triangle * const tris, const int ntris,
+                            int (* const neighbours)[3])
+{
+  assert(tris != NULL);
+  assert(ntris > 0);
+  assert(neighbours != NULL);
+
+  _Optional Edge * const edges = malloc(sizeof(*edges) * 3 * (size_t)ntris);
+  if (edges == NULL) {
+    return false;
+  }
+
+  int nedges = 0;
+  for (int t = 0; t < ntris; ++t) {
+    for (int s = 0; s < 3; ++s) {
+      const int a = tris[t].id[s], b = tris[t].id[(s + 1) % 3];
+      neighbours[t][s] = NoTriangle;
+      (&*edges)[nedges++] = (Edge){
+        .lo = LOWEST(a, b),
+        .hi = HIGHEST(a, b),
+        .tri = t,
+        .side = s,
+        .forward = a < b
+      };
+    }
+  }
+
+  qsort(&*edges, (size_t)nedges, sizeof(*edges), compare_edges);
+
+  for (int i = 0; i < nedges; ) {
+    int j = i + 1;
+    while ((j < nedges) && (compare_edges(&*edges + i, &*edges + j) == 0)) {
+      ++j;
+    }
+
+    /* Pair up triangles on opposite sides of the same edge */
+    for (int e = i; e < j; ++e) {
+      const Edge * const ee = &*edges + e;
+      if (neighbours[ee->tri][ee->side] != NoTriangle) {
+        continue;
+      }
+      for (int f = e + 1; f < j; ++f) {
+        const Edge * const ef = &*edges + f;
+        if ((ef->forward != ee->forward) && (ef->tri != ee->tri) &&
+            (neighbours[ef->tri][ef->side] == NoTriangle)) {
+          neighbours[ee->tri][ee->side] = ef->tri;
+          neighbours[ef->tri][ef->side] = ee->tri;
+          break;
+        }
+      }
+    }
+    i = j;
+  }
+
+  free(edges);
+  return true;
+}
+
+static int count_free_neighbours(int (* const neighbours)[3],
+                                 const bool * const done, const int t)
+{
+  int count = 0;
+  for (int s = 0; s < 3; ++s) {
+    const int n = neighbours[t][s];
+    if ((n != NoTriangle) && !done[n]) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+/* Returns the side of a triangle which joins the given vertices */
+static int find_side(const Triangle * const tri, const int a, const int b)
+{
+  assert(tri != NULL);
+
+  for (int s = 0; s < 3; ++s) {
+    const int c = tri->id[s], d = tri->id[(s + 1) % 3];
+    if (((c == a) && (d == b)) || ((c == b) && (d == a))) {
+      return s;
+    }
+  }
+  return -1;
+}
+
+/* Orders triangles so that each follows a neighbour with which it shares
+   the edge between the previous two vertices of a strip */
+static bool stripify(const Triangle * const tris, const int ntris,
+                     Triangle * const out)
+{
+  assert(tris != NULL);
+  assert(ntris > 0);
+  assert(out != NULL);
+
+  _Optional int (* const neighbours)[3] = malloc(sizeof(*neighbours) *
+                                                 (size_t)ntris);
+  _Optional bool * const done = calloc((size_t)ntris, sizeof(*done));
+  if ((neighbours == NULL) || (done == NULL) ||
+      !find_neighbours(tris, ntris, &*neighbours)) {
+    free(done);
+    free(neighbours);
+    return false;
+  }
+
+  int nout = 0;
+  while (nout < ntris) {
+    /* Start a new strip at the triangle with fewest free neighbours,
+       which is most likely to be left isolated otherwise */
+    int start = NoTriangle, best = 4;
+    for (int t = 0; t < ntris; ++t) {
+      if (!(&*done)[t]) {
+        const int n = count_free_neighbours(&*neighbours, &*done, t);
+        if (n < best) {
+          best = n;
+          start = t;
+        }
+      }
+    }
+    assert(start != NoTriangle);
+
+    /* Leave the first triangle by whichever free side leads to the
+       neighbour with fewest free neighbours of its own */
+    int exit_side = 0, fewest = 4;
+    for (int s = 0; s < 3; ++s) {
+      const int n = (&*neighbours)[start][s];
+      if ((n != NoTriangle) && !(&*done)[n]) {
+        const int count = count_free_neighbours(&*neighbours, &*done, n);
+        if (count < fewest) {
+          fewest = count;
+          exit_side = s;
+        }
+      }
+    }
+
+    int t = start;
+    int p = tris[t].id[exit_side], q = tris[t].id[(exit_side + 1) % 3];
+    (&*done)[t] = true;
+    out[nout++] = tris[t];
+
+    for (;;) {
+      const int side = find_side(tris + t, p, q);
+      assert(side >= 0);
+      const int next = (&*neighbours)[t][side];
+      if ((next == NoTriangle) || (&*done)[next]) {
+        break;
+      }
+
+      /* The strip continues with the vertex opposite the shared edge */
+      const int next_side = find_side(tris + next, p, q);
+      assert(next_side >= 0);
+      const int r = tris[next].id[(next_side + 2) % 3];
+      p = q;
+      q = r;
+      t = next;
+      (&*done)[t] = true;
+      out[nout++] = tris[t];
+    }
+  }
+
+  free(done);
+  free(neighbours);
+  return true;
+}
+
+static double vertex_score(const VertexInfo * const vi)
+{
+  assert(vi != NULL);
+
+  if (vi->remaining == 0) {
+    return -1.0; /* No triangles need this vertex */
+  }
+
+  double score = 0.0;
+  if (vi->cache_pos >= 3) {
+    const double scaler = 1.0 / (CacheSize - 3);
+    score = pow(1.0 - ((vi->cache_pos - 3) * scaler), CACHE_DECAY_POWER);
+  } else if (vi->cache_pos >= 0) {
+    /* The most recent triangle's vertices get a fixed score so that its
+       neighbours don't always win */
+    score = LAST_TRI_SCORE;
+  }
+
+  /* Favour vertices with few triangles left, to avoid orphaning them */
+  score += VALENCE_BOOST_SCALE * pow(vi->remaining, -VALENCE_BOOST_POWER);
+  return score;
+}
+
+/* Reorders triangles to keep vertices in a least-recently-used cache for
+   as long as they are needed, using Forsyth's greedy algorithm */
+static bool optimise_order(const Triangle * const tris, const int ntris,
+                           const int nids, Triangle * const out)
+{
+  assert(tris != NULL);
+  assert(ntris > 0);
+  assert(nids > 0);
+  assert(out != NULL);
+
+  _Optional VertexInfo * const vinfo = calloc((size_t)nids, sizeof(*vinfo));
+  _Optional int * const vtris = malloc(sizeof(int) * 3 * (size_t)ntris);
+  _Optional double * const tscore = malloc(sizeof(double) * (size_t)ntris);
+  _Optional bool * const done = calloc((size_t)ntris, sizeof(*done));
+  if ((vinfo == NULL) || (vtris == NULL) || (tscore == NULL) ||
+      (done == NULL)) {
+    free(done);
+    free(tscore);
+    free(vtris);
+    free(vinfo);
+    return false;
+  }
+  VertexInfo * const vi = &*vinfo;
+
+  /* Make a list of the triangles that use each vertex */
+  for (int t = 0; t < ntris; ++t) {
+    for (int k = 0; k < 3; ++k) {
+      ++vi[tris[t].id[k]].remaining;
+    }
+  }
+  int first = 0;
+  for (int v = 0; v < nids; ++v) {
+    vi[v].first = first;
+    first += vi[v].remaining;
+    vi[v].remaining = 0;
+    vi[v].cache_pos = -1;
+  }
+  for (int t = 0; t < ntris; ++t) {
+    for (int k = 0; k < 3; ++k) {
+      VertexInfo * const v = vi + tris[t].id[k];
+      (&*vtris)[v->first + v->remaining++] = t;
+    }
+  }
+
+  for (int v = 0; v < nids; ++v) {
+    vi[v].score = vertex_score(vi + v);
+  }
+  for (int t = 0; t < ntris; ++t) {
+    (&*tscore)[t] = vi[tris[t].id[0]].score + vi[tris[t].id[1]].score +
+                    vi[tris[t].id[2]].score;
+  }
+
+  int cache[CacheSize + 3];
+  int ncached = 0;
+
+  for (int nout = 0; nout < ntris; ++nout) {
+    /* Prefer triangles using cached vertices; otherwise scan them all */
+    int best = NoTriangle;
+    double best_score = -1.0;
+    for (int c = 0; c < ncached; ++c) {
+      const VertexInfo * const v = vi + cache[c];
+      for (int i = 0; i < v->remaining; ++i) {
+        const int t = (&*vtris)[v->first + i];
+        if ((&*tscore)[t] > best_score) {
+          best_score = (&*tscore)[t];
+          best = t;
+        }
+      }
+    }
+    if (best == NoTriangle) {
+      for (int t = 0; t < ntris; ++t) {
+        if (!(&*done)[t] && ((&*tscore)[t] > best_score)) {
+          best_score = (&*tscore)[t];
+          best = t;
+        }
+      }
+    }
+    assert(best != NoTriangle);
+
+    (&*done)[best] = true;
+    out[nout] = tris[best];
+
+    /* Remove the triangle from the lists of its vertices */
+    for (int k = 0; k < 3; ++k) {
+      VertexInfo * const v = vi + tris[best].id[k];
+      int * const list = &*vtris + v->first;
+      for (int i = 0; i < v->remaining; ++i) {
+        if (list[i] == best) {
+          list[i] = list[--v->remaining];
+          break;
+        }
+      }
+    }
+
+    /* Move its vertices to the front of the cache */
+    int new_cache[CacheSize + 3];
+    int nnew = 0;
+    for (int k = 0; k < 3; ++k) {
+      new_cache[nnew++] = tris[best].id[k];
+    }
+    for (int c = 0; c < ncached; ++c) {
+      const int id = cache[c];
+      if ((id != tris[best].id[0]) && (id != tris[best].id[1]) &&
+          (id != tris[best].id[2])) {
+        new_cache[nnew++] = id;
+      }
+    }
+
+    /* Update scores of vertices that were or are now in the cache */
+    for (int c = 0; c < nnew; ++c) {
+      vi[new_cache[c]].cache_pos = (c < CacheSize) ? c : -1;
+    }
+    for (int c = 0; c < nnew; ++c) {
+      VertexInfo * const v = vi + new_cache[c];
+      v->score = vertex_score(v);
+    }
+    for (int c = 0; c < nnew; ++c) {
+      const VertexInfo * const v = vi + new_cache[c];
+      for (int i = 0; i < v->remaining; ++i) {
+        const int t = (&*vtris)[v->first + i];
+        (&*tscore)[t] = vi[tris[t].id[0]].score + vi[tris[t].id[1]].score +
+                        vi[tris[t].id[2]].score;
+      }
+    }
+
+    ncached = LOWEST(nnew, (int)CacheSize);
+    memcpy(cache, new_cache, sizeof(cache[0]) * (size_t)ncached);
+  }
+
+  free(done);
+  free(tscore);
+  free(vtris);
+  free(vinfo);
+  return true;
+}
+
+/* Reorders a run of triangles of the same colour, keeping the original
+   order unless another is better */
+static bool optimise_run(Triangle * const tris, const int ntris,
+                         const int nids, VCacheStats * const stats)
+{
+  assert(tris != NULL);
+  assert(ntris > 0);
+  assert(stats != NULL);
+
+  const long int before = count_misses(tris, ntris);
+  long int after = before;
+
+  _Optional Triangle * const strips = malloc(sizeof(*strips) *
+                                             (size_t)ntris);
+  _Optional Triangle * const optimised = malloc(sizeof(*optimised) *
+                                                (size_t)ntris);
+  bool success = (strips != NULL) && (optimised != NULL);
+
+  if (success) {
+    success = stripify(tris, ntris, &*strips) &&
+              optimise_order(&*strips, ntris, nids, &*optimised);
+  }
+
+  if (success) {
+    const long int strip_misses = count_misses(&*strips, ntris);
+    const long int optimised_misses = count_misses(&*optimised, ntris);
+    if (optimised_misses < after) {
+      after = optimised_misses;
+      memcpy(tris, &*optimised, sizeof(*tris) * (size_t)ntris);
+    }
+    if (strip_misses < after) {
+      after = strip_misses;
+      memcpy(tris, &*strips, sizeof(*tris) * (size_t)ntris);
+    }
+  }
+
+  stats->triangles += ntris;
+  stats->misses_before += before;
+  stats->misses_after += after;
+
+  free(optimised);
+  free(strips);
+  return success;
+}
+
+static bool add_primitive(Group * const group, const int * const sides,
+                          const int nsides, const int colour, const int id)
+{
+  assert(group != NULL);
+  assert(sides != NULL);
+
+  _Optional Primitive * const pp = group_add_primitive(group);
+  if (!pp) {
+    return false;
+  }
+
+  for (int s = 0; s < nsides; ++s) {
+    if (primitive_add_side(&*pp, sides[s]) < 0) {
+      return false;
+    }
+  }
+  primitive_set_colour(&*pp, colour);
+  primitive_set_id(&*pp, id);
+  return true;
+}
+
+static bool optimise_group(Group * const group, const int * const ids,
+                           const int nids, Triangle * const tris,
+                           VCacheStats * const stats)
+{
+  assert(group != NULL);
+  assert(ids != NULL);
+  assert(tris != NULL);
+  assert(stats != NULL);
+
+  const int nprims = group_get_num_primitives(group);
+  Group out;
+  group_init(&out);
+  bool success = true;
+  int ntris = 0;
+
+  for (int p = 0; (p <= nprims) && success; ++p) {
+    _Optional const Primitive * const pp = (p < nprims) ?
+                                           group_get_primitive(group, p) :
+                                           NULL;
+    const int nsides = pp ? primitive_get_num_sides(&*pp) : 0;
+    const int colour = pp ? primitive_get_colour(&*pp) : -1;
+
+    /* Only reorder triangles within a run of the same colour, so that
+       overlapping polygons of different colours keep their order */
+    if ((ntris > 0) && ((nsides < 3) || (colour != tris[0].colour))) {
+      success = optimise_run(tris, ntris, nids, stats);
+      for (int t = 0; (t < ntris) && success; ++t) {
+        success = add_primitive(&out, tris[t].v, 3, tris[t].colour,
+                                tris[t].prim_id);
+      }
+      ntris = 0;
+    }
+
+    if (!pp || !success) {
+      continue;
+    }
+
+    if (nsides < 3) {
+      /* Lines and points can't be part of a triangle mesh */
+      int sides[2];
+      for (int s = 0; s < nsides; ++s) {
+        sides[s] = primitive_get_side(&*pp, s);
+      }
+      success = add_primitive(&out, sides, nsides, colour,
+                              primitive_get_id(&*pp));
+      continue;
+    }
+
+    /* Split polygons into fans, which preserves their winding order */
+    const int v0 = primitive_get_side(&*pp, 0);
+    for (int s = 1; s < nsides - 1; ++s) {
+      Triangle * const tri = tris + ntris++;
+      tri->v[0] = v0;
+      tri->v[1] = primitive_get_side(&*pp, s);
+      tri->v[2] = primitive_get_side(&*pp, s + 1);
+      for (int k = 0; k < 3; ++k) {
+        tri->id[k] = ids[tri->v[k]];
+      }
+      tri->colour = colour;
+      tri->prim_id = primitive_get_id(&*pp);
+    }
+  }
+
+  if (success) {
+    group_free(group);
+    *group = out;
+  } else {
+    group_free(&out);
+  }
+  return success;
+}
+
+bool vcache_optimise(const VertexArray * const varray, Group * const groups,
+                     const int ngroups, const bool duplicate, const int rot,
+                     VCacheStats * const stats)
+{
+  assert(varray != NULL);
+  assert(groups != NULL);
+  assert(ngroups >= 0);
+  assert(stats != NULL);
+
+  *stats = (VCacheStats){.triangles = 0, .misses_before = 0,
+                         .misses_after = 0};
+
+  const int nvertices = vertex_array_get_num_vertices(varray);
+  int maxtris = 0;
+  for (int g = 0; g < ngroups; ++g) {
+    const int nprims = group_get_num_primitives(groups + g);
+    int ntris = 0;
+    for (int p = 0; p < nprims; ++p) {
+      _Optional const Primitive * const pp =
+        group_get_primitive(groups + g, p);
+      if (pp) {
+        ntris += HIGHEST(primitive_get_num_sides(&*pp) - 2, 0);
+      }
+    }
+    maxtris = HIGHEST(maxtris, ntris);
+  }
+
+  if ((nvertices == 0) || (maxtris == 0)) {
+    return true;
+  }
+
+  _Optional int * const ids = malloc(sizeof(int) * (size_t)nvertices);
+  _Optional Triangle * const tris = malloc(sizeof(*tris) * (size_t)maxtris);
+  if ((ids == NULL) || (tris == NULL)) {
+    fprintf(stderr, "Failed allocating memory for vertex cache "
+                    "optimisation\n");
+    free(tris);
+    free(ids);
+    return false;
+  }
+
+  /* Vertices at the same position are output as one vertex unless
+     duplicates are kept */
+  for (int v = 0; v < nvertices; ++v) {
+    (&*ids)[v] = v;
+  }
+
+  bool success = duplicate || vmerge_find_ids(varray, &*ids, rot);
+  for (int g = 0; (g < ngroups) && success; ++g) {
+    success = optimise_group(groups + g, &*ids, nvertices, &*tris, stats);
+  }
+
+  if (!success) {
+    fprintf(stderr, "Failed allocating memory for vertex cache "
+                    "optimisation\n");
+  }
+
+  free(tris);
+  free(ids);
+  return success;
+}
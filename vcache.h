@@ -0,0 +1,24 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Triangle ordering for a post-transform vertex cache
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef VCACHE_H
+#define VCACHE_H
+
+#include <stdbool.h>
+
+#include "Vertex.h"
+#include "Group.h"
+
+typedef struct {
+  long int triangles;
+  long int misses_before; /* Simulated cache misses in the original order */
+  long int misses_after;  /* Simulated cache misses in the new order */
+} VCacheStats;
+
+bool vcache_optimise(const VertexArray *varray, Group *groups, int ngroups,
+                     bool duplicate, int rot, VCacheStats *stats);
+
+#endif /* VCACHE_H */
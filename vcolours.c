@@ -0,0 +1,717 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Output of meshes with per-vertex or texture colours
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+/* 3DObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+/* Local header files */
+#include "misc.h"
+#include "colours.h"
+#include "polygons.h"
+#include "faces.h"
+#include "hash.h"
+#include "vmerge.h"
+#include "vcolours.h"
+
+enum {
+  MaxMaterialName = 64
+};
+
+typedef struct {
+  int v;      /* Index of the vertex in the input array */
+  int colour; /* Physical colour of faces that use this vertex, or -1 */
+  int id;     /* Index of this entry before sorting */
+} ColouredVertex;
+
+typedef struct {
+  _Optional ColouredVertex *vertices;
+  int nvertices;
+  int nalloc;
+  _Optional int *slots; /* Index of a vertex in each hash slot, or -1 */
+  int nslots;           /* Number of hash slots (a power of two) */
+  const int *ids;       /* First input vertex at the same position as each
+                           input vertex */
+} VertexTable;
+
+typedef struct {
+  _Optional int *colours;
+  int ncolours;
+  int nalloc;
+} TexelTable;
+
+typedef struct {
+  _Optional double (*normals)[3];
+  _Optional int *slots; /* Index of a normal in each hash slot, or -1 */
+  int nnormals;
+  int nslots;           /* Number of hash slots (a power of two) */
+} NormalTable;
+
+typedef struct {
+  const int *sides;             /* Vertex index for each side */
+  _Optional const int *tsides;  /* Texture coordinate index for each side */
+  int nsides;
+  int normal;                   /* Normal index, or -1 if none */
+} Face;
+
+typedef struct {
+  const Face *face;
+  const VColoursCounts *totals; /* Numbers written before this object */
+  const VColoursCounts *counts; /* Numbers written for this object */
+  VertexStyle vstyle;
+} FaceOutput;
+
+typedef struct {
+  int colour;
+  int normal;
+} PrimitiveInfo;
+
+/* Normals that are written identically are the same normal */
+#define NORMAL_SCALE (1e6)
+
+static unsigned long int hash_vertex(const int id, const int colour)
+{
+  return (unsigned long int)hash_update(hash_update(HASH_INITIAL, &id,
+                                                    sizeof(id)),
+                                        &colour, sizeof(colour));
+}
+
+/* Resizes the hash table of a vertex table and reinserts every vertex */
+static bool grow_slots(VertexTable * const table, const int nslots)
+{
+  assert(table != NULL);
+  assert(nslots > table->nvertices);
+
+  _Optional int * const slots = malloc(sizeof(int) * (size_t)nslots);
+  if (slots == NULL) {
+    return false;
+  }
+
+  for (int i = 0; i < nslots; ++i) {
+    (&*slots)[i] = -1;
+  }
+
+  const unsigned long int mask = (unsigned long int)nslots - 1;
+  for (int i = 0; i < table->nvertices; ++i) {
+    const ColouredVertex * const cv = &*table->vertices + i;
+    unsigned long int slot = hash_vertex(table->ids[cv->v], cv->colour) & mask;
+    while ((&*slots)[slot] >= 0) {
+      slot = (slot + 1) & mask;
+    }
+    (&*slots)[slot] = i;
+  }
+
+  free(table->slots);
+  table->slots = slots;
+  table->nslots = nslots;
+  return true;
+}
+
+/* Returns the index of a vertex with the given position and colour,
+   adding one if not found, or -1 if memory allocation failed */
+static int find_vertex(VertexTable * const table, const int v,
+                       const int colour)
+{
+  assert(table != NULL);
+  assert(v >= 0);
+
+  /* Keep the hash table at most half full */
+  if ((table->nvertices * 2 >= table->nslots) &&
+      !grow_slots(table, table->nslots ? table->nslots * 2 : 128)) {
+    return -1;
+  }
+
+  const int id = table->ids[v];
+  const unsigned long int mask = (unsigned long int)table->nslots - 1;
+  unsigned long int slot = hash_vertex(id, colour) & mask;
+  for (; (&*table->slots)[slot] >= 0; slot = (slot + 1) & mask) {
+    const int i = (&*table->slots)[slot];
+    const ColouredVertex * const cv = &*table->vertices + i;
+    if ((cv->colour == colour) && (table->ids[cv->v] == id)) {
+      return i;
+    }
+  }
+
+  if (table->nvertices == table->nalloc) {
+    const int nalloc = table->nalloc ? table->nalloc * 2 : 64;
+    _Optional ColouredVertex * const vertices =
+      realloc(table->vertices, sizeof(*vertices) * (size_t)nalloc);
+    if (vertices == NULL) {
+      return -1;
+    }
+    table->vertices = vertices;
+    table->nalloc = nalloc;
+  }
+
+  (&*table->slots)[slot] = table->nvertices;
+  (&*table->vertices)[table->nvertices] = (ColouredVertex){
+    .v = v,
+    .colour = colour,
+    .id = table->nvertices
+  };
+  return table->nvertices++;
+}
+
+/* Returns the index of a texture coordinate for the given colour,
+   adding one if not found, or -1 if memory allocation failed */
+static int find_texel(TexelTable * const table, const int colour)
+{
+  assert(table != NULL);
+  assert(colour >= 0);
+
+  for (int i = 0; i < table->ncolours; ++i) {
+    if ((&*table->colours)[i] == colour) {
+      return i;
+    }
+  }
+
+  if (table->ncolours == table->nalloc) {
+    const int nalloc = table->nalloc ? table->nalloc * 2 : 16;
+    _Optional int * const colours =
+      realloc(table->colours, sizeof(*colours) * (size_t)nalloc);
+    if (colours == NULL) {
+      return -1;
+    }
+    table->colours = colours;
+    table->nalloc = nalloc;
+  }
+
+  (&*table->colours)[table->ncolours] = colour;
+  return table->ncolours++;
+}
+
+static unsigned long int hash_normal(const long int * const q)
+{
+  assert(q != NULL);
+
+  unsigned long int h = 0;
+  for (int k = 0; k < 3; ++k) {
+    h = (h * 31u) + (unsigned long int)q[k];
+  }
+  return h ^ (h >> 16);
+}
+
+static void quantise_normal(const double * const normal, long int * const q)
+{
+  assert(normal != NULL);
+  assert(q != NULL);
+
+  for (int k = 0; k < 3; ++k) {
+    q[k] = lround(normal[k] * NORMAL_SCALE);
+  }
+}
+
+/* Returns the index of a normal equal to the given normal, adding it to
+   the table if not found */
+static int find_normal(NormalTable * const table,
+                       const double * const normal)
+{
+  assert(table != NULL);
+  assert(normal != NULL);
+  assert(table->nnormals < table->nslots);
+
+  long int q[3];
+  quantise_normal(normal, q);
+
+  const unsigned long int mask = (unsigned long int)table->nslots - 1;
+  for (unsigned long int slot = hash_normal(q) & mask; ;
+       slot = (slot + 1) & mask) {
+    int * const index = &*table->slots + slot;
+    if (*index < 0) {
+      *index = table->nnormals;
+      for (int k = 0; k < 3; ++k) {
+        (&*table->normals)[table->nnormals][k] = normal[k];
+      }
+      return table->nnormals++;
+    }
+
+    long int qs[3];
+    quantise_normal((&*table->normals)[*index], qs);
+    if ((qs[0] == q[0]) && (qs[1] == q[1]) && (qs[2] == q[2])) {
+      return *index;
+    }
+  }
+}
+
+static int compare_vertices(const void * const a, const void * const b)
+{
+  const ColouredVertex * const cva = a, * const cvb = b;
+
+  if (cva->v != cvb->v) {
+    return (cva->v > cvb->v) - (cva->v < cvb->v);
+  }
+  return (cva->colour > cvb->colour) - (cva->colour < cvb->colour);
+}
+
+static bool output_corner(FILE * const out, const int side, void * const arg)
+{
+  assert(out != NULL);
+  assert(arg != NULL);
+
+  const FaceOutput * const fo = arg;
+  const Face * const face = fo->face;
+  if ((fputc(' ', out) < 0) ||
+      !faces_output_index(out, face->sides[side], fo->totals->vertices,
+                          fo->counts->vertices, fo->vstyle)) {
+    return false;
+  }
+
+  if ((face->tsides == NULL) && (face->normal < 0)) {
+    return true;
+  }
+
+  if ((fputc('/', out) < 0) ||
+      ((face->tsides != NULL) &&
+       !faces_output_index(out, face->tsides[side], fo->totals->texels,
+                           fo->counts->texels, fo->vstyle))) {
+    return false;
+  }
+
+  if (face->normal < 0) {
+    return true;
+  }
+
+  return (fputc('/', out) >= 0) &&
+         faces_output_index(out, face->normal, fo->totals->normals,
+                            fo->counts->normals, fo->vstyle);
+}
+
+static bool output_vertices_coloured(FILE * const out,
+                                     const VertexTable * const table,
+                                     const VertexArray * const varray,
+                                     const int rot)
+{
+  assert(out != NULL);
+  assert(table != NULL);
+  assert(varray != NULL);
+
+  bool rotating = false;
+  for (int i = 0; i < table->nvertices; ++i) {
+    const ColouredVertex * const cv = &*table->vertices + i;
+    _Optional Coord (* const coords)[3] = vertex_array_get_coords(varray,
+                                                                  cv->v);
+    if (!coords) {
+      fprintf(stderr, "Bad vertex %d\n", cv->v);
+      return false;
+    }
+
+    int n = 0;
+    if ((rot > 0) && (cv->v >= rot) && !rotating) {
+      rotating = true;
+      n = fputs("# Following vertices rotate\n", out);
+    }
+
+    if ((n >= 0) && (cv->colour < 0)) {
+      n = fprintf(out, "v %f %f %f\n", (*coords)[0], (*coords)[1],
+                  (*coords)[2]);
+    } else if (n >= 0) {
+      double red, green, blue;
+      decode_colour(cv->colour, &red, &green, &blue, 0);
+      n = fprintf(out, "v %f %f %f %f %f %f\n", (*coords)[0], (*coords)[1],
+                  (*coords)[2], red, green, blue);
+    }
+
+    if (n < 0) {
+      fprintf(stderr, "Failed writing to output file: %s\n",
+              strerror(errno));
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool output_texels(FILE * const out, const TexelTable * const table,
+                          const int rows)
+{
+  assert(out != NULL);
+  assert(table != NULL);
+  assert(rows > 0);
+
+  for (int i = 0; i < table->ncolours; ++i) {
+    double u, v;
+    atlas_get_texel((&*table->colours)[i], rows, &u, &v);
+    if (fprintf(out, "vt %f %f\n", u, v) < 0) {
+      fprintf(stderr, "Failed writing to output file: %s\n",
+              strerror(errno));
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool output_normals(FILE * const out,
+                           const NormalTable * const table)
+{
+  assert(out != NULL);
+  assert(table != NULL);
+
+  for (int i = 0; i < table->nnormals; ++i) {
+    const double * const n = (&*table->normals)[i];
+    if (fprintf(out, "vn %f %f %f\n", n[0], n[1], n[2]) < 0) {
+      fprintf(stderr, "Failed writing to output file: %s\n",
+              strerror(errno));
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Calculates the unit normal of every primitive in one pass */
+static bool compute_normals(const VertexArray * const varray,
+                            const Group * const groups, const int ngroups,
+                            double (* const normals)[3])
+{
+  assert(varray != NULL);
+  assert(groups != NULL);
+  assert(normals != NULL);
+
+  int prim = 0;
+  for (int g = 0; g < ngroups; ++g) {
+    const int nprims = group_get_num_primitives(groups + g);
+    for (int p = 0; p < nprims; ++p) {
+      _Optional const Primitive * const pp =
+        group_get_primitive(groups + g, p);
+      if (!pp) {
+        continue;
+      }
+
+      double n[3];
+      if (!polygon_normal(varray, &*pp, n)) {
+        fprintf(stderr, "Bad vertex in primitive %d\n", p);
+        return false;
+      }
+
+      /* Lines, points and degenerate polygons have no normal */
+      const int nsides = primitive_get_num_sides(&*pp);
+      const double len = sqrt((n[0] * n[0]) + (n[1] * n[1]) + (n[2] * n[2]));
+      const double scale = (nsides >= 3) && (len > 0.0) ? 1.0 / len : 0.0;
+      for (int k = 0; k < 3; ++k) {
+        normals[prim][k] = n[k] * scale;
+      }
+      ++prim;
+    }
+  }
+  return true;
+}
+
+bool vcolours_output(FILE * const out, const char * const name,
+                     VColoursCounts * const totals,
+                     const VertexArray * const varray,
+                     const Group * const groups, const int ngroups,
+                     OutputPrimitivesGetColourFn * const get_colour,
+                     _Optional OutputPrimitivesGetMaterialFn * const
+                       get_material,
+                     void * const arg, const VertexStyle vstyle,
+                     const MeshStyle mstyle, const ColourStyle cstyle,
+                     const bool normals, const bool duplicate, const int rot)
+{
+  assert(out != NULL);
+  assert(name != NULL);
+  assert(totals != NULL);
+  assert(totals->vertices >= 0);
+  assert(totals->texels >= 0);
+  assert(totals->normals >= 0);
+  assert(varray != NULL);
+  assert(groups != NULL);
+  assert(ngroups >= 0);
+  assert(get_colour != NULL);
+  assert((cstyle != ColourStyle_Material) || (get_material != NULL));
+
+  const bool atlas = (cstyle == ColourStyle_PhysicalAtlas) ||
+                     (cstyle == ColourStyle_LogicalAtlas);
+  const int rows = (cstyle == ColourStyle_LogicalAtlas) ?
+                   AtlasLogicalRows : AtlasPhysicalRows;
+
+  /* Count the sides of all primitives */
+  int nsides = 0, nprims_total = 0;
+  for (int g = 0; g < ngroups; ++g) {
+    const int nprims = group_get_num_primitives(groups + g);
+    for (int p = 0; p < nprims; ++p) {
+      _Optional const Primitive * const pp =
+        group_get_primitive(groups + g, p);
+      if (pp) {
+        nsides += primitive_get_num_sides(&*pp);
+        ++nprims_total;
+      }
+    }
+  }
+
+  /* Assign a vertex index (and texture coordinate index, if any) to each
+     side of each primitive */
+  const size_t nalloc = (size_t)(nsides > 0 ? nsides : 1);
+  const size_t nprims_alloc = (size_t)(nprims_total > 0 ? nprims_total : 1);
+  int nslots = 1;
+  while (nslots < 2 * nprims_total) {
+    nslots *= 2;
+  }
+
+  _Optional int * const sides = malloc(sizeof(int) * nalloc);
+  _Optional int * const tsides = atlas ? malloc(sizeof(int) * nalloc) : NULL;
+  _Optional PrimitiveInfo * const prims = malloc(sizeof(*prims) *
+                                                 nprims_alloc);
+  _Optional double (* const pnormals)[3] =
+    normals ? malloc(sizeof(*pnormals) * nprims_alloc) : NULL;
+  NormalTable ntable = {
+    .normals = normals ? malloc(sizeof(*ntable.normals) * nprims_alloc) : NULL,
+    .slots = normals ? malloc(sizeof(int) * (size_t)nslots) : NULL,
+    .nnormals = 0,
+    .nslots = nslots
+  };
+
+  if ((sides == NULL) || (atlas && (tsides == NULL)) || (prims == NULL) ||
+      (normals && ((pnormals == NULL) || (ntable.normals == NULL) ||
+                   (ntable.slots == NULL)))) {
+    fprintf(stderr, "Failed allocating memory for colours\n");
+    free(ntable.slots);
+    free(ntable.normals);
+    free(pnormals);
+    free(prims);
+    free(tsides);
+    free(sides);
+    return false;
+  }
+
+  /* Vertices at the same position are merged unless duplicates are
+     kept, but not if they have different colours */
+  const int nvertices = vertex_array_get_num_vertices(varray);
+  _Optional int * const ids = malloc(sizeof(int) *
+                                     (size_t)(nvertices > 0 ? nvertices : 1));
+  bool success = (ids != NULL);
+  if (success) {
+    for (int v = 0; v < nvertices; ++v) {
+      (&*ids)[v] = v;
+    }
+    success = duplicate || vmerge_find_ids(varray, &*ids, rot);
+  }
+  if (!success) {
+    fprintf(stderr, "Failed allocating memory for colours\n");
+  }
+
+  VertexTable vtable = {
+    .vertices = NULL,
+    .nvertices = 0,
+    .nalloc = 0,
+    .slots = NULL,
+    .nslots = 0,
+    .ids = ids ? &*ids : NULL
+  };
+  TexelTable ttable = {.colours = NULL, .ncolours = 0, .nalloc = 0};
+  _Optional int *remap = NULL;
+
+  if (success && normals) {
+    for (int i = 0; i < nslots; ++i) {
+      (&*ntable.slots)[i] = -1;
+    }
+    success = compute_normals(varray, groups, ngroups, &*pnormals);
+  }
+
+  int side = 0, prim = 0;
+  for (int g = 0; (g < ngroups) && success; ++g) {
+    const int nprims = group_get_num_primitives(groups + g);
+    for (int p = 0; (p < nprims) && success; ++p) {
+      _Optional const Primitive * const pp =
+        group_get_primitive(groups + g, p);
+      if (!pp) {
+        continue;
+      }
+
+      /* Ask for the colour only once because false colours change on
+         every call */
+      const int colour = get_colour(&*pp, arg);
+      if (atlas && (colour >= AtlasColumns * rows)) {
+        fprintf(stderr, "Colour %d is outside the texture atlas\n", colour);
+        success = false;
+        break;
+      }
+
+      PrimitiveInfo * const info = &*prims + prim;
+      info->colour = colour;
+      info->normal = -1;
+      if (normals) {
+        const double * const n = (&*pnormals)[prim];
+        if ((n[0] != 0.0) || (n[1] != 0.0) || (n[2] != 0.0)) {
+          info->normal = find_normal(&ntable, n);
+        }
+      }
+      ++prim;
+
+      const int texel = atlas ? find_texel(&ttable, colour) : 0;
+      const int n = primitive_get_num_sides(&*pp);
+      for (int s = 0; (s < n) && (texel >= 0); ++s) {
+        const int index = find_vertex(&vtable, primitive_get_side(&*pp, s),
+                                      (cstyle == ColourStyle_Vertex) ?
+                                        colour : -1);
+        if (index < 0) {
+          success = false;
+          break;
+        }
+        if (tsides) {
+          (&*tsides)[side] = texel;
+        }
+        (&*sides)[side++] = index;
+      }
+      if (texel < 0) {
+        success = false;
+      }
+      if (!success) {
+        fprintf(stderr, "Failed allocating memory for colours\n");
+      }
+    }
+  }
+
+  if (success && (vtable.nvertices > 0)) {
+    /* Emit vertices in their original order so that rotating vertices
+       stay together at the end */
+    remap = malloc(sizeof(int) * (size_t)vtable.nvertices);
+    if (remap == NULL) {
+      fprintf(stderr, "Failed allocating memory for colours\n");
+      success = false;
+    } else {
+      qsort(&*vtable.vertices, (size_t)vtable.nvertices,
+            sizeof(*vtable.vertices), compare_vertices);
+      for (int i = 0; i < vtable.nvertices; ++i) {
+        (&*remap)[(&*vtable.vertices)[i].id] = i;
+      }
+      for (int s = 0; s < side; ++s) {
+        (&*sides)[s] = (&*remap)[(&*sides)[s]];
+      }
+    }
+  }
+
+  if (success) {
+    success = output_vertices_coloured(out, &vtable, varray, rot);
+  }
+
+  if (success && atlas) {
+    success = output_texels(out, &ttable, rows);
+  }
+
+  if (success && normals) {
+    success = output_normals(out, &ntable);
+  }
+
+  if (success && atlas && (nsides > 0) &&
+      fputs("usemtl " ATLAS_MATERIAL "\n", out) < 0) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+    success = false;
+  }
+
+  const VColoursCounts counts = {
+    .vertices = vtable.nvertices,
+    .texels = ttable.ncolours,
+    .normals = ntable.nnormals
+  };
+  char material[MaxMaterialName] = "", last_material[MaxMaterialName] = "";
+
+  side = prim = 0;
+  for (int g = 0; (g < ngroups) && success; ++g) {
+    const int nprims = group_get_num_primitives(groups + g);
+    if (nprims == 0) {
+      continue;
+    }
+
+    if (fprintf(out, "g %s %s_%d\n", name, name, g) < 0) {
+      fprintf(stderr, "Failed writing to output file: %s\n",
+              strerror(errno));
+      success = false;
+      break;
+    }
+
+    for (int p = 0; p < nprims; ++p) {
+      _Optional const Primitive * const pp =
+        group_get_primitive(groups + g, p);
+      if (!pp) {
+        continue;
+      }
+
+      const PrimitiveInfo * const info = &*prims + prim++;
+      if (cstyle == ColourStyle_Material) {
+        /* Only switch material when it changes */
+        const int len = get_material(material, sizeof(material),
+                                     info->colour, arg);
+        if ((len < 0) || ((size_t)len >= sizeof(material))) {
+          fprintf(stderr, "Bad material name for colour %d\n", info->colour);
+          success = false;
+          break;
+        }
+        if (strcmp(material, last_material) != 0) {
+          if (fprintf(out, "usemtl %s\n", material) < 0) {
+            fprintf(stderr, "Failed writing to output file: %s\n",
+                    strerror(errno));
+            success = false;
+            break;
+          }
+          strcpy(last_material, material);
+        }
+      }
+
+      const Face face = {
+        .sides = &*sides + side,
+        .tsides = tsides ? &*tsides + side : NULL,
+        .nsides = primitive_get_num_sides(&*pp),
+        .normal = info->normal
+      };
+      FaceOutput fo = {
+        .face = &face,
+        .totals = totals,
+        .counts = &counts,
+        .vstyle = vstyle
+      };
+      if ((face.nsides > 0) &&
+          !faces_output(out, face.nsides, mstyle, output_corner, &fo)) {
+        fprintf(stderr, "Failed writing to output file: %s\n",
+                strerror(errno));
+        success = false;
+        break;
+      }
+      side += face.nsides;
+    }
+  }
+
+  if (success) {
+    totals->vertices += counts.vertices;
+    totals->texels += counts.texels;
+    totals->normals += counts.normals;
+  }
+
+  free(remap);
+  free(ttable.colours);
+  free(vtable.slots);
+  free(vtable.vertices);
+  free(ids);
+  free(ntable.slots);
+  free(ntable.normals);
+  free(pnormals);
+  free(prims);
+  free(tsides);
+  free(sides);
+  return success;
+}
@@ -0,0 +1,42 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Output of meshes with per-vertex colours, textures or normals
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef VCOLOURS_H
+#define VCOLOURS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "Vertex.h"
+#include "Group.h"
+#include "ObjFile.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+typedef enum {
+  ColourStyle_Vertex,        /* Colour components follow each vertex */
+  ColourStyle_PhysicalAtlas, /* Texture coordinates in a 16x16 atlas */
+  ColourStyle_LogicalAtlas,  /* Texture coordinates in a 16x20 atlas */
+  ColourStyle_Material       /* A named material for each colour */
+} ColourStyle;
+
+typedef struct {
+  int vertices; /* Number of 'v' lines */
+  int texels;   /* Number of 'vt' lines */
+  int normals;  /* Number of 'vn' lines */
+} VColoursCounts;
+
+bool vcolours_output(FILE *out, const char *name, VColoursCounts *totals,
+                     const VertexArray *varray, const Group *groups,
+                     int ngroups, OutputPrimitivesGetColourFn *get_colour,
+                     _Optional OutputPrimitivesGetMaterialFn *get_material,
+                     void *arg, VertexStyle vstyle, MeshStyle mstyle,
+                     ColourStyle cstyle, bool normals, bool duplicate,
+                     int rot);
+
+#endif /* VCOLOURS_H */
@@ -0,0 +1,458 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Output of plot groups and the program that selects them
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <math.h>
+
+/* 3DObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+
+/* Local header files */
+#include "misc.h"
+#include "sfformats.h"
+#include "polygons.h"
+#include "byteorder.h"
+#include "visibility.h"
+
+enum {
+  NumOctants = 8,
+  VisibilityVersion = 1,
+  HeaderSize = 16,
+  ObjectRecordSize = 16,
+  GroupRecordSize = 8,
+  TestRecordSize = 12,
+  CommandRecordSize = 4,
+  NoTest = 0xff,
+  MaxUInt16 = 0xffff,
+  InitialObjects = 16
+};
+
+static const char visibility_magic[8] = {'S','F','3','K','V','I','S','I'};
+
+typedef enum {
+  TestResult_Fail,
+  TestResult_Pass,
+  TestResult_Unknown
+} TestResult;
+
+#define NORMAL_TOLERANCE (1e-6)
+
+bool visibility_get_tests(const VertexArray * const varray,
+                          const Group * const vectors, const int ntests,
+                          VisibilityTests * const tests)
+{
+  assert(varray != NULL);
+  assert(vectors != NULL);
+  assert(ntests >= 0);
+  assert(ntests <= VisibilityMaxTests);
+  assert(tests != NULL);
+
+  if (ntests > group_get_num_primitives(vectors)) {
+    fprintf(stderr, "Missing vector test polygon %d\n", ntests - 1);
+    return false;
+  }
+
+  for (int t = 0; t < ntests; ++t) {
+    _Optional const Primitive * const pp = group_get_primitive(vectors, t);
+    if (!pp) {
+      fprintf(stderr, "Missing vector test polygon %d\n", t);
+      return false;
+    }
+
+    /* As for the normals of faces in the output */
+    double normal[3];
+    if (!polygon_normal(varray, &*pp, normal)) {
+      fprintf(stderr, "Bad vertex in vector test polygon %d\n", t);
+      return false;
+    }
+
+    const double len = sqrt((normal[0] * normal[0]) +
+                            (normal[1] * normal[1]) +
+                            (normal[2] * normal[2]));
+    for (int k = 0; k < 3; ++k) {
+      tests->normals[t][k] = (len > NORMAL_TOLERANCE) ? normal[k] / len : 0.0;
+    }
+  }
+
+  tests->ntests = ntests;
+  return true;
+}
+
+/* Returns whether a polygon with the given normal faces every viewer in
+   the given octant of directions, no viewer in it, or only some of them.
+   Bit k of the octant number is set if the viewer is on the negative side
+   of axis k. */
+static TestResult test_octant(const double (* const normal)[3],
+                              const int octant)
+{
+  assert(normal != NULL);
+  assert(octant >= 0);
+  assert(octant < NumOctants);
+
+  bool towards = false, away = false;
+  for (int k = 0; k < 3; ++k) {
+    const double dot = (octant & (1 << k)) ? -(*normal)[k] : (*normal)[k];
+    if (dot > 0.0) {
+      towards = true;
+    } else if (dot < 0.0) {
+      away = true;
+    }
+  }
+
+  if (towards == away) {
+    return TestResult_Unknown;
+  }
+  return towards ? TestResult_Pass : TestResult_Fail;
+}
+
+static TestResult run_command(const VisibilityCommand * const command,
+                              const VisibilityTests * const tests,
+                              const int octant)
+{
+  assert(command != NULL);
+  assert(tests != NULL);
+
+  if (command->action == SFPlotAction_FacingAlways) {
+    return TestResult_Pass;
+  }
+
+  assert(command->test >= 0);
+  assert(command->test < tests->ntests);
+  const TestResult result = test_octant(&tests->normals[command->test],
+                                        octant);
+
+  switch (command->action) {
+    case SFPlotAction_FacingIf:
+    case SFPlotAction_AllIf:
+      return result;
+
+    default:
+      /* Illegal actions behave like SFPlotAction_AllIfNot in the game */
+      if (result == TestResult_Pass) {
+        return TestResult_Fail;
+      }
+      return (result == TestResult_Fail) ? TestResult_Pass : result;
+  }
+}
+
+static bool output_command(FILE * const out,
+                           const VisibilityCommand * const command)
+{
+  assert(out != NULL);
+  assert(command != NULL);
+
+  switch (command->action) {
+    case SFPlotAction_FacingAlways:
+      return fprintf(out, "# Plot command: facing %d\n", command->group) >= 0;
+
+    case SFPlotAction_FacingIf:
+      return fprintf(out, "# Plot command: facing %d if %d\n",
+                     command->group, command->test) >= 0;
+
+    case SFPlotAction_FacingIfNot:
+      return fprintf(out, "# Plot command: facing %d unless %d\n",
+                     command->group, command->test) >= 0;
+
+    case SFPlotAction_AllIf:
+      return fprintf(out, "# Plot command: all %d if %d\n",
+                     command->group, command->test) >= 0;
+
+    default:
+      return fprintf(out, "# Plot command: all %d unless %d\n",
+                     command->group, command->test) >= 0;
+  }
+}
+
+/* Finds the range of primitive numbers of each group, in the order in
+   which the primitives are output */
+static void get_ranges(const Group * const groups, const int ngroups,
+                       int * const first, int * const nprims)
+{
+  assert(groups != NULL);
+  assert(ngroups >= 0);
+  assert(first != NULL);
+  assert(nprims != NULL);
+
+  int next = 0;
+  for (int g = 0; g < ngroups; ++g) {
+    first[g] = next;
+    nprims[g] = group_get_num_primitives(groups + g);
+    next += nprims[g];
+  }
+}
+
+bool visibility_output(FILE * const out, const Group * const groups,
+                       const int ngroups,
+                       const VisibilityCommand * const commands,
+                       const int ncommands,
+                       const VisibilityTests * const tests)
+{
+  assert(out != NULL);
+  assert(groups != NULL);
+  assert(ngroups >= 0);
+  assert(ncommands >= 0);
+  assert(commands != NULL || ncommands == 0);
+  assert(tests != NULL);
+
+  /* Primitives are output in order of their group */
+  int first[VisibilityNumGroups], nprims[VisibilityNumGroups];
+  assert(ngroups <= VisibilityNumGroups);
+  get_ranges(groups, ngroups, first, nprims);
+  for (int g = 0; g < ngroups; ++g) {
+    if ((nprims[g] > 0) &&
+        fprintf(out, "# Plot group %d: primitives %d to %d\n", g, first[g],
+                first[g] + nprims[g] - 1) < 0) {
+      return false;
+    }
+  }
+
+  for (int t = 0; t < tests->ntests; ++t) {
+    if (fprintf(out, "# Vector test %d: %f %f %f\n", t,
+                tests->normals[t][0], tests->normals[t][1],
+                tests->normals[t][2]) < 0) {
+      return false;
+    }
+  }
+
+  for (int c = 0; c < ncommands; ++c) {
+    if (!output_command(out, commands + c)) {
+      return false;
+    }
+  }
+
+  if (ncommands == 0) {
+    return true;
+  }
+
+  /* Evaluate the program for a distant viewer in each octant of view
+     directions, marking groups that depend on the exact direction */
+  for (int octant = 0; octant < NumOctants; ++octant) {
+    if (fprintf(out, "# Octant %cx%cy%cz:",
+                (octant & 1) ? '-' : '+', (octant & 2) ? '-' : '+',
+                (octant & 4) ? '-' : '+') < 0) {
+      return false;
+    }
+
+    for (int c = 0; c < ncommands; ++c) {
+      const TestResult result = run_command(commands + c, tests, octant);
+      if ((result != TestResult_Fail) &&
+          fprintf(out, " %d%s", commands[c].group,
+                  (result == TestResult_Unknown) ? "?" : "") < 0) {
+        return false;
+      }
+    }
+
+    if (fputc('\n', out) < 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void visibility_list_init(VisibilityList * const list)
+{
+  assert(list != NULL);
+
+  *list = (VisibilityList){
+    .objects = NULL,
+    .nobjects = 0,
+    .objects_alloc = 0,
+  };
+}
+
+bool visibility_list_add(VisibilityList * const list, const int index,
+                         const SFObjectType type, const int type_count,
+                         const int plot_type, const Group * const groups,
+                         const int ngroups,
+                         const VisibilityCommand * const commands,
+                         const int ncommands,
+                         const VisibilityTests * const tests)
+{
+  assert(list != NULL);
+  assert(index >= 0);
+  assert(type_count >= 0);
+  assert(plot_type >= 0);
+  assert(groups != NULL);
+  assert(ngroups >= 0);
+  assert(ngroups <= VisibilityNumGroups);
+  assert(ncommands >= 0);
+  assert(ncommands <= VisibilityMaxCommands);
+  assert(commands != NULL || ncommands == 0);
+  assert(tests != NULL);
+
+  if (list->nobjects >= list->objects_alloc) {
+    const int nalloc = list->objects_alloc > 0 ?
+                       list->objects_alloc * 2 : InitialObjects;
+    _Optional VisibilityObject * const objects =
+      realloc(list->objects, sizeof(*objects) * (size_t)nalloc);
+    if (objects == NULL) {
+      fprintf(stderr, "Failed allocating memory for plot group "
+              "visibility\n");
+      return false;
+    }
+    list->objects = objects;
+    list->objects_alloc = nalloc;
+  }
+
+  VisibilityObject * const object = &*list->objects + list->nobjects++;
+  *object = (VisibilityObject){
+    .index = index,
+    .type = type,
+    .type_count = type_count,
+    .plot_type = plot_type,
+    .ncommands = ncommands,
+    .tests = *tests,
+  };
+
+  get_ranges(groups, ngroups, object->first, object->nprims);
+  for (int g = ngroups; g < VisibilityNumGroups; ++g) {
+    object->first[g] = object->nprims[g] = 0;
+  }
+
+  for (int c = 0; c < ncommands; ++c) {
+    object->commands[c] = commands[c];
+  }
+  return true;
+}
+
+/* Size of the data following an object's entry in the object table,
+   rounded up to a whole number of words */
+static uint32_t get_data_size(const VisibilityObject * const object)
+{
+  assert(object != NULL);
+
+  const uint32_t size = (VisibilityNumGroups * GroupRecordSize) +
+                        ((uint32_t)object->tests.ntests * TestRecordSize) +
+                        ((uint32_t)object->ncommands * CommandRecordSize) +
+                        ((uint32_t)object->ncommands * NumOctants);
+  return (size + 3u) & ~3u;
+}
+
+static bool write_data(FILE * const out,
+                       const VisibilityObject * const object)
+{
+  assert(out != NULL);
+  assert(object != NULL);
+
+  unsigned char data[(VisibilityNumGroups * GroupRecordSize) +
+                     (VisibilityMaxTests * TestRecordSize) +
+                     (VisibilityMaxCommands * CommandRecordSize) +
+                     (VisibilityMaxCommands * NumOctants)] = {0};
+  size_t pos = 0;
+
+  for (int g = 0; g < VisibilityNumGroups; ++g) {
+    put_uint32(data + pos, (uint32_t)object->first[g]);
+    put_uint32(data + pos + 4, (uint32_t)object->nprims[g]);
+    pos += GroupRecordSize;
+  }
+
+  for (int t = 0; t < object->tests.ntests; ++t) {
+    for (int k = 0; k < 3; ++k) {
+      put_float32(data + pos + (4 * k), object->tests.normals[t][k]);
+    }
+    pos += TestRecordSize;
+  }
+
+  for (int c = 0; c < object->ncommands; ++c) {
+    const VisibilityCommand * const command = object->commands + c;
+    data[pos] = (unsigned char)command->action;
+    data[pos + 1] = (command->test >= 0) ? (unsigned char)command->test :
+                                           NoTest;
+    data[pos + 2] = (unsigned char)command->group;
+    pos += CommandRecordSize;
+  }
+
+  /* One byte per command for each octant, as in the comments */
+  for (int octant = 0; octant < NumOctants; ++octant) {
+    for (int c = 0; c < object->ncommands; ++c) {
+      data[pos++] = (unsigned char)run_command(object->commands + c,
+                                               &object->tests, octant);
+    }
+  }
+
+  const uint32_t size = get_data_size(object);
+  assert(pos <= size);
+  assert(size <= sizeof(data));
+  return fwrite(data, size, 1, out) == 1;
+}
+
+bool visibility_list_write(FILE * const out, const VisibilityList * const list)
+{
+  assert(out != NULL);
+  assert(list != NULL);
+
+  for (int o = 0; o < list->nobjects; ++o) {
+    const VisibilityObject * const object = &*list->objects + o;
+    if ((object->index > MaxUInt16) || (object->type_count > MaxUInt16)) {
+      fprintf(stderr, "Object %d has too high a number\n", object->index);
+      return false;
+    }
+  }
+
+  unsigned char header[HeaderSize] = {0};
+  memcpy(header, visibility_magic, sizeof(visibility_magic));
+  put_uint32(header + 8, VisibilityVersion);
+  put_uint32(header + 12, (uint32_t)list->nobjects);
+  bool success = (fwrite(header, sizeof(header), 1, out) == 1);
+
+  uint32_t offset = HeaderSize + ((uint32_t)list->nobjects * ObjectRecordSize);
+  for (int o = 0; (o < list->nobjects) && success; ++o) {
+    const VisibilityObject * const object = &*list->objects + o;
+    unsigned char record[ObjectRecordSize] = {0};
+    put_uint16(record, (unsigned int)object->index);
+    put_uint16(record + 2, (unsigned int)object->type_count);
+    record[4] = (unsigned char)object->type;
+    record[5] = (unsigned char)object->plot_type;
+    record[6] = (unsigned char)object->tests.ntests;
+    record[7] = (unsigned char)object->ncommands;
+    put_uint32(record + 8, offset);
+    success = (fwrite(record, sizeof(record), 1, out) == 1);
+    offset += get_data_size(object);
+  }
+
+  for (int o = 0; (o < list->nobjects) && success; ++o) {
+    success = write_data(out, &*list->objects + o);
+  }
+
+  if (!success) {
+    fprintf(stderr, "Failed writing to output file: %s\n", strerror(errno));
+  }
+  return success;
+}
+
+void visibility_list_free(VisibilityList * const list)
+{
+  assert(list != NULL);
+
+  free(list->objects);
+  list->objects = NULL;
+  list->nobjects = 0;
+  list->objects_alloc = 0;
+}
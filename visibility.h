@@ -0,0 +1,76 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Output of plot groups and the program that selects them
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "Vertex.h"
+#include "Group.h"
+
+#include "sfformats.h"
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+enum {
+  VisibilityMaxTests = SFPlotCommands_OperandMask + 1,
+  VisibilityMaxCommands = 16, /* unknown what the game limit is */
+  VisibilityNumGroups = SFObjectFacet_VectorsGroup + 1
+};
+
+typedef struct {
+  SFPlotAction action;
+  int test;  /* Index of a polygon in group 7, or -1 if unconditional */
+  int group;
+} VisibilityCommand;
+
+typedef struct {
+  int ntests;
+  double normals[VisibilityMaxTests][3]; /* Unit normal of each test, or
+                                            zero if degenerate */
+} VisibilityTests;
+
+bool visibility_get_tests(const VertexArray *varray, const Group *vectors,
+                          int ntests, VisibilityTests *tests);
+
+bool visibility_output(FILE *out, const Group *groups, int ngroups,
+                       const VisibilityCommand *commands, int ncommands,
+                       const VisibilityTests *tests);
+
+typedef struct {
+  int index;       /* Object number within the file */
+  SFObjectType type;
+  int type_count;  /* Object number among objects of the same type */
+  int plot_type;
+  int first[VisibilityNumGroups];  /* Number of each group's first primitive */
+  int nprims[VisibilityNumGroups];
+  int ncommands;
+  VisibilityCommand commands[VisibilityMaxCommands];
+  VisibilityTests tests;
+} VisibilityObject;
+
+typedef struct {
+  _Optional VisibilityObject *objects;
+  int nobjects;
+  int objects_alloc;
+} VisibilityList;
+
+void visibility_list_init(VisibilityList *list);
+
+bool visibility_list_add(VisibilityList *list, int index, SFObjectType type,
+                         int type_count, int plot_type, const Group *groups,
+                         int ngroups, const VisibilityCommand *commands,
+                         int ncommands, const VisibilityTests *tests);
+
+bool visibility_list_write(FILE *out, const VisibilityList *list);
+
+void visibility_list_free(VisibilityList *list);
+
+#endif /* VISIBILITY_H */
@@ -0,0 +1,128 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Merging of vertices at the same position
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/* 3DObjLib headers */
+#include "Coord.h"
+#include "Vertex.h"
+
+/* Local header files */
+#include "misc.h"
+#include "hash.h"
+#include "vmerge.h"
+
+bool vmerge_same_coords(const VertexArray * const varray, const int a,
+                        const int b, const int rot)
+{
+  assert(varray != NULL);
+
+  if (a == b) {
+    return true;
+  }
+
+  /* Vertices that rotate must not be merged with ones that don't */
+  if ((rot > 0) && ((a >= rot) != (b >= rot))) {
+    return false;
+  }
+
+  _Optional Coord (* const ca)[3] = vertex_array_get_coords(varray, a);
+  _Optional Coord (* const cb)[3] = vertex_array_get_coords(varray, b);
+  if (!ca || !cb) {
+    return false;
+  }
+
+  return ((*ca)[0] == (*cb)[0]) && ((*ca)[1] == (*cb)[1]) &&
+         ((*ca)[2] == (*cb)[2]);
+}
+
+/* Hashes the position of a vertex so that vertices which compare equal
+   have the same hash */
+static uint64_t hash_coords(Coord (* const coords)[3], const bool rotates)
+{
+  assert(coords != NULL);
+
+  uint64_t hash = hash_update(HASH_INITIAL, &rotates, sizeof(rotates));
+  for (int k = 0; k < 3; ++k) {
+    /* Adding zero makes negative zero positive */
+    const double d = (double)(*coords)[k] + 0.0;
+    hash = hash_update(hash, &d, sizeof(d));
+  }
+  return hash;
+}
+
+bool vmerge_find_ids(const VertexArray * const varray, int * const ids,
+                     const int rot)
+{
+  assert(varray != NULL);
+  assert(ids != NULL);
+
+  const int nvertices = vertex_array_get_num_vertices(varray);
+  if (nvertices == 0) {
+    return true;
+  }
+
+  /* Open addressing with linear probing, at most half full */
+  size_t nslots = 16;
+  while (nslots < (size_t)nvertices * 2) {
+    nslots *= 2;
+  }
+
+  _Optional int * const slots = malloc(sizeof(int) * nslots);
+  if (slots == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i < nslots; ++i) {
+    (&*slots)[i] = -1;
+  }
+
+  for (int v = 0; v < nvertices; ++v) {
+    if (ids[v] < 0) {
+      continue;
+    }
+
+    ids[v] = v;
+    _Optional Coord (* const coords)[3] = vertex_array_get_coords(varray, v);
+    if (!coords) {
+      /* Never at the same position as any other vertex */
+      continue;
+    }
+
+    size_t i = (size_t)hash_coords(&*coords, (rot > 0) && (v >= rot)) &
+               (nslots - 1);
+    for (; (&*slots)[i] >= 0; i = (i + 1) & (nslots - 1)) {
+      if (vmerge_same_coords(varray, (&*slots)[i], v, rot)) {
+        ids[v] = (&*slots)[i];
+        break;
+      }
+    }
+
+    if (ids[v] == v) {
+      (&*slots)[i] = v;
+    }
+  }
+
+  free(slots);
+  return true;
+}
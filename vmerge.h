@@ -0,0 +1,26 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Merging of vertices at the same position
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef VMERGE_H
+#define VMERGE_H
+
+#include <stdbool.h>
+
+#include "Vertex.h"
+
+/* Reports whether two vertices are at the same position. Vertices with
+   indices of at least rot (if rot > 0) rotate, so they are never at the
+   same position as vertices that don't. */
+bool vmerge_same_coords(const VertexArray *varray, int a, int b, int rot);
+
+/* Finds the first vertex at the same position as each vertex, using a hash
+   table. On entry, ids[v] is -1 for each vertex that should be ignored.
+   On exit, ids[v] is the lowest index of a vertex that wasn't ignored and
+   is at the same position as v (which may be v itself), or -1 if v was
+   ignored. Returns false if memory allocation failed. */
+bool vmerge_find_ids(const VertexArray *varray, int *ids, int rot);
+
+#endif /* VMERGE_H */
@@ -0,0 +1,377 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Monitoring of files for changes
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifdef USE_INOTIFY
+/* Needed for lstat() when compiling as strict ISO C */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#endif
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef USE_INOTIFY
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#endif
+
+/* Local header files */
+#include "misc.h"
+#include "watch.h"
+
+#ifdef USE_INOTIFY
+enum {
+  /* Large enough for many events, including the longest possible name */
+  EventBufferSize = 64 * 1024,
+  /* Events after a file was completely written or renamed into place */
+  WatchMask = IN_CLOSE_WRITE | IN_MOVED_TO,
+};
+
+static _Optional char *dup_string(const char * const s, size_t const len)
+{
+  assert(s != NULL);
+
+  _Optional char * const copy = malloc(len + 1);
+  if (copy != NULL) {
+    memcpy(&*copy, s, len);
+    (&*copy)[len] = '\0';
+  }
+  return copy;
+}
+
+static _Optional char *join_path(const char * const dir,
+                                 const char * const leaf)
+{
+  assert(dir != NULL);
+  assert(leaf != NULL);
+
+  const size_t dir_len = strlen(dir), leaf_len = strlen(leaf);
+  _Optional char * const path = malloc(dir_len + 1 + leaf_len + 1);
+  if (path != NULL) {
+    memcpy(&*path, dir, dir_len);
+    (&*path)[dir_len] = PATH_SEPARATOR;
+    memcpy(&*path + dir_len + 1, leaf, leaf_len + 1);
+  }
+  return path;
+}
+
+static bool add_entry(Watch * const watch, const char * const dir,
+                      size_t const dir_len, _Optional const char * const path,
+                      const int tag)
+{
+  assert(watch != NULL);
+  assert(dir != NULL);
+
+  if (watch->nentries >= WatchMax) {
+    fprintf(stderr, "Too many files to monitor\n");
+    return false;
+  }
+
+  WatchEntry * const entry = watch->entries + watch->nentries;
+  *entry = (WatchEntry){
+    .tag = tag,
+    .wd = -1,
+    .dir = dup_string(dir, dir_len),
+    .leaf = NULL,
+    .path = NULL,
+  };
+
+  if (path != NULL) {
+    const char * const sep = strrchr(&*path, PATH_SEPARATOR);
+    const char * const leaf = sep ? sep + 1 : &*path;
+    entry->leaf = dup_string(leaf, strlen(leaf));
+    entry->path = dup_string(&*path, strlen(&*path));
+  }
+
+  if ((entry->dir == NULL) ||
+      ((path != NULL) && ((entry->leaf == NULL) || (entry->path == NULL)))) {
+    fprintf(stderr, "Failed allocating memory for monitored files\n");
+    free(entry->path);
+    free(entry->leaf);
+    free(entry->dir);
+    return false;
+  }
+
+  /* Adding a directory that is already monitored returns the same
+     descriptor, so that files can be matched to entries by name */
+  entry->wd = inotify_add_watch(watch->fd, &*entry->dir, WatchMask);
+  if (entry->wd < 0) {
+    fprintf(stderr, "Failed to monitor directory '%s': %s\n",
+            entry->dir, strerror(errno));
+    free(entry->path);
+    free(entry->leaf);
+    free(entry->dir);
+    return false;
+  }
+
+  ++watch->nentries;
+  return true;
+}
+
+/* Finds the entry to which a file belongs. A file that is monitored on its
+   own isn't also reported as a member of its directory. */
+static _Optional const WatchEntry *find_entry(const Watch * const watch,
+                                              const int wd,
+                                              const char * const leaf)
+{
+  assert(watch != NULL);
+  assert(leaf != NULL);
+
+  _Optional const WatchEntry *found = NULL;
+  for (int e = 0; e < watch->nentries; ++e) {
+    const WatchEntry * const entry = watch->entries + e;
+    if (entry->wd != wd) {
+      continue;
+    }
+    if (entry->leaf == NULL) {
+      if (found == NULL) {
+        found = entry;
+      }
+    } else if (strcmp(&*entry->leaf, leaf) == 0) {
+      return entry;
+    }
+  }
+  return found;
+}
+
+static bool report(const WatchEntry * const entry, const char * const leaf,
+                   WatchFn * const fn, void * const arg, bool * const stop)
+{
+  assert(entry != NULL);
+  assert(leaf != NULL);
+  assert(fn != NULL);
+  assert(stop != NULL);
+
+  if (entry->path != NULL) {
+    *stop = !fn(entry->tag, &*entry->path, &*entry->leaf, arg);
+    return true;
+  }
+
+  _Optional char * const path = join_path(&*entry->dir, leaf);
+  if (path == NULL) {
+    fprintf(stderr, "Failed allocating memory for file path\n");
+    return false;
+  }
+
+  *stop = !fn(entry->tag, &*path, leaf, arg);
+  free(path);
+  return true;
+}
+
+/* Reports every regular file that is already in a monitored directory */
+static bool scan_dir(const Watch * const watch,
+                     const WatchEntry * const entry, WatchFn * const fn,
+                     void * const arg, bool * const stop)
+{
+  assert(watch != NULL);
+  assert(entry != NULL);
+  assert(entry->leaf == NULL);
+  assert(fn != NULL);
+  assert(stop != NULL);
+
+  _Optional DIR * const d = opendir(&*entry->dir);
+  if (d == NULL) {
+    fprintf(stderr, "Failed to open directory '%s': %s\n",
+            entry->dir, strerror(errno));
+    return false;
+  }
+
+  bool success = true;
+  while (!*stop) {
+    _Optional struct dirent * const de = readdir(&*d);
+    if (de == NULL) {
+      break;
+    }
+
+    const char * const leaf = de->d_name;
+    if (find_entry(watch, entry->wd, leaf) != entry) {
+      continue;
+    }
+
+    _Optional char * const path = join_path(&*entry->dir, leaf);
+    if (path == NULL) {
+      fprintf(stderr, "Failed allocating memory for file path\n");
+      success = false;
+      break;
+    }
+
+    struct stat st;
+    if ((lstat(&*path, &st) == 0) && S_ISREG(st.st_mode)) {
+      *stop = !fn(entry->tag, &*path, leaf, arg);
+    }
+    free(path);
+  }
+
+  closedir(&*d);
+  return success;
+}
+#endif /* USE_INOTIFY */
+
+bool watch_init(Watch * const watch)
+{
+  assert(watch != NULL);
+
+  *watch = (Watch){.fd = -1, .nentries = 0};
+
+#ifdef USE_INOTIFY
+  watch->fd = inotify_init();
+  if (watch->fd < 0) {
+    fprintf(stderr, "Failed to start monitoring files: %s\n",
+            strerror(errno));
+    return false;
+  }
+  return true;
+#else
+  fprintf(stderr, "Monitoring files is not supported by this build\n");
+  return false;
+#endif
+}
+
+bool watch_add_dir(Watch * const watch, const char * const dir,
+                   const int tag)
+{
+  assert(watch != NULL);
+  assert(dir != NULL);
+
+#ifdef USE_INOTIFY
+  return add_entry(watch, dir, strlen(dir), NULL, tag);
+#else
+  NOT_USED(tag);
+  return false;
+#endif
+}
+
+bool watch_add_file(Watch * const watch, const char * const path,
+                    const int tag)
+{
+  assert(watch != NULL);
+  assert(path != NULL);
+
+#ifdef USE_INOTIFY
+  /* Files are often replaced by renaming another file, so monitor the
+     directory rather than the file itself */
+  const char * const sep = strrchr(path, PATH_SEPARATOR);
+  if (sep == NULL) {
+    return add_entry(watch, ".", 1, path, tag);
+  }
+  return add_entry(watch, path, sep == path ? 1 : (size_t)(sep - path),
+                   path, tag);
+#else
+  NOT_USED(tag);
+  return false;
+#endif
+}
+
+bool watch_run(Watch * const watch, WatchFn * const fn, void * const arg,
+               const bool verbose)
+{
+  assert(watch != NULL);
+  assert(fn != NULL);
+
+#ifdef USE_INOTIFY
+  bool stop = false;
+  for (int e = 0; (e < watch->nentries) && !stop; ++e) {
+    const WatchEntry * const entry = watch->entries + e;
+    if ((entry->leaf == NULL) && !scan_dir(watch, entry, fn, arg, &stop)) {
+      return false;
+    }
+  }
+
+  _Optional char * const buf = malloc(EventBufferSize);
+  if (buf == NULL) {
+    fprintf(stderr, "Failed allocating memory for file events\n");
+    return false;
+  }
+
+  bool success = true;
+  while (success && !stop) {
+    if (verbose) {
+      puts("Waiting for changes");
+    }
+
+    /* Report progress before blocking, in case output is redirected */
+    fflush(stdout);
+
+    const ssize_t n = read(watch->fd, &*buf, EventBufferSize);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Failed to read file events: %s\n", strerror(errno));
+      success = false;
+      break;
+    }
+
+    for (ssize_t pos = 0; (pos < n) && success && !stop; ) {
+      struct inotify_event event;
+      memcpy(&event, &*buf + pos, sizeof(event));
+      const char * const leaf = &*buf + pos + sizeof(event);
+      pos += (ssize_t)(sizeof(event) + event.len);
+
+      if (event.mask & IN_Q_OVERFLOW) {
+        fprintf(stderr, "Warning: some changes to files were missed\n");
+        continue;
+      }
+      if ((event.len == 0) || (event.mask & IN_ISDIR)) {
+        continue;
+      }
+
+      _Optional const WatchEntry * const entry = find_entry(watch, event.wd,
+                                                            leaf);
+      if (entry != NULL) {
+        success = report(&*entry, leaf, fn, arg, &stop);
+      }
+    }
+  }
+
+  free(buf);
+  return success;
+#else
+  NOT_USED(arg);
+  NOT_USED(verbose);
+  return false;
+#endif
+}
+
+void watch_destroy(Watch * const watch)
+{
+  assert(watch != NULL);
+
+#ifdef USE_INOTIFY
+  for (int e = 0; e < watch->nentries; ++e) {
+    WatchEntry * const entry = watch->entries + e;
+    free(entry->path);
+    free(entry->leaf);
+    free(entry->dir);
+  }
+  if (watch->fd >= 0) {
+    close(watch->fd);
+  }
+#endif
+  watch->nentries = 0;
+  watch->fd = -1;
+}
@@ -0,0 +1,49 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Monitoring of files for changes
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+
+#if !defined(USE_OPTIONAL) && !defined(_Optional)
+#define _Optional
+#endif
+
+enum {
+  WatchMax = 4 /* Maximum number of directories and files monitored */
+};
+
+/* Called with the tag of the directory or file to which 'path' belongs and
+   the leaf name of 'path'. Monitoring stops if it returns false. */
+typedef bool WatchFn(int tag, const char *path, const char *leaf,
+                     void *arg);
+
+typedef struct {
+  int tag;
+  int wd;                 /* Watch descriptor of the directory */
+  _Optional char *dir;    /* Directory to be monitored */
+  _Optional char *leaf;   /* Name of a single file, or NULL for all */
+  _Optional char *path;   /* Path of a single file, or NULL for all */
+} WatchEntry;
+
+typedef struct {
+  int fd;
+  int nentries;
+  WatchEntry entries[WatchMax];
+} Watch;
+
+bool watch_init(Watch *watch);
+
+bool watch_add_dir(Watch *watch, const char *dir, int tag);
+
+bool watch_add_file(Watch *watch, const char *path, int tag);
+
+bool watch_run(Watch *watch, WatchFn *fn, void *arg, bool verbose);
+
+void watch_destroy(Watch *watch);
+
+#endif /* WATCH_H */
@@ -0,0 +1,127 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Parallel processing of independent work items
+ *  Copyright (C) 2026 Christopher Bazley
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public Licence as published by
+ *  the Free Software Foundation; either version 2 of the Licence, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public Licence for more details.
+ *
+ *  You should have received a copy of the GNU General Public Licence
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
+
+/* Local header files */
+#include "misc.h"
+#include "workers.h"
+
+#ifdef USE_PTHREADS
+typedef struct {
+  pthread_mutex_t lock;
+  int next;  /* Index of the next item to be claimed */
+  int nitems;
+  bool success;
+  WorkerFn *fn;
+  void *arg;
+} WorkQueue;
+
+static void *worker(void *arg)
+{
+  WorkQueue * const queue = arg;
+  assert(queue != NULL);
+
+  for (;;) {
+    pthread_mutex_lock(&queue->lock);
+    const int index = queue->next;
+    if (index < queue->nitems) {
+      ++queue->next;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    if (index >= queue->nitems) {
+      break;
+    }
+
+    const bool success = queue->fn(index, queue->arg);
+
+    if (!success) {
+      pthread_mutex_lock(&queue->lock);
+      queue->success = false;
+      pthread_mutex_unlock(&queue->lock);
+    }
+  }
+
+  return NULL;
+}
+#endif
+
+bool workers_run(const int nthreads, const int nitems, WorkerFn * const fn,
+                 void * const arg)
+{
+  assert(nthreads >= 1);
+  assert(nitems >= 0);
+  assert(fn != NULL);
+
+#ifdef USE_PTHREADS
+  const int nextra = LOWEST(nthreads, nitems) - 1;
+  if (nextra > 0) {
+    WorkQueue queue = {
+      .next = 0,
+      .nitems = nitems,
+      .success = true,
+      .fn = fn,
+      .arg = arg,
+    };
+
+    _Optional pthread_t * const threads = malloc(sizeof(*threads) *
+                                                 (size_t)nextra);
+    if (threads != NULL && pthread_mutex_init(&queue.lock, NULL) == 0) {
+      int nstarted = 0;
+      while (nstarted < nextra &&
+             pthread_create(&*threads + nstarted, NULL, worker,
+                            &queue) == 0) {
+        ++nstarted;
+      }
+
+      /* The calling thread also processes items, so it doesn't matter
+         if fewer threads than requested could be started. */
+      (void)worker(&queue);
+
+      for (int t = 0; t < nstarted; ++t) {
+        pthread_join((&*threads)[t], NULL);
+      }
+
+      pthread_mutex_destroy(&queue.lock);
+      free(threads);
+      return queue.success;
+    }
+
+    free(threads);
+    /* Fall back to processing the items sequentially */
+  }
+#endif
+
+  bool success = true;
+  for (int index = 0; index < nitems; ++index) {
+    if (!fn(index, arg)) {
+      success = false;
+    }
+  }
+  return success;
+}
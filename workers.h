@@ -0,0 +1,16 @@
+/*
+ *  SF3KtoObj - Converts Star Fighter 3000 graphics to Wavefront format
+ *  Parallel processing of independent work items
+ *  Copyright (C) 2026 Christopher Bazley
+ */
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stdbool.h>
+
+typedef bool WorkerFn(int index, void *arg);
+
+bool workers_run(int nthreads, int nitems, WorkerFn *fn, void *arg);
+
+#endif /* WORKERS_H */